@@ -0,0 +1,199 @@
+#include "libprimis.h"
+#include "../src/shared/geomexts.h"
+#include "../src/shared/glexts.h"
+#include "../src/engine/world/bih.h"
+
+#include <functional>
+
+#include "benchutils.h"
+#include "benchbih.h"
+
+namespace
+{
+    constexpr int terraingrid = 160;        //terrain quads per side, 2*160*160 = 51200 triangles
+    constexpr float terrainsize = 256;
+    constexpr int rockrings = 32,           //each rock is 2*32*64 = 4096 triangles
+                  rocksegments = 64,
+                  numrocks = 6;
+
+    //vertices and triangles for one of the model's BIH meshes
+    struct benchmesh final
+    {
+        std::vector<vec> verts;
+        std::vector<BIH::mesh::tri> tris;
+    };
+
+    float terrainheight(float x, float y)
+    {
+        return 16 + 8*std::sin(x*0.05f)*std::cos(y*0.07f) + 2*std::sin(x*0.31f + y*0.23f);
+    }
+
+    //a heightfield whose vertex spacing grows with distance from the origin,
+    //so that small triangles are packed into one corner as in a detailed model
+    benchmesh genterrain()
+    {
+        benchmesh m;
+        for(int y = 0; y <= terraingrid; ++y)
+        {
+            float fy = static_cast<float>(y)/terraingrid;
+            for(int x = 0; x <= terraingrid; ++x)
+            {
+                float fx = static_cast<float>(x)/terraingrid,
+                      px = terrainsize*fx*fx,
+                      py = terrainsize*fy*fy;
+                m.verts.emplace_back(px, py, terrainheight(px, py));
+            }
+        }
+        for(uint y = 0; y < terraingrid; ++y)
+        {
+            for(uint x = 0; x < terraingrid; ++x)
+            {
+                uint v = y*(terraingrid+1) + x;
+                m.tris.push_back({{v, v+1, v+terraingrid+2}});
+                m.tris.push_back({{v, v+terraingrid+2, v+terraingrid+1}});
+            }
+        }
+        return m;
+    }
+
+    //a lumpy sphere sitting on the terrain
+    benchmesh genrock(benchrng &rng)
+    {
+        benchmesh m;
+        float radius = rng.uniform(6, 16),
+              bumps = rng.uniform(3, 7);
+        vec center(rng.uniform(0, terrainsize), rng.uniform(0, terrainsize), 0);
+        center.z = terrainheight(center.x, center.y);
+        for(int r = 0; r <= rockrings; ++r)
+        {
+            float pitch = M_PI*(static_cast<float>(r)/rockrings - 0.5f);
+            for(int s = 0; s <= rocksegments; ++s)
+            {
+                float yaw = 2*M_PI*s/rocksegments,
+                      dist = radius*(1 + 0.15f*std::sin(bumps*yaw)*std::cos(bumps*pitch));
+                m.verts.push_back(vec(std::cos(yaw)*std::cos(pitch), std::sin(yaw)*std::cos(pitch), std::sin(pitch)).mul(dist).add(center));
+            }
+        }
+        for(uint r = 0; r < rockrings; ++r)
+        {
+            for(uint s = 0; s < rocksegments; ++s)
+            {
+                uint v = r*(rocksegments+1) + s;
+                m.tris.push_back({{v, v+1, v+rocksegments+2}});
+                m.tris.push_back({{v, v+rocksegments+2, v+rocksegments+1}});
+            }
+        }
+        return m;
+    }
+
+    std::vector<BIH::mesh> setupmeshes(const std::vector<benchmesh> &model)
+    {
+        std::vector<BIH::mesh> meshes;
+        for(const benchmesh &b : model)
+        {
+            BIH::mesh m;
+            m.xform.identity();
+            m.flags = BIH::Mesh_Render | BIH::Mesh_Collide;
+            const uchar *pos = reinterpret_cast<const uchar *>(b.verts.data());
+            m.setmesh(b.tris.data(), b.tris.size(), pos, sizeof(vec), pos, sizeof(vec));
+            meshes.push_back(m);
+        }
+        return meshes;
+    }
+
+    struct bihray final
+    {
+        vec o, ray;
+    };
+
+    void benchtree(const benchconfig &cfg, size_t n, const std::vector<BIH::mesh> &meshes, int sah, std::vector<benchresult> &results)
+    {
+        const char *suffix = sah ? "_sah" : "_mid";
+        setvar("bihsah", sah);
+
+        std::string name = std::string("bih_build") + suffix;
+        if(cfg.wants(name.c_str()))
+        {
+            results.push_back(runbench(name.c_str(), cfg.rebuilds, 1, [&meshes] (size_t) -> double
+            {
+                BIH b(meshes);
+                return b.getentradius();
+            }));
+        }
+
+        BIH b(meshes);
+
+        //rays from above the terrain in every direction, some of which hit the rocks or terrain
+        name = std::string("bih_shadowray") + suffix;
+        if(cfg.wants(name.c_str()))
+        {
+            benchrng rng(cfg.seed + 20);
+            std::vector<bihray> rays(n);
+            for(bihray &r : rays)
+            {
+                r.o = vec(rng.uniform(0, terrainsize), rng.uniform(0, terrainsize), 0);
+                r.o.z = terrainheight(r.o.x, r.o.y) + rng.uniform(1, 48);
+                r.ray = rng.direction();
+            }
+            //traversal stops at the first triangle it finds, which depends on the tree, so only hits are counted
+            results.push_back(runbench(name.c_str(), cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+            {
+                float dist;
+                return b.traverse(rays[i].o, rays[i].ray, 128, dist, Ray_Shadow) ? 1 : 0;
+            }));
+        }
+
+        //player sized volumes near the terrain surface, some of which are embedded in it
+        benchrng rng(cfg.seed + 21);
+        std::vector<vec> positions(n);
+        for(vec &p : positions)
+        {
+            p = vec(rng.uniform(0, terrainsize), rng.uniform(0, terrainsize), 0);
+            p.z = terrainheight(p.x, p.y) + rng.uniform(-8, 24);
+        }
+        physent d;
+        d.radius = d.xradius = d.yradius = 4;
+        d.eyeheight = 14;
+        d.aboveeye = 2;
+        const vec dir(0, 0, -1);
+
+        name = std::string("bih_boxcollide") + suffix;
+        if(cfg.wants(name.c_str()))
+        {
+            results.push_back(runbench(name.c_str(), cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+            {
+                d.o = positions[i];
+                return b.boxcollide(&d, dir, 0, vec(0, 0, 0), 0, 0, 0).collided ? 1 : 0;
+            }));
+        }
+
+        name = std::string("bih_ellipsecollide") + suffix;
+        if(cfg.wants(name.c_str()))
+        {
+            results.push_back(runbench(name.c_str(), cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+            {
+                d.o = positions[i];
+                return b.ellipsecollide(&d, dir, 0, vec(0, 0, 0), 0, 0, 0).collided ? 1 : 0;
+            }));
+        }
+    }
+}
+
+void benchbih(const benchconfig &cfg, std::vector<benchresult> &results)
+{
+    benchrng rng(cfg.seed + 19);
+    std::vector<benchmesh> model;
+    model.push_back(genterrain());
+    for(int i = 0; i < numrocks; ++i)
+    {
+        model.push_back(genrock(rng));
+    }
+    std::vector<BIH::mesh> meshes = setupmeshes(model);
+
+    size_t n = cfg.samples*cfg.batchsize;
+    for(int sah = 0; sah < 2; ++sah)
+    {
+        benchtree(cfg, n, meshes, sah, results);
+    }
+    setvar("bihsah", 1);
+}
@@ -0,0 +1,19 @@
+#ifndef BENCHBIH_H_
+#define BENCHBIH_H_
+
+/**
+ * @brief Runs the bounding interval hierarchy benchmarks.
+ *
+ * Generates a model made of a terrain mesh with more triangles than the old
+ * 16K triangle per mesh limit and a handful of rock meshes, then builds its BIH
+ * twice: once with midpoint splits (`bihsah 0`, reported as `bih_*_mid`) and
+ * once with the surface area heuristic (`bihsah 1`, `bih_*_sah`). Times the
+ * builds, shadow rays, and box and ellipse collisions against both trees with
+ * the same inputs, so their checksums should match.
+ *
+ * @param cfg the benchmark settings
+ * @param results the vector to append results to
+ */
+extern void benchbih(const benchconfig &cfg, std::vector<benchresult> &results);
+
+#endif
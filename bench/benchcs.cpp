@@ -0,0 +1,87 @@
+#include "libprimis.h"
+#include "../src/engine/interface/cs.h"
+
+#include <functional>
+
+#include "benchutils.h"
+#include "benchcs.h"
+
+namespace
+{
+    struct benchscript final
+    {
+        const char *name,
+                   *setup, //run before every batch
+                   *body;  //timed, returning a number
+    };
+
+    const benchscript scripts[] =
+    {
+        {
+            "constmath",
+            "",
+            "result (+ (* 2 3) (<< 1 4) (div 100 7) (- 9) (max 3 (min 8 5)))"
+        },
+        {
+            "varmath",
+            "benchcsi = 0",
+            "benchcsi = (+ $benchcsi 1); + (* $benchcsi 3) (mod $benchcsi 7) (div $benchcsi 2) (& $benchcsi 15)"
+        },
+        {
+            "loopmath",
+            "",
+            "benchcsacc = 0; loop i 64 [benchcsacc = (+ $benchcsacc (* $i $i) (>> $i 1))]; result $benchcsacc"
+        },
+        {
+            "floatmath",
+            "",
+            "benchcsacc = 0; loop i 64 [benchcsacc = (+f $benchcsacc (*f $i 0.5) (divf 1 (+f $i 1)))]; result $benchcsacc"
+        },
+        {
+            "branches",
+            "",
+            "benchcsacc = 0; loop i 64 [if (< $i 32) [benchcsacc = (+ $benchcsacc 1)] [benchcsacc = (- $benchcsacc 1)]; "
+            "if 0 [echo unreachable]; if (= 1 1) [benchcsacc = (+ $benchcsacc 2)] [benchcsacc = 0]]; result $benchcsacc"
+        }
+    };
+}
+
+void benchcs(const benchconfig &cfg, std::vector<benchresult> &results)
+{
+    static bool inited = false;
+    if(!inited)
+    {
+        initidents();
+        initcscmds();
+        initmathcmds();
+        initcontrolcmds();
+        inited = true;
+    }
+    for(const benchscript &s : scripts)
+    {
+        for(int optimize = 0; optimize < 2; ++optimize)
+        {
+            std::string name = std::string("cs_") + s.name + (optimize ? "_opt" : "_vm");
+            if(!cfg.wants(name.c_str()))
+            {
+                continue;
+            }
+            setvar("csoptimize", optimize);
+            uint *code = compilecode(s.body);
+            results.push_back(runbench(name.c_str(), cfg.samples, cfg.batchsize, [code] (size_t) -> double
+            {
+                tagval t;
+                executeret(code, t);
+                double val = t.getfloat();
+                freearg(t);
+                return val;
+            },
+            [&s] ()
+            {
+                execute(s.setup);
+            }));
+            freecode(code);
+        }
+    }
+    setvar("csoptimize", 1);
+}
@@ -0,0 +1,19 @@
+#ifndef BENCHCS_H_
+#define BENCHCS_H_
+
+/**
+ * @brief Runs the CubeScript interpreter benchmarks.
+ *
+ * Registers the CubeScript builtins, then times a set of scripts (constant and
+ * variable math, float math, and literal and computed if conditions), each
+ * compiled once with the compile time optimizations off (`csoptimize 0`,
+ * reported as `cs_<script>_vm`) and once with them on (`cs_<script>_opt`).
+ * Both versions of a script return the same values, so their checksums should
+ * match.
+ *
+ * @param cfg the benchmark settings
+ * @param results the vector to append results to
+ */
+extern void benchcs(const benchconfig &cfg, std::vector<benchresult> &results);
+
+#endif
@@ -0,0 +1,299 @@
+#include "libprimis.h"
+#include "../src/shared/geomexts.h"
+#include "../src/engine/world/octaworld.h"
+#include "../src/engine/world/physics.h"
+#include "../src/engine/world/raycube.h"
+#include "../src/engine/world/raypacket.h"
+
+#include <functional>
+
+#include "benchutils.h"
+#include "benchocta.h"
+#include "benchworld.h"
+
+namespace
+{
+    struct leafcube final
+    {
+        const cube *c;
+        ivec o;
+        int size;
+    };
+
+    //finds points just above the terrain by casting rays straight down from the top of the world
+    std::vector<vec> gensurfacepoints(benchrng &rng, size_t n)
+    {
+        float size = rootworld.mapsize();
+        std::vector<vec> points;
+        points.reserve(n);
+        for(size_t i = 0; i < n; ++i)
+        {
+            vec o(rng.uniform(0, size), rng.uniform(0, size), size - 1),
+                down(0, 0, -1);
+            float dist = rootworld.raycube(o, down, 0, Ray_ClipMat, 0, nullptr);
+            points.push_back(o.add(down.mul(dist - 0.5f)));
+        }
+        return points;
+    }
+
+    //finds the leaf cubes containing points just below the terrain surface, which are mostly sloped
+    std::vector<leafcube> gensurfacecubes(benchrng &rng, size_t n)
+    {
+        std::vector<vec> points = gensurfacepoints(rng, n);
+        std::vector<leafcube> cubes;
+        cubes.reserve(n);
+        for(const vec &p : points)
+        {
+            leafcube l;
+            l.c = &rootworld.lookupcube(ivec(vec(p).sub(vec(0, 0, 1))), 0, l.o, l.size);
+            cubes.push_back(l);
+        }
+        return cubes;
+    }
+
+    void benchraycube(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        benchrng rng(cfg.seed + 1);
+        float size = rootworld.mapsize();
+        std::vector<vec> origins(n),
+                         rays(n);
+        for(size_t i = 0; i < n; ++i)
+        {
+            origins[i] = vec(rng.uniform(0, size), rng.uniform(0, size), rng.uniform(size*0.75f, size));
+            rays[i] = rng.direction();
+        }
+        if(cfg.wants("raycube"))
+        {
+            results.push_back(runbench("raycube", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+            {
+                return rootworld.raycube(origins[i], rays[i], 0, Ray_ClipMat, 0, nullptr);
+            }));
+        }
+        if(!cfg.wants("raycubebatch"))
+        {
+            return;
+        }
+        //same rays as above, so the checksums should match raycube's
+        std::vector<std::vector<raycubequery>> batches(cfg.samples);
+        for(size_t i = 0; i < n; ++i)
+        {
+            batches[i/cfg.batchsize].push_back({origins[i], rays[i], 0, Ray_ClipMat, 0, nullptr});
+        }
+        std::vector<raycuberesult> out;
+        auto castbatch = [&] (size_t b, bool parallel) -> double
+        {
+            raycubebatch(batches[b], out, parallel);
+            double sum = 0;
+            for(const raycuberesult &i : out)
+            {
+                sum += i.dist;
+            }
+            return sum;
+        };
+        results.push_back(runbatchbench("raycubebatch", cfg.samples, cfg.batchsize, [&] (size_t b) -> double
+        {
+            return castbatch(b, false);
+        }));
+        results.push_back(runbatchbench("raycubebatch_mt", cfg.samples, cfg.batchsize, [&] (size_t b) -> double
+        {
+            return castbatch(b, true);
+        }));
+    }
+
+    //rays from points on the terrain towards lights scattered above it, as done for shadowing
+    void benchshadowray(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        benchrng rng(cfg.seed + 2);
+        float size = rootworld.mapsize();
+        std::vector<vec> origins = gensurfacepoints(rng, n),
+                         rays(n);
+        std::vector<float> dists(n);
+        for(size_t i = 0; i < n; ++i)
+        {
+            vec light(rng.uniform(0, size), rng.uniform(0, size), rng.uniform(size*0.6f, size*0.9f));
+            rays[i] = light.sub(origins[i]);
+            dists[i] = rays[i].magnitude();
+            rays[i].div(dists[i]);
+        }
+        results.push_back(runbench("shadowray", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+        {
+            return rootworld.shadowray(origins[i], rays[i], dists[i], Ray_Shadow, nullptr);
+        }));
+    }
+
+    //clusters of rays from nearby points on the terrain towards the same light, as when shadowing a lightmap
+    void benchshadowraybatch(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        constexpr size_t clustersize = 8;
+        benchrng rng(cfg.seed + 7);
+        float size = rootworld.mapsize();
+        std::vector<vec> origins = gensurfacepoints(rng, (n + clustersize - 1)/clustersize);
+        std::vector<std::vector<shadowrayquery>> batches(cfg.samples);
+        vec light;
+        for(size_t i = 0; i < n; ++i)
+        {
+            if(!(i%clustersize))
+            {
+                light = vec(rng.uniform(0, size), rng.uniform(0, size), rng.uniform(size*0.6f, size*0.9f));
+            }
+            vec o = vec(origins[i/clustersize]).add(vec(rng.uniform(-2, 2), rng.uniform(-2, 2), 0)),
+                ray = vec(light).sub(o);
+            float dist = ray.magnitude();
+            batches[i/cfg.batchsize].push_back({o, ray.div(dist), dist});
+        }
+        if(cfg.wants("shadowray_coherent"))
+        {
+            results.push_back(runbench("shadowray_coherent", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+            {
+                const shadowrayquery &q = batches[i/cfg.batchsize][i%cfg.batchsize];
+                return rootworld.shadowray(q.o, q.ray, q.radius, Ray_Shadow, nullptr);
+            }));
+        }
+        //same rays as above for each packet kernel, so the checksums should match (to within rounding)
+        std::vector<float> out;
+        const std::array<const char *, 3> names = {"shadowraybatch_scalar", "shadowraybatch_sse", "shadowraybatch_avx2"};
+        for(int simd = 0; simd < static_cast<int>(names.size()); ++simd)
+        {
+            if(!cfg.wants(names[simd]))
+            {
+                continue;
+            }
+            setvar("raypacketsimd", simd);
+            if(simd == 2 && raypacketlanes() < 8)
+            {
+                continue; //no AVX2 on this CPU
+            }
+            results.push_back(runbatchbench(names[simd], cfg.samples, cfg.batchsize, [&] (size_t b) -> double
+            {
+                shadowraybatch(batches[b], out, Ray_Shadow);
+                double sum = 0;
+                for(float i : out)
+                {
+                    sum += i;
+                }
+                return sum;
+            }));
+        }
+        setvar("raypacketsimd", 2);
+    }
+
+    //player sized boxes near the terrain surface, some of which are embedded in it
+    void benchcollide(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        benchrng rng(cfg.seed + 3);
+        std::vector<vec> positions = gensurfacepoints(rng, n);
+        for(vec &p : positions)
+        {
+            p.z += rng.uniform(-8, 24);
+        }
+        physent d;
+        d.radius = d.xradius = d.yradius = 4;
+        d.eyeheight = 14;
+        d.aboveeye = 2;
+        results.push_back(runbench("collide", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+        {
+            d.o = positions[i];
+            return collide(&d) ? 1 : 0;
+        }));
+    }
+
+    void benchlookupcube(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        benchrng rng(cfg.seed + 4);
+        int size = rootworld.mapsize();
+        std::vector<ivec> points(n);
+        for(ivec &p : points)
+        {
+            p = ivec(rng.range(0, size), rng.range(0, size), rng.range(0, size));
+        }
+        results.push_back(runbench("lookupcube", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+        {
+            ivec ro;
+            int rsize;
+            rootworld.lookupcube(points[i], 0, ro, rsize);
+            return rsize;
+        }));
+    }
+
+    void benchneighborcube(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        benchrng rng(cfg.seed + 5);
+        std::vector<leafcube> cubes = gensurfacecubes(rng, n);
+        std::vector<int> orients(n);
+        for(int &i : orients)
+        {
+            i = rng.range(0, 6);
+        }
+        results.push_back(runbench("neighborcube", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+        {
+            ivec no;
+            int nsize;
+            rootworld.neighborcube(orients[i], cubes[i].o, cubes[i].size, no, nsize);
+            return nsize;
+        }));
+    }
+
+    void benchgenclipplanes(const benchconfig &cfg, size_t n, std::vector<benchresult> &results)
+    {
+        benchrng rng(cfg.seed + 6);
+        std::vector<leafcube> cubes = gensurfacecubes(rng, n);
+        clipplanes p;
+        results.push_back(runbench("genclipplanes", cfg.samples, cfg.batchsize, [&] (size_t i) -> double
+        {
+            const leafcube &l = cubes[i];
+            genclipbounds(*l.c, l.o, l.size, p);
+            genclipplanes(*l.c, l.o, l.size, p);
+            return p.size;
+        }));
+    }
+
+    void benchremip(const benchconfig &cfg, std::vector<benchresult> &results)
+    {
+        results.push_back(runbench("remip", cfg.rebuilds, 1, [] (size_t) -> double
+        {
+            rootworld.remip();
+            return 0;
+        },
+        [&cfg] ()
+        {
+            genbenchworld(cfg.scale, cfg.seed);
+        }));
+    }
+}
+
+void benchocta(const benchconfig &cfg, std::vector<benchresult> &results)
+{
+    size_t n = cfg.samples*cfg.batchsize;
+    if(cfg.wants("raycube") || cfg.wants("raycubebatch"))
+    {
+        benchraycube(cfg, n, results);
+    }
+    if(cfg.wants("shadowray"))
+    {
+        benchshadowray(cfg, n, results);
+    }
+    if(cfg.wants("shadowray_coherent") || cfg.wants("shadowraybatch"))
+    {
+        benchshadowraybatch(cfg, n, results);
+    }
+    if(cfg.wants("collide"))
+    {
+        benchcollide(cfg, n, results);
+    }
+    if(cfg.wants("lookupcube"))
+    {
+        benchlookupcube(cfg, n, results);
+    }
+    if(cfg.wants("neighborcube"))
+    {
+        benchneighborcube(cfg, n, results);
+    }
+    if(cfg.wants("genclipplanes"))
+    {
+        benchgenclipplanes(cfg, n, results);
+    }
+    if(cfg.wants("remip"))
+    {
+        benchremip(cfg, results);
+    }
+}
@@ -0,0 +1,18 @@
+#ifndef BENCHOCTA_H_
+#define BENCHOCTA_H_
+
+/**
+ * @brief Runs the octree query and rebuild benchmarks.
+ *
+ * Expects the world to have been generated with genbenchworld() using the same
+ * scale and seed as in the config. Runs raycube, raycubebatch (on one thread and
+ * on the worker threads), shadowray, collide, lookupcube, neighborcube,
+ * genclipplanes and remip (filtered by the config), appending their results.
+ * remip is run last, as it regenerates the world before every batch.
+ *
+ * @param cfg the benchmark settings
+ * @param results the vector to append results to
+ */
+extern void benchocta(const benchconfig &cfg, std::vector<benchresult> &results);
+
+#endif
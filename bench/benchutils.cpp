@@ -0,0 +1,142 @@
+#include "libprimis.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+#include "benchutils.h"
+
+benchrng::benchrng(uint seed) : state(seed ? seed : 1)
+{
+}
+
+//xorshift32: small, fast and defined entirely by integer ops, so identical everywhere
+uint benchrng::next()
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+float benchrng::uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * (next() >> 8) * (1.0f/(1<<24));
+}
+
+int benchrng::range(int lo, int hi)
+{
+    return lo + static_cast<int>(next() % static_cast<uint>(hi - lo));
+}
+
+vec benchrng::direction()
+{
+    vec d;
+    do
+    {
+        d = vec(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+    } while(d.squaredlen() > 1 || d.squaredlen() < 1e-4f);
+    return d.normalize();
+}
+
+benchresult runbench(const char *name, size_t samples, size_t batchsize,
+                     const std::function<double(size_t)> &op,
+                     const std::function<void()> &setup)
+{
+    using clock = std::chrono::steady_clock;
+
+    benchresult r;
+    r.name = name;
+    r.ops = samples*batchsize;
+    r.seconds = 0;
+    r.checksum = 0;
+
+    if(setup)
+    {
+        setup();
+    }
+    for(size_t i = 0; i < batchsize; ++i)
+    {
+        op(i);
+    }
+
+    std::vector<double> batchns;
+    batchns.reserve(samples);
+    for(size_t s = 0; s < samples; ++s)
+    {
+        if(setup)
+        {
+            setup();
+        }
+        size_t base = s*batchsize;
+        double sum = 0;
+        clock::time_point start = clock::now();
+        for(size_t i = 0; i < batchsize; ++i)
+        {
+            sum += op(base + i);
+        }
+        clock::time_point end = clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+        r.seconds += ns * 1e-9;
+        r.checksum += sum;
+        batchns.push_back(ns/batchsize);
+    }
+    std::sort(batchns.begin(), batchns.end());
+    auto percentile = [&batchns] (double p) -> double
+    {
+        if(batchns.empty())
+        {
+            return 0;
+        }
+        size_t i = static_cast<size_t>(p * (batchns.size() - 1) + 0.5);
+        return batchns[i];
+    };
+    r.nsmin = percentile(0);
+    r.nsp50 = percentile(0.5);
+    r.nsp90 = percentile(0.9);
+    r.nsp99 = percentile(0.99);
+    r.nsmax = percentile(1);
+    return r;
+}
+
+benchresult runbatchbench(const char *name, size_t samples, size_t batchsize,
+                          const std::function<double(size_t)> &batch)
+{
+    benchresult r = runbench(name, samples, 1, batch);
+    r.ops *= batchsize;
+    r.nsmin /= batchsize;
+    r.nsp50 /= batchsize;
+    r.nsp90 /= batchsize;
+    r.nsp99 /= batchsize;
+    r.nsmax /= batchsize;
+    return r;
+}
+
+void printresults(FILE *f, const std::vector<benchresult> &results, bool csv, int scale, uint seed)
+{
+    if(csv)
+    {
+        std::fprintf(f, "name,scale,seed,ops,seconds,opspersec,ns_min,ns_p50,ns_p90,ns_p99,ns_max,checksum\n");
+        for(const benchresult &r : results)
+        {
+            std::fprintf(f, "%s,%d,%u,%zu,%.6f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f,%.17g\n",
+                         r.name.c_str(), scale, seed, r.ops, r.seconds,
+                         r.seconds > 0 ? r.ops/r.seconds : 0.0,
+                         r.nsmin, r.nsp50, r.nsp90, r.nsp99, r.nsmax, r.checksum);
+        }
+        return;
+    }
+    std::fprintf(f, "{\n  \"scale\": %d,\n  \"seed\": %u,\n  \"results\": [\n", scale, seed);
+    for(size_t i = 0; i < results.size(); ++i)
+    {
+        const benchresult &r = results[i];
+        std::fprintf(f, "    {\"name\": \"%s\", \"ops\": %zu, \"seconds\": %.6f, \"opspersec\": %.1f, "
+                        "\"ns_min\": %.2f, \"ns_p50\": %.2f, \"ns_p90\": %.2f, \"ns_p99\": %.2f, \"ns_max\": %.2f, "
+                        "\"checksum\": %.17g}%s\n",
+                     r.name.c_str(), r.ops, r.seconds,
+                     r.seconds > 0 ? r.ops/r.seconds : 0.0,
+                     r.nsmin, r.nsp50, r.nsp90, r.nsp99, r.nsmax, r.checksum,
+                     i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(f, "  ]\n}\n");
+}
@@ -0,0 +1,121 @@
+#ifndef BENCHUTILS_H_
+#define BENCHUTILS_H_
+
+/**
+ * @brief Settings shared by all of the benchmarks in a run.
+ */
+struct benchconfig final
+{
+    int scale;          //world scale to generate
+    uint seed;          //seed for the world and the query inputs
+    size_t samples,     //timed batches per benchmark
+           batchsize,   //operations per batch
+           rebuilds;    //timed batches for benchmarks which rebuild the world each batch
+    std::string only;   //if not empty, only benchmarks whose names contain this are run
+
+    bool wants(const char *name) const
+    {
+        return only.empty() || std::strstr(name, only.c_str());
+    }
+};
+
+/**
+ * @brief Timing results for a single benchmark.
+ *
+ * Latencies are per operation, in nanoseconds. Each sample times a batch of
+ * operations (so that the clock overhead does not dominate short queries) and
+ * the percentiles are taken over the per-operation average of each batch.
+ */
+struct benchresult final
+{
+    std::string name;
+    size_t ops;         //total number of timed operations
+    double seconds,     //total time spent in timed operations
+           nsmin,
+           nsp50,
+           nsp90,
+           nsp99,
+           nsmax;
+    double checksum;    //sum of the values returned by each operation, for checking that results do not change
+};
+
+/**
+ * @brief Deterministic pseudorandom number generator for benchmark inputs.
+ *
+ * Unlike the standard library distributions, produces the same sequence on
+ * every platform and standard library implementation for a given seed.
+ */
+class benchrng final
+{
+    public:
+        benchrng(uint seed);
+
+        uint next();
+
+        /**
+         * @brief Returns a float in the range [lo, hi).
+         */
+        float uniform(float lo, float hi);
+
+        /**
+         * @brief Returns an int in the range [lo, hi).
+         */
+        int range(int lo, int hi);
+
+        /**
+         * @brief Returns a random unit vector.
+         */
+        vec direction();
+
+    private:
+        uint state;
+};
+
+/**
+ * @brief Times an operation over a number of samples.
+ *
+ * Before each sample, `setup` (if set) is run outside of the timed region.
+ * A single untimed batch is run before the first sample to warm caches.
+ *
+ * @param name the name to report the benchmark as
+ * @param samples the number of timed batches to run
+ * @param batchsize the number of operations in each batch
+ * @param op the operation to time, passed the index of the operation (which
+ *        is the same for the warmup batch as for the first timed batch)
+ * @param setup optional untimed function to run before every batch
+ *
+ * @return the timing results for the benchmark
+ */
+extern benchresult runbench(const char *name, size_t samples, size_t batchsize,
+                            const std::function<double(size_t)> &op,
+                            const std::function<void()> &setup = nullptr);
+
+/**
+ * @brief Times an operation which processes a whole batch at once.
+ *
+ * As runbench(), but `batch` is called once per sample with the index of the
+ * sample, and performs `batchsize` operations itself. The results are reported
+ * per operation, so they can be compared directly with those of runbench().
+ *
+ * @param name the name to report the benchmark as
+ * @param samples the number of timed batches to run
+ * @param batchsize the number of operations each call to batch performs
+ * @param batch the function to time, passed the index of the batch
+ *
+ * @return the timing results for the benchmark
+ */
+extern benchresult runbatchbench(const char *name, size_t samples, size_t batchsize,
+                                 const std::function<double(size_t)> &batch);
+
+/**
+ * @brief Prints the results of a benchmark run in a machine readable form.
+ *
+ * @param f the file to print to
+ * @param results the list of benchmark results
+ * @param csv true to print comma separated values, false for a JSON object
+ * @param scale the world scale the benchmarks were run with
+ * @param seed the seed the world and queries were generated from
+ */
+extern void printresults(FILE *f, const std::vector<benchresult> &results, bool csv, int scale, uint seed);
+
+#endif
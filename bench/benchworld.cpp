@@ -0,0 +1,116 @@
+#include "libprimis.h"
+#include "../src/engine/world/octaworld.h"
+
+#include <functional>
+
+#include "benchutils.h"
+#include "benchworld.h"
+
+namespace
+{
+    constexpr int columns = 64,     //terrain columns per map side
+                  lattice = 8;      //columns between terrain noise lattice points
+
+    //bilinearly interpolated value noise, heights in units of grid cubes
+    std::vector<int> genheights(benchrng &rng, int maxheight)
+    {
+        constexpr int points = columns/lattice + 1;
+        std::array<float, points*points> h;
+        for(float &i : h)
+        {
+            i = rng.uniform(0, maxheight);
+        }
+        std::vector<int> heights(columns*columns);
+        for(int y = 0; y < columns; ++y)
+        {
+            for(int x = 0; x < columns; ++x)
+            {
+                int lx = x/lattice,
+                    ly = y/lattice;
+                float fx = static_cast<float>(x%lattice)/lattice,
+                      fy = static_cast<float>(y%lattice)/lattice,
+                      h0 = h[ly*points + lx]*(1-fx) + h[ly*points + lx + 1]*fx,
+                      h1 = h[(ly+1)*points + lx]*(1-fx) + h[(ly+1)*points + lx + 1]*fx;
+                heights[y*columns + x] = static_cast<int>(h0*(1-fy) + h1*fy);
+            }
+        }
+        return heights;
+    }
+
+    void setsolid(const ivec &o, int size)
+    {
+        cube &c = rootworld.lookupcube(o, size);
+        setcubefaces(c, facesolid);
+    }
+
+    void setempty(const ivec &o, int size)
+    {
+        cube &c = rootworld.lookupcube(o, size);
+        setcubefaces(c, faceempty);
+    }
+
+    //pushes down the top of each vertical edge of the cube to a random height, making a sloped top
+    void slopetop(const ivec &o, int size, benchrng &rng)
+    {
+        cube &c = rootworld.lookupcube(o, size);
+        for(int i = 0; i < 2; ++i)
+        {
+            for(int j = 0; j < 2; ++j)
+            {
+                EDGE_SET(CUBE_EDGE(c, 2, i, j), 1, rng.range(4, 9));
+            }
+        }
+    }
+}
+
+bool genbenchworld(int scale, uint seed)
+{
+    worldqueriesonly = true; //there is no GL context to build vertex arrays with
+    if(!rootworld.emptymap(scale, true, false))
+    {
+        return false;
+    }
+    //emptymap leaves the bottom half of the world solid and the top half empty
+    benchrng rng(seed);
+    int size = rootworld.mapsize(),
+        ground = size/2,
+        grid = size/columns;
+    std::vector<int> heights = genheights(rng, columns/4);
+    for(int y = 0; y < columns; ++y)
+    {
+        for(int x = 0; x < columns; ++x)
+        {
+            int h = heights[y*columns + x];
+            for(int z = 0; z < h; ++z)
+            {
+                setsolid(ivec(x*grid, y*grid, ground + z*grid), grid);
+            }
+            if(h > 0)
+            {
+                slopetop(ivec(x*grid, y*grid, ground + (h-1)*grid), grid, rng);
+            }
+        }
+    }
+    //caves carved below the ground, cut at half the terrain grid size
+    for(int i = 0; i < columns*4; ++i)
+    {
+        int cx = rng.range(0, columns*2 - 8),
+            cy = rng.range(0, columns*2 - 8),
+            cz = rng.range(columns - 16, columns - 2),
+            len = rng.range(2, 8);
+        for(int j = 0; j < len; ++j)
+        {
+            setempty(ivec((cx + j)*grid/2, cy*grid/2, cz*grid/2), grid/2);
+        }
+    }
+    //floating blocks above the terrain, at a quarter of the terrain grid size
+    for(int i = 0; i < columns*4; ++i)
+    {
+        int bx = rng.range(0, columns*4),
+            by = rng.range(0, columns*4),
+            bz = rng.range(columns*3, columns*4);
+        setsolid(ivec(bx*grid/4, by*grid/4, bz*grid/4), grid/4);
+    }
+    rootworld.allchanged();
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef BENCHWORLD_H_
+#define BENCHWORLD_H_
+
+/**
+ * @brief Generates the deterministic benchmark world into the rootworld.
+ *
+ * Creates an empty map of the given scale and fills it with rolling terrain
+ * made of sloped cubes, caves carved below the terrain, and floating blocks
+ * above it. The same scale and seed always produce the same octree.
+ *
+ * Does not require a window or GL context: sets `worldqueriesonly`, so that
+ * the world is only prepared for collision and ray queries.
+ *
+ * @param scale the world scale (log2 of the map size), 10..16
+ * @param seed the seed to generate the terrain from
+ *
+ * @return true if the world was created
+ */
+extern bool genbenchworld(int scale, uint seed);
+
+#endif
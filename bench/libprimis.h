@@ -0,0 +1,8 @@
+#ifndef LIBPRIMIS_H_
+#define LIBPRIMIS_H_
+
+#include "../src/libprimis-headers/cube.h"
+#include "../src/libprimis-headers/iengine.h"
+#include "../src/libprimis-headers/consts.h"
+
+#endif
@@ -0,0 +1,128 @@
+#include "libprimis.h"
+
+#include <functional>
+
+#include "benchutils.h"
+#include "benchworld.h"
+#include "benchocta.h"
+#include "benchcs.h"
+#include "benchbih.h"
+
+namespace
+{
+    void usage()
+    {
+        std::fprintf(stderr,
+            "usage: libprimis_bench [options]\n"
+            "  -s <scale>    world scale, 10..16 (default 11)\n"
+            "  -x <seed>     seed for the world and queries (default 1)\n"
+            "  -n <samples>  timed batches per benchmark (default 200)\n"
+            "  -q <count>    operations per batch (default 256)\n"
+            "  -r <count>    timed batches for world rebuild benchmarks (default 10)\n"
+            "  -b <name>     only run benchmarks whose names contain <name>\n"
+            "  -c            print comma separated values instead of JSON\n"
+            "  -o <file>     write results to <file> instead of stdout\n");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    benchconfig cfg;
+    cfg.scale = 11;
+    cfg.seed = 1;
+    cfg.samples = 200;
+    cfg.batchsize = 256;
+    cfg.rebuilds = 10;
+    bool csv = false;
+    const char *outfile = nullptr;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        if(arg[0] != '-' || !arg[1] || arg[2])
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+        if(arg[1] == 'c')
+        {
+            csv = true;
+            continue;
+        }
+        if(i + 1 >= argc)
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+        const char *val = argv[++i];
+        switch(arg[1])
+        {
+            case 's':
+            {
+                cfg.scale = std::atoi(val);
+                break;
+            }
+            case 'x':
+            {
+                cfg.seed = std::strtoul(val, nullptr, 0);
+                break;
+            }
+            case 'n':
+            {
+                cfg.samples = std::max(std::atoi(val), 1);
+                break;
+            }
+            case 'q':
+            {
+                cfg.batchsize = std::max(std::atoi(val), 1);
+                break;
+            }
+            case 'r':
+            {
+                cfg.rebuilds = std::max(std::atoi(val), 1);
+                break;
+            }
+            case 'b':
+            {
+                cfg.only = val;
+                break;
+            }
+            case 'o':
+            {
+                outfile = val;
+                break;
+            }
+            default:
+            {
+                usage();
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::fprintf(stderr, "generating world (scale %d, seed %u)\n", cfg.scale, cfg.seed);
+    if(!genbenchworld(cfg.scale, cfg.seed))
+    {
+        std::fprintf(stderr, "failed to generate world\n");
+        return EXIT_FAILURE;
+    }
+    cfg.scale = rootworld.mapscale(); //emptymap clamps the requested scale
+
+    std::vector<benchresult> results;
+    benchocta(cfg, results);
+    benchcs(cfg, results);
+    benchbih(cfg, results);
+
+    FILE *f = outfile ? std::fopen(outfile, "w") : stdout;
+    if(!f)
+    {
+        std::fprintf(stderr, "could not open %s\n", outfile);
+        return EXIT_FAILURE;
+    }
+    printresults(f, results, csv, cfg.scale, cfg.seed);
+    if(f != stdout)
+    {
+        std::fclose(f);
+    }
+    return EXIT_SUCCESS;
+}
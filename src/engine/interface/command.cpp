@@ -17,13 +17,19 @@
 #include "../libprimis-headers/cube.h"
 #include "../../shared/stream.h"
 
+#include <chrono>
+#include <fstream>
+#include <list>
+#include <map>
+#include <string_view>
+
 #include "console.h"
 #include "control.h"
 #include "cs.h"
 
 #include "world/octaedit.h"
 
-std::unordered_map<std::string, ident> idents; // contains ALL vars/commands/aliases
+identtable idents; // contains ALL vars/commands/aliases
 static std::vector<ident *> identmap;
 static ident *dummyident = nullptr;
 std::queue<ident *> triggerqueue; //for the game to handle var change events
@@ -51,6 +57,8 @@ void ident::getval(tagval &r) const
     ::getval(alias.val, valtype, r);
 }
 
+const ident *lastcstralias = nullptr;
+
 void ident::getcstr(tagval &v) const
 {
     switch(valtype)
@@ -63,6 +71,7 @@ void ident::getcstr(tagval &v) const
         case Value_String:
         case Value_CString:
         {
+            lastcstralias = this;
             v.setcstr(alias.val.s);
             break;
         }
@@ -147,6 +156,7 @@ void tagval::setnumber(double val)
 
 void tagval::setstr(char *val)
 {
+    csallocs++;
     type = Value_String;
     s = val;
 }
@@ -454,6 +464,7 @@ static void freeargs(tagval *args, int &oldnum, int newnum)
 
 void cleancode(ident &id)
 {
+    dropparsedlist(id);
     if(id.alias.code)
     {
         id.alias.code[0] -= 0x100;
@@ -471,6 +482,7 @@ tagval * commandret = &noret;
 
 void clear_command()
 {
+    clearcodecache();
     for(auto& [k, i] : idents)
     {
         if(i.type==Id_Alias)
@@ -478,6 +490,7 @@ void clear_command()
             delete[] i.name;
             i.name = nullptr;
 
+            dropparsedlist(i);
             i.forcenull();
 
             delete[] i.alias.code;
@@ -543,6 +556,9 @@ void clearoverrides()
 static bool initedidents = false;
 static std::vector<ident> *identinits = nullptr;
 
+//incremented whenever an ident is added, as code compiled before then may have been compiled differently
+static uint identgeneration = 0;
+
 static ident *addident(const ident &id)
 {
     if(!initedidents)
@@ -554,13 +570,9 @@ static ident *addident(const ident &id)
         identinits->push_back(id);
         return nullptr;
     }
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(id.name);
-    if(itr == idents.end())
-    {
-        //we need to make a new entry
-        idents[id.name] = id;
-    }
-    ident &def = idents[id.name];
+    identgeneration++;
+    //only makes a new entry if there is none with the name
+    ident &def = (*idents.try_emplace(id.name, id).first).second;
     def.index = identmap.size();
     identmap.push_back(&def);
     return identmap.back();
@@ -797,24 +809,26 @@ static bool checknumber(const char *s)
     }
 }
 
-ident *newident(const char *name, int flags)
+//as newident(const char *, int), for names which are slices of a longer string (e.g. while compiling)
+static ident *newident(std::string_view name, int flags)
 {
-    ident *id = nullptr;
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
-    if(itr == idents.end())
+    identtable::iterator itr = idents.find(name);
+    if(itr != idents.end())
     {
-        if(checknumber(name))
-        {
-            debugcode("number %s is not a valid identifier name", name);
-            return dummyident;
-        }
-        id = addident(ident(Id_Alias, newstring(name), flags));
+        return &(*(itr)).second;
     }
-    else
+    std::string namestr(name);
+    if(checknumber(namestr.c_str()))
     {
-        id = &(*(itr)).second;
+        debugcode("number %s is not a valid identifier name", namestr.c_str());
+        return dummyident;
     }
-    return id;
+    return addident(ident(Id_Alias, newstring(namestr.c_str()), flags));
+}
+
+ident *newident(const char *name, int flags)
+{
+    return newident(std::string_view(name), flags);
 }
 
 static ident *forceident(tagval &v)
@@ -858,7 +872,7 @@ ident *writeident(const char *name, int flags)
 
 static void resetvar(char *name)
 {
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    identtable::iterator itr = idents.find(name);
     if(itr == idents.end())
     {
         return;
@@ -908,7 +922,7 @@ void setalias(ident &id, tagval &v)
 
 static void setalias(const char *name, tagval &v)
 {
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    identtable::iterator itr = idents.find(name);
     if(itr != idents.end())
     {
         ident *id = &(*(itr)).second;
@@ -1022,7 +1036,12 @@ struct DefVar final : identval
  */
 ident* getvar(int vartype, const char *name)
 {
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    return getvar(vartype, identkey(name));
+}
+
+ident *getvar(int vartype, const identkey &key)
+{
+    identtable::iterator itr = idents.find(key);
     if(itr != idents.end())
     {
         ident *id = &(*(itr)).second;
@@ -1112,7 +1131,12 @@ void storeval(ident *id, T &dst, T *src) {
 
 void setvar(const char *name, int i, bool dofunc, bool doclamp)
 {
-    ident *id = getvar(Id_Var, name);
+    setvar(identkey(name), i, dofunc, doclamp);
+}
+
+void setvar(const identkey &key, int i, bool dofunc, bool doclamp)
+{
+    ident *id = getvar(Id_Var, key);
     if(!id)
     {
         return;
@@ -1134,7 +1158,12 @@ void setvar(const char *name, int i, bool dofunc, bool doclamp)
 }
 void setfvar(const char *name, float f, bool dofunc, bool doclamp)
 {
-    ident *id = getvar(Id_FloatVar, name);
+    setfvar(identkey(name), f, dofunc, doclamp);
+}
+
+void setfvar(const identkey &key, float f, bool dofunc, bool doclamp)
+{
+    ident *id = getvar(Id_FloatVar, key);
     if(!id)
     {
         return;
@@ -1156,7 +1185,12 @@ void setfvar(const char *name, float f, bool dofunc, bool doclamp)
 }
 void setsvar(const char *name, const char *str, bool dofunc)
 {
-    ident *id = getvar(Id_StringVar, name);
+    setsvar(identkey(name), str, dofunc);
+}
+
+void setsvar(const identkey &key, const char *str, bool dofunc)
+{
+    ident *id = getvar(Id_StringVar, key);
     if(!id)
     {
         return;
@@ -1222,7 +1256,12 @@ bool identexists(const char *name)
 
 ident *getident(const char *name)
 {
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    return getident(identkey(name));
+}
+
+ident *getident(const identkey &key)
+{
+    identtable::iterator itr = idents.find(key);
     if(itr != idents.end())
     {
         return &(*(itr)).second;
@@ -1232,7 +1271,7 @@ ident *getident(const char *name)
 
 void touchvar(const char *name)
 {
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    identtable::iterator itr = idents.find(name);
     if(itr != idents.end())
     {
         ident* id = &(*(itr)).second;
@@ -1252,7 +1291,7 @@ void touchvar(const char *name)
 const char *getalias(const char *name)
 {
     ident *i = nullptr;
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    identtable::iterator itr = idents.find(name);
     if(itr != idents.end())
     {
         i = &(*(itr)).second;
@@ -2045,14 +2084,12 @@ static void compileident(std::vector<uint> &code, ident *id = dummyident)
 
 static void compileident(std::vector<uint> &code, const stringslice &word)
 {
-    std::string lookupsubstr = std::string(word.str).substr(0, word.len);
-    compileident(code, newident(lookupsubstr.c_str(), Idf_Unknown));
+    compileident(code, newident(std::string_view(word.str, word.len), Idf_Unknown));
 }
 
 static void compileint(std::vector<uint> &code, const stringslice &word)
 {
-    std::string lookupsubstr = std::string(word.str).substr(0, word.len);
-    compileint(code, word.len ? parseint(lookupsubstr.c_str()) : 0);
+    compileint(code, word.len ? parseint(std::string(word.str, word.len).c_str()) : 0);
 }
 
 static void compilefloat(std::vector<uint> &code, float f = 0.0f)
@@ -2079,6 +2116,185 @@ static void compilefloat(std::vector<uint> &code, const stringslice &word)
     compilefloat(code, word.len ? parsefloat(word.str) : 0.0f);
 }
 
+static VARF(csoptimize, 0, 1, 1, clearcodecache()); //fold constant math and literal if conditions, and call math commands directly, when compiling cubescript
+
+//reads the int or float constant compiled at code[i], moving i past it
+static bool compiledconst(const std::vector<uint> &code, size_t &i, tagval &v)
+{
+    if(i >= code.size())
+    {
+        return false;
+    }
+    uint op = code[i];
+    switch(op&0xFF)
+    {
+        case Code_ValI|Ret_Integer:
+        {
+            v.setint(static_cast<int>(op)>>8);
+            i++;
+            return true;
+        }
+        case Code_ValI|Ret_Float:
+        {
+            v.setfloat(static_cast<float>(static_cast<int>(op)>>8));
+            i++;
+            return true;
+        }
+        case Code_Val|Ret_Integer:
+        case Code_Val|Ret_Float:
+        {
+            if(i+1 >= code.size())
+            {
+                return false;
+            }
+            union
+            {
+                float f;
+                uint u;
+            } conv;
+            conv.u = code[i+1];
+            if((op&Code_RetMask) == Ret_Integer)
+            {
+                v.setint(static_cast<int>(conv.u));
+            }
+            else
+            {
+                v.setfloat(conv.f);
+            }
+            i += 2;
+            return true;
+        }
+    }
+    return false;
+}
+
+//compiles a folded int or float, keeping the exact value of floats (compilefloat turns -0 into 0)
+static void compileconst(std::vector<uint> &code, const tagval &v)
+{
+    if(v.type == Value_Integer)
+    {
+        compileint(code, v.i);
+    }
+    else if(v.f >= -0x800000 && v.f <= 0x7FFFFF && static_cast<int>(v.f) == v.f && !std::signbit(v.f))
+    {
+        code.push_back(Code_ValI|Ret_Float|(static_cast<int>(v.f)<<8));
+    }
+    else
+    {
+        union
+        {
+            float f;
+            uint u;
+        } conv;
+        conv.f = v.f;
+        code.push_back(Code_Val|Ret_Float);
+        code.push_back(conv.u);
+    }
+}
+
+//replaces a call to a math command whose args (compiled from start) are all constants with its result
+static bool foldmath(std::vector<uint> &code, size_t start, int op, int numargs, int rettype)
+{
+    if(numargs > Max_Args)
+    {
+        return false;
+    }
+    tagval args[Max_Args];
+    size_t i = start;
+    for(int j = 0; j < numargs; ++j)
+    {
+        //the statement's result is set after the call, so nulling it beforehand (see foldresultarg) can be dropped
+        while(i < code.size() && code[i] == Code_Null)
+        {
+            i++;
+        }
+        if(!compiledconst(code, i, args[j]))
+        {
+            return false;
+        }
+    }
+    if(i != code.size())
+    {
+        return false;
+    }
+    tagval result;
+    result.setnull();
+    mathop(op, args, numargs, result);
+    code.resize(start);
+    compileconst(code, result);
+    code.push_back(Code_Result|ret_code_any(rettype));
+    return true;
+}
+
+//turns a folded statement used as an argument (a constant, Code_Result, then Code_ResultArg) into the constant itself
+static bool foldresultarg(std::vector<uint> &code, size_t start, int wordtype)
+{
+    tagval v;
+    size_t i = start;
+    int ret = ret_code_any(wordtype);
+    if(ret == Ret_String || !compiledconst(code, i, v) || i+1 != code.size() || code[i] != Code_Result)
+    {
+        return false;
+    }
+    forcearg(v, ret);
+    code.resize(start);
+    //Code_ResultArg leaves the result null, which a later command may not overwrite
+    code.push_back(Code_Null);
+    compileconst(code, v);
+    return true;
+}
+
+//returns whether the if condition compiled from start to end is a constant true (1) or false (0), or neither (-1); start is moved past any Code_Null left by foldresultarg
+static int compiledcond(const std::vector<uint> &code, int &start, int end)
+{
+    if(start < end && code[start] == Code_Null)
+    {
+        start++;
+    }
+    if(start >= end)
+    {
+        return -1;
+    }
+    uint op = code[start];
+    tagval v;
+    switch(op&0xFF)
+    {
+        case Code_ValI|Ret_Null:
+        {
+            return end == start+1 ? 0 : -1;
+        }
+        case Code_ValI|Ret_String:
+        {
+            if(end != start+1)
+            {
+                return -1;
+            }
+            char s[4] = { static_cast<char>((op>>8)&0xFF), static_cast<char>((op>>16)&0xFF), static_cast<char>((op>>24)&0xFF), '\0' };
+            v.setcstr(s);
+            return getbool(v) ? 1 : 0;
+        }
+        case Code_Macro:
+        case Code_Val|Ret_String:
+        {
+            if(end != start + 1 + static_cast<int>((op>>8)/sizeof(uint)) + 1)
+            {
+                return -1;
+            }
+            v.setcstr(reinterpret_cast<const char *>(&code[start+1]));
+            return getbool(v) ? 1 : 0;
+        }
+        default:
+        {
+            size_t i = start;
+            if(!compiledconst(code, i, v) || static_cast<int>(i) != end)
+            {
+                return -1;
+            }
+            return getbool(v) ? 1 : 0;
+        }
+    }
+}
+
 bool getbool(const tagval &v)
 {
     auto getbool = [] (const char *s)
@@ -2274,8 +2490,7 @@ static void compilelookup(std::vector<uint> &code, const char *&p, int ltype, in
                 goto invalid; //invalid is near bottom of fxn
             }
         lookupid:
-            std::string lookupsubstr = std::string(lookup.str).substr(0, lookup.len);
-            ident *id = newident(lookupsubstr.c_str(), Idf_Unknown);
+            ident *id = newident(std::string_view(lookup.str, lookup.len), Idf_Unknown);
             if(id)
             {
                 switch(id->type)
@@ -2686,8 +2901,7 @@ static bool compileblocksub(std::vector<uint> &code, const char *&p, int prevarg
                 return false;
             }
         lookupid:
-            std::string lookupsubstr = std::string(lookup.str).substr(0, lookup.len);
-            ident *id = newident(lookupsubstr.c_str(), Idf_Unknown);
+            ident *id = newident(std::string_view(lookup.str, lookup.len), Idf_Unknown);
             if(id)
             {
                 switch(id->type)
@@ -3038,7 +3252,10 @@ static bool compilearg(std::vector<uint> &code, const char *&p, int wordtype, in
                 compilestatements(code, p, wordtype > Value_Any ? Value_CAny : Value_Any, ')', prevargs);
                 if(code.size() > start)
                 {
-                    code.push_back(Code_ResultArg|ret_code_any(wordtype));
+                    if(!csoptimize || !foldresultarg(code, start, wordtype))
+                    {
+                        code.push_back(Code_ResultArg|ret_code_any(wordtype));
+                    }
                 }
                 else
                 {
@@ -3162,8 +3379,7 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                     p++;
                     if(idname.str)
                     {
-                        std::string lookupsubstr = std::string(idname.str).substr(0, idname.len);
-                        ident *id = newident(lookupsubstr.c_str(), Idf_Unknown);
+                        ident *id = newident(std::string_view(idname.str, idname.len), Idf_Unknown);
                         if(id)
                         {
                             switch(id->type)
@@ -3229,8 +3445,7 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
         else
         {
             ident *id = nullptr;
-            std::string lookupsubstr = std::string(idname.str).substr(0, idname.len);
-            std::unordered_map<std::string, ident>::iterator itr = idents.find(lookupsubstr);
+            identtable::iterator itr = idents.find(std::string_view(idname.str, idname.len));
             if(itr != idents.end())
             {
                 id = &(*(itr)).second;
@@ -3282,6 +3497,7 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                     {
                         int comtype = Code_Com,
                             fakeargs = 0;
+                        uint argstart = code.size();
                         bool rep = false;
                         for(const char *fmt = id->cmd.args; *fmt; fmt++)
                         {
@@ -3530,6 +3746,18 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                         code.push_back(comtype|ret_code_any(rettype)|(id->index<<8));
                         break;
                     compilecomv:
+                        if(comtype == Code_ComV && csoptimize)
+                        {
+                            int math = getmathop(id->name);
+                            if(math >= 0)
+                            {
+                                if(!foldmath(code, argstart, math, numargs, rettype))
+                                {
+                                    code.push_back(Code_Math|ret_code_any(rettype)|(numargs<<8)|(math<<13));
+                                }
+                                break;
+                            }
+                        }
                         code.push_back(comtype|ret_code_any(rettype)|(numargs<<8)|(id->index<<13));
                         break;
                     }
@@ -3572,6 +3800,7 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                     }
                     case Id_If:
                     {
+                        int condstart = code.size();
                         if(more)
                         {
                             more = compilearg(code, p, Value_CAny, prevargs);
@@ -3603,6 +3832,20 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                                         code[start1] = (len1<<8) | Code_JumpFalse;
                                         code[start1+1] = Code_EnterResult;
                                         code[start1+len1] = (code[start1+len1]&~Code_RetMask) | ret_code_any(rettype);
+                                        //skip the test of a literal condition, dropping the body if it is false
+                                        switch(csoptimize ? compiledcond(code, condstart, start1) : -1)
+                                        {
+                                            case 0:
+                                            {
+                                                code.resize(condstart);
+                                                break;
+                                            }
+                                            case 1:
+                                            {
+                                                code[condstart] = Code_Jump|((start1-condstart)<<8);
+                                                break;
+                                            }
+                                        }
                                         break;
                                     }
                                     compileblock(code);
@@ -3622,6 +3865,21 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                                             code[start2] = (len2<<8) | Code_Jump;
                                             code[start2+1] = Code_EnterResult;
                                             code[start2+len2] = (code[start2+len2]&~Code_RetMask) | ret_code_any(rettype);
+                                            //jump straight to the branch taken by a literal condition, dropping the else branch if it is not
+                                            switch(csoptimize ? compiledcond(code, condstart, start1) : -1)
+                                            {
+                                                case 0:
+                                                {
+                                                    code[condstart] = Code_Jump|((start2-condstart)<<8);
+                                                    break;
+                                                }
+                                                case 1:
+                                                {
+                                                    code.resize(start2);
+                                                    code[condstart] = Code_Jump|((start1-condstart)<<8);
+                                                    break;
+                                                }
+                                            }
                                             break;
                                         }
                                         else if(op1 == (Code_Empty|(len1<<8)))
@@ -3630,6 +3888,21 @@ static void compilestatements(std::vector<uint> &code, const char *&p, int retty
                                             code[start2] = (len2<<8) | Code_JumpTrue;
                                             code[start2+1] = Code_EnterResult;
                                             code[start2+len2] = (code[start2+len2]&~Code_RetMask) | ret_code_any(rettype);
+                                            switch(csoptimize ? compiledcond(code, condstart, start1) : -1)
+                                            {
+                                                case 0:
+                                                {
+                                                    code[start2] = Code_Jump;
+                                                    code[condstart] = Code_Jump|((start1-(condstart+1))<<8);
+                                                    break;
+                                                }
+                                                case 1:
+                                                {
+                                                    code.resize(start2);
+                                                    code[condstart] = Code_Jump|((start1-(condstart+1))<<8);
+                                                    break;
+                                                }
+                                            }
                                             break;
                                         }
                                     }
@@ -3822,6 +4095,7 @@ uint *compilecode(const char *p)
     std::vector<uint> buf;
     buf.reserve(64);
     compilemain(buf, p);
+    csallocs++;
     uint *code = new uint[buf.size()];
     std::memcpy(code, buf.data(), buf.size()*sizeof(uint));
     code[0] += 0x100;
@@ -3836,6 +4110,7 @@ static const uint *forcecode(tagval &v)
         buf.reserve(64);
         compilemain(buf, v.getstr());
         freearg(v);
+        csallocs++;
         uint * arr = new uint[buf.size()];
         std::memcpy(arr, buf.data(), buf.size()*sizeof(uint));
         v.setcode(arr+1);
@@ -4120,6 +4395,7 @@ void* arg(const ident *id, tagval args[], int n, int offset = 0)
  */
 void callcom(const ident *id, tagval args[], int n, int offset=0)
 {
+    csprofilescope profile(id->name);
     /**
      * @brief Return the n-th argument. The lambda expression captures the `id`
      * and `args` so only the parameter number `n` needs to be passed.
@@ -4357,13 +4633,17 @@ static void callcommand(ident *id, tagval *args, int numargs, bool lookup = fals
             {
                 i = std::max(i+1, numargs);
                 std::vector<char> buf;
+                csprofilescope profile(id->name);
                 reinterpret_cast<comfun1>(id->fun)(conc(buf, args, i, true));
                 goto cleanup;
             }
             case 'V':
             {
                 i = std::max(i+1, numargs);
-                reinterpret_cast<comfunv>(id->fun)(args, i);
+                {
+                    csprofilescope profile(id->name);
+                    reinterpret_cast<comfunv>(id->fun)(args, i);
+                }
                 goto cleanup;
             }
             case '1':
@@ -4445,7 +4725,22 @@ static int rundepth = 0; //current rundepth
         } \
     }
 
-static const uint *runcode(const uint *code, tagval &result)
+// runcode() keeps the addresses of its labels in a static table, which are only
+// valid for the one copy of the function compiled; label addresses and computed
+// gotos are extensions, which -Wpedantic would otherwise warn about
+#if defined(__GNUC__)
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+#if defined(__clang__)
+    #define RUNCODE_ATTRIBUTES __attribute__((noinline))
+#elif defined(__GNUC__)
+    #define RUNCODE_ATTRIBUTES __attribute__((noinline, noclone))
+#else
+    #define RUNCODE_ATTRIBUTES
+#endif
+
+RUNCODE_ATTRIBUTES static const uint *runcode(const uint *code, tagval &result)
 {
     result.setnull();
     if(rundepth >= maxrundepth)
@@ -4453,6 +4748,131 @@ static const uint *runcode(const uint *code, tagval &result)
         debugcode("exceeded recursion limit");
         return skipcode(code, result);
     }
+#if defined(__GNUC__)
+    // with GCC and clang each opcode jumps straight to its case below through
+    // this table, so the dispatch can be copied to the end of each case rather
+    // than all of them going back through the switch's bounds check and jump
+    #define OPLABEL(name) name:
+    #define DISPATCHRETS(code, name) \
+        dispatch[code|Ret_Null] = dispatch[code|Ret_String] = dispatch[code|Ret_Integer] = dispatch[code|Ret_Float] = &&name
+    static void *dispatch[256];
+    static bool dispatchinit = false;
+    if(!dispatchinit)
+    {
+        std::fill(std::begin(dispatch), std::end(dispatch), &&op_none);
+        dispatch[Code_Start] = dispatch[Code_Offset] = &&op_start;
+        dispatch[Code_Null|Ret_Null] = &&op_null_null;
+        dispatch[Code_Null|Ret_String] = &&op_null_str;
+        dispatch[Code_Null|Ret_Integer] = &&op_null_int;
+        dispatch[Code_Null|Ret_Float] = &&op_null_float;
+        dispatch[Code_False|Ret_String] = &&op_false_str;
+        dispatch[Code_False|Ret_Null] = dispatch[Code_False|Ret_Integer] = &&op_false_null;
+        dispatch[Code_False|Ret_Float] = &&op_false_float;
+        dispatch[Code_True|Ret_String] = &&op_true_str;
+        dispatch[Code_True|Ret_Null] = dispatch[Code_True|Ret_Integer] = &&op_true_null;
+        dispatch[Code_True|Ret_Float] = &&op_true_float;
+        dispatch[Code_Not|Ret_String] = &&op_not_str;
+        dispatch[Code_Not|Ret_Null] = dispatch[Code_Not|Ret_Integer] = &&op_not_null;
+        dispatch[Code_Not|Ret_Float] = &&op_not_float;
+        dispatch[Code_Pop] = &&op_pop;
+        dispatch[Code_Enter] = &&op_enter;
+        dispatch[Code_EnterResult] = &&op_enterresult;
+        dispatch[Code_Exit|Ret_String] = dispatch[Code_Exit|Ret_Integer] =
+            dispatch[Code_Exit|Ret_Float] = &&op_exit_str;
+        dispatch[Code_Exit|Ret_Null] = &&op_exit_null;
+        dispatch[Code_ResultArg|Ret_String] = dispatch[Code_ResultArg|Ret_Integer] =
+            dispatch[Code_ResultArg|Ret_Float] = &&op_resultarg_str;
+        dispatch[Code_ResultArg|Ret_Null] = &&op_resultarg_null;
+        dispatch[Code_Print] = &&op_print;
+        dispatch[Code_Local] = &&op_local;
+        DISPATCHRETS(Code_DoArgs, op_doargs);
+        DISPATCHRETS(Code_Do, op_do);
+        dispatch[Code_Jump] = &&op_jump;
+        dispatch[Code_JumpTrue] = &&op_jumptrue;
+        dispatch[Code_JumpFalse] = &&op_jumpfalse;
+        dispatch[Code_JumpResultTrue] = &&op_jumpresulttrue;
+        dispatch[Code_JumpResultFalse] = &&op_jumpresultfalse;
+        dispatch[Code_Macro] = &&op_macro;
+        dispatch[Code_Val|Ret_String] = &&op_val_str;
+        dispatch[Code_ValI|Ret_String] = &&op_vali_str;
+        dispatch[Code_Val|Ret_Null] = dispatch[Code_ValI|Ret_Null] = &&op_val_null;
+        dispatch[Code_Val|Ret_Integer] = &&op_val_int;
+        dispatch[Code_ValI|Ret_Integer] = &&op_vali_int;
+        dispatch[Code_Val|Ret_Float] = &&op_val_float;
+        dispatch[Code_ValI|Ret_Float] = &&op_vali_float;
+        dispatch[Code_Dup|Ret_Null] = &&op_dup_null;
+        dispatch[Code_Dup|Ret_Integer] = &&op_dup_int;
+        dispatch[Code_Dup|Ret_Float] = &&op_dup_float;
+        dispatch[Code_Dup|Ret_String] = &&op_dup_str;
+        dispatch[Code_Force|Ret_String] = &&op_force_str;
+        dispatch[Code_Force|Ret_Integer] = &&op_force_int;
+        dispatch[Code_Force|Ret_Float] = &&op_force_float;
+        dispatch[Code_Result|Ret_Null] = &&op_result_null;
+        dispatch[Code_Result|Ret_String] = dispatch[Code_Result|Ret_Integer] =
+            dispatch[Code_Result|Ret_Float] = &&op_result_str;
+        dispatch[Code_Empty|Ret_Null] = &&op_empty_null;
+        dispatch[Code_Empty|Ret_String] = &&op_empty_str;
+        dispatch[Code_Empty|Ret_Integer] = &&op_empty_int;
+        dispatch[Code_Empty|Ret_Float] = &&op_empty_float;
+        dispatch[Code_Block] = &&op_block;
+        dispatch[Code_Compile] = &&op_compile;
+        dispatch[Code_Cond] = &&op_cond;
+        dispatch[Code_Ident] = &&op_ident;
+        dispatch[Code_IdentArg] = &&op_identarg;
+        dispatch[Code_IdentU] = &&op_identu;
+        dispatch[Code_LookupU|Ret_String] = &&op_lookupu_str;
+        dispatch[Code_Lookup|Ret_String] = &&op_lookup_str;
+        dispatch[Code_LookupArg|Ret_String] = &&op_lookuparg_str;
+        dispatch[Code_LookupU|Ret_Integer] = &&op_lookupu_int;
+        dispatch[Code_Lookup|Ret_Integer] = &&op_lookup_int;
+        dispatch[Code_LookupArg|Ret_Integer] = &&op_lookuparg_int;
+        dispatch[Code_LookupU|Ret_Float] = &&op_lookupu_float;
+        dispatch[Code_Lookup|Ret_Float] = &&op_lookup_float;
+        dispatch[Code_LookupArg|Ret_Float] = &&op_lookuparg_float;
+        dispatch[Code_LookupU|Ret_Null] = &&op_lookupu_null;
+        dispatch[Code_Lookup|Ret_Null] = &&op_lookup_null;
+        dispatch[Code_LookupArg|Ret_Null] = &&op_lookuparg_null;
+        dispatch[Code_LookupMU|Ret_String] = &&op_lookupmu_str;
+        dispatch[Code_LookupM|Ret_String] = &&op_lookupm_str;
+        dispatch[Code_LookupMArg|Ret_String] = &&op_lookupmarg_str;
+        dispatch[Code_LookupMU|Ret_Null] = &&op_lookupmu_null;
+        dispatch[Code_LookupM|Ret_Null] = &&op_lookupm_null;
+        dispatch[Code_LookupMArg|Ret_Null] = &&op_lookupmarg_null;
+        dispatch[Code_StrVar|Ret_String] = dispatch[Code_StrVar|Ret_Null] = &&op_strvar_str;
+        dispatch[Code_StrVar|Ret_Integer] = &&op_strvar_int;
+        dispatch[Code_StrVar|Ret_Float] = &&op_strvar_float;
+        dispatch[Code_StrVarM] = &&op_strvarm;
+        dispatch[Code_StrVar1] = &&op_strvar1;
+        dispatch[Code_IntVar|Ret_Integer] = dispatch[Code_IntVar|Ret_Null] = &&op_intvar_int;
+        dispatch[Code_IntVar|Ret_String] = &&op_intvar_str;
+        dispatch[Code_IntVar|Ret_Float] = &&op_intvar_float;
+        dispatch[Code_IntVar1] = &&op_intvar1;
+        dispatch[Code_IntVar2] = &&op_intvar2;
+        dispatch[Code_IntVar3] = &&op_intvar3;
+        dispatch[Code_FloatVar|Ret_Float] = dispatch[Code_FloatVar|Ret_Null] = &&op_floatvar_float;
+        dispatch[Code_FloatVar|Ret_String] = &&op_floatvar_str;
+        dispatch[Code_FloatVar|Ret_Integer] = &&op_floatvar_int;
+        dispatch[Code_FloatVar1] = &&op_floatvar1;
+        DISPATCHRETS(Code_Com, op_com);
+        DISPATCHRETS(Code_ComD, op_comd);
+        DISPATCHRETS(Code_ComV, op_comv);
+        DISPATCHRETS(Code_Math, op_math);
+        DISPATCHRETS(Code_ComC, op_comc);
+        DISPATCHRETS(Code_ConC, op_conc);
+        DISPATCHRETS(Code_ConCW, op_conc);
+        DISPATCHRETS(Code_ConCM, op_concm);
+        dispatch[Code_Alias] = &&op_alias;
+        dispatch[Code_AliasArg] = &&op_aliasarg;
+        dispatch[Code_AliasU] = &&op_aliasu;
+        DISPATCHRETS(Code_Call, op_call);
+        DISPATCHRETS(Code_CallArg, op_callarg);
+        DISPATCHRETS(Code_CallU, op_callu);
+        dispatchinit = true;
+    }
+    #undef DISPATCHRETS
+#else
+    #define OPLABEL(name)
+#endif
     ++rundepth;
     int numargs = 0;
     tagval args[Max_Args+Max_Results],
@@ -4461,33 +4881,41 @@ static const uint *runcode(const uint *code, tagval &result)
     for(;;)
     {
         uint op = *code++;
+#if defined(__GNUC__)
+        goto *dispatch[op&0xFF];
+#endif
         switch(op&0xFF)
         {
             case Code_Start:
             case Code_Offset:
+            OPLABEL(op_start)
             {
                 continue;
             }
             // For Code_Null cases, set results to null, empty, or 0 values.
             case Code_Null|Ret_Null:
+            OPLABEL(op_null_null)
             {
                 freearg(result);
                 result.setnull();
                 continue;
             }
             case Code_Null|Ret_String:
+            OPLABEL(op_null_str)
             {
                 freearg(result);
                 result.setstr(newstring(""));
                 continue;
             }
             case Code_Null|Ret_Integer:
+            OPLABEL(op_null_int)
             {
                 freearg(result);
                 result.setint(0);
                 continue;
             }
             case Code_Null|Ret_Float:
+            OPLABEL(op_null_float)
             {
                 freearg(result);
                 result.setfloat(0.0f);
@@ -4495,6 +4923,7 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             // For Code_False cases, set results to 0 values.
             case Code_False|Ret_String:
+            OPLABEL(op_false_str)
             {
                 freearg(result);
                 result.setstr(newstring("0"));
@@ -4502,12 +4931,14 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             case Code_False|Ret_Null: // Null case left empty intentionally.
             case Code_False|Ret_Integer:
+            OPLABEL(op_false_null)
             {
                 freearg(result);
                 result.setint(0);
                 continue;
             }
             case Code_False|Ret_Float:
+            OPLABEL(op_false_float)
             {
                 freearg(result);
                 result.setfloat(0.0f);
@@ -4515,6 +4946,7 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             // For Code_False cases, set results to 1 values.
             case Code_True|Ret_String:
+            OPLABEL(op_true_str)
             {
                 freearg(result);
                 result.setstr(newstring("1"));
@@ -4522,12 +4954,14 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             case Code_True|Ret_Null: // Null case left empty intentionally.
             case Code_True|Ret_Integer:
+            OPLABEL(op_true_null)
             {
                 freearg(result);
                 result.setint(1);
                 continue;
             }
             case Code_True|Ret_Float:
+            OPLABEL(op_true_float)
             {
                 freearg(result);
                 result.setfloat(1.0f);
@@ -4535,6 +4969,7 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             // For Code_Not cases, negate values (flip 0's and 1's).
             case Code_Not|Ret_String:
+            OPLABEL(op_not_str)
             {
                 freearg(result);
                 --numargs;
@@ -4544,6 +4979,7 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             case Code_Not|Ret_Null: // Null case left empty intentionally.
             case Code_Not|Ret_Integer:
+            OPLABEL(op_not_null)
             {
                 freearg(result);
                 --numargs;
@@ -4552,6 +4988,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Not|Ret_Float:
+            OPLABEL(op_not_float)
             {
                 freearg(result);
                 --numargs;
@@ -4560,16 +4997,19 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Pop:
+            OPLABEL(op_pop)
             {
                 freearg(args[--numargs]);
                 continue;
             }
             case Code_Enter:
+            OPLABEL(op_enter)
             {
                 code = runcode(code, args[numargs++]);
                 continue;
             }
             case Code_EnterResult:
+            OPLABEL(op_enterresult)
             {
                 freearg(result);
                 code = runcode(code, result);
@@ -4578,33 +5018,39 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_Exit|Ret_String:
             case Code_Exit|Ret_Integer:
             case Code_Exit|Ret_Float:
+            OPLABEL(op_exit_str)
             {
                 forcearg(result, op&Code_RetMask);
             }
             [[fallthrough]];
             case Code_Exit|Ret_Null:
+            OPLABEL(op_exit_null)
             {
                 goto exit;
             }
             case Code_ResultArg|Ret_String:
             case Code_ResultArg|Ret_Integer:
             case Code_ResultArg|Ret_Float:
+            OPLABEL(op_resultarg_str)
             {
                 forcearg(result, op&Code_RetMask);
             }
             [[fallthrough]];
             case Code_ResultArg|Ret_Null:
+            OPLABEL(op_resultarg_null)
             {
                 args[numargs++] = result;
                 result.setnull();
                 continue;
             }
             case Code_Print:
+            OPLABEL(op_print)
             {
                 printvar(identmap[op>>8]);
                 continue;
             }
             case Code_Local:
+            OPLABEL(op_local)
             {
                 freearg(result);
                 int numlocals = op>>8,
@@ -4625,6 +5071,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_DoArgs|Ret_String:
             case Code_DoArgs|Ret_Integer:
             case Code_DoArgs|Ret_Float:
+            OPLABEL(op_doargs)
             {
                 UNDOARGS
                 freearg(result);
@@ -4638,6 +5085,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_Do|Ret_String:
             case Code_Do|Ret_Integer:
             case Code_Do|Ret_Float:
+            OPLABEL(op_do)
             {
                 freearg(result);
                 runcode(args[--numargs].code, result);
@@ -4646,12 +5094,14 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Jump:
+            OPLABEL(op_jump)
             {
                 uint len = op>>8;
                 code += len;
                 continue;
             }
             case Code_JumpTrue:
+            OPLABEL(op_jumptrue)
             {
                 uint len = op>>8;
                 if(getbool(args[--numargs]))
@@ -4662,6 +5112,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_JumpFalse:
+            OPLABEL(op_jumpfalse)
             {
                 uint len = op>>8;
                 if(!getbool(args[--numargs]))
@@ -4672,6 +5123,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_JumpResultTrue:
+            OPLABEL(op_jumpresulttrue)
             {
                 uint len = op>>8;
                 freearg(result);
@@ -4692,6 +5144,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_JumpResultFalse:
+            OPLABEL(op_jumpresultfalse)
             {
                 uint len = op>>8;
                 freearg(result);
@@ -4712,6 +5165,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Macro:
+            OPLABEL(op_macro)
             {
                 uint len = op>>8;
                 args[numargs++].setmacro(code);
@@ -4719,6 +5173,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Val|Ret_String:
+            OPLABEL(op_val_str)
             {
                 uint len = op>>8;
                 const char * codearr = reinterpret_cast<const char *>(code);
@@ -4733,6 +5188,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_ValI|Ret_String:
+            OPLABEL(op_vali_str)
             {
                 char s[4] = { static_cast<char>((op>>8)&0xFF), static_cast<char>((op>>16)&0xFF), static_cast<char>((op>>24)&0xFF), '\0' };
                 args[numargs++].setstr(newstring(s));
@@ -4740,70 +5196,83 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             case Code_Val|Ret_Null:
             case Code_ValI|Ret_Null:
+            OPLABEL(op_val_null)
             {
                 args[numargs++].setnull();
                 continue;
             }
             case Code_Val|Ret_Integer:
+            OPLABEL(op_val_int)
             {
                 args[numargs++].setint(static_cast<int>(*code++));
                 continue;
             }
             case Code_ValI|Ret_Integer:
+            OPLABEL(op_vali_int)
             {
                 args[numargs++].setint(static_cast<int>(op)>>8);
                 continue;
             }
             case Code_Val|Ret_Float:
+            OPLABEL(op_val_float)
             {
                 args[numargs++].setfloat(*reinterpret_cast<const float *>(code++));
                 continue;
             }
             case Code_ValI|Ret_Float:
+            OPLABEL(op_vali_float)
             {
                 args[numargs++].setfloat(static_cast<float>(static_cast<int>(op)>>8));
                 continue;
             }
             case Code_Dup|Ret_Null:
+            OPLABEL(op_dup_null)
             {
                 args[numargs-1].getval(args[numargs]);
                 numargs++;
                 continue;
             }
             case Code_Dup|Ret_Integer:
+            OPLABEL(op_dup_int)
             {
                 args[numargs].setint(args[numargs-1].getint());
                 numargs++;
                 continue;
             }
             case Code_Dup|Ret_Float:
+            OPLABEL(op_dup_float)
             {
                 args[numargs].setfloat(args[numargs-1].getfloat());
                 numargs++;
                 continue;
             }
             case Code_Dup|Ret_String:
+            OPLABEL(op_dup_str)
             {
                 args[numargs].setstr(newstring(args[numargs-1].getstr()));
                 numargs++;
                 continue;
             }
             case Code_Force|Ret_String:
+            OPLABEL(op_force_str)
             {
                 forcestr(args[numargs-1]);
                 continue;
             }
             case Code_Force|Ret_Integer:
+            OPLABEL(op_force_int)
             {
                 forceint(args[numargs-1]);
                 continue;
             }
             case Code_Force|Ret_Float:
+            OPLABEL(op_force_float)
             {
                 forcefloat(args[numargs-1]);
                 continue;
             }
             case Code_Result|Ret_Null:
+            OPLABEL(op_result_null)
             {
                 freearg(result);
                 result = args[--numargs];
@@ -4812,6 +5281,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_Result|Ret_String:
             case Code_Result|Ret_Integer:
             case Code_Result|Ret_Float:
+            OPLABEL(op_result_str)
             {
                 freearg(result);
                 result = args[--numargs];
@@ -4819,26 +5289,31 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Empty|Ret_Null:
+            OPLABEL(op_empty_null)
             {
                 args[numargs++].setcode(emptyblock[Value_Null]+1);
                 break;
             }
             case Code_Empty|Ret_String:
+            OPLABEL(op_empty_str)
             {
                 args[numargs++].setcode(emptyblock[Value_String]+1);
                 break;
             }
             case Code_Empty|Ret_Integer:
+            OPLABEL(op_empty_int)
             {
                 args[numargs++].setcode(emptyblock[Value_Integer]+1);
                 break;
             }
             case Code_Empty|Ret_Float:
+            OPLABEL(op_empty_float)
             {
                 args[numargs++].setcode(emptyblock[Value_Float]+1);
                 break;
             }
             case Code_Block:
+            OPLABEL(op_block)
             {
                 uint len = op>>8;
                 args[numargs++].setcode(code+1);
@@ -4846,6 +5321,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Compile:
+            OPLABEL(op_compile)
             {
                 tagval &arg = args[numargs-1];
                 std::vector<uint> buf;
@@ -4894,6 +5370,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Cond:
+            OPLABEL(op_cond)
             {
                 tagval &arg = args[numargs-1];
                 switch(arg.type)
@@ -4920,11 +5397,13 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Ident:
+            OPLABEL(op_ident)
             {
                 args[numargs++].setident(identmap[op>>8]);
                 continue;
             }
             case Code_IdentArg:
+            OPLABEL(op_identarg)
             {
                 ident *id = identmap[op>>8];
                 if(!(aliasstack->usedargs&(1<<id->index)))
@@ -4936,6 +5415,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_IdentU:
+            OPLABEL(op_identu)
             {
                 tagval &arg = args[numargs-1];
                 ident *id = arg.type ==     Value_String
@@ -4952,13 +5432,14 @@ static const uint *runcode(const uint *code, tagval &result)
             }
 
             case Code_LookupU|Ret_String:
+            OPLABEL(op_lookupu_str)
                 #define LOOKUPU(aval, sval, ival, fval, nval) { \
                     tagval &arg = args[numargs-1]; \
                     if(arg.type != Value_String && arg.type != Value_Macro && arg.type != Value_CString) \
                     { \
                         continue; \
                     } \
-                    std::unordered_map<std::string, ident>::iterator itr = idents.find(arg.s); \
+                    identtable::iterator itr = idents.find(arg.s); \
                     if(itr != idents.end()) \
                     { \
                         ident* id = &(*(itr)).second; \
@@ -5027,6 +5508,7 @@ static const uint *runcode(const uint *code, tagval &result)
                         arg.setstr(newstring(floatstr(*id->val.storage.f))),
                         arg.setstr(newstring("")));
             case Code_Lookup|Ret_String:
+            OPLABEL(op_lookup_str)
                 #define LOOKUP(aval) { \
                     ident * const id = identmap[op>>8]; \
                     if(id->flags&Idf_Unknown) \
@@ -5038,6 +5520,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 LOOKUP(args[numargs++].setstr(newstring(id->getstr())));
             case Code_LookupArg|Ret_String:
+            OPLABEL(op_lookuparg_str)
                 #define LOOKUPARG(aval, nval) { \
                     ident * const id = identmap[op>>8]; \
                     if(!(aliasstack->usedargs&(1<<id->index))) \
@@ -5050,6 +5533,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 LOOKUPARG(args[numargs++].setstr(newstring(id->getstr())), args[numargs++].setstr(newstring("")));
             case Code_LookupU|Ret_Integer:
+            OPLABEL(op_lookupu_int)
             {
                 LOOKUPU(arg.setint(id->getint()),
                         arg.setint(static_cast<int>(std::strtoul(*id->val.storage.s, nullptr, 0))),
@@ -5058,104 +5542,129 @@ static const uint *runcode(const uint *code, tagval &result)
                         arg.setint(0));
             }
             case Code_Lookup|Ret_Integer:
+            OPLABEL(op_lookup_int)
                 LOOKUP(args[numargs++].setint(id->getint()));
             case Code_LookupArg|Ret_Integer:
+            OPLABEL(op_lookuparg_int)
                 LOOKUPARG(args[numargs++].setint(id->getint()), args[numargs++].setint(0));
             case Code_LookupU|Ret_Float:
+            OPLABEL(op_lookupu_float)
                 LOOKUPU(arg.setfloat(id->getfloat()),
                         arg.setfloat(parsefloat(*id->val.storage.s)),
                         arg.setfloat(static_cast<float>(*id->val.storage.i)),
                         arg.setfloat(*id->val.storage.f),
                         arg.setfloat(0.0f));
             case Code_Lookup|Ret_Float:
+            OPLABEL(op_lookup_float)
                 LOOKUP(args[numargs++].setfloat(id->getfloat()));
             case Code_LookupArg|Ret_Float:
+            OPLABEL(op_lookuparg_float)
                 LOOKUPARG(args[numargs++].setfloat(id->getfloat()), args[numargs++].setfloat(0.0f));
             case Code_LookupU|Ret_Null:
+            OPLABEL(op_lookupu_null)
                 LOOKUPU(id->getval(arg),
                         arg.setstr(newstring(*id->val.storage.s)),
                         arg.setint(*id->val.storage.i),
                         arg.setfloat(*id->val.storage.f),
                         arg.setnull());
             case Code_Lookup|Ret_Null:
+            OPLABEL(op_lookup_null)
                 LOOKUP(id->getval(args[numargs++]));
             case Code_LookupArg|Ret_Null:
+            OPLABEL(op_lookuparg_null)
                 LOOKUPARG(id->getval(args[numargs++]), args[numargs++].setnull());
             case Code_LookupMU|Ret_String:
+            OPLABEL(op_lookupmu_str)
                 LOOKUPU(id->getcstr(arg),
                         arg.setcstr(*id->val.storage.s),
                         arg.setstr(newstring(intstr(*id->val.storage.i))),
                         arg.setstr(newstring(floatstr(*id->val.storage.f))),
                         arg.setcstr(""));
             case Code_LookupM|Ret_String:
+            OPLABEL(op_lookupm_str)
                 LOOKUP(id->getcstr(args[numargs++]));
             case Code_LookupMArg|Ret_String:
+            OPLABEL(op_lookupmarg_str)
                 LOOKUPARG(id->getcstr(args[numargs++]), args[numargs++].setcstr(""));
             case Code_LookupMU|Ret_Null:
+            OPLABEL(op_lookupmu_null)
                 LOOKUPU(id->getcval(arg),
                         arg.setcstr(*id->val.storage.s),
                         arg.setint(*id->val.storage.i),
                         arg.setfloat(*id->val.storage.f),
                         arg.setnull());
             case Code_LookupM|Ret_Null:
+            OPLABEL(op_lookupm_null)
                 LOOKUP(id->getcval(args[numargs++]));
             case Code_LookupMArg|Ret_Null:
+            OPLABEL(op_lookupmarg_null)
                 LOOKUPARG(id->getcval(args[numargs++]), args[numargs++].setnull());
 
             case Code_StrVar|Ret_String:
             case Code_StrVar|Ret_Null:
+            OPLABEL(op_strvar_str)
             {
                 args[numargs++].setstr(newstring(*identmap[op>>8]->val.storage.s));
                 continue;
             }
             case Code_StrVar|Ret_Integer:
+            OPLABEL(op_strvar_int)
             {
                 args[numargs++].setint(static_cast<int>(std::strtoul((*identmap[op>>8]->val.storage.s), nullptr, 0)));
                 continue;
             }
             case Code_StrVar|Ret_Float:
+            OPLABEL(op_strvar_float)
             {
                 args[numargs++].setfloat(parsefloat(*identmap[op>>8]->val.storage.s));
                 continue;
             }
             case Code_StrVarM:
+            OPLABEL(op_strvarm)
             {
                 args[numargs++].setcstr(*identmap[op>>8]->val.storage.s);
                 continue;
             }
             case Code_StrVar1:
+            OPLABEL(op_strvar1)
             {
                 setsvarchecked(identmap[op>>8], args[--numargs].s); freearg(args[numargs]);
                 continue;
             }
             case Code_IntVar|Ret_Integer:
             case Code_IntVar|Ret_Null:
+            OPLABEL(op_intvar_int)
             {
                 args[numargs++].setint(*identmap[op>>8]->val.storage.i);
                 continue;
             }
             case Code_IntVar|Ret_String:
+            OPLABEL(op_intvar_str)
             {
                 args[numargs++].setstr(newstring(intstr(*identmap[op>>8]->val.storage.i)));
                 continue;
             }
             case Code_IntVar|Ret_Float:
+            OPLABEL(op_intvar_float)
             {
                 args[numargs++].setfloat(static_cast<float>(*identmap[op>>8]->val.storage.i));
                 continue;
             }
             case Code_IntVar1:
+            OPLABEL(op_intvar1)
             {
                 setvarchecked(identmap[op>>8], args[--numargs].i);
                 continue;
             }
             case Code_IntVar2:
+            OPLABEL(op_intvar2)
             {
                 numargs -= 2;
                 setvarchecked(identmap[op>>8], (args[numargs].i<<16)|(args[numargs+1].i<<8));
                 continue;
             }
             case Code_IntVar3:
+            OPLABEL(op_intvar3)
             {
                 numargs -= 3;
                 setvarchecked(identmap[op>>8], (args[numargs].i<<16)|(args[numargs+1].i<<8)|args[numargs+2].i);
@@ -5163,21 +5672,25 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             case Code_FloatVar|Ret_Float:
             case Code_FloatVar|Ret_Null:
+            OPLABEL(op_floatvar_float)
             {
                 args[numargs++].setfloat(*identmap[op>>8]->val.storage.f);
                 continue;
             }
             case Code_FloatVar|Ret_String:
+            OPLABEL(op_floatvar_str)
             {
                 args[numargs++].setstr(newstring(floatstr(*identmap[op>>8]->val.storage.f)));
                 continue;
             }
             case Code_FloatVar|Ret_Integer:
+            OPLABEL(op_floatvar_int)
             {
                 args[numargs++].setint(static_cast<int>(*identmap[op>>8]->val.storage.f));
                 continue;
             }
             case Code_FloatVar1:
+            OPLABEL(op_floatvar1)
             {
                 setfvarchecked(identmap[op>>8], args[--numargs].f);
                 continue;
@@ -5186,6 +5699,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_Com|Ret_String:
             case Code_Com|Ret_Float:
             case Code_Com|Ret_Integer:
+            OPLABEL(op_com)
             {
                 ident * const id = identmap[op>>8];
                 int offset = numargs-id->numargs;
@@ -5199,6 +5713,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_ComD|Ret_String:
             case Code_ComD|Ret_Float:
             case Code_ComD|Ret_Integer:
+            OPLABEL(op_comd)
             {
                 ident * const id = identmap[op>>8];
                 int offset = numargs-(id->numargs-1);
@@ -5213,12 +5728,30 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_ComV|Ret_String:
             case Code_ComV|Ret_Float:
             case Code_ComV|Ret_Integer:
+            OPLABEL(op_comv)
             {
                 ident * const id = identmap[op>>13];
                 int callargs = (op>>8)&0x1F,
                     offset = numargs-callargs;
                 forcenull(result);
-                reinterpret_cast<comfunv>(id->fun)(&args[offset], callargs);
+                {
+                    csprofilescope profile(id->name);
+                    reinterpret_cast<comfunv>(id->fun)(&args[offset], callargs);
+                }
+                forcearg(result, op&Code_RetMask);
+                freeargs(args, numargs, offset);
+                continue;
+            }
+            case Code_Math|Ret_Null:
+            case Code_Math|Ret_String:
+            case Code_Math|Ret_Float:
+            case Code_Math|Ret_Integer:
+            OPLABEL(op_math)
+            {
+                int callargs = (op>>8)&0x1F,
+                    offset = numargs-callargs;
+                forcenull(result);
+                mathop(op>>13, &args[offset], callargs, result);
                 forcearg(result, op&Code_RetMask);
                 freeargs(args, numargs, offset);
                 continue;
@@ -5227,6 +5760,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_ComC|Ret_String:
             case Code_ComC|Ret_Float:
             case Code_ComC|Ret_Integer:
+            OPLABEL(op_comc)
             {
                 ident * const id = identmap[op>>13];
                 int callargs = (op>>8)&0x1F,
@@ -5235,6 +5769,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 {
                     std::vector<char> buf;
                     buf.reserve(maxstrlen);
+                    csprofilescope profile(id->name);
                     reinterpret_cast<comfun1>(id->fun)(conc(buf, &args[offset], callargs, true));
                 }
                 forcearg(result, op&Code_RetMask);
@@ -5249,6 +5784,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_ConCW|Ret_String:
             case Code_ConCW|Ret_Float:
             case Code_ConCW|Ret_Integer:
+            OPLABEL(op_conc)
             {
                 int numconc = op>>8;
                 char *s = conc(&args[numargs-numconc], numconc, (op&Code_OpMask)==Code_ConC);
@@ -5263,6 +5799,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_ConCM|Ret_String:
             case Code_ConCM|Ret_Float:
             case Code_ConCM|Ret_Integer:
+            OPLABEL(op_concm)
             {
                 int numconc = op>>8;
                 char *s = conc(&args[numargs-numconc], numconc, false);
@@ -5272,16 +5809,19 @@ static const uint *runcode(const uint *code, tagval &result)
                 continue;
             }
             case Code_Alias:
+            OPLABEL(op_alias)
             {
                 setalias(*identmap[op>>8], args[--numargs]);
                 continue;
             }
             case Code_AliasArg:
+            OPLABEL(op_aliasarg)
             {
                 setarg(*identmap[op>>8], args[--numargs]);
                 continue;
             }
             case Code_AliasU:
+            OPLABEL(op_aliasu)
             {
                 numargs -= 2;
                 setalias(args[numargs].getstr(), args[numargs+1]);
@@ -5293,6 +5833,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_Call|Ret_String:
             case Code_Call|Ret_Float:
             case Code_Call|Ret_Integer:
+            OPLABEL(op_call)
             {
                 #define FORCERESULT { \
                     freeargs(args, numargs, SKIPARGS(offset)); \
@@ -5301,6 +5842,7 @@ static const uint *runcode(const uint *code, tagval &result)
                 }
                 //==================================================== CALLALIAS
                 #define CALLALIAS { \
+                    csprofilescope profile(id->name); \
                     identstack argstack[Max_Args]; \
                     for(int i = 0; i < callargs; i++) \
                     { \
@@ -5359,6 +5901,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_CallArg|Ret_String:
             case Code_CallArg|Ret_Float:
             case Code_CallArg|Ret_Integer:
+            OPLABEL(op_callarg)
             {
                 forcenull(result);
                 ident *id = identmap[op>>13];
@@ -5378,6 +5921,7 @@ static const uint *runcode(const uint *code, tagval &result)
             case Code_CallU|Ret_String:
             case Code_CallU|Ret_Float:
             case Code_CallU|Ret_Integer:
+            OPLABEL(op_callu)
             {
                 int callargs = op>>8,
                     offset = numargs-callargs;
@@ -5395,7 +5939,7 @@ static const uint *runcode(const uint *code, tagval &result)
                     continue;
                 }
                 ident *id = nullptr;
-                std::unordered_map<std::string, ident>::iterator itr = idents.find(idarg.s);
+                identtable::iterator itr = idents.find(idarg.s);
                 if(itr != idents.end())
                 {
                     id = &(*(itr)).second;
@@ -5493,12 +6037,352 @@ static const uint *runcode(const uint *code, tagval &result)
             }
             #undef SKIPARGS
         }
+#if defined(__GNUC__)
+    op_none:;
+#endif
     }
+    #undef OPLABEL
 exit:
     commandret = prevret;
     --rundepth;
     return code;
 }
+#undef RUNCODE_ATTRIBUTES
+#if defined(__GNUC__)
+    #pragma GCC diagnostic pop
+#endif
+
+// compiled code cache
+//
+// execute() and executeret() are passed the same strings over and over by
+// binds, menus, and configs; rather than compiling them each time, the code for
+// recently executed strings is kept, up to `codecachekb` kilobytes. Cached
+// code holds a reference to itself (see freecode()), so code which is still in
+// use elsewhere (e.g. a block stored in an alias) outlives its cache entry.
+
+static VAR(codecachekb, 0, 1024, 65536); //size limit of the compiled code cache, 0 to disable it
+
+namespace
+{
+    class codecache final
+    {
+        public:
+            codecache() : generation(0), bytes(0), hits(0), misses(0)
+            {
+            }
+
+            //returns the code for p, with a reference the caller must release with freecode()
+            uint *get(const char *p, int rettype)
+            {
+                size_t limit = static_cast<size_t>(codecachekb) << 10;
+                //new idents may change how strings compile
+                if(generation != identgeneration)
+                {
+                    clear();
+                    generation = identgeneration;
+                }
+                evict(limit);
+                std::unordered_map<std::string_view, std::list<entry>::iterator> &lookup = lookups[rettype == Value_Integer];
+                auto itr = lookup.find(p);
+                if(itr != lookup.end())
+                {
+                    hits++;
+                    entries.splice(entries.begin(), entries, (*itr).second);
+                    uint *code = (*itr).second->code;
+                    code[0] += 0x100;
+                    return code;
+                }
+                misses++;
+                std::vector<uint> buf;
+                buf.reserve(64);
+                compilemain(buf, p, rettype);
+                csallocs++;
+                uint *code = new uint[buf.size()];
+                std::memcpy(code, buf.data(), buf.size()*sizeof(uint));
+                code[0] += 0x100;
+                //compiling may have added idents; code compiled since is still valid, but older entries are not
+                if(generation != identgeneration)
+                {
+                    clear();
+                    generation = identgeneration;
+                }
+                size_t len = std::strlen(p),
+                       size = len + buf.size()*sizeof(uint);
+                //strings too large to share the cache with others are not worth caching (e.g. whole config files)
+                if(size <= limit/4)
+                {
+                    entries.push_front({std::string(p, len), rettype == Value_Integer, code, size});
+                    lookup.emplace(entries.front().source, entries.begin());
+                    code[0] += 0x100;
+                    bytes += size;
+                    evict(limit);
+                }
+                return code;
+            }
+
+            void clear()
+            {
+                evict(0);
+            }
+
+            codecachestats stats() const
+            {
+                return {hits, misses, entries.size(), bytes};
+            }
+
+        private:
+            struct entry final
+            {
+                std::string source;
+                bool intret; //compiled with an integer return type, for execute()
+                uint *code;
+                size_t size; //bytes used by the source and code
+            };
+
+            std::list<entry> entries; //most recently used first
+            std::array<std::unordered_map<std::string_view, std::list<entry>::iterator>, 2> lookups; //for Value_Any, Value_Integer code
+            uint generation;
+            size_t bytes,
+                   hits,
+                   misses;
+
+            void evict(size_t limit)
+            {
+                while(bytes > limit && entries.size())
+                {
+                    entry &e = entries.back();
+                    lookups[e.intret].erase(e.source);
+                    freecode(e.code);
+                    bytes -= e.size;
+                    entries.pop_back();
+                }
+            }
+    };
+
+    codecache compiledcode;
+}
+
+codecachestats getcodecachestats()
+{
+    return compiledcode.stats();
+}
+
+void clearcodecache()
+{
+    compiledcode.clear();
+}
+
+// cubescript profiler
+//
+// When `csprofile` is set, each alias and command call (and each window's
+// contents and each bind, see ui.cpp and console.cpp) is timed. Totals are kept
+// per name for csprofileprint, and per call stack for csprofilesave, which
+// writes the stacks in the collapsed format read by flamegraph tools.
+
+size_t csallocs = 0;
+
+VARF(csprofile, 0, 0, 1, resetcsprofile()); //record time spent in cubescript calls; changing it clears the profile
+
+namespace
+{
+    class csprofiler final
+    {
+        public:
+            csprofiler()
+            {
+                clear();
+            }
+
+            void begin(std::string_view name)
+            {
+                int parent = frames.size() ? frames.back().node : 0;
+                int node;
+                auto child = nodes[parent].children.find(name);
+                if(child != nodes[parent].children.end())
+                {
+                    node = (*child).second;
+                }
+                else
+                {
+                    node = nodes.size();
+                    nodes[parent].children.emplace(name, node);
+                    nodes.push_back({std::string(name), parent, {}, 0});
+                }
+                auto itr = totals.find(name);
+                if(itr == totals.end())
+                {
+                    itr = totals.emplace(name, total()).first;
+                }
+                total &t = (*itr).second;
+                t.calls++;
+                t.active++;
+                frames.push_back({node, &t, 0, csallocs, 0, std::chrono::steady_clock::now()});
+            }
+
+            void end()
+            {
+                if(frames.empty())
+                {
+                    return;
+                }
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                frame f = frames.back();
+                frames.pop_back();
+                int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - f.start).count();
+                size_t allocs = csallocs - f.startallocs;
+                total &t = *f.t;
+                t.exclusive += ns - f.childns;
+                t.allocs += allocs - f.childallocs;
+                nodes[f.node].self += ns - f.childns;
+                //recursive calls are already included in the outermost call's time
+                if(!--t.active)
+                {
+                    t.inclusive += ns;
+                    t.inclusiveallocs += allocs;
+                }
+                if(frames.size())
+                {
+                    frames.back().childns += ns;
+                    frames.back().childallocs += allocs;
+                }
+            }
+
+            void clear()
+            {
+                nodes.clear();
+                nodes.push_back({"", -1, {}, 0});
+                totals.clear();
+                frames.clear();
+            }
+
+            bool stats(const char *name, csprofilestats &s) const
+            {
+                auto itr = totals.find(std::string_view(name));
+                if(itr == totals.end())
+                {
+                    return false;
+                }
+                const total &t = (*itr).second;
+                s = {t.calls, t.inclusive/1e6, t.exclusive/1e6, t.allocs, t.inclusiveallocs};
+                return true;
+            }
+
+            void print(int num) const
+            {
+                std::vector<std::pair<const std::string *, const total *>> sorted;
+                sorted.reserve(totals.size());
+                for(const auto &[name, t] : totals)
+                {
+                    sorted.emplace_back(&name, &t);
+                }
+                std::sort(sorted.begin(), sorted.end(), [] (const auto &a, const auto &b) { return a.second->exclusive > b.second->exclusive; });
+                if(num > 0 && static_cast<size_t>(num) < sorted.size())
+                {
+                    sorted.resize(num);
+                }
+                conoutf("%10s %10s %10s %8s  %s", "calls", "incl ms", "excl ms", "allocs", "name");
+                for(const auto &[name, t] : sorted)
+                {
+                    conoutf("%10zu %10.3f %10.3f %8zu  %s", t->calls, t->inclusive/1e6, t->exclusive/1e6, t->allocs, name->c_str());
+                }
+            }
+
+            //writes one line per call stack: the names of its calls separated by semicolons, then microseconds spent in the last call
+            bool save(const char *filename) const
+            {
+                std::fstream f;
+                f.open(copypath(filename), std::ios::out);
+                if(!f.is_open())
+                {
+                    return false;
+                }
+                std::vector<const std::string *> stack;
+                for(const node &n : nodes)
+                {
+                    int64_t us = n.self/1000;
+                    if(n.parent < 0 || us <= 0)
+                    {
+                        continue;
+                    }
+                    stack.clear();
+                    for(const node *p = &n; p->parent >= 0; p = &nodes[p->parent])
+                    {
+                        stack.push_back(&p->name);
+                    }
+                    for(size_t i = stack.size(); i-- > 0;)
+                    {
+                        f << *stack[i] << (i ? ";" : " ");
+                    }
+                    f << us << "\n";
+                }
+                return true;
+            }
+
+        private:
+            struct total final
+            {
+                size_t calls = 0,
+                       active = 0; //calls in progress, for not counting recursive calls twice
+                int64_t inclusive = 0, //nanoseconds
+                        exclusive = 0;
+                size_t allocs = 0,
+                       inclusiveallocs = 0;
+            };
+
+            //one per distinct call stack; nodes[0] is the root, which is never called
+            struct node final
+            {
+                std::string name;
+                int parent;
+                std::map<std::string, int, std::less<>> children;
+                int64_t self; //nanoseconds spent in calls with this stack, excluding the calls they made
+            };
+
+            struct frame final
+            {
+                int node;
+                total *t;
+                int64_t childns;
+                size_t startallocs,
+                       childallocs;
+                std::chrono::steady_clock::time_point start;
+            };
+
+            std::vector<node> nodes;
+            std::map<std::string, total, std::less<>> totals;
+            std::vector<frame> frames; //calls in progress, innermost last
+    };
+
+    csprofiler profiler;
+}
+
+void beginprofile(const char *name, const char *kind)
+{
+    if(!kind)
+    {
+        profiler.begin(name);
+        return;
+    }
+    std::string key = kind;
+    key += ':';
+    key += name;
+    profiler.begin(key);
+}
+
+void endprofile()
+{
+    profiler.end();
+}
+
+bool getcsprofilestats(const char *name, csprofilestats &stats)
+{
+    return profiler.stats(name, stats);
+}
+
+void resetcsprofile()
+{
+    profiler.clear();
+}
 
 void executeret(const uint *code, tagval &result)
 {
@@ -5507,15 +6391,9 @@ void executeret(const uint *code, tagval &result)
 
 void executeret(const char *p, tagval &result)
 {
-    std::vector<uint> code;
-    code.reserve(64);
-    compilemain(code, p, Value_Any);
-    runcode(code.data()+1, result);
-    if(static_cast<int>(code[0]) >= 0x100)
-    {
-        uint *arr = new uint[code.size()];
-        std::memcpy(arr, code.data(), code.size()*sizeof(uint));
-    }
+    uint *code = compiledcode.get(p, Value_Any);
+    runcode(code+1, result);
+    freecode(code);
 }
 
 void executeret(ident *id, tagval *args, int numargs, bool lookup, tagval &result)
@@ -5637,16 +6515,10 @@ int execute(const uint *code)
 
 int execute(const char *p)
 {
-    std::vector<uint> code;
-    code.reserve(64);
-    compilemain(code, p, Value_Integer);
+    uint *code = compiledcode.get(p, Value_Integer);
     tagval result;
-    runcode(code.data()+1, result);
-    if(static_cast<int>(code[0]) >= 0x100)
-    {
-        uint * arr = new uint[code.size()];
-        std::memcpy(arr, code.data(), code.size()*sizeof(uint));
-    }
+    runcode(code+1, result);
+    freecode(code);
     int i = result.getint();
     freearg(result);
     return i;
@@ -5664,7 +6536,7 @@ int execute(ident *id, tagval *args, int numargs, bool lookup)
 int execident(const char *name, int noid, bool lookup)
 {
     ident *id = nullptr;
-    std::unordered_map<std::string, ident>::iterator itr = idents.find(name);
+    identtable::iterator itr = idents.find(name);
     if(itr != idents.end())
     {
         id = &(*(itr)).second;
@@ -5712,7 +6584,7 @@ void initcscmds()
 
     addcommand("defvar", reinterpret_cast<identfun>(+[] (const char *name, int *min, int *initval, int *max, char *onchange)
     {
-        std::unordered_map<std::string, ident>::const_iterator itr = idents.find(name);
+        identtable::const_iterator itr = idents.find(name);
         if(itr != idents.end())
         {
             debugcode("cannot redefine %s as a variable", name);
@@ -5726,7 +6598,7 @@ void initcscmds()
     }), "siiis", Id_Command);
     addcommand("defvarp", reinterpret_cast<identfun>(+[] (const char *name, int *min, int *initval, int *max, char *onchange)
     {
-        std::unordered_map<std::string, ident>::const_iterator itr = idents.find(name);
+        identtable::const_iterator itr = idents.find(name);
         if(itr != idents.end())
         {
             debugcode("cannot redefine %s as a variable", name);
@@ -5740,7 +6612,7 @@ void initcscmds()
     }), "siiis", Id_Command);
     addcommand("deffvar", reinterpret_cast<identfun>(+[] (const char *name, float *min, float *initval, float *max, char *onchange)
     {
-        std::unordered_map<std::string, ident>::const_iterator itr = idents.find(name);
+        identtable::const_iterator itr = idents.find(name);
         if(itr != idents.end())
         {
             debugcode("cannot redefine %s as a variable", name);
@@ -5754,7 +6626,7 @@ void initcscmds()
     }), "sfffs", Id_Command);
     addcommand("deffvarp", reinterpret_cast<identfun>(+[] (const char *name, float *min, float *initval, float *max, char *onchange)
     {
-        std::unordered_map<std::string, ident>::const_iterator itr = idents.find(name);
+        identtable::const_iterator itr = idents.find(name);
         if(itr != idents.end())
         {
             debugcode("cannot redefine %s as a variable", name);
@@ -5768,7 +6640,7 @@ void initcscmds()
     }), "sfffs", Id_Command);
     addcommand("defsvar", reinterpret_cast<identfun>(+[] (const char *name, char *initval, char *onchange)
     {
-        std::unordered_map<std::string, ident>::const_iterator itr = idents.find(name);
+        identtable::const_iterator itr = idents.find(name);
         if(itr != idents.end())
         {
             debugcode("cannot redefine %s as a variable", name);
@@ -5782,7 +6654,7 @@ void initcscmds()
     }), "sss", Id_Command);
     addcommand("defsvarp", reinterpret_cast<identfun>(+[] (const char *name, char *initval, char *onchange)
     {
-        std::unordered_map<std::string, ident>::const_iterator itr = idents.find(std::string(name));
+        identtable::const_iterator itr = idents.find(name);
         if(itr != idents.end())
         {
             debugcode("cannot redefine %s as a variable", name); return;
@@ -5804,4 +6676,18 @@ void initcscmds()
     addcommand("alias", reinterpret_cast<identfun>(+[] (const char *name, tagval *v){ setalias(name, *v); v->type = Value_Null;}), "sT", Id_Command);
     addcommand("resetvar", reinterpret_cast<identfun>(resetvar), "s", Id_Command);
     addcommand("doargs", reinterpret_cast<identfun>(doargs), "e", Id_DoArgs);
+    addcommand("codecachestats", reinterpret_cast<identfun>(+[] ()
+    {
+        codecachestats stats = getcodecachestats();
+        conoutf("code cache: %zu hits, %zu misses, %zu entries, %zu bytes", stats.hits, stats.misses, stats.entries, stats.bytes);
+    }), "", Id_Command);
+    addcommand("csprofileprint", reinterpret_cast<identfun>(+[] (const int *num) { profiler.print(*num > 0 ? *num : 20); }), "i", Id_Command);
+    addcommand("csprofilesave", reinterpret_cast<identfun>(+[] (const char *name)
+    {
+        if(!profiler.save(name))
+        {
+            conoutf(Console_Error, "could not write cubescript profile to %s", name);
+        }
+    }), "s", Id_Command);
+    addcommand("csprofilereset", reinterpret_cast<identfun>(resetcsprofile), "", Id_Command);
 }
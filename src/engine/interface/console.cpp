@@ -950,7 +950,10 @@ namespace
             char *&action = k.actions[state][0] ? k.actions[state] : k.actions[KeyMap::Action_Default];
             keyaction = action;
             keypressed = &k;
-            execute(keyaction);
+            {
+                csprofilescope profile(k.name, "bind");
+                execute(keyaction);
+            }
             keypressed = nullptr;
             if(keyaction!=action)
             {
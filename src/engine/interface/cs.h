@@ -80,6 +80,7 @@ enum CubeScriptCodes
     Code_JumpFalse,
     Code_JumpResultTrue,  //60
     Code_JumpResultFalse,
+    Code_Math,            //arithmetic or comparison command called directly, see mathop()
 
     Code_OpMask = 0x3F,
     Code_Ret = 6,
@@ -92,6 +93,52 @@ enum CubeScriptCodes
     Ret_Float   = Value_Float<<Code_Ret,
 };
 
+/**
+ * @brief The arithmetic and comparison commands compiled to Code_Math.
+ *
+ * Each corresponds to the variadic command of the same symbol registered by
+ * initmathcmds(), and behaves the same way when passed to mathop().
+ */
+enum MathOp
+{
+    MathOp_Add = 0,     // +
+    MathOp_Mul,         // *
+    MathOp_Sub,         // -
+    MathOp_Eq,          // =
+    MathOp_NotEq,       // !=
+    MathOp_Less,        // <
+    MathOp_Greater,     // >
+    MathOp_LessEq,      // <=
+    MathOp_GreaterEq,   // >=
+    MathOp_Xor,         // ^ and ~
+    MathOp_And,         // &
+    MathOp_Or,          // |
+    MathOp_XorNot,      // ^~
+    MathOp_AndNot,      // &~
+    MathOp_OrNot,       // |~
+    MathOp_Shl,         // <<
+    MathOp_Shr,         // >>
+    MathOp_Div,         // div
+    MathOp_Mod,         // mod
+    MathOp_Min,         // min
+    MathOp_Max,         // max
+    MathOp_AddF,        // +f
+    MathOp_MulF,        // *f
+    MathOp_SubF,        // -f
+    MathOp_EqF,         // =f
+    MathOp_NotEqF,      // !=f
+    MathOp_LessF,       // <f
+    MathOp_GreaterF,    // >f
+    MathOp_LessEqF,     // <=f
+    MathOp_GreaterEqF,  // >=f
+    MathOp_DivF,        // divf
+    MathOp_ModF,        // modf
+    MathOp_Pow,         // pow
+    MathOp_MinF,        // minf
+    MathOp_MaxF,        // maxf
+    MathOp_NumOps
+};
+
 struct stringslice final
 {
     const char *str;
@@ -213,6 +260,24 @@ extern void poparg(ident &id);
 extern void pusharg(ident &id, const tagval &v, identstack &stack);
 extern bool getbool(const tagval &v);
 extern void cleancode(ident &id);
+
+/**
+ * @brief The alias whose string value ident::getcstr() last returned.
+ *
+ * The list commands use it to find the parsed form of an alias's list without
+ * reading the list again; it is only a hint, checked against the value passed.
+ */
+extern const ident *lastcstralias;
+
+/**
+ * @brief Drops the parsed form of an alias's list kept by the list commands.
+ *
+ * Called by cleancode() whenever the alias's value changes.
+ *
+ * @param id the alias whose value changed
+ */
+extern void dropparsedlist(const ident &id);
+
 extern char *conc(const tagval *v, int n, bool space);
 extern char *conc(const tagval *v, int n, bool space, const char *prefix);
 extern void freearg(tagval &v);
@@ -225,7 +290,120 @@ extern void redoarg(ident &id, const identstack &stack);
 extern const char *parseword(const char *p);
 
 extern bool validateblock(const char *s);
-extern std::unordered_map<std::string, ident> idents;
+
+/**
+ * @brief Hashes an ident name.
+ *
+ * Uses 64 bit FNV-1a, which can be evaluated at compile time, so that the names
+ * of idents the engine looks up can be hashed when it is built (see identkey).
+ *
+ * @param name the name to hash
+ *
+ * @return the hash of the name
+ */
+constexpr size_t hashidentname(std::string_view name)
+{
+    ullong h = 0xCBF29CE484222325ULL;
+    for(char c : name)
+    {
+        h = (h ^ static_cast<uchar>(c)) * 0x100000001B3ULL;
+    }
+    return static_cast<size_t>(h);
+}
+
+/**
+ * @brief An ident name and its hash.
+ *
+ * Looking an identkey up in the idents table uses the stored hash instead of
+ * hashing the name again; declaring one constexpr (e.g. for a var the engine
+ * sets by name) computes the hash at compile time.
+ */
+struct identkey final
+{
+    std::string_view name;
+    size_t hash;
+
+    constexpr explicit identkey(std::string_view n) : name(n), hash(hashidentname(n)) {}
+};
+
+/**
+ * @brief Hash for the idents table, accepting names without copying them into a std::string.
+ */
+struct identhash final
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const
+    {
+        return hashidentname(name);
+    }
+
+    size_t operator()(const identkey &key) const
+    {
+        return key.hash;
+    }
+};
+
+/**
+ * @brief Key comparison for the idents table, accepting names without copying them into a std::string.
+ */
+struct identequal final
+{
+    using is_transparent = void;
+
+    bool operator()(std::string_view a, std::string_view b) const
+    {
+        return a == b;
+    }
+
+    bool operator()(const identkey &a, std::string_view b) const
+    {
+        return a.name == b;
+    }
+
+    bool operator()(std::string_view a, const identkey &b) const
+    {
+        return a == b.name;
+    }
+};
+
+/**
+ * @brief Table of idents by name.
+ *
+ * May be searched with a const char *, a std::string_view, or an identkey,
+ * none of which allocate a temporary std::string.
+ */
+typedef std::unordered_map<std::string, ident, identhash, identequal> identtable;
+
+extern identtable idents;
+
+/**
+ * @brief Returns the ident with the key's name, or nullptr if there is none.
+ */
+extern ident *getident(const identkey &key);
+
+/**
+ * @brief Returns the var of the given type with the key's name, or nullptr if there is none.
+ *
+ * @param vartype the ident type (Id_Var, Id_FloatVar, or Id_StringVar) the var must have
+ * @param key the name of the var
+ */
+extern ident *getvar(int vartype, const identkey &key);
+
+/**
+ * @brief Sets the int var with the key's name, as setvar(const char *, int, bool, bool) does.
+ */
+extern void setvar(const identkey &key, int i, bool dofunc = true, bool doclamp = true);
+
+/**
+ * @brief Sets the float var with the key's name, as setfvar(const char *, float, bool, bool) does.
+ */
+extern void setfvar(const identkey &key, float f, bool dofunc = true, bool doclamp = true);
+
+/**
+ * @brief Sets the string var with the key's name, as setsvar(const char *, const char *, bool) does.
+ */
+extern void setsvar(const identkey &key, const char *str, bool dofunc = true);
 
 extern void setvarchecked(ident *id, int val);
 extern void setfvarchecked(ident *id, float val);
@@ -250,6 +428,139 @@ extern void clearoverrides();
  */
 extern void clearsleep(bool clearoverrides = true);
 
+/**
+ * @brief Statistics about the compiled code cache used by execute() and executeret().
+ */
+struct codecachestats final
+{
+    size_t hits,    /// strings whose code was found in the cache
+           misses,  /// strings which had to be compiled
+           entries, /// strings in the cache
+           bytes;   /// bytes used by the cached strings and code
+};
+
+/**
+ * @brief Returns statistics about the compiled code cache.
+ *
+ * Strings passed to execute(const char *) and executeret(const char *, tagval &)
+ * have their compiled code cached, so that strings run often (such as binds
+ * and menu scripts) are only compiled once. The hit and miss counts are totals
+ * since startup.
+ */
+extern codecachestats getcodecachestats();
+
+/**
+ * @brief Drops all entries from the compiled code cache.
+ *
+ * Called automatically when new idents are added, since the code compiled for a
+ * string can depend on which idents exist.
+ */
+extern void clearcodecache();
+
+extern int csprofile;    //whether the cubescript profiler is recording calls
+extern size_t csallocs;  //strings and code buffers allocated for cubescript values since startup
+
+/**
+ * @brief Starts timing a call in the cubescript profiler.
+ *
+ * Must be paired with a later call to endprofile(); use csprofilescope rather
+ * than calling this directly. Calls are recorded under name, or under
+ * "kind:name" if kind is set (e.g. "ui:main" for the contents of a window).
+ *
+ * @param name the name of the ident or script being called
+ * @param kind if set, the kind of script being called
+ */
+extern void beginprofile(const char *name, const char *kind = nullptr);
+
+/**
+ * @brief Stops timing the call most recently started with beginprofile().
+ *
+ * Does nothing if the profile was reset since the call started.
+ */
+extern void endprofile();
+
+/**
+ * @brief Times the enclosing block in the cubescript profiler, if it is enabled.
+ *
+ * Costs a single check of the `csprofile` variable when the profiler is off.
+ */
+struct csprofilescope final
+{
+    bool active;
+
+    csprofilescope(const char *name, const char *kind = nullptr) : active(csprofile != 0)
+    {
+        if(active)
+        {
+            beginprofile(name, kind);
+        }
+    }
+
+    ~csprofilescope()
+    {
+        if(active)
+        {
+            endprofile();
+        }
+    }
+};
+
+/**
+ * @brief Totals recorded by the cubescript profiler for one name.
+ */
+struct csprofilestats final
+{
+    size_t calls;           /// times the name was called
+    double inclusive,       /// milliseconds spent in calls, including the calls they made (recursive calls counted once)
+           exclusive;       /// milliseconds spent in calls, excluding the calls they made
+    size_t allocs,          /// strings and code buffers allocated, excluding the calls made
+           inclusiveallocs; /// strings and code buffers allocated, including the calls made (recursive calls counted once)
+};
+
+/**
+ * @brief Returns the totals the cubescript profiler has recorded for a name.
+ *
+ * Aliases and commands are recorded under their own names; calls which the
+ * compiler evaluated at compile time or turned into Code_Math are not recorded.
+ *
+ * @param name the name to look up, as passed to beginprofile()
+ * @param stats set to the totals for the name, if it has been called
+ *
+ * @return true if the name has been called since the profile was last reset
+ */
+extern bool getcsprofilestats(const char *name, csprofilestats &stats);
+
+/**
+ * @brief Drops everything recorded by the cubescript profiler.
+ *
+ * Also done whenever the `csprofile` variable is changed.
+ */
+extern void resetcsprofile();
+
+/**
+ * @brief Evaluates one of the math commands on a list of arguments.
+ *
+ * Used both by the commands themselves and by the compiler, which emits
+ * Code_Math for calls to them and evaluates calls with only constant
+ * arguments at compile time (unless the `csoptimize` variable is 0).
+ *
+ * @param op the MathOp to evaluate
+ * @param args the arguments, already converted to integers (for the integer
+ *        ops) or floats (for the ops ending in F, and pow)
+ * @param numargs the number of arguments
+ * @param result set to the integer or float result; must be null beforehand
+ */
+extern void mathop(int op, const tagval *args, int numargs, tagval &result);
+
+/**
+ * @brief Returns the MathOp for a command name.
+ *
+ * @param name the name of the command
+ *
+ * @return the MathOp evaluated by the command, or -1 if it is not a math command
+ */
+extern int getmathop(const char *name);
+
 extern char *executestr(ident *id, tagval *args, int numargs, bool lookup = false);
 extern uint *compilecode(const char *p);
 extern void freecode(uint *p);
@@ -794,8 +794,94 @@ void explodelist(const char *s, std::vector<std::string> &elems, int limit)
     }
 }
 
+// parsed list cache
+//
+// at, listlen and sublist would otherwise parse a list from its start on every
+// call, so indexing every element of a list in a loop takes quadratic time.
+// Long lists held by aliases are parsed once into the positions of their
+// elements, kept per alias, and dropped by cleancode() when the alias's value
+// changes, as its compiled code is. A list is found again by the alias that
+// ident::getcstr() last returned, without looking at its text.
+
+namespace
+{
+    struct listspan final
+    {
+        uint start,      //offsets into the alias value of the element's text
+             end,
+             quotestart, //offsets of the element's text including any quotes or brackets
+             quoteend,
+             next;       //offset parselist() continues from after the element
+        int sublist;     //index of the element's own parsed form in parsedlist::sublists, or -1
+    };
+
+    struct parsedlist final
+    {
+        std::vector<listspan> elems;
+        uint end;                         //offset at which parselist() found no more elements
+        std::vector<parsedlist> sublists; //elements which nested at indices have looked into
+    };
+
+    constexpr size_t maxparsedlists = 64,
+                     minparsedlistlen = 128; //shorter lists are parsed each time they are used
+
+    std::unordered_map<const ident *, parsedlist> parsedlists; //keyed by the alias holding the list
+
+    //parses the list starting at p, with offsets relative to base
+    void parselistspans(const char *base, const char *p, parsedlist &l)
+    {
+        const char *start, *end, *qstart, *qend;
+        while(parselist(p, start, end, qstart, qend))
+        {
+            l.elems.push_back({static_cast<uint>(start - base), static_cast<uint>(end - base),
+                               static_cast<uint>(qstart - base), static_cast<uint>(qend - base),
+                               static_cast<uint>(p - base), -1});
+        }
+        l.end = p - base;
+    }
+
+    //returns the parsed form of s, or nullptr if s is not the value of the alias last looked up or is too short to bother
+    parsedlist *getparsedlist(const char *s)
+    {
+        const ident *id = lastcstralias;
+        if(!id || (id->valtype != Value_String && id->valtype != Value_CString) || id->alias.val.s != s)
+        {
+            return nullptr;
+        }
+        auto itr = parsedlists.find(id);
+        if(itr != parsedlists.end())
+        {
+            return &itr->second;
+        }
+        if(std::strlen(s) < minparsedlistlen)
+        {
+            return nullptr;
+        }
+        if(parsedlists.size() >= maxparsedlists)
+        {
+            parsedlists.clear();
+        }
+        parsedlist &l = parsedlists[id];
+        parselistspans(s, s, l);
+        return &l;
+    }
+}
+
+void dropparsedlist(const ident &id)
+{
+    if(!parsedlists.empty())
+    {
+        parsedlists.erase(&id);
+    }
+}
+
 static int listlen(const char *s)
 {
+    const parsedlist *parsed = getparsedlist(s);
+    if(parsed)
+    {
+        return parsed->elems.size();
+    }
     int n = 0;
     while(parselist(s))
     {
@@ -815,13 +901,46 @@ static void at(tagval *args, int numargs)
     {
         return;
     }
-    const char *start  = args[0].getstr(),
-               *end    = start + std::strlen(start),
+    const char *base   = args[0].getstr(),
+               *start  = base,
+               *end    = start,
                *qstart = "";
+    parsedlist *parsed = numargs > 1 ? getparsedlist(base) : nullptr;
+    if(!parsed)
+    {
+        end += std::strlen(start);
+    }
     for(int i = 1; i < numargs; i++)
     {
         const char *list = start;
         int pos = args[i].getint();
+        if(parsed)
+        {
+            //as when parsing, negative positions give the first element
+            size_t index = std::max(pos, 0);
+            if(index >= parsed->elems.size())
+            {
+                start = end = qstart = "";
+                parsed = nullptr;
+                continue;
+            }
+            listspan &elem = parsed->elems[index];
+            start = base + elem.start;
+            end = base + elem.end;
+            qstart = base + elem.quotestart;
+            if(i + 1 < numargs)
+            {
+                //inner lists are parsed from the element's start, as parselist() stops at its closing bracket
+                if(elem.sublist < 0)
+                {
+                    elem.sublist = parsed->sublists.size();
+                    parsed->sublists.emplace_back();
+                    parselistspans(base, start, parsed->sublists.back());
+                }
+                parsed = &parsed->sublists[elem.sublist];
+            }
+            continue;
+        }
         for(; pos > 0; pos--)
         {
             if(!parselist(list))
@@ -841,6 +960,33 @@ static void sublist(const char *s, const int *skip, const int *count, const int
 {
     int offset = std::max(*skip, 0),
         len = *numargs >= 3 ? std::max(*count, 0) : -1;
+    const parsedlist *parsed = getparsedlist(s);
+    if(parsed)
+    {
+        const char *base = s;
+        size_t numelems = parsed->elems.size();
+        if(len < 0)
+        {
+            const char *rest = base;
+            if(offset > 0)
+            {
+                rest += static_cast<size_t>(offset) <= numelems ? parsed->elems[offset-1].next : parsed->end;
+                skiplist(rest);
+            }
+            commandret->setstr(newstring(rest));
+        }
+        else if(len > 0 && static_cast<size_t>(offset) < numelems)
+        {
+            const listspan &first = parsed->elems[offset],
+                           &last = parsed->elems[std::min(numelems, static_cast<size_t>(offset) + len) - 1];
+            commandret->setstr(newstring(base + first.quotestart, last.quoteend - first.quotestart));
+        }
+        else
+        {
+            commandret->setstr(newstring(""));
+        }
+        return;
+    }
     for(int i = 0; i < offset; ++i)
     {
         if(!parselist(s))
@@ -1346,39 +1492,302 @@ static void sortlist(const char *list, ident *x, ident *y, const uint *body, con
     commandret->setstr(sorted);
 }
 
+namespace
+{
+    template<class T>
+    T mathval(const tagval &v);
+
+    template<>
+    int mathval<int>(const tagval &v)
+    {
+        return v.i;
+    }
+
+    template<>
+    float mathval<float>(const tagval &v)
+    {
+        return v.f;
+    }
+
+    //applies op to the args from left to right; with fewer than two args, applies unary to the first (or to initial if there are none)
+    template<class T, class F, class U>
+    T mathfold(const tagval *args, int numargs, T initial, F op, U unary)
+    {
+        if(numargs < 2)
+        {
+            return unary(numargs > 0 ? mathval<T>(args[0]) : initial);
+        }
+        T val = mathval<T>(args[0]);
+        for(int i = 1; i < numargs; ++i)
+        {
+            val = op(val, mathval<T>(args[i]));
+        }
+        return val;
+    }
+
+    template<class T, class F>
+    T mathfold(const tagval *args, int numargs, T initial, F op)
+    {
+        return mathfold(args, numargs, initial, op, [] (T val) { return val; });
+    }
+
+    //true if cmp holds for each arg and the one after it; with fewer than two args, compares the first (or 0 if there are none) to 0
+    template<class T, class F>
+    int mathcompare(const tagval *args, int numargs, F cmp)
+    {
+        if(numargs < 2)
+        {
+            return cmp(numargs > 0 ? mathval<T>(args[0]) : T(0), T(0)) ? 1 : 0;
+        }
+        for(int i = 1; i < numargs; ++i)
+        {
+            if(!cmp(mathval<T>(args[i-1]), mathval<T>(args[i])))
+            {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    //command names of each MathOp, in enum order
+    const char * const mathopnames[MathOp_NumOps] =
+    {
+        "+", "*", "-", "=", "!=", "<", ">", "<=", ">=", "^", "&", "|", "^~", "&~", "|~", "<<", ">>", "div", "mod", "min", "max",
+        "+f", "*f", "-f", "=f", "!=f", "<f", ">f", "<=f", ">=f", "divf", "modf", "pow", "minf", "maxf"
+    };
+}
+
+void mathop(int op, const tagval *args, int numargs, tagval &result)
+{
+    switch(op)
+    {
+        case MathOp_Add:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a + b; }));
+            break;
+        }
+        case MathOp_Mul:
+        {
+            result.setint(mathfold(args, numargs, 1, [] (int a, int b) { return a * b; }));
+            break;
+        }
+        case MathOp_Sub:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a - b; }, [] (int a) { return -a; }));
+            break;
+        }
+        case MathOp_Eq:
+        {
+            result.setint(mathcompare<int>(args, numargs, [] (int a, int b) { return a == b; }));
+            break;
+        }
+        case MathOp_NotEq:
+        {
+            result.setint(mathcompare<int>(args, numargs, [] (int a, int b) { return a != b; }));
+            break;
+        }
+        case MathOp_Less:
+        {
+            result.setint(mathcompare<int>(args, numargs, [] (int a, int b) { return a < b; }));
+            break;
+        }
+        case MathOp_Greater:
+        {
+            result.setint(mathcompare<int>(args, numargs, [] (int a, int b) { return a > b; }));
+            break;
+        }
+        case MathOp_LessEq:
+        {
+            result.setint(mathcompare<int>(args, numargs, [] (int a, int b) { return a <= b; }));
+            break;
+        }
+        case MathOp_GreaterEq:
+        {
+            result.setint(mathcompare<int>(args, numargs, [] (int a, int b) { return a >= b; }));
+            break;
+        }
+        case MathOp_Xor:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a ^ b; }, [] (int a) { return ~a; }));
+            break;
+        }
+        case MathOp_And:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a & b; }));
+            break;
+        }
+        case MathOp_Or:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a | b; }));
+            break;
+        }
+        case MathOp_XorNot:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a ^ ~b; }));
+            break;
+        }
+        case MathOp_AndNot:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a & ~b; }));
+            break;
+        }
+        case MathOp_OrNot:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a | ~b; }));
+            break;
+        }
+        case MathOp_Shl:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return b < 32 ? a << std::max(b, 0) : 0; }));
+            break;
+        }
+        case MathOp_Shr:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return a >> std::clamp(b, 0, 31); }));
+            break;
+        }
+        case MathOp_Div:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return b ? a / b : 0; }));
+            break;
+        }
+        case MathOp_Mod:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return b ? a % b : 0; }));
+            break;
+        }
+        case MathOp_Min:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return std::min(a, b); }));
+            break;
+        }
+        case MathOp_Max:
+        {
+            result.setint(mathfold(args, numargs, 0, [] (int a, int b) { return std::max(a, b); }));
+            break;
+        }
+        case MathOp_AddF:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) { return a + b; }));
+            break;
+        }
+        case MathOp_MulF:
+        {
+            result.setfloat(mathfold(args, numargs, 1.0f, [] (float a, float b) { return a * b; }));
+            break;
+        }
+        case MathOp_SubF:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) { return a - b; }, [] (float a) { return -a; }));
+            break;
+        }
+        case MathOp_EqF:
+        {
+            result.setint(mathcompare<float>(args, numargs, [] (float a, float b) { return a == b; }));
+            break;
+        }
+        case MathOp_NotEqF:
+        {
+            result.setint(mathcompare<float>(args, numargs, [] (float a, float b) { return a != b; }));
+            break;
+        }
+        case MathOp_LessF:
+        {
+            result.setint(mathcompare<float>(args, numargs, [] (float a, float b) { return a < b; }));
+            break;
+        }
+        case MathOp_GreaterF:
+        {
+            result.setint(mathcompare<float>(args, numargs, [] (float a, float b) { return a > b; }));
+            break;
+        }
+        case MathOp_LessEqF:
+        {
+            result.setint(mathcompare<float>(args, numargs, [] (float a, float b) { return a <= b; }));
+            break;
+        }
+        case MathOp_GreaterEqF:
+        {
+            result.setint(mathcompare<float>(args, numargs, [] (float a, float b) { return a >= b; }));
+            break;
+        }
+        case MathOp_DivF:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) { return b ? a / b : 0.0f; }));
+            break;
+        }
+        case MathOp_ModF:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) { return b ? std::fmod(a, b) : 0.0f; }));
+            break;
+        }
+        case MathOp_Pow:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) -> float { return std::pow(a, b); }));
+            break;
+        }
+        case MathOp_MinF:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) { return std::min(a, b); }));
+            break;
+        }
+        case MathOp_MaxF:
+        {
+            result.setfloat(mathfold(args, numargs, 0.0f, [] (float a, float b) { return std::max(a, b); }));
+            break;
+        }
+    }
+}
+
+int getmathop(const char *name)
+{
+    if(!std::strcmp(name, "~"))
+    {
+        return MathOp_Xor;
+    }
+    for(int i = 0; i < MathOp_NumOps; ++i)
+    {
+        if(!std::strcmp(name, mathopnames[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
 void initmathcmds()
 {
     //integer and boolean operators, used with named symbol, i.e. + or *
     //no native boolean type, they are treated like integers
-    addcommand("+", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val + val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val + val2; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command); //0 substituted if nothing passed in arg2: n + 0 is still n
-    addcommand("*", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val * val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val * val2; } } else { val = numargs > 0 ? args[0].i : 1; ; } intret(val); }; }), "i" "1V", Id_Command); //1 substituted if nothing passed in arg2: n * 1 is still n
-    addcommand("-", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val - val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val - val2; } } else { val = numargs > 0 ? args[0].i : 0; val = -val; } intret(val); }; }), "i" "1V", Id_Command); //the minus operator inverts if used as unary
-    addcommand("=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].i == args[1].i; for(int i = 2; i < numargs && val; i++) { val = args[i-1].i == args[i].i; } } else { val = (numargs > 0 ? args[0].i : 0) == 0; } intret(static_cast<int>(val)); }; }), "i" "1V", Id_Command);
-    addcommand("!=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].i != args[1].i; for(int i = 2; i < numargs && val; i++) { val = args[i-1].i != args[i].i; } } else { val = (numargs > 0 ? args[0].i : 0) != 0; } intret(static_cast<int>(val)); }; }), "i" "1V", Id_Command);
-    addcommand("<", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].i < args[1].i; for(int i = 2; i < numargs && val; i++) { val = args[i-1].i < args[i].i; } } else { val = (numargs > 0 ? args[0].i : 0) < 0; } intret(static_cast<int>(val)); }; }), "i" "1V", Id_Command);
-    addcommand(">", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].i > args[1].i; for(int i = 2; i < numargs && val; i++) { val = args[i-1].i > args[i].i; } } else { val = (numargs > 0 ? args[0].i : 0) > 0; } intret(static_cast<int>(val)); }; }), "i" "1V", Id_Command);
-    addcommand("<=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].i <= args[1].i; for(int i = 2; i < numargs && val; i++) { val = args[i-1].i <= args[i].i; } } else { val = (numargs > 0 ? args[0].i : 0) <= 0; } intret(static_cast<int>(val)); }; }), "i" "1V", Id_Command);
-    addcommand(">=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].i >= args[1].i; for(int i = 2; i < numargs && val; i++) { val = args[i-1].i >= args[i].i; } } else { val = (numargs > 0 ? args[0].i : 0) >= 0; } intret(static_cast<int>(val)); }; }), "i" "1V", Id_Command);
-    addcommand("^", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val ^ val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val ^ val2; } } else { val = numargs > 0 ? args[0].i : 0; val = ~val; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val ^ val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val ^ val2; } } else { val = numargs > 0 ? args[0].i : 0; val = ~val; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("&", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val & val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val & val2; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("|", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val | val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val | val2; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("^~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val ^~ val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val ^~ val2; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("&~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val &~ val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val &~ val2; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("|~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val |~ val2; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val |~ val2; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("<<", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val = val2 < 32 ? val << std::max(val2, 0) : 0; for(int i = 2; i < numargs; i++) { val2 = args[i].i; val = val2 < 32 ? val << std::max(val2, 0) : 0; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand(">>", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; val >>= std::clamp(val2, 0, 31); for(int i = 2; i < numargs; i++) { val2 = args[i].i; val >>= std::clamp(val2, 0, 31); } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
+    addcommand("+", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Add, args, numargs, *commandret); }), "i" "1V", Id_Command); //0 substituted if nothing passed in arg2: n + 0 is still n
+    addcommand("*", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Mul, args, numargs, *commandret); }), "i" "1V", Id_Command); //1 substituted if nothing passed in arg2: n * 1 is still n
+    addcommand("-", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Sub, args, numargs, *commandret); }), "i" "1V", Id_Command); //the minus operator inverts if used as unary
+    addcommand("=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Eq, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("!=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_NotEq, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("<", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Less, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand(">", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Greater, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("<=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_LessEq, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand(">=", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_GreaterEq, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("^", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Xor, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Xor, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("&", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_And, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("|", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Or, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("^~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_XorNot, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("&~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_AndNot, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("|~", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_OrNot, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("<<", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Shl, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand(">>", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Shr, args, numargs, *commandret); }), "i" "1V", Id_Command);
 
     //floating point operators, used with <operator>f, i.e. +f or *f
-    addcommand("+" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val; if(numargs >= 2) { val = args[0].f; float val2 = args[1].f; val = val + val2; for(int i = 2; i < numargs; i++) { val2 = args[i].f; val = val + val2; } } else { val = numargs > 0 ? args[0].f : 0; ; } floatret(val); }; }), "f" "1V", Id_Command);
-    addcommand("*" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val; if(numargs >= 2) { val = args[0].f; float val2 = args[1].f; val = val * val2; for(int i = 2; i < numargs; i++) { val2 = args[i].f; val = val * val2; } } else { val = numargs > 0 ? args[0].f : 1; ; } floatret(val); }; }), "f" "1V", Id_Command);
-    addcommand("-" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val; if(numargs >= 2) { val = args[0].f; float val2 = args[1].f; val = val - val2; for(int i = 2; i < numargs; i++) { val2 = args[i].f; val = val - val2; } } else { val = numargs > 0 ? args[0].f : 0; val = -val; } floatret(val); }; }), "f" "1V", Id_Command);
-    addcommand("=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].f == args[1].f; for(int i = 2; i < numargs && val; i++) { val = args[i-1].f == args[i].f; } } else { val = (numargs > 0 ? args[0].f : 0) == 0; } intret(static_cast<int>(val)); }; }), "f" "1V", Id_Command);
-    addcommand("!=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].f != args[1].f; for(int i = 2; i < numargs && val; i++) { val = args[i-1].f != args[i].f; } } else { val = (numargs > 0 ? args[0].f : 0) != 0; } intret(static_cast<int>(val)); }; }), "f" "1V", Id_Command);
-    addcommand("<" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].f < args[1].f; for(int i = 2; i < numargs && val; i++) { val = args[i-1].f < args[i].f; } } else { val = (numargs > 0 ? args[0].f : 0) < 0; } intret(static_cast<int>(val)); }; }), "f" "1V", Id_Command);
-    addcommand(">" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].f > args[1].f; for(int i = 2; i < numargs && val; i++) { val = args[i-1].f > args[i].f; } } else { val = (numargs > 0 ? args[0].f : 0) > 0; } intret(static_cast<int>(val)); }; }), "f" "1V", Id_Command);
-    addcommand("<=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].f <= args[1].f; for(int i = 2; i < numargs && val; i++) { val = args[i-1].f <= args[i].f; } } else { val = (numargs > 0 ? args[0].f : 0) <= 0; } intret(static_cast<int>(val)); }; }), "f" "1V", Id_Command);
-    addcommand(">=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { bool val; if(numargs >= 2) { val = args[0].f >= args[1].f; for(int i = 2; i < numargs && val; i++) { val = args[i-1].f >= args[i].f; } } else { val = (numargs > 0 ? args[0].f : 0) >= 0; } intret(static_cast<int>(val)); }; }), "f" "1V", Id_Command);
+    addcommand("+" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_AddF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("*" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_MulF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("-" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_SubF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_EqF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("!=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_NotEqF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("<" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_LessF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand(">" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_GreaterF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("<=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_LessEqF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand(">=" "f", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_GreaterEqF, args, numargs, *commandret); }), "f" "1V", Id_Command);
 
     addcommand("!", reinterpret_cast<identfun>(+[] (const tagval *a) { intret(getbool(*a) ? 0 : 1); }), "t", Id_Not);
     addcommand("&&", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { if(!numargs) { intret(1); } else { for(int i = 0; i < numargs; ++i) { if(i) { freearg(*commandret); } if(args[i].type == Value_Code) { executeret(args[i].code, *commandret); } else { *commandret = args[i]; } if(!getbool(*commandret)) { break; } } } }; }), "E1V", Id_And);
@@ -1386,12 +1795,12 @@ void initmathcmds()
     addcommand("||", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { if(!numargs) { intret(0); } else { for(int i = 0; i < numargs; ++i) { if(i) { freearg(*commandret); } if(args[i].type == Value_Code) { executeret(args[i].code, *commandret); } else { *commandret = args[i]; } if(getbool(*commandret)) { break; } } } }; }), "E1V", Id_Or);
 
     //int division
-    addcommand("div", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; { if(val2) val /= val2; else val = 0; }; for(int i = 2; i < numargs; i++) { val2 = args[i].i; { if(val2) val /= val2; else val = 0; }; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("mod", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val; if(numargs >= 2) { val = args[0].i; int val2 = args[1].i; { if(val2) val %= val2; else val = 0; }; for(int i = 2; i < numargs; i++) { val2 = args[i].i; { if(val2) val %= val2; else val = 0; }; } } else { val = numargs > 0 ? args[0].i : 0; ; } intret(val); }; }), "i" "1V", Id_Command);
+    addcommand("div", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Div, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("mod", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Mod, args, numargs, *commandret); }), "i" "1V", Id_Command);
     //float division
-    addcommand("divf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val; if(numargs >= 2) { val = args[0].f; float val2 = args[1].f; { if(val2) val /= val2; else val = 0; }; for(int i = 2; i < numargs; i++) { val2 = args[i].f; { if(val2) val /= val2; else val = 0; }; } } else { val = numargs > 0 ? args[0].f : 0; ; } floatret(val); }; }), "f" "1V", Id_Command);
-    addcommand("modf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val; if(numargs >= 2) { val = args[0].f; float val2 = args[1].f; { if(val2) val = std::fmod(val, val2); else val = 0; }; for(int i = 2; i < numargs; i++) { val2 = args[i].f; { if(val2) val = std::fmod(val, val2); else val = 0; }; } } else { val = numargs > 0 ? args[0].f : 0; ; } floatret(val); }; }), "f" "1V", Id_Command);
-    addcommand("pow", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val; if(numargs >= 2) { val = args[0].f; float val2 = args[1].f; val = std::pow(val, val2); for(int i = 2; i < numargs; i++) { val2 = args[i].f; val = std::pow(val, val2); } } else { val = numargs > 0 ? args[0].f : 0; ; } floatret(val); }; }), "f" "1V", Id_Command);
+    addcommand("divf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_DivF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("modf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_ModF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("pow", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Pow, args, numargs, *commandret); }), "f" "1V", Id_Command);
 
     //float transcendentals
     addcommand("sin", reinterpret_cast<identfun>(+[] (const float *a) { floatret(std::sin(*a/RAD)); }), "f", Id_Command);
@@ -1407,10 +1816,10 @@ void initmathcmds()
     addcommand("log10", reinterpret_cast<identfun>(+[] (const float *a) { floatret(std::log10(*a)); }), "f", Id_Command);
     addcommand("exp", reinterpret_cast<identfun>(+[] (const float *a) { floatret(std::exp(*a)); }), "f", Id_Command);
 
-    addcommand("min", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val = numargs > 0 ? args[0].i : 0; for(int i = 1; i < numargs; i++) { val = std::min(val, args[i].i); } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("max", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { int val = numargs > 0 ? args[0].i : 0; for(int i = 1; i < numargs; i++) { val = std::max(val, args[i].i); } intret(val); }; }), "i" "1V", Id_Command);
-    addcommand("minf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val = numargs > 0 ? args[0].f : 0; for(int i = 1; i < numargs; i++) { val = std::min(val, args[i].f); } floatret(val); }; }), "f" "1V", Id_Command);
-    addcommand("maxf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { { float val = numargs > 0 ? args[0].f : 0; for(int i = 1; i < numargs; i++) { val = std::max(val, args[i].f); } floatret(val); }; }), "f" "1V", Id_Command);
+    addcommand("min", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Min, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("max", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_Max, args, numargs, *commandret); }), "i" "1V", Id_Command);
+    addcommand("minf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_MinF, args, numargs, *commandret); }), "f" "1V", Id_Command);
+    addcommand("maxf", reinterpret_cast<identfun>(+[] (const tagval *args, int numargs) { mathop(MathOp_MaxF, args, numargs, *commandret); }), "f" "1V", Id_Command);
 
     addcommand("bitscan", reinterpret_cast<identfun>(+[] (const int *n) { intret(BITSCAN(*n)); }), "i", Id_Command);
 
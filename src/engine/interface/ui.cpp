@@ -1235,7 +1235,10 @@ namespace UI
         reset(world);
         setup();
         window = this;
-        buildchildren(contents);
+        {
+            csprofilescope profile(name.c_str(), "ui");
+            buildchildren(contents);
+        }
         window = nullptr;
     }
 
@@ -13,6 +13,7 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
+#include "../../shared/asyncio.h"
 
 #include <memory>
 #include <optional>
@@ -822,6 +823,18 @@ void animmodel::part::initskins(Texture *tex, Texture *masks, uint limit)
     }
 }
 
+void animmodel::part::loadskintexture(size_t i, const std::string &name, const std::function<void(skin &, Texture *)> &set)
+{
+    //skins may be added while the texture loads, so the skin is looked up again by index
+    textureloadasync(name.c_str(), AsyncPriority_Normal, [this, i, set] (Texture *t)
+    {
+        if(i < skins.size())
+        {
+            set(skins[i], t);
+        }
+    });
+}
+
 bool animmodel::part::alphatested() const
 {
     for(const skin &i : skins)
@@ -1682,7 +1695,7 @@ void animmodel::setBIH()
     }
     std::vector<BIH::mesh> meshes;
     genBIH(meshes);
-    bih = std::make_unique<BIH>(meshes);
+    bih = std::make_unique<BIH>(meshes, modelname() + ".bih");
 }
 
 bool animmodel::animated() const
@@ -641,6 +641,20 @@ class animmodel : public model
                  */
                 bool unlink(const part *p);
                 void initskins(Texture *tex = notexture, Texture *masks = notexture, uint limit = 0);
+
+                /**
+                 * @brief Loads a texture for one of this part's skins in the background.
+                 *
+                 * The image is read and decoded by textureloadasync(), and set is
+                 * called with the skin once the texture has been created on the
+                 * main thread. loadmodel() waits for these loads before the model
+                 * is used, so the part outlives the request.
+                 *
+                 * @param i the index of the skin in this part's skins
+                 * @param name the texture name, as passed to textureload()
+                 * @param set the function to store the texture in the skin with
+                 */
+                void loadskintexture(size_t i, const std::string &name, const std::function<void(skin &, Texture *)> &set);
                 bool alphatested() const;
                 void preloadBIH() const;
                 void preloadshaders();
@@ -1257,12 +1271,20 @@ struct modelcommands
     static void setskin(const char *meshname, const char *tex, const char *masks)
     {
         std::vector<std::vector<animmodel::skin>::iterator> skinlist = getskins(meshname);
+        if(skinlist.empty())
+        {
+            return;
+        }
+        part &mdl = *MDL::loading->parts.back();
+        const std::string texname = makerelpath(MDL::dir.c_str(), tex),
+                          masksname = *masks ? makerelpath(MDL::dir.c_str(), masks) : "";
         for(std::vector<animmodel::skin>::iterator s : skinlist)
         {
-            (*s).tex = textureload(makerelpath(MDL::dir.c_str(), tex), 0, true, false);
+            size_t i = s - mdl.skins.begin();
+            mdl.loadskintexture(i, texname, [] (animmodel::skin &sk, Texture *t) { sk.tex = t; });
             if(*masks)
             {
-                (*s).masks = textureload(makerelpath(MDL::dir.c_str(), masks), 0, true, false);
+                mdl.loadskintexture(i, masksname, [] (animmodel::skin &sk, Texture *t) { sk.masks = t; });
             }
         }
     }
@@ -1330,20 +1352,31 @@ struct modelcommands
 
     static void setbumpmap(const char *meshname, const char *normalmapfile)
     {
-        Texture *normalmaptex = textureload(makerelpath(MDL::dir.c_str(), normalmapfile), 0, true, false);
         auto skinlist = getskins(meshname);
+        if(skinlist.empty())
+        {
+            return;
+        }
+        part &mdl = *MDL::loading->parts.back();
+        const std::string name = makerelpath(MDL::dir.c_str(), normalmapfile);
         for(auto s : skinlist)
         {
-            (*s).normalmap = normalmaptex;
+            mdl.loadskintexture(s - mdl.skins.begin(), name, [] (animmodel::skin &sk, Texture *t) { sk.normalmap = t; });
         }
     }
 
     static void setdecal(const char *meshname, const char *decal)
     {
         auto skinlist = getskins(meshname);
+        if(skinlist.empty())
+        {
+            return;
+        }
+        part &mdl = *MDL::loading->parts.back();
+        const std::string name = makerelpath(MDL::dir.c_str(), decal);
         for(auto s : skinlist)
         {
-            (*s).decal = textureload(makerelpath(MDL::dir.c_str(), decal), 0, true, false);
+            mdl.loadskintexture(s - mdl.skins.begin(), name, [] (animmodel::skin &sk, Texture *t) { sk.decal = t; });
         }
     }
 
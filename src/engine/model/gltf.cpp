@@ -97,6 +97,7 @@ bool gltf::GLTFMeshGroup::loadmesh(const char *filename, float, part &p)
     try
     {
         GLTFModelInfo mi(filename);
+        sources = mi.getfilenames();
 
         std::vector<std::string> nodenames = mi.getnodenames(GLTFModelInfo::NodeType_Mesh);
         for(std::string meshname : nodenames)
@@ -1,4 +1,3 @@
-
 /**
  * @file gltfloader.cpp
  * @brief GLTF 2.0 loading functionality
@@ -6,21 +5,38 @@
  * This file handles the loading of GLTF 2.0 files, converting them into data
  * structures readable by the program.
  *
- * The various get() functions *generate* the output vectors of arrays on demand;
- * they are not stored inside the object.
+ * The JSON part of the file (the whole file for .gltf, the first chunk for
+ * .glb) is tokenized once into a compact document, from which the nodes,
+ * meshes, accessors, buffer views, buffers and animations are read. Binary
+ * buffers are memory mapped and never copied; the various get() functions
+ * *generate* the output vectors of arrays on demand by reading accessors
+ * straight from them; they are not stored inside the object.
  *
  * This file, and gltfloader.h along with it, are explicitly designed not to rely
  * on the dependencies of the rest of the engine. It should be possible to compile
  * this file without the build system of the engine at large.
  */
 #include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <array>
 #include <optional>
 #include <cstdint>
+#include <charconv>
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define GLTF_MMAP 1
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 typedef unsigned int uint;
 typedef unsigned short ushort;
@@ -44,20 +60,573 @@ typedef unsigned short ushort;
     #define GL_FLOAT 5126
 #endif
 
+/**
+ * @brief A JSON document, parsed in a single pass.
+ *
+ * Every value is stored in one vector; the elements of arrays and the members
+ * of objects are stored contiguously in a second one, so that finding a member
+ * or an element never needs to look at the source text again. Strings and
+ * keys are views into the source text, which must outlive the document.
+ */
+class GLTFModelInfo::JsonDocument final
+{
+    public:
+        enum ValueType
+        {
+            Value_Null = 0,
+            Value_Bool,
+            Value_Number,
+            Value_String,
+            Value_Array,
+            Value_Object
+        };
+
+        struct Value final
+        {
+            ValueType type;
+            double number;         //for numbers, and 1 or 0 for bools
+            std::string_view text; //for strings, without quotes or escape processing
+            uint first,            //index of the first child in members
+                 count;            //number of children of arrays and objects
+        };
+
+        //throws std::logic_error if json is not valid JSON
+        JsonDocument(std::string_view json) : text(json), pos(0)
+        {
+            skipspace();
+            parsevalue(0);
+            skipspace();
+            if(pos != text.size())
+            {
+                throw std::logic_error("GLTF loader error: unexpected characters after end of JSON (too many trailing } or ]?)");
+            }
+        }
+
+        const Value &root() const
+        {
+            return values[0];
+        }
+
+        //returns the member of an object with the given key, or nullptr if there is none (or v is not an object)
+        const Value *find(const Value &v, std::string_view key) const
+        {
+            if(v.type != Value_Object)
+            {
+                return nullptr;
+            }
+            for(uint i = v.first; i < v.first + v.count; ++i)
+            {
+                if(members[i].key == key)
+                {
+                    return &values[members[i].value];
+                }
+            }
+            return nullptr;
+        }
+
+        //returns the i'th element of an array or object; i must be less than its count
+        const Value &element(const Value &v, size_t i) const
+        {
+            return values[members[v.first + i].value];
+        }
+
+        //returns a member which must be a non-negative integer, or fallback if it is absent
+        size_t getindex(const Value &v, std::string_view key, size_t fallback = 0) const
+        {
+            const Value *m = find(v, key);
+            if(!m)
+            {
+                return fallback;
+            }
+            if(m->type != Value_Number || m->number < 0)
+            {
+                throw std::logic_error("GLTF loader error: expected a non-negative number for " + std::string(key));
+            }
+            return static_cast<size_t>(m->number);
+        }
+
+        std::optional<size_t> getoptionalindex(const Value &v, std::string_view key) const
+        {
+            if(!find(v, key))
+            {
+                return std::nullopt;
+            }
+            return getindex(v, key);
+        }
+
+        std::string getstring(const Value &v, std::string_view key, std::string_view fallback = "") const;
+
+        //sets array to an array member, returning its number of elements (0 if it is absent)
+        uint getarray(const Value &v, std::string_view key, const Value *&array) const
+        {
+            array = find(v, key);
+            if(!array)
+            {
+                return 0;
+            }
+            if(array->type != Value_Array)
+            {
+                throw std::logic_error("GLTF loader error: expected an array for " + std::string(key));
+            }
+            return array->count;
+        }
+
+        template<size_t N>
+        std::optional<std::array<float, N>> getfloats(const Value &v, std::string_view key) const
+        {
+            const Value *array;
+            if(!getarray(v, key, array))
+            {
+                return std::nullopt;
+            }
+            std::array<float, N> out{};
+            for(size_t i = 0; i < std::min<size_t>(N, array->count); ++i)
+            {
+                out[i] = element(*array, i).number;
+            }
+            return out;
+        }
+
+    private:
+        struct Member final
+        {
+            std::string_view key; //empty for array elements
+            uint value;           //index in values
+        };
+
+        static constexpr int maxdepth = 256;
+
+        std::string_view text;
+        size_t pos;
+        std::vector<Value> values;
+        std::vector<Member> members,
+                            pending; //children of the arrays and objects still being parsed
+
+        [[noreturn]] void error(const char *msg) const
+        {
+            throw std::logic_error(std::string("GLTF loader error: ") + msg + " at offset " + std::to_string(pos));
+        }
+
+        void skipspace()
+        {
+            while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+            {
+                pos++;
+            }
+        }
+
+        //parses a string starting at its opening quote, returning its contents
+        std::string_view parsestring()
+        {
+            size_t start = ++pos;
+            while(pos < text.size() && text[pos] != '"')
+            {
+                pos += text[pos] == '\\' ? 2 : 1;
+            }
+            if(pos >= text.size())
+            {
+                error("unterminated string");
+            }
+            return text.substr(start, pos++ - start);
+        }
+
+        bool parseliteral(std::string_view literal)
+        {
+            if(text.substr(pos, literal.size()) != literal)
+            {
+                return false;
+            }
+            pos += literal.size();
+            return true;
+        }
+
+        uint parsevalue(int depth)
+        {
+            if(depth > maxdepth)
+            {
+                error("nesting too deep");
+            }
+            if(pos >= text.size())
+            {
+                error("unexpected end of JSON (too few trailing } or ]?)");
+            }
+            uint index = values.size();
+            values.push_back({Value_Null, 0, {}, 0, 0});
+            char c = text[pos];
+            if(c == '{' || c == '[')
+            {
+                bool object = c == '{';
+                char close = object ? '}' : ']';
+                size_t base = pending.size();
+                pos++;
+                skipspace();
+                if(pos < text.size() && text[pos] == close)
+                {
+                    pos++;
+                }
+                else
+                {
+                    for(;;)
+                    {
+                        std::string_view key;
+                        if(object)
+                        {
+                            if(pos >= text.size() || text[pos] != '"')
+                            {
+                                error("expected object key");
+                            }
+                            key = parsestring();
+                            skipspace();
+                            if(pos >= text.size() || text[pos] != ':')
+                            {
+                                error("expected ':'");
+                            }
+                            pos++;
+                            skipspace();
+                        }
+                        uint child = parsevalue(depth + 1);
+                        pending.push_back({key, child});
+                        skipspace();
+                        if(pos >= text.size())
+                        {
+                            error("unexpected end of JSON (too few trailing } or ]?)");
+                        }
+                        if(text[pos] == ',')
+                        {
+                            pos++;
+                            skipspace();
+                            continue;
+                        }
+                        if(text[pos] != close)
+                        {
+                            error(object ? "expected ',' or '}'" : "expected ',' or ']'");
+                        }
+                        pos++;
+                        break;
+                    }
+                }
+                Value &v = values[index];
+                v.type = object ? Value_Object : Value_Array;
+                v.first = members.size();
+                v.count = pending.size() - base;
+                members.insert(members.end(), pending.begin() + base, pending.end());
+                pending.resize(base);
+            }
+            else if(c == '"')
+            {
+                std::string_view s = parsestring();
+                values[index].type = Value_String;
+                values[index].text = s;
+            }
+            else if(parseliteral("true"))
+            {
+                values[index].type = Value_Bool;
+                values[index].number = 1;
+            }
+            else if(parseliteral("false"))
+            {
+                values[index].type = Value_Bool;
+            }
+            else if(parseliteral("null"))
+            {
+                values[index].type = Value_Null;
+            }
+            else if(c == '-' || (c >= '0' && c <= '9'))
+            {
+                double d = 0;
+                std::from_chars_result r = std::from_chars(text.data() + pos, text.data() + text.size(), d);
+                if(r.ec != std::errc())
+                {
+                    error("invalid number");
+                }
+                pos = r.ptr - text.data();
+                values[index].type = Value_Number;
+                values[index].number = d;
+            }
+            else
+            {
+                error("unexpected character");
+            }
+            return index;
+        }
+};
+
+namespace
+{
+    //glb container constants, see the binary glTF section of the GLTF 2.0 spec
+    constexpr uint glbmagic = 0x46546C67,     //"glTF"
+                   glbjsonchunk = 0x4E4F534A, //"JSON"
+                   glbbinchunk = 0x004E4942;  //"BIN\0"
+
+    uint readu32(const char *p)
+    {
+        uint v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    //decodes the escape sequences in a JSON string's contents
+    std::string jsonstring(std::string_view s)
+    {
+        if(s.find('\\') == std::string_view::npos)
+        {
+            return std::string(s);
+        }
+        std::string out;
+        out.reserve(s.size());
+        for(size_t i = 0; i < s.size(); ++i)
+        {
+            if(s[i] != '\\' || i + 1 >= s.size())
+            {
+                out.push_back(s[i]);
+                continue;
+            }
+            char c = s[++i];
+            switch(c)
+            {
+                case 'n': out.push_back('\n'); break;
+                case 't': out.push_back('\t'); break;
+                case 'r': out.push_back('\r'); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'u':
+                {
+                    uint code = 0;
+                    if(i + 4 >= s.size() || std::from_chars(s.data() + i + 1, s.data() + i + 5, code, 16).ptr != s.data() + i + 5)
+                    {
+                        throw std::logic_error("GLTF loader error: invalid \\u escape");
+                    }
+                    i += 4;
+                    //encode as UTF-8; surrogate pairs are passed through as separate code points
+                    if(code < 0x80)
+                    {
+                        out.push_back(code);
+                    }
+                    else if(code < 0x800)
+                    {
+                        out.push_back(0xC0 | (code >> 6));
+                        out.push_back(0x80 | (code & 0x3F));
+                    }
+                    else
+                    {
+                        out.push_back(0xE0 | (code >> 12));
+                        out.push_back(0x80 | ((code >> 6) & 0x3F));
+                        out.push_back(0x80 | (code & 0x3F));
+                    }
+                    break;
+                }
+                default: out.push_back(c); break; // \" \\ \/
+            }
+        }
+        return out;
+    }
+
+    //decodes %XX escapes in a relative uri
+    std::string uripath(std::string_view uri)
+    {
+        std::string out;
+        for(size_t i = 0; i < uri.size(); ++i)
+        {
+            uint c = 0;
+            if(uri[i] == '%' && i + 2 < uri.size() && std::from_chars(uri.data() + i + 1, uri.data() + i + 3, c, 16).ptr == uri.data() + i + 3)
+            {
+                out.push_back(c);
+                i += 2;
+            }
+            else
+            {
+                out.push_back(uri[i]);
+            }
+        }
+        return out;
+    }
+
+    std::vector<char> decodebase64(std::string_view s)
+    {
+        auto sextet = [] (char c) -> int
+        {
+            if(c >= 'A' && c <= 'Z') return c - 'A';
+            if(c >= 'a' && c <= 'z') return c - 'a' + 26;
+            if(c >= '0' && c <= '9') return c - '0' + 52;
+            if(c == '+') return 62;
+            if(c == '/') return 63;
+            return -1;
+        };
+        std::vector<char> out;
+        out.reserve(s.size() / 4 * 3);
+        uint bits = 0;
+        int numbits = 0;
+        for(char c : s)
+        {
+            int v = sextet(c);
+            if(v < 0)
+            {
+                if(c == '=')
+                {
+                    break;
+                }
+                throw std::logic_error("GLTF loader error: invalid base64 data");
+            }
+            bits = (bits << 6) | v;
+            numbits += 6;
+            if(numbits >= 8)
+            {
+                numbits -= 8;
+                out.push_back(static_cast<char>((bits >> numbits) & 0xFF));
+            }
+        }
+        return out;
+    }
+}
+
+std::string GLTFModelInfo::JsonDocument::getstring(const Value &v, std::string_view key, std::string_view fallback) const
+{
+    const Value *m = find(v, key);
+    if(!m || m->type != Value_String)
+    {
+        return std::string(fallback);
+    }
+    return jsonstring(m->text);
+}
+
+//MappedFile
+
+GLTFModelInfo::MappedFile::MappedFile(const std::string &path) : begin(nullptr), length(0), mapped(false)
+{
+#ifdef GLTF_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        throw std::ios_base::failure("unable to open file " + path);
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        throw std::ios_base::failure("unable to read file " + path);
+    }
+    length = st.st_size;
+    if(length)
+    {
+        void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED)
+        {
+            close(fd);
+            throw std::ios_base::failure("unable to map file " + path);
+        }
+        begin = static_cast<const char *>(p);
+        mapped = true;
+    }
+    close(fd);
+#else
+    std::ifstream infile(path, std::ios::binary | std::ios::ate);
+    if(!infile.good())
+    {
+        throw std::ios_base::failure("unable to open file " + path);
+    }
+    length = infile.tellg();
+    infile.seekg(0);
+    contents.resize(length);
+    if(!infile.read(contents.data(), length))
+    {
+        throw std::ios_base::failure("unable to read file " + path);
+    }
+    begin = contents.data();
+#endif
+}
+
+GLTFModelInfo::MappedFile::MappedFile(MappedFile &&f) noexcept : begin(f.begin), length(f.length), mapped(f.mapped), contents(std::move(f.contents))
+{
+    f.begin = nullptr;
+    f.length = 0;
+    f.mapped = false;
+}
+
+GLTFModelInfo::MappedFile::~MappedFile()
+{
+#ifdef GLTF_MMAP
+    if(mapped)
+    {
+        munmap(const_cast<char *>(begin), length);
+    }
+#endif
+}
+
+const char *GLTFModelInfo::MappedFile::data() const
+{
+    return begin;
+}
+
+size_t GLTFModelInfo::MappedFile::size() const
+{
+    return length;
+}
+
 //populates the object vectors with the data in the gltf file
 GLTFModelInfo::GLTFModelInfo(std::string_view path, bool messages) : messages(messages)
 {
-    std::ifstream infile;
-    infile.exceptions(std::ifstream::failbit);
-    infile.open(path.data());
-    std::vector<std::string> output;
-
-    findnodes(path);
-    findmeshes(path);
-    findaccessors(path);
-    findbufferviews(path);
-    findbuffers(path);
-    findanimations(path);
+    files.emplace_back(std::string(path));
+    filenames.emplace_back(path);
+    const char *data = files.back().data();
+    size_t size = files.back().size();
+
+    std::string_view json(data, size),
+                     glbbuffer;
+    if(size >= 12 && readu32(data) == glbmagic)
+    {
+        //binary container: 12 byte header, then a JSON chunk, then an optional BIN chunk
+        if(readu32(data + 4) != 2)
+        {
+            throw std::logic_error("GLTF loader error: unsupported glb version");
+        }
+        size_t end = std::min<size_t>(size, readu32(data + 8)),
+               offset = 12;
+        json = {};
+        while(offset + 8 <= end)
+        {
+            size_t chunklength = readu32(data + offset);
+            uint chunktype = readu32(data + offset + 4);
+            offset += 8;
+            if(chunklength > end - offset)
+            {
+                throw std::logic_error("GLTF loader error: glb chunk out of range of file");
+            }
+            if(chunktype == glbjsonchunk && !json.data())
+            {
+                json = std::string_view(data + offset, chunklength);
+            }
+            else if(chunktype == glbbinchunk && !glbbuffer.data())
+            {
+                glbbuffer = std::string_view(data + offset, chunklength);
+            }
+            offset += (chunklength + 3) & ~static_cast<size_t>(3);
+        }
+        if(!json.data())
+        {
+            throw std::logic_error("GLTF loader error: glb file has no JSON chunk");
+        }
+    }
+    if(messages)
+    {
+        std::printf("loading %s: %zu bytes of JSON, %zu bytes of glb buffer\n", std::string(path).c_str(), json.size(), glbbuffer.size());
+    }
+
+    JsonDocument doc(json);
+    std::string dir(path.substr(0, path.find_last_of("/\\") + 1));
+
+    loadnodes(doc);
+    loadmeshes(doc);
+    loadaccessors(doc);
+    loadbufferviews(doc);
+    loadbuffers(doc, dir, glbbuffer);
+    loadanimations(doc);
+    checkindices();
+}
+
+//the gltf or glb file first, then any external buffer files it reads
+std::vector<std::string> GLTFModelInfo::getfilenames() const
+{
+    return filenames;
 }
 
 //NodeType_Mesh will return all nodes which contain meshes
@@ -101,20 +670,18 @@ std::vector<std::array<float, 3>> GLTFModelInfo::getpositions(std::string_view n
                 return positions;
             }
             const Accessor &a = accessors[m.positions.value()];
-            const BufferView &bv = bufferviews[a.bufferview];
             if(a.componenttype == GL_FLOAT)
             {
-                std::vector<float> floatbuf = gettypeblock<float>(bv.buffer, bv.bytelength, bv.byteoffset);
+                positions = readaccessor<float, float, 3>(a, a.count);
                 if(n.translation)
                 {
-                    for(size_t i = 0; i < floatbuf.size(); i+=3)
+                    for(std::array<float, 3> &p : positions)
                     {
-                        floatbuf[i] += n.translation.value()[0];
-                        floatbuf[i+1] += n.translation.value()[1];
-                        floatbuf[i+2] += n.translation.value()[2];
+                        p[0] += n.translation.value()[0];
+                        p[1] += n.translation.value()[1];
+                        p[2] += n.translation.value()[2];
                     }
                 }
-                positions = fillvector<float, float, 3>(floatbuf);
             }
             else
             {
@@ -135,11 +702,9 @@ std::vector<std::array<float, 3>> GLTFModelInfo::getnormals(std::string_view nam
         if(m.name == name && m.normals)
         {
             const Accessor &a = accessors[m.normals.value()];
-            const BufferView &bv = bufferviews[a.bufferview];
             if(a.componenttype == GL_FLOAT)
             {
-                std::vector<float> floatbuf = gettypeblock<float>(bv.buffer, bv.bytelength, bv.byteoffset);
-                normals = fillvector<float, float, 3>(floatbuf);
+                normals = readaccessor<float, float, 3>(a, a.count);
             }
             else
             {
@@ -160,11 +725,9 @@ std::vector<std::array<float, 2>> GLTFModelInfo::gettexcoords(std::string_view n
         if(m.name == name && m.texcoords)
         {
             const Accessor &a = accessors[m.texcoords.value()];
-            const BufferView &bv = bufferviews[a.bufferview];
             if(a.componenttype == GL_FLOAT)
             {
-                std::vector<float> floatbuf = gettypeblock<float>(bv.buffer, bv.bytelength, bv.byteoffset);
-                texcoords = fillvector<float, float, 2>(floatbuf);
+                texcoords = readaccessor<float, float, 2>(a, a.count);
             }
             else
             {
@@ -185,16 +748,13 @@ std::vector<std::array<uint, 4>> GLTFModelInfo::getjoints(std::string_view name)
         if(m.name == name && m.joints)
         {
             const Accessor &a = accessors[m.joints.value()];
-            const BufferView &bv = bufferviews[a.bufferview];
             if(a.componenttype == GL_UNSIGNED_BYTE)
             {
-                std::vector<uint8_t> scalarbuf = gettypeblock<uint8_t>(bv.buffer, bv.bytelength, bv.byteoffset);
-                joints = fillvector<uint, uint8_t, 4>(scalarbuf);
+                joints = readaccessor<uint, uint8_t, 4>(a, a.count);
             }
             else if(a.componenttype == GL_UNSIGNED_SHORT)
             {
-                std::vector<ushort> scalarbuf = gettypeblock<ushort>(bv.buffer, bv.bytelength, bv.byteoffset);
-                joints = fillvector<uint, ushort, 4>(scalarbuf);
+                joints = readaccessor<uint, ushort, 4>(a, a.count);
             }
             else
             {
@@ -215,11 +775,9 @@ std::vector<std::array<float, 4>> GLTFModelInfo::getweights(std::string_view nam
         if(m.name == name && m.weights)
         {
             const Accessor &a = accessors[m.weights.value()];
-            const BufferView &bv = bufferviews[a.bufferview];
             if(a.componenttype == GL_FLOAT)
             {
-                std::vector<float> floatbuf = gettypeblock<float>(bv.buffer, bv.bytelength, bv.byteoffset);
-                weights = fillvector<float, float, 4>(floatbuf);
+                weights = readaccessor<float, float, 4>(a, a.count);
             }
             else
             {
@@ -239,17 +797,15 @@ std::vector<std::array<uint, 3>> GLTFModelInfo::getindices(std::string_view name
     {
         if(m.name == name && m.indices)
         {
+            //indices are scalars, read three at a time as triangles
             const Accessor &a = accessors[m.indices.value()];
-            const BufferView &bv = bufferviews[a.bufferview];
             if(a.componenttype == GL_UNSIGNED_SHORT)
             {
-                std::vector<ushort> scalarbuf = gettypeblock<ushort>(bv.buffer, bv.bytelength, bv.byteoffset);
-                indices = fillvector<uint, ushort, 3>(scalarbuf);
+                indices = readaccessor<uint, ushort, 3>(a, a.count/3);
             }
             else if(a.componenttype == GL_UNSIGNED_INT)
             {
-                std::vector<uint> uintbuf = gettypeblock<uint>(bv.buffer, bv.bytelength, bv.byteoffset);
-                indices = fillvector<uint, uint, 3>(uintbuf);
+                indices = readaccessor<uint, uint, 3>(a, a.count/3);
             }
             else
             {
@@ -261,7 +817,7 @@ std::vector<std::array<uint, 3>> GLTFModelInfo::getindices(std::string_view name
             {
                 for(size_t j = 0; j < 3; ++j)
                 {
-                    if(i[j] >= accessors[m.positions.value()].count)
+                    if(!m.positions || i[j] >= accessors[m.positions.value()].count)
                     {
                         throw std::logic_error("invalid texture index");
                     }
@@ -300,184 +856,49 @@ bool GLTFModelInfo::operator==(const GLTFModelInfo &m) const
 //private methods
 ////////////////////////////////////////
 
-std::vector<std::string> GLTFModelInfo::loadjsonfile(std::string_view name)
+template<class T, class U, size_t N>
+std::vector<std::array<T, N>> GLTFModelInfo::readaccessor(const Accessor &a, size_t count) const
 {
-    std::string wholefile;
-    std::string line;
-    std::ifstream infile;
-    infile.open(name.data());
-    std::vector<std::string> output;
-
-    if(!infile.good())
+    const BufferView &bv = bufferviews[a.bufferview];
+    const Buffer &b = buffers[bv.buffer];
+    constexpr size_t elementsize = N*sizeof(U);
+    const size_t stride = bv.bytestride ? bv.bytestride : elementsize,
+                 viewend = std::min<size_t>(static_cast<size_t>(bv.byteoffset) + bv.bytelength, b.size),
+                 start = static_cast<size_t>(bv.byteoffset) + a.byteoffset;
+    if(count && (start > viewend || (count - 1) * stride + elementsize > viewend - start))
     {
-        perror("Error opening GLTF file");
-        return output;//empty vector
-    }
-    while(getline(infile, line))
-    {
-        bool stringliteral = false;
-        //strip all whitespace not inside string literals
-        for(size_t i = 0; i < line.size(); ++i)
-        {
-            if((i == 0 && line[i] == '"') || (line[i] == '"' && line[i-1] != '\\'))
-            {
-                stringliteral = !stringliteral;
-            }
-            if(!stringliteral)
-            {
-                if(line[i] == ' ' || line[i] == '\t')
-                {
-                    line.erase(i, 1);
-                    i--;
-                }
-            }
-        }
-        stringliteral = false;
-        wholefile.append(line);
+        std::printf("accessor %zu out of range: %zu elements of %zu bytes at %zu > %zu\n", a.index, count, stride, start, viewend);
+        throw std::logic_error("accessor out of range of its buffer");
     }
-    //line break after every { } ] ,
-
-    //helper lambda
-    auto pushstring = [] (size_t depth, std::vector<std::string> &out, const std::string &wholefile, size_t lastbreak, size_t cur)
+    std::vector<std::array<T, N>> output(count);
+    const char *src = b.data + start;
+    for(std::array<T, N> &v : output)
     {
-        std::string line(depth, ' ');
-        line.append(wholefile.substr(lastbreak, cur - lastbreak));
-        out.push_back(line);
-    };
-    size_t lastbreak = 0,
-           bracketdepth = 0;
-    for(size_t i = 0; i < wholefile.size(); ++i)
-    {
-        if(wholefile[i] == ']' || wholefile[i] == '}')
-        {
-            if(bracketdepth == 0)
-            {
-                throw std::logic_error("GLTF loader error: too many trailing } or ]");
-            }
-            pushstring(bracketdepth, output, wholefile, lastbreak, i);
-            bracketdepth--;
-            lastbreak = i;
-        }
-        else if(wholefile[i] =='{')
-        {
-            pushstring(bracketdepth, output, wholefile, lastbreak, i+1);
-            bracketdepth++;
-            lastbreak = i+1;
-        }
-        else if(wholefile[i] =='[')
-        {
-            pushstring(bracketdepth, output, wholefile, lastbreak, i+1);
-            bracketdepth++;
-            lastbreak = i+1;
-        }
-        else if(wholefile[i] ==',')
+        std::array<U, N> element;
+        std::memcpy(element.data(), src, elementsize);
+        for(size_t j = 0; j < N; ++j)
         {
-            pushstring(bracketdepth, output, wholefile, lastbreak, i+1);
-            lastbreak = i+1;
+            v[j] = element[j];
         }
+        src += stride;
     }
-    if(bracketdepth != 0)
-    {
-        throw std::logic_error("GLTF loader error: too few trailing } or ]");
-    }
-
-    infile.close();
     return output;
 }
 
-//helper for find<object> functions
-std::vector<std::string> GLTFModelInfo::getblockbyname(std::string_view path, std::string_view blockname, size_t maxdepth)
-{
-    std::vector<std::string> file = loadjsonfile(path);
-    size_t blockstart = 0;
-    for(size_t i = 0; i < file.size(); ++i)
-    {
-        size_t itr = file[i].find(blockname);
-        if(maxdepth)
-        {
-            if(itr <= maxdepth)
-            {
-                blockstart = i;
-                break;
-            }
-        }
-        else if(itr != std::string::npos)
-        {
-            blockstart = i;
-            break;
-        }
-    }
-    std::vector<std::string> block = getblock(file, blockstart);
-    return block;
-}
-
-//helper to sanitize things dropped by sscanf
-//removes ", from strings, part of json syntax
-void GLTFModelInfo::cleanstring(std::string &s)
-{
-    for(size_t i = 0; i < s.size(); ++i)
-    {
-        if(s[i] == '\"' || s[i] == ',')
-        {
-            s.erase(i, 1);
-            i--;
-        }
-    }
-}
-
-//returns number of nodes
-size_t GLTFModelInfo::findnodes(std::string_view path)
+void GLTFModelInfo::loadnodes(const JsonDocument &doc)
 {
     nodes.clear();
-    std::vector<std::string> nodeblock = getblockbyname(path, "\"nodes\"", 1); //get only "node" at indent depth 1
-    size_t numnodes = 0;
-    //get indices by parsing sub-blocks
-    for(size_t i = 0; i < nodeblock.size(); ++i)
+    const JsonDocument::Value *nodeblock;
+    uint numnodes = doc.getarray(doc.root(), "nodes", nodeblock);
+    for(uint i = 0; i < numnodes; ++i)
     {
-        std::vector<std::string> block = getblock(nodeblock, i);
-        if(!block.size())
-        {
-            continue;
-        }
-        Node n{"", std::nullopt, std::nullopt, std::nullopt, {}};
-        for(size_t j = 0; j < block.size(); ++j)
+        const JsonDocument::Value &block = doc.element(*nodeblock, i);
+        Node n{doc.getstring(block, "name"), doc.getfloats<3>(block, "translation"), doc.getfloats<4>(block, "rotation"), doc.getoptionalindex(block, "mesh"), {}};
+        const JsonDocument::Value *children;
+        uint numchildren = doc.getarray(block, "children", children);
+        for(uint j = 0; j < numchildren; ++j)
         {
-            if(block[j].find(" \"name\":") != std::string::npos)
-            {
-                std::array<char, 256> s;
-                s.fill(0);
-                std::sscanf(block[j].c_str(), " \"name\":%s", s.data());
-                n.name = s.data();
-                cleanstring(n.name);
-            }
-            else if(block[j].find("\"mesh\"") != std::string::npos)
-            {
-                uint mesh = 0;
-                std::sscanf( block[j].c_str(), " \"mesh\":%u", &mesh);
-                n.mesh = mesh;
-            }
-            else if(block[j].find("\"translation\"") != std::string::npos)
-            {
-                std::array<float, 3> translation = {0,0,0};
-                std::vector<std::string> translationblock = getblock(block, j);
-                for(size_t k = 0; k < translationblock.size(); ++k)
-                {
-                    std::sscanf( translationblock[k].c_str(), " %f", &translation[k]);
-                }
-                n.translation = translation;
-            }
-            else if(block[j].find("\"children\"") != std::string::npos)
-            {
-                std::vector<size_t> children;
-                std::vector<std::string> translationblock = getblock(block, j);
-                for(size_t k = 0; k < translationblock.size(); ++k)
-                {
-                    size_t child = 0;
-                    std::sscanf( translationblock[k].c_str(), " %lu", &child);
-                    children.push_back(child);
-                }
-                n.children = children;
-            }
+            n.children.push_back(doc.element(*children, j).number);
         }
         if(messages)
         {
@@ -491,80 +912,47 @@ size_t GLTFModelInfo::findnodes(std::string_view path)
             {
                 std::printf("node translation: %f %f %f\n", n.translation.value()[0], n.translation.value()[1], n.translation.value()[2]);
             }
-
         }
-        nodes.push_back(n); //no benefit to std::move fundamental types
-        i += block.size();
-        numnodes++;
+        nodes.push_back(std::move(n));
     }
-    return numnodes;
 }
 
-//returns number of meshes
-size_t GLTFModelInfo::findmeshes(std::string_view path)
+void GLTFModelInfo::loadmeshes(const JsonDocument &doc)
 {
     meshes.clear();
-    std::vector<std::string> accessorblock = getblockbyname(path, "\"meshes\"");
-    size_t nummeshes = 0;
-    //get indices by parsing sub-blocks
-    for(size_t i = 0; i < accessorblock.size(); ++i)
+    const JsonDocument::Value *meshblock;
+    uint nummeshes = doc.getarray(doc.root(), "meshes", meshblock);
+    for(uint i = 0; i < nummeshes; ++i)
     {
-        std::vector<std::string> block = getblock(accessorblock, i);
-        if(!block.size())
-        {
-            continue;
-        }
-        Mesh m{"", std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt};
-        for(std::string_view j : block)
+        const JsonDocument::Value &block = doc.element(*meshblock, i);
+        Mesh m{doc.getstring(block, "name"), std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt, std::nullopt};
+        //only the first primitive of each mesh is loaded
+        const JsonDocument::Value *primitives;
+        if(doc.getarray(block, "primitives", primitives))
         {
-            if(j.find(" \"name\":") != std::string_view::npos)
-            {
-                std::array<char, 256> s;
-                s.fill(0);
-                std::sscanf(j.data(), " \"name\":%s", s.data());
-                m.name = s.data();
-                cleanstring(m.name);
-            }
-            else if(j.find(" \"POSITION\":") != std::string_view::npos)
-            {
-                uint positions = 0;
-                std::sscanf(j.data(), " \"POSITION\":%u", &positions);
-                m.positions = positions; //assign to optional with operator=
-            }
-            else if(j.find("\"NORMAL\"") != std::string_view::npos)
-            {
-                uint normals = 0;
-                std::sscanf(j.data(), " \"NORMAL\":%u", &normals);
-                m.normals = normals;
-            }
-            else if(j.find("\"TEXCOORD_0\"") != std::string_view::npos)
-            {
-                uint texcoords = 0;
-                std::sscanf( j.data(), " \"TEXCOORD_0\":%u", &texcoords);
-                m.texcoords = texcoords;
-            }
-            else if(j.find("\"JOINTS_0\"") != std::string_view::npos)
+            const JsonDocument::Value &primitive = doc.element(*primitives, 0);
+            auto attribute = [&] (std::string_view key) -> std::optional<uint>
             {
-                uint joints = 0;
-                std::sscanf( j.data(), " \"JOINTS_0\":%u", &joints);
-                m.joints = joints;
-            }
-            else if(j.find("\"WEIGHTS_0\"") != std::string_view::npos)
-            {
-                uint weights = 0;
-                std::sscanf( j.data(), " \"WEIGHTS_0\":%u", &weights);
-                m.weights = weights;
-            }
-            else if(j.find("\"indices\"") != std::string_view::npos)
+                const JsonDocument::Value *attributes = doc.find(primitive, "attributes");
+                if(!attributes || !doc.find(*attributes, key))
+                {
+                    return std::nullopt;
+                }
+                return doc.getindex(*attributes, key);
+            };
+            m.positions = attribute("POSITION");
+            m.normals = attribute("NORMAL");
+            m.texcoords = attribute("TEXCOORD_0");
+            m.joints = attribute("JOINTS_0");
+            m.weights = attribute("WEIGHTS_0");
+            if(doc.find(primitive, "indices"))
             {
-                uint indices = 0;
-                std::sscanf( j.data(), " \"indices\":%u", &indices);
-                m.indices = indices;
+                m.indices = doc.getindex(primitive, "indices");
             }
         }
         if(messages)
         {
-            //note: nullopt is represented by -1 aka 18446744073709551615
+            //note: nullopt is represented by -1 aka 4294967295
             std::printf("new mesh created: %s %u %u %u %u %u %u\n",
                 m.name.c_str(),
                 m.positions ? m.positions.value() : -1,
@@ -576,288 +964,179 @@ size_t GLTFModelInfo::findmeshes(std::string_view path)
             );
         }
         meshes.push_back(std::move(m));
-        i += block.size();
-        nummeshes++;
     }
-    return nummeshes;
 }
 
-//clears accessors vector, assigns to it ones found in the given math, returns number of accessors
-size_t GLTFModelInfo::findaccessors(std::string_view path)
+void GLTFModelInfo::loadaccessors(const JsonDocument &doc)
 {
     accessors.clear();
-    std::vector<std::string> accessorblock = getblockbyname(path, "\"accessors\"");
-    size_t numaccessors = 0;
-    //get indices by parsing sub-blocks
-    for(size_t i = 0; i < accessorblock.size(); ++i)
+    const JsonDocument::Value *accessorblock;
+    uint numaccessors = doc.getarray(doc.root(), "accessors", accessorblock);
+    for(uint i = 0; i < numaccessors; ++i)
     {
-        std::vector<std::string> block = getblock(accessorblock, i);
-        if(!block.size())
-        {
-            continue;
-        }
-        Accessor a{0,0,0,0,""};
-        a.index = accessors.size();
-        for(std::string_view j : block)
-        {
-            if(j.find(" \"bufferView\":") != std::string_view::npos)
-            {
-                std::sscanf(j.data(), " \"bufferView\":%u", &a.bufferview);
-            }
-            else if(j.find("\"componentType\"") != std::string_view::npos)
-            {
-                std::sscanf(j.data(), " \"componentType\":%u", &a.componenttype);
-            }
-            else if(j.find("\"count\"") != std::string_view::npos)
-            {
-                std::sscanf( j.data(), " \"count\":%u", &a.count);
-            }
-            else if(j.find("\"type\"") != std::string_view::npos)
-            {
-                std::array<char, 32> s;
-                s.fill(0);
-                std::sscanf(j.data(), " \"type\":%s", s.data());
-                a.type = s.data();
-            }
-        }
+        const JsonDocument::Value &block = doc.element(*accessorblock, i);
+        Accessor a{accessors.size(),
+                   static_cast<uint>(doc.getindex(block, "bufferView")),
+                   static_cast<uint>(doc.getindex(block, "byteOffset")),
+                   static_cast<uint>(doc.getindex(block, "componentType")),
+                   static_cast<uint>(doc.getindex(block, "count")),
+                   doc.getstring(block, "type")};
         if(messages)
         {
-            std::printf("new accessor created: %lu %u %u %u %s\n", a.index, a.bufferview, a.componenttype, a.count, a.type.c_str());
+            std::printf("new accessor created: %zu %u %u %u %s\n", a.index, a.bufferview, a.componenttype, a.count, a.type.c_str());
         }
         accessors.push_back(std::move(a));
-        i += block.size();
-        numaccessors++;
     }
-    return numaccessors;
 }
 
-//clears buffer views vector, assigns to it buffers found in file, returns number of buffer views
-size_t GLTFModelInfo::findbufferviews(std::string_view path)
+void GLTFModelInfo::loadbufferviews(const JsonDocument &doc)
 {
     bufferviews.clear();
-    std::vector<std::string> bufferviewblock = getblockbyname(path, "\"bufferViews\"");
-    size_t numbufferviews = 0;
-    for(size_t i = 0; i < bufferviewblock.size(); ++i)
+    const JsonDocument::Value *bufferviewblock;
+    uint numbufferviews = doc.getarray(doc.root(), "bufferViews", bufferviewblock);
+    for(uint i = 0; i < numbufferviews; ++i)
     {
-        std::vector<std::string> block = getblock(bufferviewblock, i);
-        if(!block.size())
-        {
-            continue;
-        }
-        BufferView b{0,0,0,0};
-        b.index = bufferviews.size();
-        for(std::string_view j : block)
-        {
-            if(j.find(" \"buffer\":") != std::string_view::npos)
-            {
-                std::sscanf(j.data(), " \"buffer\":%u", &b.buffer);
-            }
-            else if(j.find("\"byteLength\"") != std::string_view::npos)
-            {
-                std::sscanf(j.data(), " \"byteLength\":%u", &b.bytelength);
-            }
-            else if(j.find("\"byteOffset\"") != std::string_view::npos)
-            {
-                std::sscanf( j.data(), " \"byteOffset\":%u", &b.byteoffset);
-            }
-        }
+        const JsonDocument::Value &block = doc.element(*bufferviewblock, i);
+        BufferView b{bufferviews.size(),
+                     static_cast<uint>(doc.getindex(block, "buffer")),
+                     static_cast<uint>(doc.getindex(block, "byteOffset")),
+                     static_cast<uint>(doc.getindex(block, "byteLength")),
+                     static_cast<uint>(doc.getindex(block, "byteStride"))};
         if(messages)
         {
-            std::printf("new bufferview created: %lu %u %u %u\n", b.index, b.buffer, b.bytelength, b.byteoffset);
+            std::printf("new bufferview created: %zu %u %u %u\n", b.index, b.buffer, b.bytelength, b.byteoffset);
         }
         bufferviews.push_back(b); //no benefit from std::move of fundamental types
-        i += block.size();
-        numbufferviews++;
     }
-    return numbufferviews;
 }
 
-size_t GLTFModelInfo::findbuffers(std::string_view path)
+void GLTFModelInfo::loadbuffers(const JsonDocument &doc, const std::string &dir, std::string_view glbbuffer)
 {
     buffers.clear();
-    std::vector<std::string> bufferblock = getblockbyname(path, "\"buffers\"");
-    size_t numbuffers = 0;
-    for(size_t i = 0; i < bufferblock.size(); ++i)
+    const JsonDocument::Value *bufferblock;
+    uint numbuffers = doc.getarray(doc.root(), "buffers", bufferblock);
+    for(uint i = 0; i < numbuffers; ++i)
     {
-        std::vector<std::string> block = getblock(bufferblock, i);
-        if(!block.size())
+        const JsonDocument::Value &block = doc.element(*bufferblock, i);
+        Buffer b{buffers.size(), static_cast<uint>(doc.getindex(block, "byteLength")), doc.getstring(block, "uri"), nullptr, 0, {}};
+        constexpr std::string_view datauri = "data:",
+                                   base64 = ";base64,";
+        if(b.uri.empty())
         {
-            continue;
-        }
-        std::string dir = path.data();
-        dir = dir.substr(0, dir.find_last_of("/\\") + 1);
-        Buffer b{0, 0, dir, {}};
-        b.index = buffers.size();
-        for(std::string_view j : block)
-        {
-            if(j.find(" \"byteLength\":") != std::string_view::npos)
+            //the first buffer of a glb file may refer to its BIN chunk
+            if(i != 0 || !glbbuffer.data())
             {
-                std::sscanf(j.data(), " \"byteLength\":%u", &b.bytelength);
+                throw std::logic_error("GLTF loader error: buffer has no uri");
             }
-            else if(j.find("\"uri\"") != std::string_view::npos)
+            b.data = glbbuffer.data();
+            b.size = glbbuffer.size();
+        }
+        else if(b.uri.compare(0, datauri.size(), datauri) == 0)
+        {
+            size_t start = b.uri.find(base64);
+            if(start == std::string::npos)
             {
-                std::array<char, 256> s;
-                s.fill(0);
-                std::sscanf(j.data(), " \"uri\":\"%s", s.data());
-                b.uri.append(s.data());
-                cleanstring(b.uri);
+                throw std::logic_error("GLTF loader error: data uri is not base64");
             }
+            b.decoded = decodebase64(std::string_view(b.uri).substr(start + base64.size()));
+            b.data = b.decoded.data();
+            b.size = b.decoded.size();
+            b.uri.resize(start + base64.size()); //no need to keep the data twice
+        }
+        else
+        {
+            filenames.push_back(dir + uripath(b.uri));
+            files.emplace_back(filenames.back());
+            b.data = files.back().data();
+            b.size = files.back().size();
         }
-        std::ifstream binary(b.uri, std::ios::binary);
-        std::vector<char> buffer(std::istreambuf_iterator<char>(binary), {});
-        b.buf = buffer;
         if(messages)
         {
-            std::printf("new buffer created: %lu %u %s %lu\n", b.index, b.bytelength, b.uri.c_str(), buffer.size());
+            std::printf("new buffer created: %zu %u %s %zu\n", b.index, b.bytelength, b.uri.c_str(), b.size);
         }
         buffers.push_back(std::move(b));
-        i += block.size();
-        numbuffers++;
-        binary.close();
     }
-    return numbuffers;
 }
 
-//clears buffer views vector, assigns to it buffers found in file, returns number of buffer views
-size_t GLTFModelInfo::findanimations(std::string_view path)
+void GLTFModelInfo::loadanimations(const JsonDocument &doc)
 {
     animations.clear();
-    std::vector<std::string> animationsblock = getblockbyname(path, "\"animations\""); //all of the animations section
-    size_t numanimations = 0;
-    for(size_t i = 0; i < animationsblock.size(); ++i)
+    const JsonDocument::Value *animationsblock;
+    uint numanimations = doc.getarray(doc.root(), "animations", animationsblock); //all of the animations section
+    for(uint i = 0; i < numanimations; ++i)
     {
-        std::vector<std::string> block = getblock(animationsblock, i); //a single animation data block
-        if(!block.size())
-        {
-            continue;
-        }
+        const JsonDocument::Value &block = doc.element(*animationsblock, i); //a single animation data block
         Animation a;
-        for(size_t j = 0; j < block.size(); ++j)
+        a.name = doc.getstring(block, "name");
+        const JsonDocument::Value *channelblock;
+        uint numchannels = doc.getarray(block, "channels", channelblock); // all of the channel information of a single anim
+        for(uint j = 0; j < numchannels; ++j)
         {
-            if(block[j].find(" \"name\":") != std::string::npos)
+            const JsonDocument::Value &channeldata = doc.element(*channelblock, j); // a single channel data block
+            Animation::Channel c{a.channels.size(), doc.getindex(channeldata, "sampler"), 0, ""};
+            if(const JsonDocument::Value *target = doc.find(channeldata, "target"))
             {
-                std::array<char, 256> s;
-                s.fill(0);
-                std::sscanf(block[j].c_str(), " \"name\":\"%s", s.data());
-                a.name = s.data();
-                cleanstring(a.name);
+                c.targetnode = doc.getindex(*target, "node");
+                c.targetpath = doc.getstring(*target, "path");
             }
-            if(block[j].find(" \"channels\":") != std::string::npos)
+            if(messages)
             {
-                std::vector<std::string> channelblock = getblock(animationsblock, j+1); // all of the channel information of a single anim
-                for(size_t k = 0; k < channelblock.size(); ++k)
-                {
-                    std::vector<std::string> channeldata = getblock(channelblock, k); // a single channel data block
-                    if(!channeldata.size())
-                    {
-                        continue;
-                    }
-                    Animation::Channel c{a.channels.size(),0,0,""};
-                    for(std::string_view l : channeldata)
-                    {
-                        if(l.find(" \"sampler\":") != std::string_view::npos)
-                        {
-                            std::sscanf(l.data(), " \"sampler\":%lu", &c.sampler);
-                        }
-                        else if(l.find("\"node\"") != std::string_view::npos)
-                        {
-                            std::sscanf(l.data(), " \"node\":%lu", &c.targetnode);
-                        }
-                        else if(l.find("\"path\"") != std::string_view::npos)
-                        {
-                            std::array<char, 256> s;
-                            s.fill(0);
-                            std::sscanf(l.data(), " \"path\":%s", s.data());
-                            c.targetpath = s.data();
-                            cleanstring(c.targetpath);
-                        }
-                    }
-                    if(messages)
-                    {
-                        std::printf("new channel (animation %lu) added: %lu %lu %s\n", animations.size(), c.sampler, c.targetnode, c.targetpath.c_str());
-                    }
-                    a.channels.push_back(std::move(c));
-                    k += channeldata.size();
-                }
+                std::printf("new channel (animation %zu) added: %zu %zu %s\n", animations.size(), c.sampler, c.targetnode, c.targetpath.c_str());
             }
-            if(block[j].find(" \"samplers\":") != std::string::npos)
+            a.channels.push_back(std::move(c));
+        }
+        const JsonDocument::Value *samplerblock;
+        uint numsamplers = doc.getarray(block, "samplers", samplerblock);
+        for(uint j = 0; j < numsamplers; ++j)
+        {
+            const JsonDocument::Value &samplerdata = doc.element(*samplerblock, j);
+            Animation::Sampler s{a.samplers.size(), doc.getindex(samplerdata, "input"), doc.getstring(samplerdata, "interpolation", "LINEAR"), doc.getindex(samplerdata, "output")};
+            if(messages)
             {
-                std::vector<std::string> channelblock = getblock(animationsblock, j+1); // all of the channel information of a single anim
-                for(size_t k = 0; k < channelblock.size(); ++k)
-                {
-                    std::vector<std::string> channeldata = getblock(channelblock, k); // a single channel data block
-                    if(!channeldata.size())
-                    {
-                        continue;
-                    }
-                    Animation::Sampler s{a.samplers.size(),0,"", 0};
-                    for(std::string_view l : channeldata)
-                    {
-                        if(l.find(" \"input\":") != std::string_view::npos)
-                        {
-                            std::sscanf(l.data(), " \"input\":%lu", &s.input);
-                        }
-                        else if(l.find("\"output\"") != std::string_view::npos)
-                        {
-                            std::sscanf(l.data(), " \"output\":%lu", &s.output);
-                        }
-                        else if(l.find("\"interpolation\"") != std::string_view::npos)
-                        {
-                            std::array<char, 256> str;
-                            str.fill(0);
-                            std::sscanf(l.data(), " \"interpolation\":%s", str.data());
-                            s.interpolation = str.data();
-                            cleanstring(s.interpolation);
-                        }
-                    }
-                    if(messages)
-                    {
-                        std::printf("new sampler (animation %lu) added: %lu %lu %s %lu\n", animations.size(), s.index, s.input, s.interpolation.c_str(), s.output);
-                    }
-                    a.samplers.push_back(std::move(s));
-                    k += channeldata.size();
-                }
+                std::printf("new sampler (animation %zu) added: %zu %zu %s %zu\n", animations.size(), s.index, s.input, s.interpolation.c_str(), s.output);
             }
+            a.samplers.push_back(std::move(s));
         }
         if(messages)
         {
-            std::printf("new animation (index %lu) created: %s\n", animations.size(), a.name.c_str());
+            std::printf("new animation (index %zu) created: %s\n", animations.size(), a.name.c_str());
         }
         animations.push_back(std::move(a));
-        i += animationsblock.size();
-        numanimations++;
     }
-    return numanimations;
 }
 
-//get the indented block starting at the specified line
-std::vector<std::string> GLTFModelInfo::getblock(const std::vector<std::string> &file, size_t line)
+//checks that the indices objects refer to each other by are in range, so that the getters need not
+void GLTFModelInfo::checkindices() const
 {
-    auto getindentationdepth = [] (const std::string &r) -> size_t
+    for(const Node &n : nodes)
     {
-        size_t indentationdepth = 0;
-        for(const char &c : r)
+        if(n.mesh && n.mesh.value() >= meshes.size())
         {
-            if(c != ' ')
+            throw std::logic_error("GLTF loader error: node mesh index out of range");
+        }
+    }
+    for(const Mesh &m : meshes)
+    {
+        for(const std::optional<uint> &i : {m.positions, m.normals, m.texcoords, m.joints, m.weights, m.indices})
+        {
+            if(i && i.value() >= accessors.size())
             {
-                break;
+                throw std::logic_error("GLTF loader error: mesh accessor index out of range");
             }
-            indentationdepth++;
         }
-        return indentationdepth;
-    };
-
-    std::string line0 = std::string(file[line]);
-    size_t line0depth = getindentationdepth(line0);
-
-    std::vector<std::string> block;
-    for(size_t i = line+1; i < file.size(); ++i)
+    }
+    for(const Accessor &a : accessors)
+    {
+        if(a.bufferview >= bufferviews.size())
+        {
+            throw std::logic_error("GLTF loader error: accessor buffer view index out of range");
+        }
+    }
+    for(const BufferView &bv : bufferviews)
     {
-        if(getindentationdepth(file[i]) <= line0depth)
+        if(bv.buffer >= buffers.size())
         {
-            break;
+            throw std::logic_error("GLTF loader error: buffer view buffer index out of range");
         }
-        block.push_back(file[i]);
     }
-    return block;
 }
@@ -7,8 +7,12 @@ class GLTFModelInfo final
     public:
         /**
          * @brief Populates the object vectors with the data in the gltf file
-         * throws std::ios_base::failure if unable to load file
-         * throws std::logic_error if invalid bracketing
+         *
+         * Accepts both JSON .gltf files and binary .glb containers (detected
+         * by their header, not the extension). The JSON is parsed in a single
+         * pass, and buffers are mapped rather than copied.
+         * throws std::ios_base::failure if unable to load file or one of its buffers
+         * throws std::logic_error if invalid JSON (e.g. invalid bracketing) or glb container
          * throws std::logic_error if invalid geometry data type (e.g. float vertex indices)
          *
          * @param path the path of the file to load
@@ -17,6 +21,8 @@ class GLTFModelInfo final
         GLTFModelInfo(std::string_view path, bool messages = false);
         //return list of mesh names, using one of the NodeTypes
         std::vector<std::string> getnodenames(int type) const;
+        //return the names of the files read: the gltf or glb file, then any buffer files
+        std::vector<std::string> getfilenames() const;
         //getter functions generate vectors of arrays of the appropriate type
         //given the node name
         std::vector<std::array<float, 3>> getpositions(std::string_view name) const;
@@ -66,6 +72,7 @@ class GLTFModelInfo final
         {
             size_t index; //index of this accessor
             uint bufferview; //index in the binary buffer this points to
+            uint byteoffset; //offset of the first element within the buffer view
             uint componenttype; //type of individual elements
             uint count; //number of elements
             std::string type; //type of data structure (vec2/vec3/scalar/etc)
@@ -76,7 +83,8 @@ class GLTFModelInfo final
             size_t index;
             uint buffer,
                  byteoffset,
-                 bytelength;
+                 bytelength,
+                 bytestride; //0 if elements are tightly packed
         };
 
         struct Buffer final
@@ -84,7 +92,9 @@ class GLTFModelInfo final
             size_t index;
             uint bytelength;
             std::string uri;
-            std::vector<char> buf;
+            const char *data; //points into a MappedFile, or into decoded
+            size_t size;
+            std::vector<char> decoded; //contents of buffers embedded in the file as base64 data uris
         };
 
         struct Animation final
@@ -108,70 +118,58 @@ class GLTFModelInfo final
             std::string name;
         };
 
-        //T: the type of the output arrays in the vector
-        //U: the type of the vector of input data
-        //N: the number of elements in output arrays
-        template<class T, class U, int N>
-        static std::vector<std::array<T, N>> fillvector(const std::vector<U> &block)
-        {
-            std::vector<std::array<T, N>> output;
-            for(size_t i = 0; i < block.size(); i+=N)
-            {
-                std::array<T, N> v;
-                for(size_t j = 0; j < N; ++j)
-                {
-                    v[j] = block[i+j];
-                };
-                output.push_back(v);
-            }
-            return output;
-        }
-
-
-        //index and length in bytes
-        //returns a new copy of the buffer, as a vector, in the appropriate type
-        template<class T>
-        std::vector<T> gettypeblock(size_t bufindex, uint length, uint index) const
+        /**
+         * @brief A file read by the loader.
+         *
+         * The file is memory mapped where the platform supports it, and read
+         * into memory with a single read otherwise; either way buffers point
+         * straight into it rather than copying it.
+         */
+        class MappedFile final
         {
-            if(length + index > buffers[bufindex].buf.size())
-            {
-                std::printf("indices specified out of range: %u + %u > %lu\n", length, index, buffers[bufindex].buf.size());
-            }
-            std::vector<T> outbuf;
-            for(uint i = index; i < index + length; i+=sizeof(T))
-            {
-                //type pun the char array to T
-                char *data = new char[sizeof(T)];
-                for(uint j = 0; j < sizeof(T); ++j)
-                {
-                    data[j] = buffers[bufindex].buf[i+j];
-                }
-                T *outdata = reinterpret_cast<T*>(data);
-                outbuf.push_back(*outdata);
-                delete[] data; //this is safe because the vector pushes back values and not pointers
-            }
-            return outbuf;
-        }
+            public:
+                //throws std::ios_base::failure if unable to open file
+                MappedFile(const std::string &path);
+                MappedFile(MappedFile &&f) noexcept;
+                MappedFile(const MappedFile &) = delete;
+                MappedFile &operator=(const MappedFile &) = delete;
+                ~MappedFile();
+
+                const char *data() const;
+                size_t size() const;
+            private:
+                const char *begin;
+                size_t length;
+                bool mapped;
+                std::vector<char> contents; //used when the file is not mapped
+        };
+
+        class JsonDocument; //parsed JSON, see gltfloader.cpp
 
         /**
-         * @brief Loads a (gltf) json file to a std::vector
+         * @brief Reads an accessor's elements from its buffer.
          *
-         * Loads a JSON file and creates a new line for each bracket level and entry.
+         * Reads each element directly from the (mapped) buffer, using the
+         * buffer view's stride if it has one.
+         * throws std::logic_error if the elements are outside the buffer view or buffer
          *
-         * @param name path to the file to load
+         * @tparam T the type of the output arrays in the vector
+         * @tparam U the type of the components stored in the buffer
+         * @tparam N the number of components in each element
          *
-         * @return vector containing contents of file line by line
+         * @param a the accessor to read
+         * @param count the number of elements to read
          */
-        std::vector<std::string> loadjsonfile(std::string_view name);
-        std::vector<std::string> getblockbyname(std::string_view path, std::string_view blockname, size_t maxdepth = 0);
-        static void cleanstring(std::string &s);
-        size_t findnodes(std::string_view path);
-        size_t findmeshes(std::string_view path);
-        size_t findaccessors(std::string_view path);
-        size_t findbufferviews(std::string_view path);
-        size_t findbuffers(std::string_view path);
-        size_t findanimations(std::string_view path);
-        std::vector<std::string> getblock(const std::vector<std::string> &file, size_t line);
+        template<class T, class U, size_t N>
+        std::vector<std::array<T, N>> readaccessor(const Accessor &a, size_t count) const;
+
+        void loadnodes(const JsonDocument &doc);
+        void loadmeshes(const JsonDocument &doc);
+        void loadaccessors(const JsonDocument &doc);
+        void loadbufferviews(const JsonDocument &doc);
+        void loadbuffers(const JsonDocument &doc, const std::string &dir, std::string_view glbbuffer);
+        void loadanimations(const JsonDocument &doc);
+        void checkindices() const;
 
         const bool messages;
         std::vector<Node> nodes;
@@ -180,6 +178,8 @@ class GLTFModelInfo final
         std::vector<BufferView> bufferviews;
         std::vector<Buffer> buffers;
         std::vector<Animation> animations;
+        std::vector<MappedFile> files; //the gltf or glb file, and any binary files its buffers are in
+        std::vector<std::string> filenames; //names of the files in files
 
 };
 
@@ -101,6 +101,10 @@ const md5::skelanimspec *md5::md5meshgroup::loadanim(const std::string &filename
 {
     {
         const skelanimspec *sa = skel->findskelanim(filename);
+        if(!sa)
+        {
+            sa = loadanimcache(filename, adjustments);
+        }
         if(sa)
         {
             return sa;
@@ -301,6 +305,10 @@ const md5::skelanimspec *md5::md5meshgroup::loadanim(const std::string &filename
         delete[] animdata;
     }
     delete f;
+    if(sas)
+    {
+        saveanimcache(*sas, adjustments);
+    }
 
     return sas;
 }
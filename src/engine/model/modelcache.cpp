@@ -0,0 +1,231 @@
+/**
+ * @file modelcache.cpp
+ * @brief binary cache files for processed model data
+ *
+ * Parsing text model formats, building their normals, tangents and blend
+ * weights, and building their collision trees is much slower than reading the
+ * result back; model loaders can write what they build to a cache file and try
+ * reading it before their source files on later loads. A cache is only used if every source file it was built from
+ * still has the recorded size and hash, so edited models are always reloaded.
+ */
+#include "../libprimis-headers/cube.h"
+#include "../../shared/stream.h"
+
+#include <format>
+
+#include "modelcache.h"
+
+VAR(modelcache, 0, 0, 1); //read and write model cache files
+
+namespace
+{
+    constexpr uint modelcachemagic = 0x434D5050; //"PPMC" in little endian byte order
+    constexpr uint modelcacheversion = 1;
+    constexpr size_t modelcachealign = 16;
+    constexpr uint maxsources = 64;
+    constexpr uint maxnamelen = 4096;
+
+    struct modelcacheheader final
+    {
+        uint magic,
+             version,
+             format,
+             numsources;
+    };
+
+    //hashes a file with 64 bit FNV-1a, reading it in chunks
+    bool hashfile(const char *name, size_t &size, ullong &hash)
+    {
+        stream *f = openfile(name, "rb");
+        if(!f)
+        {
+            return false;
+        }
+        std::array<uchar, 1<<16> buf;
+        hash = 0xCBF29CE484222325ULL;
+        size = 0;
+        for(;;)
+        {
+            size_t len = f->read(buf.data(), buf.size());
+            for(size_t i = 0; i < len; ++i)
+            {
+                hash = (hash ^ buf[i]) * 0x100000001B3ULL;
+            }
+            size += len;
+            if(len < buf.size())
+            {
+                break;
+            }
+        }
+        delete f;
+        return true;
+    }
+}
+
+std::string modelcachename(std::string_view name)
+{
+    return path(std::format("cache/models/{}.pmc", name));
+}
+
+// modelcachewriter
+
+modelcachewriter::modelcachewriter(uint format) : format(format)
+{
+}
+
+bool modelcachewriter::addsource(const std::string &name)
+{
+    source s;
+    s.name = name;
+    if(sources.size() >= maxsources || name.size() > maxnamelen || !hashfile(name.c_str(), s.size, s.hash))
+    {
+        return false;
+    }
+    sources.push_back(std::move(s));
+    return true;
+}
+
+void modelcachewriter::putstring(std::string_view s)
+{
+    put<uint>(s.size());
+    putbytes(s.data(), s.size());
+}
+
+void modelcachewriter::putbytes(const void *data, size_t len)
+{
+    const uchar *bytes = static_cast<const uchar *>(data);
+    records.insert(records.end(), bytes, bytes + len);
+}
+
+void modelcachewriter::align()
+{
+    records.resize((records.size() + modelcachealign - 1) & ~(modelcachealign - 1), 0);
+}
+
+bool modelcachewriter::save(const std::string &name) const
+{
+    //the header is padded so that records keep their alignment within the file
+    std::vector<uchar> header;
+    modelcacheheader h = { modelcachemagic, modelcacheversion, format, static_cast<uint>(sources.size()) };
+    const uchar *hbytes = reinterpret_cast<const uchar *>(&h);
+    header.insert(header.end(), hbytes, hbytes + sizeof(h));
+    for(const source &s : sources)
+    {
+        uint len = s.name.size();
+        ullong size = s.size;
+        header.insert(header.end(), reinterpret_cast<const uchar *>(&len), reinterpret_cast<const uchar *>(&len) + sizeof(len));
+        header.insert(header.end(), s.name.begin(), s.name.end());
+        header.insert(header.end(), reinterpret_cast<const uchar *>(&size), reinterpret_cast<const uchar *>(&size) + sizeof(size));
+        header.insert(header.end(), reinterpret_cast<const uchar *>(&s.hash), reinterpret_cast<const uchar *>(&s.hash) + sizeof(s.hash));
+    }
+    header.resize((header.size() + modelcachealign - 1) & ~(modelcachealign - 1), 0);
+
+    std::string tmpname = name + ".tmp";
+    stream *f = openfile(tmpname.c_str(), "wb");
+    if(!f)
+    {
+        return false;
+    }
+    bool written = f->write(header.data(), header.size()) == header.size() &&
+                   f->write(records.data(), records.size()) == records.size();
+    delete f;
+    string tmppath;
+    copystring(tmppath, findfile(tmpname.c_str(), "wb"));
+    if(!written)
+    {
+        std::remove(tmppath);
+        return false;
+    }
+    string cachepath;
+    copystring(cachepath, findfile(name.c_str(), "wb"));
+    std::remove(cachepath);
+    return !std::rename(tmppath, cachepath);
+}
+
+// modelcachereader
+
+modelcachereader::modelcachereader() : pos(0)
+{
+}
+
+bool modelcachereader::load(const std::string &name, uint format)
+{
+    data.clear();
+    pos = 0;
+    size_t len;
+    char *buf = loadfile(name.c_str(), &len, false);
+    if(!buf)
+    {
+        return false;
+    }
+    data.assign(buf, buf + len);
+    delete[] buf;
+
+    modelcacheheader h;
+    if(!get(h) || h.magic != modelcachemagic || h.version != modelcacheversion || h.format != format || h.numsources > maxsources)
+    {
+        return false;
+    }
+    for(uint i = 0; i < h.numsources; ++i)
+    {
+        std::string source;
+        ullong size, hash;
+        if(!getstring(source) || !get(size) || !get(hash))
+        {
+            return false;
+        }
+        size_t cursize;
+        ullong curhash;
+        if(!hashfile(source.c_str(), cursize, curhash) || cursize != size || curhash != hash)
+        {
+            return false;
+        }
+    }
+    align();
+    return true;
+}
+
+bool modelcachereader::getstring(std::string &s)
+{
+    uint len;
+    if(!get(len) || len > maxnamelen || len > data.size() - pos)
+    {
+        return false;
+    }
+    s.assign(reinterpret_cast<const char *>(data.data() + pos), len);
+    pos += len;
+    return true;
+}
+
+bool modelcachereader::done() const
+{
+    return pos == data.size();
+}
+
+bool modelcachereader::getbytes(void *out, size_t len)
+{
+    if(len > data.size() - pos)
+    {
+        pos = data.size();
+        return false;
+    }
+    std::memcpy(out, data.data() + pos, len);
+    pos += len;
+    return true;
+}
+
+bool modelcachereader::skip(size_t len)
+{
+    if(len > data.size() - pos)
+    {
+        pos = data.size();
+        return false;
+    }
+    pos += len;
+    return true;
+}
+
+void modelcachereader::align()
+{
+    pos = std::min((pos + modelcachealign - 1) & ~(modelcachealign - 1), data.size());
+}
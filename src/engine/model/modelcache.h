@@ -0,0 +1,199 @@
+#ifndef MODELCACHE_H_
+#define MODELCACHE_H_
+
+extern int modelcache;
+
+/**
+ * @brief Returns the name of the cache file for a model file.
+ *
+ * Cache files are kept under `cache/models/` with the model file's relative
+ * path and a `.pmc` extension; like other written files, they are placed in
+ * the home directory if one is set.
+ *
+ * @param name the name of the model file the cache is for
+ *
+ * @return the name of the cache file
+ */
+extern std::string modelcachename(std::string_view name);
+
+/**
+ * @brief Writes a model cache file.
+ *
+ * A model cache file stores processed model data, so that later loads of the
+ * same model can skip parsing and processing its source files. The file starts
+ * with a header holding a magic number, the cache version, a format number
+ * chosen by the caller, and the size and FNV-1a hash of each source file. It is
+ * followed by the caller's records, in the order they were put.
+ *
+ * Arrays are aligned to 16 bytes from the start of the file, so that they can
+ * be used in place once the file is in memory. Records must only contain
+ * trivially copyable types, and are stored in the host's byte order; the
+ * format number should change with the layout of the types stored.
+ */
+class modelcachewriter final
+{
+    public:
+        modelcachewriter(uint format);
+
+        /**
+         * @brief Adds a file to the list of sources the cache depends on.
+         *
+         * @param name the name of the file, as passed to openfile()
+         *
+         * @return true if the file was read and hashed, false otherwise
+         */
+        bool addsource(const std::string &name);
+
+        template<class T>
+        void put(const T &val)
+        {
+            putbytes(&val, sizeof(T));
+        }
+
+        template<class T>
+        void putarray(const T *vals, size_t num)
+        {
+            put<uint>(num);
+            align();
+            putbytes(vals, num*sizeof(T));
+        }
+
+        void putstring(std::string_view s);
+
+        /**
+         * @brief Writes the header and records to a file.
+         *
+         * The file is written under a temporary name and then renamed, so that
+         * a failed write does not leave a truncated cache behind.
+         *
+         * @param name the name of the cache file
+         *
+         * @return true if the file was written, false otherwise
+         */
+        bool save(const std::string &name) const;
+
+    private:
+        struct source final
+        {
+            std::string name;
+            size_t size;
+            ullong hash;
+        };
+        uint format;
+        std::vector<source> sources;
+        std::vector<uchar> records;
+
+        void putbytes(const void *data, size_t len);
+        void align(); //pads records to the next 16 byte boundary
+};
+
+/**
+ * @brief Reads a model cache file written by modelcachewriter.
+ *
+ * The whole file is read into memory by load(); the get functions then copy
+ * records out of it in the order they were put. All of them return false,
+ * leaving the reader at the end of the file, if a record would run past it.
+ */
+class modelcachereader final
+{
+    public:
+        modelcachereader();
+
+        /**
+         * @brief Loads a cache file, checking that it is still valid.
+         *
+         * @param name the name of the cache file
+         * @param format the format number the cache was written with
+         *
+         * @return true if the file exists, has the current version and the
+         *         given format, and all of its sources have the recorded size
+         *         and hash; false otherwise
+         */
+        bool load(const std::string &name, uint format);
+
+        template<class T>
+        bool get(T &val)
+        {
+            return getbytes(&val, sizeof(T));
+        }
+
+        /**
+         * @brief Reads an array into a heap-allocated array.
+         *
+         * @param vals set to a new[] array holding the values, or nullptr if
+         *        there are none
+         * @param num set to the number of values read
+         * @param maxnum the largest number of values to accept
+         *
+         * @return true if the array was read, false otherwise
+         */
+        template<class T>
+        bool getarray(T *&vals, size_t &num, size_t maxnum)
+        {
+            const T *data = getarraydata<T>(num, maxnum);
+            if(!data)
+            {
+                return false;
+            }
+            vals = nullptr;
+            if(num)
+            {
+                vals = new T[num];
+                std::memcpy(vals, data, num*sizeof(T));
+            }
+            return true;
+        }
+
+        template<class T>
+        bool getarray(std::vector<T> &vals, size_t maxnum)
+        {
+            size_t num;
+            const T *data = getarraydata<T>(num, maxnum);
+            if(!data)
+            {
+                return false;
+            }
+            vals.resize(num);
+            if(num)
+            {
+                std::memcpy(vals.data(), data, num*sizeof(T));
+            }
+            return true;
+        }
+
+        bool getstring(std::string &s);
+
+        /**
+         * @brief Returns whether all of the file's records have been read.
+         */
+        bool done() const;
+
+    private:
+        std::vector<uchar> data;
+        size_t pos;
+
+        bool getbytes(void *out, size_t len);
+        bool skip(size_t len);
+        void align();
+
+        //returns a pointer into data, which is non-null (but may be at the end of data) on success
+        template<class T>
+        const T *getarraydata(size_t &num, size_t maxnum)
+        {
+            uint len;
+            if(!get(len) || len > maxnum)
+            {
+                return nullptr;
+            }
+            align();
+            size_t start = pos;
+            if(!skip(static_cast<size_t>(len)*sizeof(T)))
+            {
+                return nullptr;
+            }
+            num = len;
+            return reinterpret_cast<const T *>(data.data() + start);
+        }
+};
+
+#endif
@@ -15,11 +15,17 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
+#include "../../shared/threadpool.h"
 
 #include <optional>
 #include <memory>
 #include <format>
 
+#if defined(__x86_64__) || defined(_M_X64)
+    #define SKELMODEL_SSE 1
+    #include <immintrin.h>
+#endif
+
 #include "interface/console.h"
 #include "interface/control.h"
 #include "interface/cs.h"
@@ -38,9 +44,98 @@
 #include "model.h"
 #include "ragdoll.h"
 #include "animmodel.h"
+#include "modelcache.h"
 #include "skelmodel.h"
 
 static VAR(maxskelanimdata, 1, 192, 0); //sets maximum number of gpu bones
+static VAR(maxskelcache, 1, 64, 4096);   //poses kept per skeleton for later frames; more are kept if all are used in one frame
+
+namespace
+{
+    //model cache format for skeletal mesh groups; changes with the layout of the types cached as raw bytes
+    constexpr uint skelcacheformat = sizeof(skelmodel::vert) | sizeof(skelmodel::tri)<<8 | sizeof(skelmodel::blendcombo)<<16 | sizeof(dualquat)<<24;
+    //model cache format for skeletal animations
+    constexpr uint skelanimcacheformat = sizeof(dualquat) | sizeof(skeladjustment)<<8;
+
+    //a pose left by checkskelcache() for skeleton::flushposes() to evaluate
+    struct posejob final
+    {
+        skelmodel::skeleton *skel;
+        size_t entry; //index in skel->skelcache
+        vec axis, forward;
+    };
+
+    std::vector<posejob> posejobs;
+    bool queueingposes = false;
+
+    //space for skeleton::posebones() to work in, one per thread so that poses can be evaluated on several threads at once
+    struct posescratch final
+    {
+        std::vector<dualquat> pitchposes; //pose of each of the skeleton's pitchdeps
+        std::vector<float> pitchangles,   //angle of each of the skeleton's pitchcorrects
+                           pitchtotals;   //angle of each pitchcorrect plus those of its parents
+    };
+
+    thread_local posescratch scratch;
+
+    skelmodel::skeleton::posecachestats posestats = {0, 0, 0, 0, 0};
+
+    void hashcombine(size_t &h, size_t v)
+    {
+        h ^= v + 0x9e3779b9 + (h<<6) + (h>>2);
+    }
+
+    void hashanimpos(size_t &h, const animmodel::AnimPos &p)
+    {
+        hashcombine(h, std::hash<int>()(p.fr1));
+        hashcombine(h, std::hash<int>()(p.fr2));
+        //t is ignored by AnimPos::operator== when both frames are the same
+        hashcombine(h, std::hash<float>()(p.fr1 == p.fr2 ? 0 : p.t));
+    }
+
+    //hash of the fields compared by skeleton::checkskelcache(), consistent with AnimState::operator==;
+    //the partmask is compared by value, so it is left out rather than hashing each bone
+    size_t hashpose(const animmodel::AnimState *as, int numanimparts, float pitch, const ragdolldata *rdata)
+    {
+        size_t h = std::hash<float>()(pitch);
+        hashcombine(h, std::hash<const ragdolldata *>()(rdata));
+        for(int i = 0; i < numanimparts; ++i)
+        {
+            hashanimpos(h, as[i].cur);
+            if(as[i].interp < 1)
+            {
+                hashcombine(h, std::hash<float>()(as[i].interp));
+                hashanimpos(h, as[i].prev);
+            }
+            else
+            {
+                hashcombine(h, 1);
+            }
+        }
+        return h;
+    }
+
+#ifdef SKELMODEL_SSE
+    //dot product of two quaternions, in every lane
+    __m128 dotquat(__m128 a, __m128 b)
+    {
+        __m128 m = _mm_mul_ps(a, b);
+        m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+    }
+
+    //as dualquat::accumulate(): adds d times k, negated if d's real part faces away from real
+    void accumulatedualquat(__m128 &real, __m128 &dual, const dualquat &d, float k)
+    {
+        __m128 dreal = _mm_loadu_ps(d.real.data()),
+               ddual = _mm_loadu_ps(d.dual.data()),
+               flip = _mm_and_ps(_mm_cmplt_ps(dotquat(real, dreal), _mm_setzero_ps()), _mm_set1_ps(-0.0f)),
+               scale = _mm_xor_ps(_mm_set1_ps(k), flip);
+        real = _mm_add_ps(real, _mm_mul_ps(dreal, scale));
+        dual = _mm_add_ps(dual, _mm_mul_ps(ddual, scale));
+    }
+#endif
+}
 
 //animcacheentry child classes
 
@@ -58,7 +153,7 @@ void skelmodel::skelcacheentry::nextversion()
     version = Shader::uniformlocversion();
 }
 
-skelmodel::skelcacheentry::skelcacheentry() : bdata(nullptr), version(-1)
+skelmodel::skelcacheentry::skelcacheentry() : bdata(nullptr), version(-1), pending(false)
 {
 }
 
@@ -96,11 +191,11 @@ bool skelmodel::animcacheentry::operator!=(const animcacheentry &c) const
 
 skelmodel::skeleton::pitchcorrect::pitchcorrect(int bone, size_t target, float pitchscale, float pitchmin, float pitchmax) :
     bone(bone), parent (-1), target(target), pitchmin(pitchmin), pitchmax(pitchmax),
-    pitchscale(pitchscale), pitchangle(0), pitchtotal(0)
+    pitchscale(pitchscale)
 {
 }
 
-skelmodel::skeleton::pitchcorrect::pitchcorrect() : parent(-1), pitchangle(0), pitchtotal(0)
+skelmodel::skeleton::pitchcorrect::pitchcorrect() : parent(-1)
 {
 }
 
@@ -135,6 +230,8 @@ skelmodel::skeleton::skeleton(skelmeshgroup * const group) :
     ragdoll(nullptr),
     owner(group),
     numinterpbones(0),
+    skelcachemru(-1),
+    skelcachelru(-1),
     bones(nullptr)
 {
 }
@@ -577,35 +674,32 @@ float skelmodel::skeleton::calcdeviation(const vec &axis, const vec &forward, co
     return atan2f(dy, dx)*RAD;
 }
 
-void skelmodel::skeleton::calcpitchcorrects(float pitch, const vec &axis, const vec &forward)
+void skelmodel::skeleton::calcpitchcorrects(float pitch, const vec &axis, const vec &forward, const dualquat *pitchposes, float *pitchangles, float *pitchtotals) const
 {
-    for(pitchtarget &t : pitchtargets)
+    for(size_t i = 0; i < pitchcorrects.size(); ++i)
     {
-        t.deviated = calcdeviation(axis, forward, t.pose, pitchdeps[t.deps].pose);
-    }
-    for(pitchcorrect &c : pitchcorrects)
-    {
-        c.pitchangle = c.pitchtotal = 0;
+        pitchangles[i] = pitchtotals[i] = 0;
     }
     for(size_t j = 0; j < pitchtargets.size(); j++)
     {
         const pitchtarget &t = pitchtargets[j];
-        float tpitch = pitch - t.deviated;
+        float tpitch = pitch - calcdeviation(axis, forward, t.pose, pitchposes[t.deps]);
         for(int parent = t.corrects; parent >= 0; parent = pitchcorrects[parent].parent)
         {
-            tpitch -= pitchcorrects[parent].pitchangle;
+            tpitch -= pitchangles[parent];
         }
         if(t.pitchmin || t.pitchmax)
         {
             tpitch = std::clamp(tpitch, t.pitchmin, t.pitchmax);
         }
-        for(pitchcorrect& c : pitchcorrects)
+        for(size_t i = 0; i < pitchcorrects.size(); ++i)
         {
+            const pitchcorrect &c = pitchcorrects[i];
             if(c.target != j)
             {
                 continue;
             }
-            float total = c.parent >= 0 ? pitchcorrects[c.parent].pitchtotal : 0,
+            float total = c.parent >= 0 ? pitchtotals[c.parent] : 0,
                   avail = tpitch - total,
                   used = tpitch*c.pitchscale;
             if(c.pitchmin || c.pitchmax)
@@ -627,8 +721,8 @@ void skelmodel::skeleton::calcpitchcorrects(float pitch, const vec &axis, const
             {
                 used = std::clamp(avail, 0.0f, used);
             }
-            c.pitchangle = used;
-            c.pitchtotal = used + total;
+            pitchangles[i] = used;
+            pitchtotals[i] = used + total;
         }
     }
 }
@@ -639,6 +733,21 @@ dualquat skelmodel::skeleton::interpbone(int bone, const std::array<framedata, m
     const AnimState &s = as[partmask[bone]];
     const framedata &f = partframes[partmask[bone]];
     dualquat d;
+#ifdef SKELMODEL_SSE
+    //the real and dual parts each fit in one register, so the blend and normalization are done four floats at a time
+    __m128 k = _mm_set1_ps((1-s.cur.t)*s.interp),
+           real = _mm_mul_ps(_mm_loadu_ps(f.fr1[bone].real.data()), k),
+           dual = _mm_mul_ps(_mm_loadu_ps(f.fr1[bone].dual.data()), k);
+    accumulatedualquat(real, dual, f.fr2[bone], s.cur.t*s.interp);
+    if(s.interp<1)
+    {
+        accumulatedualquat(real, dual, f.pfr1[bone], (1-s.prev.t)*(1-s.interp));
+        accumulatedualquat(real, dual, f.pfr2[bone], s.prev.t*(1-s.interp));
+    }
+    __m128 invlen = _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(dotquat(real, real)));
+    _mm_storeu_ps(d.real.data(), _mm_mul_ps(real, invlen));
+    _mm_storeu_ps(d.dual.data(), _mm_mul_ps(dual, invlen));
+#else
     (d = f.fr1[bone]).mul((1-s.cur.t)*s.interp);
     d.accumulate(f.fr2[bone], s.cur.t*s.interp);
     if(s.interp<1)
@@ -646,16 +755,23 @@ dualquat skelmodel::skeleton::interpbone(int bone, const std::array<framedata, m
         d.accumulate(f.pfr1[bone], (1-s.prev.t)*(1-s.interp));
         d.accumulate(f.pfr2[bone], s.prev.t*(1-s.interp));
     }
+    d.normalize();
+#endif
     return d;
 }
 
-void skelmodel::skeleton::interpbones(const AnimState *as, float pitch, const vec &axis, const vec &forward, int numanimparts, const uchar *partmask, skelcacheentry &sc)
+void skelmodel::skeleton::interpbones(const AnimState *as, float pitch, const vec &axis, const vec &forward, int numanimparts, const uchar *partmask, skelcacheentry &sc) const
 {
     if(!sc.bdata)
     {
         sc.bdata = new dualquat[numinterpbones];
     }
     sc.nextversion();
+    posebones(as, pitch, axis, forward, numanimparts, partmask, sc.bdata);
+}
+
+void skelmodel::skeleton::posebones(const AnimState *as, float pitch, const vec &axis, const vec &forward, int numanimparts, const uchar *partmask, dualquat *bdata) const
+{
     std::array<framedata, maxanimparts> partframes;
     for(int i = 0; i < numanimparts; ++i)
     {
@@ -667,34 +783,37 @@ void skelmodel::skeleton::interpbones(const AnimState *as, float pitch, const ve
             partframes[i].pfr2 = &framebones[as[i].prev.fr2*numbones];
         }
     }
-    for(pitchdep &p : pitchdeps)
+    std::vector<dualquat> &pitchposes = scratch.pitchposes;
+    pitchposes.resize(pitchdeps.size());
+    for(size_t i = 0; i < pitchdeps.size(); ++i)
     {
+        const pitchdep &p = pitchdeps[i];
         dualquat d = interpbone(p.bone, partframes, as, partmask);
-        d.normalize();
         if(p.parent >= 0)
         {
-            p.pose.mul(pitchdeps[p.parent].pose, d);
+            pitchposes[i].mul(pitchposes[p.parent], d);
         }
         else
         {
-            p.pose = d;
+            pitchposes[i] = d;
         }
     }
-    calcpitchcorrects(pitch, axis, forward);
+    scratch.pitchangles.resize(pitchcorrects.size());
+    scratch.pitchtotals.resize(pitchcorrects.size());
+    calcpitchcorrects(pitch, axis, forward, pitchposes.data(), scratch.pitchangles.data(), scratch.pitchtotals.data());
     for(size_t i = 0; i < numbones; ++i)
     {
         if(bones[i].interpindex>=0)
         {
             dualquat d = interpbone(i, partframes, as, partmask);
-            d.normalize();
             const BoneInfo &b = bones[i];
             if(b.interpparent<0)
             {
-                sc.bdata[b.interpindex] = d;
+                bdata[b.interpindex] = d;
             }
             else
             {
-                sc.bdata[b.interpindex].mul(sc.bdata[b.interpparent], d);
+                bdata[b.interpindex].mul(bdata[b.interpparent], d);
             }
             float angle;
             if(b.pitchscale)
@@ -707,7 +826,7 @@ void skelmodel::skeleton::interpbones(const AnimState *as, float pitch, const ve
             }
             else if(b.correctindex >= 0)
             {
-                angle = pitchcorrects[b.correctindex].pitchangle;
+                angle = scratch.pitchangles[b.correctindex];
             }
             else
             {
@@ -717,12 +836,12 @@ void skelmodel::skeleton::interpbones(const AnimState *as, float pitch, const ve
             {
                 angle *= (as->cur.anim & Anim_NoPitch ? 0 : as->interp) + (as->interp < 1 && as->prev.anim & Anim_NoPitch ? 0 : 1 - as->interp);
             }
-            sc.bdata[b.interpindex].mulorient(quat(axis, angle/RAD), b.base);
+            bdata[b.interpindex].mulorient(quat(axis, angle/RAD), b.base);
         }
     }
     for(const antipode &i : antipodes)
     {
-        sc.bdata[i.child].fixantipodal(sc.bdata[i.parent]);
+        bdata[i.child].fixantipodal(bdata[i.parent]);
     }
 }
 
@@ -845,6 +964,10 @@ void skelmodel::skeleton::cleanup(bool full)
         sc.bdata = nullptr;
     }
     skelcache.clear();
+    skelcacheslots.clear();
+    skelcachelookup.clear();
+    skelcachemru = skelcachelru = -1;
+    posejobs.erase(std::remove_if(posejobs.begin(), posejobs.end(), [this] (const posejob &job) { return job.skel == this; }), posejobs.end());
     blendoffsets.clear();
     if(full)
     {
@@ -852,40 +975,118 @@ void skelmodel::skeleton::cleanup(bool full)
     }
 }
 
-const skelmodel::skelcacheentry &skelmodel::skeleton::checkskelcache(const vec &pos, float scale,  const AnimState *as, float pitch, const vec &axis, const vec &forward, const ragdolldata * const rdata)
+void skelmodel::skeleton::unlinkskelcache(int i)
+{
+    skelcacheslot &slot = skelcacheslots[i];
+    if(slot.prev >= 0)
+    {
+        skelcacheslots[slot.prev].next = slot.next;
+    }
+    else
+    {
+        skelcachemru = slot.next;
+    }
+    if(slot.next >= 0)
+    {
+        skelcacheslots[slot.next].prev = slot.prev;
+    }
+    else
+    {
+        skelcachelru = slot.prev;
+    }
+    slot.prev = slot.next = -1;
+}
+
+void skelmodel::skeleton::linkskelcache(int i)
 {
+    skelcacheslot &slot = skelcacheslots[i];
+    slot.prev = -1;
+    slot.next = skelcachemru;
+    if(skelcachemru >= 0)
+    {
+        skelcacheslots[skelcachemru].prev = i;
+    }
+    else
+    {
+        skelcachelru = i;
+    }
+    skelcachemru = i;
+}
+
+const skelmodel::skelcacheentry &skelmodel::skeleton::checkskelcache(const vec &pos, float scale,  const AnimState *as, float pitch, const vec &axis, const vec &forward, const ragdolldata * const rdata, bool defer)
+{
+    defer = defer && queueingposes;
     const int numanimparts = as->owner->numanimparts;
     const std::vector<uchar> &partmask = (reinterpret_cast<const skelpart *>(as->owner))->partmask;
-    skelcacheentry *sc = nullptr;
+    const size_t hash = hashpose(as, numanimparts, pitch, rdata);
+    posestats.lookups++;
+    int index = -1;
     bool match = false;
-    for(skelcacheentry &c : skelcache)
+    auto range = skelcachelookup.equal_range(hash);
+    for(auto itr = range.first; itr != range.second; ++itr)
     {
-        for(int j = 0; j < numanimparts; ++j)
+        const skelcacheentry &c = skelcache[(*itr).second];
+        bool same = c.pitch == pitch && c.ragdoll == rdata && *c.partmask == partmask;
+        for(int j = 0; same && j < numanimparts; ++j)
+        {
+            same = c.as[j] == as[j];
+        }
+        if(same)
         {
-            if(c.as[j]!=as[j])
+            index = (*itr).second;
+            //ragdolls which have moved since are regenerated in place
+            match = !rdata || c.millis >= rdata->lastmove;
+            break;
+        }
+    }
+    if(index < 0)
+    {
+        //replace the least recently used entry, unless it (and so every entry) was used this frame
+        if(skelcachelru >= 0 && static_cast<int>(skelcache.size()) >= maxskelcache && skelcache[skelcachelru].millis < lastmillis)
+        {
+            index = skelcachelru;
+            auto old = skelcachelookup.equal_range(skelcacheslots[index].hash);
+            for(auto itr = old.first; itr != old.second; ++itr)
             {
-                goto mismatch;
+                if(static_cast<int>((*itr).second) == index)
+                {
+                    skelcachelookup.erase(itr);
+                    break;
+                }
             }
+            posestats.evicted++;
         }
-        if(c.pitch != pitch || *c.partmask != partmask || c.ragdoll != rdata || (rdata && c.millis < rdata->lastmove))
+        else
         {
-            goto mismatch;
+            index = skelcache.size();
+            skelcache.emplace_back(skelcacheentry());
+            skelcacheslots.push_back({0, -1, -1});
+            linkskelcache(index);
         }
-        match = true;
-        sc = &c;
-        break;
-    mismatch:
-        if(c.millis < lastmillis)
+        skelcacheslots[index].hash = hash;
+        skelcachelookup.emplace(hash, index);
+    }
+    if(match)
+    {
+        if(skelcache[index].millis == lastmillis)
         {
-            sc = &c;
-            break;
+            posestats.shared++;
+        }
+        else
+        {
+            posestats.reused++;
         }
     }
-    if(!sc)
+    else
     {
-        skelcache.emplace_back(skelcacheentry());
-        sc = &skelcache.back();
+        posestats.evaluated++;
     }
+    if(skelcachemru != index)
+    {
+        unlinkskelcache(index);
+        linkskelcache(index);
+    }
+    skelcacheentry *sc = &skelcache[index];
     if(!match)
     {
         for(int i = 0; i < numanimparts; ++i)
@@ -895,19 +1096,63 @@ const skelmodel::skelcacheentry &skelmodel::skeleton::checkskelcache(const vec &
         sc->pitch = pitch;
         sc->partmask = &partmask;
         sc->ragdoll = rdata;
+        sc->pending = false;
         if(rdata)
         {
             genragdollbones(*rdata, *sc, pos, scale);
         }
+        else if(defer)
+        {
+            if(!sc->bdata)
+            {
+                sc->bdata = new dualquat[numinterpbones];
+            }
+            sc->nextversion();
+            sc->pending = true;
+            posejobs.push_back({this, static_cast<size_t>(sc - skelcache.data()), axis, forward});
+        }
         else
         {
             interpbones(as, pitch, axis, forward, numanimparts, partmask.data(), *sc);
         }
     }
+    else if(sc->pending && !defer)
+    {
+        //queued earlier this frame, but needed now
+        posebones(sc->as.data(), pitch, axis, forward, numanimparts, partmask.data(), sc->bdata);
+        sc->pending = false;
+    }
     sc->millis = lastmillis;
     return *sc;
 }
 
+skelmodel::skeleton::posecachestats skelmodel::skeleton::getposecachestats()
+{
+    return posestats;
+}
+
+void skelmodel::skeleton::queueposes()
+{
+    queueingposes = true;
+}
+
+void skelmodel::skeleton::flushposes()
+{
+    queueingposes = false;
+    parallelfor(posejobs.size(), [] (size_t i)
+    {
+        const posejob &job = posejobs[i];
+        skelcacheentry &sc = job.skel->skelcache[job.entry];
+        if(!sc.pending)
+        {
+            return;
+        }
+        job.skel->posebones(sc.as.data(), sc.pitch, job.axis, job.forward, sc.as[0].owner->numanimparts, sc.partmask->data(), sc.bdata);
+        sc.pending = false;
+    });
+    posejobs.clear();
+}
+
 GLint skelmodel::skeleton::getblendoffset(const UniformLoc &u)
 {
     std::unordered_map<GLuint, GLint>::iterator itr = blendoffsets.find(Shader::lastshader->program);
@@ -1026,6 +1271,42 @@ void skelmodel::skeleton::createbones(size_t num)
     bones = new BoneInfo[numbones];
 }
 
+void skelmodel::skeleton::writecache(modelcachewriter &f) const
+{
+    f.put<uint>(numbones);
+    for(size_t i = 0; i < numbones; ++i)
+    {
+        const BoneInfo &b = bones[i];
+        f.putstring(b.name);
+        f.put<int>(b.parent);
+        f.put(b.base);
+    }
+}
+
+bool skelmodel::skeleton::readcache(modelcachereader &f)
+{
+    uint num;
+    if(numbones || !f.get(num) || num > Bonemask_Bone)
+    {
+        return false;
+    }
+    std::vector<BoneInfo> cached(num);
+    for(BoneInfo &b : cached)
+    {
+        if(!f.getstring(b.name) || !f.get(b.parent) || !f.get(b.base) || b.parent < -1 || b.parent >= static_cast<int>(num))
+        {
+            return false;
+        }
+    }
+    if(num)
+    {
+        createbones(num);
+        std::move(cached.begin(), cached.end(), bones);
+        linkchildren();
+    }
+    return true;
+}
+
 ragdollskel *skelmodel::skeleton::trycreateragdoll()
 {
     if(!ragdoll)
@@ -1174,7 +1455,13 @@ void skelmodel::skelmeshgroup::render(const AnimState *as, float pitch, const ve
 
     const vec ploc = vec(p->model->locationsize().x, p->model->locationsize().y, p->model->locationsize().z);
 
-    const skelcacheentry &sc = skel->checkskelcache(ploc, p->model->locationsize().w, as, pitch, axis, forward, !d || !d->ragdoll || d->ragdoll->skel != skel->ragdoll || d->ragdoll->millis == lastmillis ? nullptr : d->ragdoll);
+    //parts linked to this one are placed using its tags, so need its pose right away
+    bool defer = std::find_if(p->links.begin(), p->links.end(), [] (const part::linkedpart &l) { return l.p != nullptr; }) == p->links.end();
+    const skelcacheentry &sc = skel->checkskelcache(ploc, p->model->locationsize().w, as, pitch, axis, forward, !d || !d->ragdoll || d->ragdoll->skel != skel->ragdoll || d->ragdoll->millis == lastmillis ? nullptr : d->ragdoll, defer);
+    if(sc.pending)
+    {
+        return; //tags and ragdolls are set up when the model is rendered, after the pose has been evaluated
+    }
     if(!(as->cur.anim & Anim_NoRender))
     {
         int owner = &sc-&skel->skelcache[0];
@@ -1620,6 +1907,47 @@ void skelmodel::skelmesh::remapverts(const std::vector<int> remap)
     }
 }
 
+void skelmodel::skelmesh::writecache(modelcachewriter &f) const
+{
+    f.putstring(name);
+    f.put<int>(maxweights);
+    f.putarray(verts, numverts);
+    f.putarray(tris, numtris);
+}
+
+skelmodel::skelmesh *skelmodel::skelmesh::readcache(modelcachereader &f, meshgroup *m)
+{
+    std::string name;
+    int maxweights;
+    if(!f.getstring(name) || !f.get(maxweights))
+    {
+        return nullptr;
+    }
+    vert *verts = nullptr;
+    tri *tris = nullptr;
+    size_t numverts, numtris;
+    if(!f.getarray(verts, numverts, INT_MAX) || !f.getarray(tris, numtris, INT_MAX))
+    {
+        delete[] verts;
+        return nullptr;
+    }
+    for(size_t i = 0; i < numtris; ++i)
+    {
+        for(uint j : tris[i].vert)
+        {
+            if(j >= numverts)
+            {
+                delete[] verts;
+                delete[] tris;
+                return nullptr;
+            }
+        }
+    }
+    skelmesh *mesh = new skelmesh(name, verts, numverts, tris, numtris, m);
+    mesh->maxweights = maxweights;
+    return mesh;
+}
+
 int skelmodel::skelmesh::vertcount() const
 {
     return numverts;
@@ -1722,6 +2050,196 @@ void skelmodel::skelmeshgroup::sortblendcombos()
     }
 }
 
+bool skelmodel::skelmeshgroup::savecache(float smooth, const part &p) const
+{
+    if(!modelcache)
+    {
+        return false;
+    }
+    modelcachewriter f(skelcacheformat);
+    if(sources.empty())
+    {
+        if(!f.addsource(name))
+        {
+            return false;
+        }
+    }
+    for(const std::string &i : sources)
+    {
+        if(!f.addsource(i))
+        {
+            return false;
+        }
+    }
+    f.put(smooth);
+    skel->writecache(f);
+    f.putarray(blendcombos.data(), blendcombos.size());
+    f.put<uint>(meshes.size());
+    for(const Mesh *i : meshes)
+    {
+        static_cast<const skelmesh *>(i)->writecache(f);
+    }
+    f.put<uint>(p.skins.size());
+    for(const skin &i : p.skins)
+    {
+        f.putstring(i.tex && i.tex != notexture ? i.tex->name : "");
+    }
+    return f.save(modelcachename(name));
+}
+
+bool skelmodel::skelmeshgroup::loadcache(std::string_view meshfile, float smooth, part &p)
+{
+    if(!modelcache)
+    {
+        return false;
+    }
+    modelcachereader f;
+    float cachesmooth;
+    uint nummeshes;
+    if(!f.load(modelcachename(meshfile), skelcacheformat)
+    || !f.get(cachesmooth) || cachesmooth != smooth
+    || !skel->readcache(f)
+    || !f.getarray(blendcombos, INT_MAX)
+    || !f.get(nummeshes))
+    {
+        return false;
+    }
+    name = meshfile;
+    for(uint i = 0; i < nummeshes; ++i)
+    {
+        skelmesh *m = skelmesh::readcache(f, this);
+        if(!m)
+        {
+            return false;
+        }
+        meshes.push_back(m);
+        for(int j = 0; j < m->vertcount(); ++j)
+        {
+            if(static_cast<size_t>(m->getvert(j).blend) >= blendcombos.size())
+            {
+                return false;
+            }
+        }
+    }
+    uint numskins;
+    std::vector<std::string> skintex;
+    if(!f.get(numskins))
+    {
+        return false;
+    }
+    skintex.resize(std::min(numskins, static_cast<uint>(nummeshes)));
+    for(uint i = 0; i < numskins; ++i)
+    {
+        std::string tex;
+        if(!f.getstring(tex))
+        {
+            return false;
+        }
+        if(i < skintex.size())
+        {
+            skintex[i] = tex;
+        }
+    }
+    if(!f.done())
+    {
+        return false;
+    }
+    //as counted by addblendcombo() while the meshes were first loaded
+    numblends.fill(0);
+    for(const blendcombo &c : blendcombos)
+    {
+        if(c.size())
+        {
+            numblends[c.size()-1]++;
+        }
+    }
+    if(skintex.size())
+    {
+        p.initskins(notexture, notexture, skintex.size());
+        for(size_t i = 0; i < skintex.size(); ++i)
+        {
+            if(skintex[i].size())
+            {
+                p.skins[i].tex = textureload(skintex[i].c_str(), 0, true, false);
+            }
+        }
+    }
+    return true;
+}
+
+bool skelmodel::skelmeshgroup::saveanimcache(const skelanimspec &sa, const std::vector<skeladjustment> &adjustments) const
+{
+    if(!modelcache)
+    {
+        return false;
+    }
+    modelcachewriter f(skelanimcacheformat);
+    if(!f.addsource(sa.name))
+    {
+        return false;
+    }
+    //the bone bases the frames are relative to come from the group's files
+    if(sources.empty())
+    {
+        if(!f.addsource(name))
+        {
+            return false;
+        }
+    }
+    for(const std::string &i : sources)
+    {
+        if(!f.addsource(i))
+        {
+            return false;
+        }
+    }
+    f.put<uint>(skel->numbones);
+    f.putarray(reinterpret_cast<const uchar *>(adjustments.data()), adjustments.size()*sizeof(skeladjustment));
+    //frames are flipped to the same hemisphere as the skeleton's first frame, which only exists if an animation came before
+    f.putarray(skel->framebones, sa.frame ? skel->numbones : 0);
+    f.putarray(&skel->framebones[sa.frame*skel->numbones], sa.range*skel->numbones);
+    return f.save(modelcachename(sa.name));
+}
+
+const skelmodel::skelanimspec *skelmodel::skelmeshgroup::loadanimcache(const std::string &filename, const std::vector<skeladjustment> &adjustments)
+{
+    if(!modelcache || !skel->numbones)
+    {
+        return nullptr;
+    }
+    modelcachereader f;
+    uint numbones;
+    std::vector<uchar> cachedadjustments;
+    std::vector<dualquat> firstframe,
+                          frames;
+    if(!f.load(modelcachename(filename), skelanimcacheformat)
+    || !f.get(numbones) || numbones != skel->numbones
+    || !f.getarray(cachedadjustments, adjustments.size()*sizeof(skeladjustment))
+    || cachedadjustments.size() != adjustments.size()*sizeof(skeladjustment)
+    || (cachedadjustments.size() && std::memcmp(cachedadjustments.data(), adjustments.data(), cachedadjustments.size()))
+    || !f.getarray(firstframe, numbones)
+    || firstframe.size() != (skel->numframes ? numbones : 0)
+    || (firstframe.size() && std::memcmp(firstframe.data(), skel->framebones, firstframe.size()*sizeof(dualquat)))
+    || !f.getarray(frames, INT_MAX)
+    || frames.empty() || frames.size()%numbones
+    || !f.done())
+    {
+        return nullptr;
+    }
+    size_t animframes = frames.size()/numbones;
+    dualquat *animbones = new dualquat[(skel->numframes+animframes)*numbones];
+    if(skel->framebones)
+    {
+        std::memcpy(animbones, skel->framebones, skel->numframes*numbones*sizeof(dualquat));
+        delete[] skel->framebones;
+    }
+    std::memcpy(&animbones[skel->numframes*numbones], frames.data(), frames.size()*sizeof(dualquat));
+    skel->framebones = animbones;
+    const skelanimspec &sa = skel->addskelanim(filename, skel->numframes, animframes);
+    skel->numframes += animframes;
+    return &sa;
+}
+
 void skelmodel::skelmeshgroup::blendbones(const skelcacheentry &sc, blendcacheentry &bc) const
 {
     bc.nextversion();
@@ -1871,11 +2389,22 @@ animmodel::meshgroup * skelmodel::loadmeshes(const std::string &name, float smoo
     skelmeshgroup *group = newmeshes();
     group->skel = new skeleton(group);
     part &p = *parts.back();
+    if(group->loadcache(name, smooth, p))
+    {
+        return group;
+    }
+    if(modelcache) //discard anything read from a missing or invalid cache
+    {
+        delete group;
+        group = newmeshes();
+        group->skel = new skeleton(group);
+    }
     if(!group->load(name, smooth, p))
     {
         delete group;
         return nullptr;
     }
+    group->savecache(smooth, p);
     return group;
 }
 
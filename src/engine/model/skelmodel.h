@@ -8,6 +8,10 @@ enum Bonemask
     Bonemask_Bone = 0x7FFF
 };
 
+class modelcachewriter;
+class modelcachereader;
+class skeladjustment;
+
 /* skelmodel: implementation of model object for a skeletally rigged model
  *
  * skelmodel implements most of what is required to render a skeletally rigged
@@ -303,6 +307,7 @@ struct skelmodel : animmodel
     {
         dualquat *bdata; //array of size numinterpbones
         int version; //caching version
+        bool pending; //queued by skeleton::queueposes(), but not yet evaluated by skeleton::flushposes()
 
         skelcacheentry();
         void nextversion();
@@ -368,6 +373,23 @@ struct skelmodel : animmodel
              * @param remap a vector of new indices to assign
              */
             void remapverts(const std::vector<int> remap);
+
+            /**
+             * @brief Writes the mesh's name, verts and tris to a model cache.
+             *
+             * @param f the cache to write to
+             */
+            void writecache(modelcachewriter &f) const;
+
+            /**
+             * @brief Creates a skelmesh from a mesh written by writecache().
+             *
+             * @param f the cache to read from
+             * @param m the meshgroup the new mesh will belong to
+             *
+             * @return a new skelmesh, or nullptr if the cache could not be read
+             */
+            static skelmesh *readcache(modelcachereader &f, meshgroup *m);
             /**
              * @brief Returns the number of verts represented by the object.
              *
@@ -430,7 +452,7 @@ struct skelmodel : animmodel
             {
                 size_t bone; //an index in skeleton::bones
                 int frame, corrects, deps;
-                float pitchmin, pitchmax, deviated;
+                float pitchmin, pitchmax;
                 dualquat pose;
             };
             std::vector<pitchtarget> pitchtargets; //vector of pitch target objects, added to models via pitchtarget command
@@ -439,7 +461,7 @@ struct skelmodel : animmodel
             {
                 int bone, parent;
                 size_t target; //an index in skeleton::pitchtargets vector
-                float pitchmin, pitchmax, pitchscale, pitchangle, pitchtotal;
+                float pitchmin, pitchmax, pitchscale;
 
                 pitchcorrect(int bone, size_t target, float pitchscale, float pitchmin, float pitchmax);
                 pitchcorrect();
@@ -589,9 +611,12 @@ struct skelmodel : animmodel
             /**
              * @brief Gets a skelcacheentry from skeleton::skelcache
              *
-             * Returns the first skelcacheentry matching the specified pitch, partmask (from `as` parent part),
-             * ragdolldata. If no such element exists, creates one and adds it to the back of the skelcache,
-             * modifying the ragdollbones and calling interpbones() to update the model's bones
+             * Returns the skelcacheentry matching the specified pitch, partmask (from `as` parent part),
+             * ragdolldata. Entries are found by a hash of these, so models sharing an animation state share
+             * one pose regardless of how many entries are cached. If no such element exists, the least
+             * recently used entry not used this frame is replaced (once there are `maxskelcache` of them)
+             * or a new one is added to the back of the skelcache, modifying the ragdollbones and calling
+             * interpbones() to update the model's bones
              *
              * @param pos position to set in interpbones() if entry added
              * @param scale scale to add to new skelcache entry if added
@@ -600,13 +625,50 @@ struct skelmodel : animmodel
              * @param axis value to pass to interpbones() if new entry added
              * @param forward value to pass to interpbones() if new entry added
              * @param rdata ragdoll data to check against and conditionally set
+             * @param defer whether the pose may be left for flushposes() to evaluate,
+             *        if called between queueposes() and flushposes()
              *
-             * @return the skelcache entry which was either found or added
+             * @return the skelcache entry which was either found or added; if its
+             *         pending field is set, its bones are not valid until flushposes()
              */
-            const skelcacheentry &checkskelcache(const vec &pos, float scale, const AnimState *as, float pitch, const vec &axis, const vec &forward, const ragdolldata * const rdata);
+            const skelcacheentry &checkskelcache(const vec &pos, float scale, const AnimState *as, float pitch, const vec &axis, const vec &forward, const ragdolldata * const rdata, bool defer = false);
             void setgpubones(const skelcacheentry &sc, const blendcacheentry *bc, int count);
             bool shouldcleanup() const;
 
+            /**
+             * @brief Starts queueing the poses of skeletal models instead of evaluating them.
+             *
+             * Until flushposes() is called, checkskelcache() calls which may defer
+             * their pose add the skelcache entry to a queue rather than calling
+             * interpbones(), so that the poses of every model rendered in a frame
+             * can be evaluated together.
+             */
+            static void queueposes();
+
+            /**
+             * @brief Evaluates the poses queued since queueposes() and stops queueing.
+             *
+             * The poses are split across the worker threads with parallelfor().
+             */
+            static void flushposes();
+
+            /**
+             * @brief Statistics about checkskelcache() lookups, for all skeletons.
+             */
+            struct posecachestats final
+            {
+                size_t lookups,   /// calls to checkskelcache()
+                       shared,    /// lookups finding a pose already used this frame
+                       reused,    /// lookups finding a pose kept from an earlier frame
+                       evaluated, /// lookups which had to evaluate a new pose
+                       evicted;   /// poses replaced to keep skelcache within `maxskelcache`
+            };
+
+            /**
+             * @brief Returns statistics about checkskelcache() lookups since startup.
+             */
+            static posecachestats getposecachestats();
+
             /**
              * @brief Sets the pitch information for the index'th bone in the skeleton's bones
              *
@@ -682,6 +744,25 @@ struct skelmodel : animmodel
              */
             void createbones(size_t num);
 
+            /**
+             * @brief Writes the names, parents and bases of the skeleton's bones to a model cache.
+             *
+             * @param f the cache to write to
+             */
+            void writecache(modelcachewriter &f) const;
+
+            /**
+             * @brief Creates the skeleton's bones from ones written by writecache().
+             *
+             * The skeleton must not have any bones yet. Links the bones' children
+             * as linkchildren() does.
+             *
+             * @param f the cache to read from
+             *
+             * @return true if the bones were read, false otherwise
+             */
+            bool readcache(modelcachereader &f);
+
             /**
              * @brief Creates a ragdoll if none is defined; returns the skeleton's ragdoll
              *
@@ -693,6 +774,19 @@ struct skelmodel : animmodel
             skelmeshgroup * const owner;
             size_t numinterpbones;
 
+            //bookkeeping for checkskelcache(), indexed the same as skelcache
+            struct skelcacheslot final
+            {
+                size_t hash;    //of the entry's animation state
+                int prev, next; //neighbouring entries in the recently used list, or -1
+            };
+            std::vector<skelcacheslot> skelcacheslots;
+            int skelcachemru, skelcachelru; //most and least recently used entries, or -1 if there are none
+            std::unordered_multimap<size_t, size_t> skelcachelookup; //skelcache indices by hash
+
+            void unlinkskelcache(int i);
+            void linkskelcache(int i); //makes i the most recently used entry
+
             struct BoneInfo final
             {
                 std::string name;
@@ -813,6 +907,7 @@ struct skelmodel : animmodel
              * @param count the number of entries from bc to place in
              */
             void setglslbones(UniformLoc &u, const skelcacheentry &sc, const skelcacheentry &bc, int count);
+            //blends the bone's frames for the animation states, and normalizes the result
             dualquat interpbone(int bone, const std::array<framedata, maxanimparts> &partframes, const AnimState *as, const uchar *partmask) const;
             void addpitchdep(int bone, int frame);
             static float calcdeviation(const vec &axis, const vec &forward, const dualquat &pose1, const dualquat &pose2);
@@ -855,8 +950,19 @@ struct skelmodel : animmodel
              * @param val the value to set
              */
             void expandbonemask(uchar *expansion, int bone, int val) const;
-            void calcpitchcorrects(float pitch, const vec &axis, const vec &forward);
-            void interpbones(const AnimState *as, float pitch, const vec &axis, const vec &forward, int numanimparts, const uchar *partmask, skelcacheentry &sc);
+            void calcpitchcorrects(float pitch, const vec &axis, const vec &forward, const dualquat *pitchposes, float *pitchangles, float *pitchtotals) const;
+            void interpbones(const AnimState *as, float pitch, const vec &axis, const vec &forward, int numanimparts, const uchar *partmask, skelcacheentry &sc) const;
+
+            /**
+             * @brief Sets the interpolated bone transformations for a set of animation states.
+             *
+             * Does the work of interpbones() without modifying any shared state,
+             * so that the poses of several models (including several poses of the
+             * same skeleton) may be evaluated on different threads at once.
+             *
+             * @param bdata the array, of size numinterpbones, to set
+             */
+            void posebones(const AnimState *as, float pitch, const vec &axis, const vec &forward, int numanimparts, const uchar *partmask, dualquat *bdata) const;
 
             /**
              * @brief Sets up a skelcacheentry's bone transformations.
@@ -977,6 +1083,69 @@ struct skelmodel : animmodel
 
             virtual bool load(std::string_view meshfile, float smooth, part &p) = 0;
             virtual const skelanimspec *loadanim(const std::string &filename) = 0;
+
+            /**
+             * @brief Writes the group's processed meshes to its model cache file.
+             *
+             * Saves the bones, blendcombos, meshes and skin textures set up by
+             * load(), keyed by the hashes of the files load() read. Does nothing
+             * unless the modelcache variable is set.
+             *
+             * @param smooth the smoothing load() was called with
+             * @param p the part load() was called with
+             *
+             * @return true if the cache file was written, false otherwise
+             */
+            bool savecache(float smooth, const part &p) const;
+
+            /**
+             * @brief Loads the group from its model cache file, in place of load().
+             *
+             * The group must be newly created with an empty skeleton. Fails if
+             * the modelcache variable is not set, or if the cache file is missing,
+             * out of date, or was saved with a different smoothing; the group
+             * may be partly filled after a failure, and should be discarded.
+             *
+             * @param meshfile the mesh file, as passed to load()
+             * @param smooth the smoothing, as passed to load()
+             * @param p the part, as passed to load()
+             *
+             * @return true if the group was loaded, false otherwise
+             */
+            bool loadcache(std::string_view meshfile, float smooth, part &p);
+
+            /**
+             * @brief Writes an animation's frames to its model cache file.
+             *
+             * Saves the frames added by loadanim(), keyed by the hashes of the
+             * animation file and the files the group was loaded from, the bone
+             * adjustments applied to the frames, and the frame that earlier
+             * animations of the skeleton were aligned to. Does nothing unless
+             * the modelcache variable is set.
+             *
+             * @param sa the animation, as returned by loadanim()
+             * @param adjustments the bone adjustments loadanim() applied
+             *
+             * @return true if the cache file was written, false otherwise
+             */
+            bool saveanimcache(const skelanimspec &sa, const std::vector<skeladjustment> &adjustments) const;
+
+            /**
+             * @brief Adds an animation to the skeleton from its model cache file, in place of loadanim().
+             *
+             * Fails if the modelcache variable is not set, or if the cache file
+             * is missing, out of date, or was saved for other bone adjustments
+             * or an earlier animation with a different first frame; the skeleton
+             * is not changed after a failure.
+             *
+             * @param filename the animation file, as passed to loadanim()
+             * @param adjustments the bone adjustments loadanim() would apply
+             *
+             * @return the added animation, or nullptr if it was not loaded
+             */
+            const skelanimspec *loadanimcache(const std::string &filename, const std::vector<skeladjustment> &adjustments);
+        protected:
+            std::vector<std::string> sources; //files read by load() for the model cache, if not just the mesh file
         private:
             std::array<int, 4> numblends;
 
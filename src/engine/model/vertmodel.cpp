@@ -31,8 +31,15 @@
 #include "model.h"
 #include "ragdoll.h"
 #include "animmodel.h"
+#include "modelcache.h"
 #include "vertmodel.h"
 
+namespace
+{
+    //model cache format for vertex mesh groups; changes with the layout of the types cached as raw bytes
+    constexpr uint vertcacheformat = sizeof(vertmodel::vert) | sizeof(vertmodel::tcvert)<<8 | sizeof(vertmodel::tri)<<16;
+}
+
 //==============================================================================
 // vertmodel object
 //==============================================================================
@@ -40,11 +47,21 @@
 vertmodel::meshgroup * vertmodel::loadmeshes(const char *name, float smooth)
 {
     vertmeshgroup *group = newmeshes();
+    if(group->loadcache(name, smooth))
+    {
+        return group;
+    }
+    if(modelcache) //discard anything read from a missing or invalid cache
+    {
+        delete group;
+        group = newmeshes();
+    }
     if(!group->load(name, smooth))
     {
         delete group;
         return nullptr;
     }
+    group->savecache(smooth);
     return group;
 }
 
@@ -208,6 +225,81 @@ vertmodel::vertmeshgroup::~vertmeshgroup()
     delete[] vdata;
 }
 
+bool vertmodel::vertmeshgroup::savecache(float smooth) const
+{
+    if(!modelcache)
+    {
+        return false;
+    }
+    modelcachewriter f(vertcacheformat);
+    if(!f.addsource(name))
+    {
+        return false;
+    }
+    f.put(smooth);
+    f.put<int>(numframes);
+    f.put<uint>(meshes.size());
+    for(const Mesh *i : meshes)
+    {
+        const vertmesh &m = *static_cast<const vertmesh *>(i);
+        f.putstring(m.name);
+        f.putarray(m.verts, m.numverts*numframes);
+        f.putarray(m.tcverts, m.numverts);
+        f.putarray(m.tris, m.numtris);
+    }
+    return f.save(modelcachename(name));
+}
+
+bool vertmodel::vertmeshgroup::loadcache(std::string_view meshfile, float smooth)
+{
+    if(!modelcache)
+    {
+        return false;
+    }
+    modelcachereader f;
+    float cachesmooth;
+    uint nummeshes;
+    if(!f.load(modelcachename(meshfile), vertcacheformat)
+    || !f.get(cachesmooth) || cachesmooth != smooth
+    || !f.get(numframes) || numframes < 1
+    || !f.get(nummeshes))
+    {
+        return false;
+    }
+    name = meshfile;
+    for(uint i = 0; i < nummeshes; ++i)
+    {
+        std::string meshname;
+        if(!f.getstring(meshname))
+        {
+            return false;
+        }
+        vertmesh *m = new vertmesh(meshname, this);
+        meshes.push_back(m);
+        size_t numverts, numtcverts, numtris;
+        //vertices are stored for every frame, texture coordinates once
+        if(!f.getarray(m->verts, numverts, INT_MAX) || numverts%static_cast<size_t>(numframes)
+        || !f.getarray(m->tcverts, numtcverts, INT_MAX) || numtcverts != numverts/static_cast<size_t>(numframes)
+        || !f.getarray(m->tris, numtris, INT_MAX))
+        {
+            return false;
+        }
+        m->numverts = numtcverts;
+        m->numtris = numtris;
+        for(size_t j = 0; j < numtris; ++j)
+        {
+            for(uint k : m->tris[j].vert)
+            {
+                if(k >= numtcverts)
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return f.done();
+}
+
 void vertmodel::vertmeshgroup::concattagtransform(int, const matrix4x3 &, matrix4x3 &) const
 {
 }
@@ -255,6 +255,35 @@ class vertmodel : public animmodel
             void render(const AnimState *as, float, const vec &, const vec &, dynent *, part *p) final;
 
             virtual bool load(const char *name, float smooth) = 0;
+
+            /**
+             * @brief Writes the group's processed meshes to its model cache file.
+             *
+             * Saves the vertices, with their normals and tangents, and the
+             * triangles of each mesh set up by load(), keyed by the hash of the
+             * file load() read. Does nothing unless the modelcache variable is
+             * set.
+             *
+             * @param smooth the smoothing load() was called with
+             *
+             * @return true if the cache file was written, false otherwise
+             */
+            bool savecache(float smooth) const;
+
+            /**
+             * @brief Loads the group from its model cache file, in place of load().
+             *
+             * The group must be newly created. Fails if the modelcache variable
+             * is not set, or if the cache file is missing, out of date, or was
+             * saved with a different smoothing; the group may be partly filled
+             * after a failure, and should be discarded.
+             *
+             * @param meshfile the mesh file, as passed to load()
+             * @param smooth the smoothing, as passed to load()
+             *
+             * @return true if the group was loaded, false otherwise
+             */
+            bool loadcache(std::string_view meshfile, float smooth);
         };
 
         virtual vertmeshgroup *newmeshes() = 0;
@@ -763,7 +763,7 @@ bool ImageData::matchstring(std::string_view s, size_t len, std::string_view d)
     return len == d.size() && !std::memcmp(s.data(), d.data(), d.size());
 }
 
-bool ImageData::texturedata(const char *tname, bool msg, int * const compress, int * const wrap, const char *tdir, int ttype)
+bool ImageData::texturedata(const char *tname, bool msg, int * const compress, int * const wrap, const char *tdir, int ttype, SDL_Surface *surface)
 {
     auto parsetexcommands = [] (const char *&cmds, const char *&cmd, size_t &len, std::array<const char *, 4> &arg)
     {
@@ -799,6 +799,10 @@ bool ImageData::texturedata(const char *tname, bool msg, int * const compress, i
         file = std::strrchr(tname, '>');
         if(!file)
         {
+            if(surface)
+            {
+                SDL_FreeSurface(surface);
+            }
             if(msg)
             {
                 conoutf(Console_Error, "could not load <> modified texture %s", tname);
@@ -826,6 +830,11 @@ bool ImageData::texturedata(const char *tname, bool msg, int * const compress, i
 
         if(matchstring(cmd, len, "stub"))
         {
+            if(surface)
+            {
+                SDL_FreeSurface(surface);
+                return true;
+            }
             return canloadsurface(file);
         }
     }
@@ -835,7 +844,7 @@ bool ImageData::texturedata(const char *tname, bool msg, int * const compress, i
     }
     if(!data)
     {
-        SDL_Surface *s = loadsurface(file);
+        SDL_Surface *s = surface ? surface : loadsurface(file);
         if(!s)
         {
             if(msg)
@@ -124,7 +124,22 @@ class ImageData final
         void texmad(const vec &mul, const vec &add);
         void texpremul();
 
-        bool texturedata(const char *tname, bool msg = true, int * compress = nullptr, int * wrap = nullptr, const char *tdir = nullptr, int ttype = 0);
+        /**
+         * @brief Loads a texture's image and applies its <> commands.
+         *
+         * @param tname the texture name, with any <> commands
+         * @param msg whether to print errors and show load progress
+         * @param compress set by the <compress> command, if present
+         * @param wrap set by the <mirror> command, if present
+         * @param tdir if set, the directory to look for the file in
+         * @param ttype the texture type, used by type specific commands
+         * @param surface if set, used as the image instead of loading the file
+         *        (as when it has been decoded already by textureloadasync());
+         *        freed by this function
+         *
+         * @return true if the image was loaded
+         */
+        bool texturedata(const char *tname, bool msg = true, int * compress = nullptr, int * wrap = nullptr, const char *tdir = nullptr, int ttype = 0, SDL_Surface *surface = nullptr);
         bool texturedata(const Slot &slot, const Slot::Tex &tex, bool msg = true, int *compress = nullptr, int *wrap = nullptr);
 
     private:
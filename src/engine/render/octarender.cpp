@@ -257,7 +257,8 @@ namespace
 
     void gencubeedges(std::array<cube, 8> &c, const ivec &co = ivec(0, 0, 0), int size = rootworld.mapsize()>>1)
     {
-        neighborstack[++neighbordepth] = &c[0];
+        querycontext &query = worldquery();
+        query.neighborstack[++query.neighbordepth] = &c[0];
         for(int i = 0; i < 8; ++i)
         {
             ivec o(i, co, size);
@@ -274,7 +275,7 @@ namespace
                 gencubeedges(c[i], o, size);
             }
         }
-        --neighbordepth;
+        --query.neighbordepth;
     }
 
     void addtjoint(const EdgeGroup &g, const CubeEdge &e, int offset)
@@ -628,12 +629,21 @@ void cubeworld::findtjoints()
     edgegroups.clear();
 }
 
+bool worldqueriesonly = false;
+
 void cubeworld::allchanged(bool load)
 {
     if(!worldroot)
     {
         return;
     }
+    if(worldqueriesonly)
+    {
+        resetclipplanes();
+        entitiesinoctanodes();
+        setvisibility(*worldroot, ivec(0, 0, 0), mapsize()/2);
+        return;
+    }
     if(mainmenu)
     {
         load = false;
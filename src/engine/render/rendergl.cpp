@@ -10,6 +10,7 @@
  * the simple world depth fog in libprimis.
  */
 #include "../libprimis-headers/cube.h"
+#include "../../shared/asyncio.h"
 #include "../../shared/geomexts.h"
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
@@ -1808,6 +1809,7 @@ void gl_setupframe(bool force)
 void gl_drawframe(int crosshairindex, void (*gamefxn)(), void (*hudfxn)(), void (*editfxn)(), void (*hud2d)())
 {
     synctimers();
+    processasyncreads();
     xtravertsva = xtraverts = glde = gbatches = vtris = vverts = 0;
     occlusionengine.flipqueries();
     aspect = forceaspect ? forceaspect : hudw()/static_cast<float>(hudh());
@@ -10,7 +10,9 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
+#include "../../shared/asyncio.h"
 #include "../../shared/stream.h"
+#include "../../shared/threadpool.h"
 
 #include <optional>
 #include <memory>
@@ -213,6 +215,8 @@ namespace batching
         int next;
 
         void renderbatchedmodel(const model &m) const;
+        //runs the model's animation without rendering it, so that its skeletal pose is queued
+        void queuepose(const model &m) const;
         //sets bbmin and bbmax to the min/max of itself and the batchedmodel's bb
         void applybb(vec &bbmin, vec &bbmax) const;
         bool shadowmask(bool dynshadow);
@@ -285,6 +289,59 @@ namespace batching
         m.render(tempanim, basetime, basetime2, pos, orient.x, orient.y, orient.z, d, a, sizescale, colorscale);
     }
 
+    void batchedmodel::queuepose(const model &m) const
+    {
+        m.render(anim|Anim_NoRender, basetime, basetime2, pos, orient.x, orient.y, orient.z, d, attached >= 0 ? &modelattached[attached] : nullptr, sizescale, colorscale);
+    }
+
+    static VAR(parallelposes, 0, 4, 1<<16); //minimum number of animated models in a frame for their poses to be evaluated by worker threads, 0 to disable
+
+    /**
+     * @brief Evaluates the skeletal poses of the batched dynamic models across the worker threads.
+     *
+     * Each model is first run without being rendered, which queues its pose
+     * rather than evaluating it (see skelmodel::skeleton::queueposes()); the
+     * queued poses are then evaluated together before any of the models are
+     * rendered, so that the render passes find them already in the skeletons'
+     * caches.
+     */
+    static void prepareposes()
+    {
+        if(!parallelposes || numworkers() <= 1)
+        {
+            return;
+        }
+        int animated = 0;
+        for(const modelbatch &b : batches)
+        {
+            if(b.flags&Model_Mapmodel || !b.m->skeletal() || !b.m->animated())
+            {
+                continue;
+            }
+            for(int j = b.batched; j >= 0; j = batchedmodels[j].next)
+            {
+                animated++;
+            }
+        }
+        if(animated < parallelposes)
+        {
+            return;
+        }
+        skelmodel::skeleton::queueposes();
+        for(const modelbatch &b : batches)
+        {
+            if(b.flags&Model_Mapmodel || !b.m->skeletal() || !b.m->animated())
+            {
+                continue;
+            }
+            for(int j = b.batched; j >= 0; j = batchedmodels[j].next)
+            {
+                batchedmodels[j].queuepose(*b.m);
+            }
+        }
+        skelmodel::skeleton::flushposes();
+    }
+
     bool batchedmodel::shadowmask(bool dynshadow)
     {
         if(flags&(Model_Mapmodel | Model_NoShadow)) //mapmodels are not dynamic models by definition
@@ -498,6 +555,9 @@ namespace batching
 
 std::unordered_map<std::string, model *> models;
 std::vector<std::string> preloadmodels;
+//when set, loadmodel() leaves the model's skin textures loading in the background
+//and the caller must finishasyncreads() before the models are used
+static bool batchmodelloads = false;
 
 //used in iengine
 void preloadmodel(std::string name)
@@ -511,6 +571,9 @@ void preloadmodel(std::string name)
 
 void flushpreloadedmodels(bool msg)
 {
+    //load every model first so that their skins are read from disk together
+    std::vector<model *> loaded;
+    batchmodelloads = true;
     for(size_t i = 0; i < preloadmodels.size(); i++)
     {
         loadprogress = static_cast<float>(i+1)/preloadmodels.size();
@@ -524,10 +587,16 @@ void flushpreloadedmodels(bool msg)
         }
         else
         {
-            m->preloadmeshes();
-            m->preloadshaders();
+            loaded.push_back(m);
         }
     }
+    batchmodelloads = false;
+    finishasyncreads();
+    for(model *m : loaded)
+    {
+        m->preloadmeshes();
+        m->preloadshaders();
+    }
     preloadmodels.clear();
 
     loadprogress = 0;
@@ -546,6 +615,8 @@ void preloadusedmapmodels(bool msg, bool bih)
     }
 
     std::vector<std::string> col;
+    std::vector<model *> loaded;
+    batchmodelloads = true;
     for(size_t i = 0; i < used.size(); i++)
     {
         loadprogress = static_cast<float>(i+1)/used.size();
@@ -573,20 +644,27 @@ void preloadusedmapmodels(bool msg, bool bih)
         }
         else
         {
-            if(bih)
-            {
-                m->preloadBIH();
-            }
-            else if(m->collide == Collide_TRI && m->collidemodel.empty() && m->bih)
-            {
-                m->setBIH();
-            }
-            m->preloadmeshes();
-            m->preloadshaders();
-            if(!m->collidemodel.empty() && std::find(col.begin(), col.end(), m->collidemodel) == col.end())
-            {
-                col.push_back(m->collidemodel);
-            }
+            loaded.push_back(m);
+        }
+    }
+    batchmodelloads = false;
+    //skins must be in place before the shaders for the model are chosen
+    finishasyncreads();
+    for(model *m : loaded)
+    {
+        if(bih)
+        {
+            m->preloadBIH();
+        }
+        else if(m->collide == Collide_TRI && m->collidemodel.empty() && m->bih)
+        {
+            m->setBIH();
+        }
+        m->preloadmeshes();
+        m->preloadshaders();
+        if(!m->collidemodel.empty() && std::find(col.begin(), col.end(), m->collidemodel) == col.end())
+        {
+            col.push_back(m->collidemodel);
         }
     }
 
@@ -664,7 +742,8 @@ model *loadmodel(std::string_view name, int i, bool msg)
             {
                 break;
             }
-            //delete model if not successful
+            //delete model if not successful, once no skin loads refer to it
+            finishasyncreads();
             delete m;
             m = nullptr;
         }
@@ -677,6 +756,10 @@ model *loadmodel(std::string_view name, int i, bool msg)
         {
             models[m->modelname()] = m;
         }
+        if(!batchmodelloads)
+        {
+            finishasyncreads();
+        }
     }
     if((mapmodel::mapmodels.size() > static_cast<size_t>(i)) && !mapmodel::mapmodels[i].m)
     {
@@ -754,6 +837,8 @@ static void rendercullmodelquery(dynent *d, const vec &center, float radius)
 
 void GBuffer::rendermodelbatches()
 {
+    batching::prepareposes();
+
     tmodelinfo.mdlsx1 = tmodelinfo.mdlsy1 = 1;
     tmodelinfo.mdlsx2 = tmodelinfo.mdlsy2 = -1;
     tmodelinfo.mdltiles.fill(0);
@@ -1233,4 +1318,9 @@ void initrendermodelcmds()
     addcommand("nummapmodels", reinterpret_cast<identfun>(mapmodel::num), "", Id_Command);
     addcommand("clearmodel", reinterpret_cast<identfun>(clearmodel), "s", Id_Command);
     addcommand("findanims", reinterpret_cast<identfun>(findanimscmd), "s", Id_Command);
+    addcommand("skelcachestats", reinterpret_cast<identfun>(+[] ()
+    {
+        skelmodel::skeleton::posecachestats stats = skelmodel::skeleton::getposecachestats();
+        conoutf("skeleton poses: %zu lookups, %zu shared, %zu reused, %zu evaluated, %zu evicted", stats.lookups, stats.shared, stats.reused, stats.evaluated, stats.evicted);
+    }), "", Id_Command);
 }
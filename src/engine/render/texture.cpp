@@ -4,10 +4,13 @@
  */
 
 #include "../libprimis-headers/cube.h"
+#include "../../shared/asyncio.h"
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
 #include "../../shared/stream.h"
 
+#include <memory>
+
 #include "SDL_image.h"
 
 #include "imagedata.h"
@@ -1076,6 +1079,97 @@ Texture *textureload(const char *name, int clamp, bool mipit, bool msg)
     return notexture;
 }
 
+//keeps a surface decoded on an I/O thread until the main thread uploads it
+struct asynctexture final
+{
+    SDL_Surface *surface = nullptr;
+
+    ~asynctexture()
+    {
+        if(surface)
+        {
+            SDL_FreeSurface(surface);
+        }
+    }
+};
+
+//callbacks waiting on each texture being loaded by textureloadasync()
+static std::unordered_map<std::string, std::vector<std::function<void(Texture *)>>> asynctextures;
+
+void textureloadasync(const char *name, int priority, const std::function<void(Texture *)> &done, int clamp, bool mipit)
+{
+    std::string tname(name);
+    std::unordered_map<std::string, Texture>::iterator itr = textures.find(path(tname));
+    if(itr != textures.end())
+    {
+        done(&(*itr).second);
+        return;
+    }
+    //stubs are never uploaded, so there is nothing to gain by loading them in the background
+    if(tname.find("<stub") != std::string::npos)
+    {
+        done(textureload(tname.c_str(), clamp, mipit, false));
+        return;
+    }
+    auto pending = asynctextures.find(tname);
+    if(pending != asynctextures.end())
+    {
+        (*pending).second.push_back(done);
+        return;
+    }
+    asynctextures[tname].push_back(done);
+
+    size_t cmdsend = tname[0] == '<' ? tname.rfind('>') : std::string::npos;
+    std::string file = cmdsend != std::string::npos ? tname.substr(cmdsend + 1) : tname;
+    std::shared_ptr<asynctexture> state = std::make_shared<asynctexture>();
+    //runs on an I/O thread; SDL_image and the surface conversions do not touch any engine state
+    auto decode = [state] (asyncfile &f) -> bool
+    {
+        SDL_RWops *rw = SDL_RWFromConstMem(f.data.data(), f.data.size());
+        if(!rw)
+        {
+            return false;
+        }
+        const char *ext = std::strrchr(f.name.c_str(), '.');
+        state->surface = fixsurfaceformat(IMG_LoadTyped_RW(rw, 1, ext ? ext + 1 : nullptr));
+        return state->surface != nullptr;
+    };
+    auto upload = [state, tname, clamp, mipit] (asyncfile &f)
+    {
+        Texture *t = notexture;
+        std::unordered_map<std::string, Texture>::iterator itr = textures.find(tname);
+        if(itr != textures.end()) //loaded by textureload() in the meantime
+        {
+            t = &(*itr).second;
+        }
+        else if(f.ok)
+        {
+            int compress = 0,
+                wrap = clamp;
+            ImageData s;
+            //texturedata() takes ownership of the surface
+            SDL_Surface *surface = state->surface;
+            state->surface = nullptr;
+            if(s.texturedata(tname.c_str(), false, &compress, &wrap, nullptr, 0, surface))
+            {
+                t = newtexture(nullptr, tname.c_str(), s, wrap, mipit, false, false, compress);
+            }
+        }
+        else
+        {
+            conoutf(Console_Error, "could not load texture %s", f.name.c_str());
+        }
+        //callbacks may request more textures, so take them out of the table first
+        std::vector<std::function<void(Texture *)>> callbacks = std::move(asynctextures[tname]);
+        asynctextures.erase(tname);
+        for(const std::function<void(Texture *)> &callback : callbacks)
+        {
+            callback(t);
+        }
+    };
+    asyncread(file.c_str(), priority, upload, decode);
+}
+
 bool settexture(const char *name, int clamp)
 {
     Texture *t = textureload(name, clamp, true, false);
@@ -1256,7 +1350,7 @@ void compactvslots(cube * const c, int n)
 {
     if((compactvslotsprogress++&0xFFF)==0)
     {
-        renderprogress(std::min(static_cast<float>(compactvslotsprogress)/allocnodes, 1.0f), markingvslots ? "marking slots..." : "compacting slots...");
+        renderprogress(std::min(static_cast<float>(compactvslotsprogress)/getallocnodes(), 1.0f), markingvslots ? "marking slots..." : "compacting slots...");
     }
     for(int i = 0; i < std::min(n, 8); ++i)
     {
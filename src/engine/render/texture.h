@@ -4,6 +4,22 @@
 extern int hwtexsize, hwcubetexsize, hwmaxaniso, maxtexsize, hwtexunits, hwvtexunits;
 
 extern Texture *textureload(const char *name, int clamp = 0, bool mipit = true, bool msg = true);
+
+/**
+ * @brief Loads a texture, reading and decoding its image in the background.
+ *
+ * The image file is read and decoded by asyncread(); the texture is then
+ * created and done is called on the main thread, when processasyncreads() is
+ * called. If the texture is already loaded, done is called immediately.
+ * Requests for a texture which is already being loaded share the one load.
+ *
+ * @param name the texture name, as passed to textureload()
+ * @param priority the AsyncPriority of the read
+ * @param done called with the texture, or with notexture if it could not be loaded
+ * @param clamp the clamp mode, as passed to textureload()
+ * @param mipit whether to create mipmaps, as passed to textureload()
+ */
+extern void textureloadasync(const char *name, int priority, const std::function<void(Texture *)> &done, int clamp = 0, bool mipit = true);
 extern bool floatformat(GLenum format);
 extern void loadshaders();
 extern void createtexture(int tnum, int w, int h, const void *pixels, int clamp, int filter, GLenum component = GL_RGB, GLenum target = GL_TEXTURE_2D, int pw = 0, int ph = 0, int pitch = 0, bool resize = true, GLenum format = GL_FALSE, bool swizzle = false);
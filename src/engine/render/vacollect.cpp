@@ -4,6 +4,11 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
+#include "../../shared/threadpool.h"
+
+#include <functional>
+#include <memory>
+#include <unordered_set>
 
 #include "grass.h"
 #include "octarender.h"
@@ -326,6 +331,105 @@ static uchar *addvbo(vtxarray *va, int type, int numelems, int elemsize)
     return &(*(data.end()-len)); //return pointer to where iterator points
 }
 
+/**
+ * @brief Geometry for a vertex array which has not yet been packed into the vbos.
+ *
+ * vacollect generates the contents of each vbo for a va with its indices relative
+ * to the start of that va's own vertices. Packing (which decides which shared vbo
+ * each va ends up in, and therefore the offsets) depends on every va before it,
+ * so it is done in order on the main thread by packva().
+ */
+struct stagedva final
+{
+    vtxarray *va;
+    std::array<std::vector<uchar>, VBO_NumVBOs> data;
+    int worldtris, skytris, decaltris;
+    bool grass;
+};
+
+//offsets the vertex indices in an element set by the va's offset into the vertex buffer
+static void offsetelems(ushort *buf, ElementSet *elems, int numelems, ushort voffset)
+{
+    if(!voffset)
+    {
+        return;
+    }
+    for(int i = 0; i < numelems; ++i)
+    {
+        ElementSet &e = elems[i];
+        for(int j = 0; j < e.length; ++j)
+        {
+            buf[j] += voffset;
+        }
+        buf += e.length;
+        if(e.length)
+        {
+            e.minvert += voffset;
+            e.maxvert += voffset;
+        }
+    }
+}
+
+/**
+ * @brief Copies a staged va's geometry into the shared vbo buffers.
+ *
+ * Flushes the vbos first if the va would not fit into them, then assigns the
+ * va's offsets and adds the va to the global va list. Must be called on the main
+ * thread, in the order the vas were generated.
+ *
+ * @param s the staged va to pack
+ */
+static void packva(stagedva &s)
+{
+    vtxarray *va = s.va;
+    if(va->verts)
+    {
+        if(vbosize[VBO_VBuf] + va->verts > maxvbosize ||
+           vbosize[VBO_EBuf] + s.worldtris > USHRT_MAX ||
+           vbosize[VBO_SkyBuf] + s.skytris > USHRT_MAX ||
+           vbosize[VBO_DecalBuf] + s.decaltris > USHRT_MAX)
+        {
+            flushvbo();
+        }
+        uchar *vdata = addvbo(va, VBO_VBuf, va->verts, sizeof(vertex));
+        std::memcpy(vdata, s.data[VBO_VBuf].data(), s.data[VBO_VBuf].size());
+        va->minvert += va->voffset;
+        va->maxvert += va->voffset;
+    }
+    if(va->sky)
+    {
+        ushort *skydata = reinterpret_cast<ushort *>(addvbo(va, VBO_SkyBuf, va->sky, sizeof(ushort)));
+        std::memcpy(skydata, s.data[VBO_SkyBuf].data(), s.data[VBO_SkyBuf].size());
+        if(va->voffset)
+        {
+            for(uint i = 0; i < va->sky; ++i)
+            {
+                skydata[i] += va->voffset;
+            }
+        }
+    }
+    if(va->texelems)
+    {
+        ushort *edata = reinterpret_cast<ushort *>(addvbo(va, VBO_EBuf, s.worldtris, sizeof(ushort)));
+        std::memcpy(edata, s.data[VBO_EBuf].data(), s.data[VBO_EBuf].size());
+        offsetelems(edata, va->texelems, va->texs + va->alphaback + va->alphafront + va->refract, va->voffset);
+    }
+    if(va->decalelems)
+    {
+        ushort *decaldata = reinterpret_cast<ushort *>(addvbo(va, VBO_DecalBuf, s.decaltris, sizeof(ushort)));
+        std::memcpy(decaldata, s.data[VBO_DecalBuf].data(), s.data[VBO_DecalBuf].size());
+        offsetelems(decaldata, va->decalelems, va->decaltexs, va->voffset);
+    }
+    if(s.grass)
+    {
+        loadgrassshaders();
+    }
+    wverts += va->verts;
+    wtris  += va->tris + va->alphabacktris + va->alphafronttris + va->refracttris + va->decaltris;
+    allocva++;
+    valist.push_back(va);
+}
+
 //takes a packed ushort vector and turns it into a vec3 vector object
 static vec decodenormal(ushort norm)
 {
@@ -339,6 +443,26 @@ static vec decodenormal(ushort norm)
     return vec(-yaw.y*pitch.x, yaw.x*pitch.x, pitch.y);
 }
 
+/**
+ * @brief A root va cube whose geometry is collected on a worker thread.
+ *
+ * Root va cubes (those of the size at which a va is always created) never share
+ * merged faces with their siblings, so the geometry inside each one can be
+ * collected independently of the rest of the octree. The jobs are created and
+ * later consumed in the same order the serial octree walk would visit them.
+ */
+struct vajob final
+{
+    cube *c;
+    ivec o;
+    int size, csi;
+    std::array<const cube *, 32> neighbors; //neighborstack of the walk which found this job
+    int neighbordepth;
+    std::vector<octaentities *> entstack;
+    std::vector<stagedva> staged;           //vas in this subtree, in order of creation
+    int mergemax, hasmerges;
+};
+
 class vacollect final
 {
 
@@ -346,7 +470,44 @@ class vacollect final
         int updateva(std::array<cube, 8> &c, const ivec &co, int size, int csi);
         vacollect();
 
+        /**
+         * @brief Finds the root va cubes below c which do not have a va yet.
+         *
+         * Walks the octree in the same order as updateva() down to the size of
+         * the root va cubes, adding a job for each one missing a va.
+         *
+         * @param c the cubes to search
+         * @param co the origin of the cubes
+         * @param size the size of each cube in c
+         * @param csi the log2 of size
+         * @param jobs the vector to add the jobs to
+         */
+        void findjobs(std::array<cube, 8> &c, const ivec &co, int size, int csi, std::vector<vajob> &jobs);
+
+        /**
+         * @brief Collects the vas for a job's cube and its children.
+         *
+         * Generated vas are staged into the job rather than packed into vbos;
+         * they are packed later by updateva() on the main thread. Safe to call
+         * from a worker thread, as long as each job has its own vacollect and
+         * the texture slots used by the job have already been loaded.
+         *
+         * @param job the job to run
+         */
+        void runjob(vajob &job);
+
+        /**
+         * @brief Sets the jobs whose staged vas updateva() packs in place of collecting them.
+         *
+         * @param newjobs the jobs found by findjobs() and completed by runjob(), or nullptr
+         */
+        void setjobs(std::vector<vajob> *newjobs);
+
     private:
+        std::vector<vtxarray *> *roots = &varoot;  //vas without a parent yet, see updateva()
+        std::vector<stagedva> *staging = nullptr;  //where to stage vas instead of packing them, if set
+        std::vector<vajob> *jobs = nullptr;
+        size_t nextjob = 0;
         int size;
         std::vector<materialsurface> matsurfs;
         std::vector<octaentities *> mapmodels, decals;
@@ -529,6 +690,13 @@ void vacollect::setupdata(vtxarray *va)
     optimize();
     gendecals();
 
+    stagedva staged;
+    staged.va = va;
+    staged.worldtris = worldtris;
+    staged.skytris = skytris;
+    staged.decaltris = decaltris;
+    staged.grass = false;
+
     va->verts = verts.size();
     va->tris = worldtris/3;
     va->vbuf = 0;
@@ -538,17 +706,8 @@ void vacollect::setupdata(vtxarray *va)
     va->voffset = 0;
     if(va->verts)
     {
-        if(vbosize[VBO_VBuf] + static_cast<int>(verts.size()) > maxvbosize ||
-           vbosize[VBO_EBuf] + worldtris > USHRT_MAX ||
-           vbosize[VBO_SkyBuf] + skytris > USHRT_MAX ||
-           vbosize[VBO_DecalBuf] + decaltris > USHRT_MAX)
-        {
-            flushvbo();
-        }
-        uchar *vdata = addvbo(va, VBO_VBuf, va->verts, sizeof(vertex));
-        genverts(vdata);
-        va->minvert += va->voffset;
-        va->maxvert += va->voffset;
+        staged.data[VBO_VBuf].resize(va->verts*sizeof(vertex));
+        genverts(staged.data[VBO_VBuf].data());
     }
 
     va->matbuf.clear();
@@ -585,15 +744,8 @@ void vacollect::setupdata(vtxarray *va)
     va->sky = skyindices.size();
     if(va->sky)
     {
-        ushort *skydata = reinterpret_cast<ushort *>(addvbo(va, VBO_SkyBuf, va->sky, sizeof(ushort)));
-        std::memcpy(skydata, skyindices.data(), va->sky*sizeof(ushort));
-        if(va->voffset)
-        {
-            for(uint i = 0; i < va->sky; ++i)
-            {
-                skydata[i] += va->voffset;
-            }
-        }
+        staged.data[VBO_SkyBuf].resize(va->sky*sizeof(ushort));
+        std::memcpy(staged.data[VBO_SkyBuf].data(), skyindices.data(), va->sky*sizeof(ushort));
     }
 
     va->texelems = nullptr;
@@ -610,8 +762,8 @@ void vacollect::setupdata(vtxarray *va)
     if(va->texs)
     {
         va->texelems = new ElementSet[va->texs];
-        ushort *edata = reinterpret_cast<ushort *>(addvbo(va, VBO_EBuf, worldtris, sizeof(ushort))),
-               *curbuf = edata;
+        staged.data[VBO_EBuf].resize(worldtris*sizeof(ushort));
+        ushort *curbuf = reinterpret_cast<ushort *>(staged.data[VBO_EBuf].data());
         for(size_t i = 0; i < texs.size(); i++)
         {
             const SortKey &k = texs[i];
@@ -629,7 +781,6 @@ void vacollect::setupdata(vtxarray *va)
                 std::memcpy(curbuf, t.tris.data(), t.tris.size() * sizeof(ushort));
                 for(size_t j = 0; j < t.tris.size(); j++)
                 {
-                    curbuf[j] += va->voffset;
                     e.minvert = std::min(e.minvert, curbuf[j]);
                     e.maxvert = std::max(e.maxvert, curbuf[j]);
                 }
@@ -685,8 +836,8 @@ void vacollect::setupdata(vtxarray *va)
     if(va->decaltexs)
     {
         va->decalelems = new ElementSet[va->decaltexs];
-        ushort *edata = reinterpret_cast<ushort *>(addvbo(va, VBO_DecalBuf, decaltris, sizeof(ushort))),
-               *curbuf = edata;
+        staged.data[VBO_DecalBuf].resize(decaltris*sizeof(ushort));
+        ushort *curbuf = reinterpret_cast<ushort *>(staged.data[VBO_DecalBuf].data());
         for(size_t i = 0; i < decaltexs.size(); i++)
         {
             const decalkey &k = decaltexs[i];
@@ -702,7 +853,6 @@ void vacollect::setupdata(vtxarray *va)
                 std::memcpy(curbuf, t.tris.data(), t.tris.size() * sizeof(ushort));
                 for(size_t j = 0; j < t.tris.size(); j++)
                 {
-                    curbuf[j] += va->voffset;
                     e.minvert = std::min(e.minvert, curbuf[j]);
                     e.maxvert = std::max(e.maxvert, curbuf[j]);
                 }
@@ -714,7 +864,7 @@ void vacollect::setupdata(vtxarray *va)
     if(grasstris.size())
     {
         std::swap(va->grasstris, grasstris);
-        loadgrassshaders();
+        staged.grass = true;
     }
     if(mapmodels.size())
     {
@@ -724,6 +874,14 @@ void vacollect::setupdata(vtxarray *va)
     {
         va->decals.insert(va->decals.end(), decals.begin(), decals.end());
     }
+    if(staging)
+    {
+        staging->push_back(std::move(staged));
+    }
+    else
+    {
+        packva(staged);
+    }
 }
 
 bool vacollect::emptyva()
@@ -907,17 +1065,19 @@ void vacollect::gendecals()
         return;
     }
     const std::vector<extentity *> &ents = entities::getents();
+    //decals may span several octants; track which were already generated locally
+    //rather than flagging the entity, since other vacollects may share the entity
+    std::unordered_set<uint> rendered;
     for(const octaentities* oe : extdecals)
     {
         //get an index to ents in this VA from oe->decals
         for(const uint j : oe->decals)
         {
-            extentity &e = *ents[j];
-            if(e.flags&EntFlag_Render)
+            if(!rendered.insert(j).second)
             {
                 continue;
             }
-            e.flags |= EntFlag_Render;
+            const extentity &e = *ents[j];
             const DecalSlot &s = lookupdecalslot(e.attr1, true);
             if(!s.shader)
             {
@@ -927,18 +1087,6 @@ void vacollect::gendecals()
             gendecal(e, s, k);
         }
     }
-    for(const octaentities* oe : extdecals)
-    {
-        //get an index to ents in this VA from oe->decals
-        for(const uint j : oe->decals)
-        {
-            extentity &e = *ents[j];
-            if(e.flags&EntFlag_Render)
-            {
-                e.flags &= ~EntFlag_Render;
-            }
-        }
-    }
     for(auto &[k, t] : decalindices)
     {
         if(t.tris.size())
@@ -1089,6 +1237,25 @@ static int setcubevisibility(cube &c, const ivec &co, int size)
     return numvis;
 }
 
+void setvisibility(std::array<cube, 8> &c, const ivec &co, int size)
+{
+    querycontext &query = worldquery();
+    query.neighborstack[++query.neighbordepth] = &c[0];
+    for(int i = 0; i < 8; ++i)
+    {
+        ivec o(i, co, size);
+        if(c[i].children)
+        {
+            setvisibility(*c[i].children, o, size/2);
+        }
+        else
+        {
+            setcubevisibility(c[i], o, size);
+        }
+    }
+    --query.neighbordepth;
+}
+
 //index array must be >= numverts long
 //verts array must be >= Face_MaxVerts + 1 and >= numverts long
 void vacollect::addtris(const VSlot &vslot, int orient, const SortKey &key, vertex *verts, const int *index, int numverts, int tj)
@@ -1429,10 +1596,6 @@ vtxarray *vacollect::newva(const ivec &o, int size)
         va->skymax = ivec(vec(skymax).mul(8)).add(7).shr(3);
     }
 
-    wverts += va->verts;
-    wtris  += va->tris + va->alphabacktris + va->alphafronttris + va->refracttris + va->decaltris;
-    allocva++;
-    valist.push_back(va);
     return va;
 }
 
@@ -1488,7 +1651,8 @@ void vacollect::rendercube(cube &c, const ivec &co, int size, int csi, int &maxl
 
     if(c.children)
     {
-        neighborstack[++neighbordepth] = &(*c.children)[0];
+        querycontext &query = worldquery();
+        query.neighborstack[++query.neighbordepth] = &(*c.children)[0];
         c.escaped = 0;
         for(int i = 0; i < 8; ++i)
         {
@@ -1501,7 +1665,7 @@ void vacollect::rendercube(cube &c, const ivec &co, int size, int csi, int &maxl
             }
             maxlevel = std::max(maxlevel, level);
         }
-        --neighbordepth;
+        --query.neighbordepth;
 
         if(csi <= maxmergelevel && vamerges[csi].size())
         {
@@ -1841,17 +2005,35 @@ int vacollect::updateva(std::array<cube, 8> &c, const ivec &co, int size, int cs
     int ccount = 0,
         cmergemax  = vamergemax,
         chasmerges = vahasmerges;
-    neighborstack[++neighbordepth] = &c[0];
+    querycontext &query = worldquery();
+    query.neighborstack[++query.neighbordepth] = &c[0];
     for(int i = 0; i < 8; ++i)                                  // counting number of semi-solid/solid children cubes
     {
         int count = 0,
-            childpos = varoot.size();
+            childpos = roots->size();
         ivec o(i, co, size);                                    //translate cube vector to world vector
         vamergemax = 0;
         vahasmerges = 0;
+        if(jobs && nextjob < jobs->size() && (*jobs)[nextjob].c == &c[i])
+        {
+            //collected on a worker thread already, pack its vas where they would have been created
+            vajob &job = (*jobs)[nextjob++];
+            for(stagedva &staged : job.staged)
+            {
+                packva(staged);
+            }
+            job.staged.clear();
+            roots->push_back(c[i].ext->va);
+            if(job.mergemax > size)
+            {
+                cmergemax = std::max(cmergemax, job.mergemax);
+                chasmerges |= job.hasmerges&~Merge_Use;
+            }
+            continue;
+        }
         if(c[i].ext && c[i].ext->va)
         {
-            varoot.push_back(c[i].ext->va);
+            roots->push_back(c[i].ext->va);
             if(c[i].ext->va->hasmerges&Merge_Origin)
             {
                 findmergedfaces(c[i], o, size, csi, csi);
@@ -1881,14 +2063,14 @@ int vacollect::updateva(std::array<cube, 8> &c, const ivec &co, int size, int cs
                 setva(c[i], o, size, csi);
                 if(c[i].ext && c[i].ext->va)
                 {
-                    while(static_cast<long>(varoot.size()) > childpos)
+                    while(static_cast<long>(roots->size()) > childpos)
                     {
-                        vtxarray *child = varoot.back();
-                        varoot.pop_back();
+                        vtxarray *child = roots->back();
+                        roots->pop_back();
                         c[i].ext->va->children.push_back(child);
                         child->parent = c[i].ext->va;
                     }
-                    varoot.push_back(c[i].ext->va);
+                    roots->push_back(c[i].ext->va);
                     if(vamergemax > size)
                     {
                         cmergemax = std::max(cmergemax, vamergemax);
@@ -1910,13 +2092,134 @@ int vacollect::updateva(std::array<cube, 8> &c, const ivec &co, int size, int cs
         chasmerges |= vahasmerges;
         ccount += count;
     }
-    --neighbordepth;
+    --query.neighbordepth;
     vamergemax = cmergemax;
     vahasmerges = chasmerges;
 
     return ccount;
 }
 
+void vacollect::findjobs(std::array<cube, 8> &c, const ivec &co, int size, int csi, std::vector<vajob> &jobs)
+{
+    querycontext &query = worldquery();
+    query.neighborstack[++query.neighbordepth] = &c[0];
+    for(int i = 0; i < 8; ++i)
+    {
+        if(c[i].ext && c[i].ext->va)
+        {
+            continue;
+        }
+        ivec o(i, co, size);
+        if(size == std::min(vamaxsize, rootworld.mapsize()/2))
+        {
+            vajob &job = jobs.emplace_back();
+            job.c = &c[i];
+            job.o = o;
+            job.size = size;
+            job.csi = csi;
+            job.neighbors = query.neighborstack;
+            job.neighbordepth = query.neighbordepth;
+            job.entstack = entstack;
+            job.mergemax = 0;
+            job.hasmerges = 0;
+        }
+        else if(c[i].children)
+        {
+            if(c[i].ext && c[i].ext->ents)
+            {
+                entstack.push_back(c[i].ext->ents);
+            }
+            findjobs(*c[i].children, o, size/2, csi-1, jobs);
+            if(c[i].ext && c[i].ext->ents)
+            {
+                entstack.pop_back();
+            }
+        }
+    }
+    --query.neighbordepth;
+}
+
+//mirrors updateva() for a single cube which is always given its own va
+void vacollect::runjob(vajob &job)
+{
+    std::vector<vtxarray *> children;
+    roots = &children;
+    staging = &job.staged;
+    //the calling thread may be the main thread, partway through its own walk
+    querycontext &query = worldquery();
+    const std::array<const cube *, 32> oldstack = query.neighborstack;
+    const int olddepth = query.neighbordepth;
+    query.neighborstack = job.neighbors;
+    query.neighbordepth = job.neighbordepth;
+    entstack = job.entstack;
+    vamergemax = 0;
+    vahasmerges = 0;
+
+    cube &c = *job.c;
+    if(c.children)
+    {
+        if(c.ext && c.ext->ents)
+        {
+            entstack.push_back(c.ext->ents);
+        }
+        updateva(*c.children, job.o, job.size/2, job.csi-1);
+        if(c.ext && c.ext->ents)
+        {
+            entstack.pop_back();
+        }
+    }
+    else
+    {
+        setcubevisibility(c, job.o, job.size);
+    }
+    setva(c, job.o, job.size, job.csi);
+    if(c.ext && c.ext->va)
+    {
+        while(children.size())
+        {
+            vtxarray *child = children.back();
+            children.pop_back();
+            c.ext->va->children.push_back(child);
+            child->parent = c.ext->va;
+        }
+    }
+    job.mergemax = vamergemax;
+    job.hasmerges = vahasmerges;
+
+    query.neighborstack = oldstack;
+    query.neighbordepth = olddepth;
+    entstack.clear();
+    staging = nullptr;
+    roots = &varoot;
+}
+
+void vacollect::setjobs(std::vector<vajob> *newjobs)
+{
+    jobs = newjobs;
+    nextjob = 0;
+}
+
+static VAR(parallelva, 0, 1, 1); //collect the geometry for each root va cube on a separate worker thread
+
+//loads the vslots used by a cube and its children; worker threads cannot load textures themselves
+static void preloadvslots(const cube &c)
+{
+    if(c.children)
+    {
+        for(const cube &child : *c.children)
+        {
+            preloadvslots(child);
+        }
+    }
+    else if(!c.isempty())
+    {
+        for(int i = 0; i < 6; ++i)
+        {
+            lookupvslot(c.texture[i], true);
+        }
+    }
+}
+
 void cubeworld::octarender()                               // creates va s for all leaf cubes that don't already have them
 {
     int csi = 0;
@@ -1925,7 +2228,33 @@ void cubeworld::octarender()                               // creates va s for a
         csi++;
     }
     varoot.clear();
+    std::vector<vajob> jobs;
+    if(parallelva && numworkers() > 1)
+    {
+        vc.findjobs(*worldroot, ivec(0, 0, 0), mapsize()/2, csi-1, jobs);
+    }
+    if(jobs.size() > 1)
+    {
+        for(const vajob &job : jobs)
+        {
+            preloadvslots(*job.c);
+        }
+        for(const extentity *e : entities::getents())
+        {
+            if(e->type == EngineEnt_Decal)
+            {
+                lookupdecalslot(e->attr1, true);
+            }
+        }
+        parallelfor(jobs.size(), [&jobs] (size_t i)
+        {
+            std::unique_ptr<vacollect> collect = std::make_unique<vacollect>();
+            collect->runjob(jobs[i]);
+        });
+        vc.setjobs(&jobs);
+    }
     vc.updateva(*worldroot, ivec(0, 0, 0), mapsize()/2, csi-1);
+    vc.setjobs(nullptr);
     flushvbo();
     setexplicitsky(false);
     for(size_t i = 0; i < valist.size(); i++)
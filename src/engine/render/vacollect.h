@@ -14,4 +14,17 @@
  */
 extern void destroyvbo(GLuint vbo);
 
+/**
+ * @brief Sets the visibility field of every leaf cube below the given cube array.
+ *
+ * Only computes the face visibility/collision masks normally assigned while
+ * generating vertex arrays; no geometry is generated. Used to prepare a world
+ * for collision and raycasting when there is no GL context to render it with.
+ *
+ * @param c the cube array to recurse through
+ * @param co the origin of the cube array
+ * @param size the size of each cube in the array
+ */
+extern void setvisibility(std::array<cube, 8> &c, const ivec &co, int size);
+
 #endif
@@ -14,6 +14,7 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
+#include "../../shared/asyncio.h"
 
 #include "octarender.h"
 #include "rendergl.h"
@@ -38,6 +39,7 @@ namespace
 {
     constexpr int numcaustics = 32; //number of separate caustics textures to load
     std::array<const Texture *, numcaustics> caustictex = {nullptr};
+    int causticsloaded = 0; //number of caustictex entries set by their async loads
     VARFR(causticscale, 0, 50, 10000, preloadwatershaders());
     VARFR(causticmillis, 0, 75, 1000, preloadwatershaders()); //milliseconds between caustics frames
     FVARR(causticcontrast, 0, 0.6f, 2);
@@ -45,9 +47,10 @@ namespace
 
     void setupcaustics(int tmu, float surface = -1e16f)
     {
-        if(!caustictex[0])
+        if(causticsloaded < numcaustics)
         {
             loadcaustics(true);
+            finishasyncreads();
         }
         vec s = vec(0.011f, 0, 0.0066f).mul(100.0f/causticscale),
             t = vec(0, 0.011f, 0.0066f).mul(100.0f/causticscale);
@@ -118,14 +121,21 @@ void loadcaustics(bool force)
         return;
     }
     useshaderbyname("caustics");
-    if(caustictex[0])
+    static bool requested = false;
+    if(requested)
     {
         return;
     }
+    requested = true;
+    //read in the background while the map finishes loading; setupcaustics() waits for any left
     for(int i = 0; i < numcaustics; ++i)
     {
         DEF_FORMAT_STRING(name, "<grey><noswizzle>media/texture/mat_water/caustic/caust%.2d.png", i);
-        caustictex[i] = textureload(name);
+        textureloadasync(name, AsyncPriority_Low, [i] (Texture *t)
+        {
+            caustictex[i] = t;
+            causticsloaded++;
+        });
     }
 }
 
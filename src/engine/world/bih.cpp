@@ -9,11 +9,13 @@
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
+#include "../../shared/threadpool.h"
 
 #include <memory>
 #include <optional>
 
 #include "entities.h"
+#include "octaworld.h"
 #include "physics.h"
 #include "raycube.h"
 
@@ -25,20 +27,35 @@
 #include "world/bih.h"
 
 #include "model/model.h"
+#include "model/modelcache.h"
+
+static VAR(bihsah, 0, 1, 1); //build BIH trees with the surface area heuristic instead of midpoint splits
+
+namespace
+{
+    //model cache format for BIH trees; changes with the layout of the types cached as raw bytes
+    constexpr uint bihcacheformat = sizeof(BIH::Node) | sizeof(BIH::mesh::tribb)<<8 | sizeof(vec)<<16;
+}
 
 int BIH::Node::axis() const
 {
-    return child[0]>>14;
+    return child[0]>>30;
 }
 
 int BIH::Node::childindex(int which) const
 {
-    return child[which]&0x3FFF;
+    return child[which]&maxindex;
 }
 
 bool BIH::Node::isleaf(int which) const
 {
-    return (child[1]&(1<<(14+which)))!=0;
+    return (child[1]&(1u<<(30+which)))!=0;
+}
+
+void BIH::Node::setchildren(int axis, uint left, bool leftleaf, uint right, bool rightleaf)
+{
+    child[0] = (static_cast<uint>(axis)<<30) | left;
+    child[1] = (rightleaf ? 1u<<31 : 0) | (leftleaf ? 1u<<30 : 0) | right;
 }
 
 bool BIH::mesh::tribb::outside(const ivec &bo, const ivec &br) const
@@ -180,7 +197,7 @@ bool BIH::triintersect(const mesh &m, int tidx, const vec &mo, const vec &mray,
     }
     if(!(mode&Ray_Shadow))
     {
-        hitsurface = m.xformnorm().transform(n).normalize();
+        worldquery().hitsurface = m.xformnorm().transform(n).normalize();
     }
     dist = f*invdet;
     return true; //true if collided
@@ -291,7 +308,7 @@ bool BIH::traverse(const vec &o, const vec &ray, float maxdist, float &dist, int
     vec invray(ray.x ? 1/ray.x : 1e16f, ray.y ? 1/ray.y : 1e16f, ray.z ? 1/ray.z : 1e16f);
     for(const mesh &m : meshes)
     {
-        if(!(m.flags&Mesh_Render) || (!(mode&Ray_Shadow) && m.flags&Mesh_NoClip))
+        if(!m.numnodes || !(m.flags&Mesh_Render) || (!(mode&Ray_Shadow) && m.flags&Mesh_NoClip))
         {
             continue;
         }
@@ -426,28 +443,267 @@ void BIH::build(mesh &m, uint *indices, int numindices, const ivec &vmin, const
     curnode.split[0] = static_cast<short>(splitleft);
     curnode.split[1] = static_cast<short>(splitright);
 
-    if(left==1)
+    uint leftchild = indices[0],
+         rightchild = indices[right];
+    if(left!=1)
     {
-        curnode.child[0] = (axis<<14) | indices[0];
+        leftchild = m.numnodes - offset;
+        build(m, indices, left, leftmin, leftmax);
     }
-    else
+    if(numindices-right!=1)
     {
-        curnode.child[0] = (axis<<14) | (m.numnodes - offset);
-        build(m, indices, left, leftmin, leftmax);
+        rightchild = m.numnodes - offset;
+        build(m, &indices[right], numindices-right, rightmin, rightmax);
+    }
+    curnode.setchildren(axis, leftchild, left==1, rightchild, numindices-right==1);
+}
+
+namespace
+{
+    constexpr int sahbins = 16;     //candidate split positions per axis, between bins of triangle centers
+    constexpr int maxsahdepth = 48; //depth below which buildsah() only makes median splits
+
+    struct sahbin final
+    {
+        int count;
+        ivec bbmin, bbmax;
+
+        sahbin() : count(0), bbmin(INT_MAX, INT_MAX, INT_MAX), bbmax(INT_MIN, INT_MIN, INT_MIN) {}
+
+        void add(const ivec &trimin, const ivec &trimax, int n = 1)
+        {
+            count += n;
+            bbmin.min(trimin);
+            bbmax.max(trimax);
+        }
+
+        //half the surface area of the bounds, weighted by the number of triangles in them
+        float cost() const
+        {
+            if(!count)
+            {
+                return 0;
+            }
+            float dx = bbmax.x - bbmin.x,
+                  dy = bbmax.y - bbmin.y,
+                  dz = bbmax.z - bbmin.z;
+            return (dx*dy + dy*dz + dz*dx)*count;
+        }
+    };
+
+    int sahbinindex(int center, int cmin, int extent)
+    {
+        return std::min(static_cast<int>((static_cast<llong>(center - cmin)*sahbins)/(extent + 1)), sahbins - 1);
     }
+}
 
-    if(numindices-right==1)
+void BIH::buildsah(mesh &m, uint *indices, int numindices, int depth) const
+{
+    ivec cmin(INT_MAX, INT_MAX, INT_MAX),
+         cmax(INT_MIN, INT_MIN, INT_MIN);
+    for(int i = 0; i < numindices; ++i)
     {
-        curnode.child[1] = (1<<15) | (left==1 ? 1<<14 : 0) | indices[right];
+        ivec c(m.tribbs[indices[i]].center);
+        cmin.min(c);
+        cmax.max(c);
+    }
+    int axis = -1,
+        splitbin = 0;
+    if(depth < maxsahdepth)
+    {
+        float bestcost = 1e30f;
+        for(int k = 0; k < 3; ++k)
+        {
+            int extent = cmax[k] - cmin[k];
+            if(extent <= 0)
+            {
+                continue;
+            }
+            std::array<sahbin, sahbins> bins;
+            for(int i = 0; i < numindices; ++i)
+            {
+                const mesh::tribb &tri = m.tribbs[indices[i]];
+                ivec c(tri.center),
+                     r(tri.radius);
+                bins[sahbinindex(c[k], cmin[k], extent)].add(ivec(c).sub(r), ivec(c).add(r));
+            }
+            //rightcost[i] is the cost of putting bins i and above on the right
+            std::array<float, sahbins> rightcost;
+            sahbin right;
+            for(int i = sahbins-1; i > 0; --i)
+            {
+                right.add(bins[i].bbmin, bins[i].bbmax, bins[i].count);
+                rightcost[i] = right.count ? right.cost() : -1;
+            }
+            sahbin left;
+            for(int i = 0; i < sahbins-1; ++i)
+            {
+                left.add(bins[i].bbmin, bins[i].bbmax, bins[i].count);
+                if(!left.count || rightcost[i+1] < 0)
+                {
+                    continue;
+                }
+                float cost = left.cost() + rightcost[i+1];
+                if(cost < bestcost)
+                {
+                    bestcost = cost;
+                    axis = k;
+                    splitbin = i;
+                }
+            }
+        }
+    }
+
+    int left;
+    if(axis >= 0)
+    {
+        int cminaxis = cmin[axis],
+            extent = cmax[axis] - cminaxis;
+        left = std::partition(indices, indices + numindices, [&] (uint i)
+        {
+            return sahbinindex(ivec(m.tribbs[i].center)[axis], cminaxis, extent) <= splitbin;
+        }) - indices;
     }
     else
     {
-        curnode.child[1] = (left==1 ? 1<<14 : 0) | (m.numnodes - offset);
-        build(m, &indices[right], numindices-right, rightmin, rightmax);
+        //centers cannot be separated, or the tree is already deep: halve the triangles along the widest axis
+        axis = 2;
+        for(int k = 0; k < 2; ++k)
+        {
+            if(cmax[k] - cmin[k] > cmax[axis] - cmin[axis])
+            {
+                axis = k;
+            }
+        }
+        left = numindices/2;
+        std::nth_element(indices, indices + left, indices + numindices, [&] (uint a, uint b)
+        {
+            return ivec(m.tribbs[a].center)[axis] < ivec(m.tribbs[b].center)[axis];
+        });
+    }
+
+    int splitleft = SHRT_MIN,
+        splitright = SHRT_MAX;
+    for(int i = 0; i < numindices; ++i)
+    {
+        const mesh::tribb &tri = m.tribbs[indices[i]];
+        int center = ivec(tri.center)[axis],
+            radius = ivec(tri.radius)[axis];
+        if(i < left)
+        {
+            splitleft = std::max(splitleft, center + radius);
+        }
+        else
+        {
+            splitright = std::min(splitright, center - radius);
+        }
+    }
+
+    int offset = m.numnodes++;
+    Node &curnode = m.nodes[offset];
+    curnode.split[0] = static_cast<short>(splitleft);
+    curnode.split[1] = static_cast<short>(splitright);
+
+    uint leftchild = indices[0],
+         rightchild = indices[left];
+    if(left!=1)
+    {
+        leftchild = m.numnodes - offset;
+        buildsah(m, indices, left, depth+1);
+    }
+    if(numindices-left!=1)
+    {
+        rightchild = m.numnodes - offset;
+        buildsah(m, &indices[left], numindices-left, depth+1);
+    }
+    curnode.setchildren(axis, leftchild, left==1, rightchild, numindices-left==1);
+}
+
+ullong BIH::cachekey() const
+{
+    //64 bit FNV-1a over everything the trees are built from
+    ullong hash = 0xCBF29CE484222325ULL;
+    auto add = [&hash] (const void *data, size_t len)
+    {
+        const uchar *bytes = static_cast<const uchar *>(data);
+        for(size_t i = 0; i < len; ++i)
+        {
+            hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+        }
+    };
+    add(&bihsah, sizeof(bihsah));
+    for(const mesh &m : meshes)
+    {
+        add(&m.xform, sizeof(m.xform));
+        add(&m.numtris, sizeof(m.numtris));
+        for(int i = 0; i < m.numtris; ++i)
+        {
+            for(uint j : m.tris[i].vert)
+            {
+                vec v = m.getpos(j);
+                add(&v, sizeof(v));
+            }
+        }
+    }
+    return hash;
+}
+
+bool BIH::loadcache(const std::string &name, ullong key, mesh::tribb *tribbs)
+{
+    modelcachereader f;
+    ullong cachedkey;
+    uint nummeshes;
+    if(!f.load(modelcachename(name), bihcacheformat) || !f.get(cachedkey) || cachedkey != key || !f.get(nummeshes) || nummeshes != meshes.size())
+    {
+        return false;
     }
+    std::vector<Node> cachednodes;
+    std::vector<mesh::tribb> cachedtribbs;
+    for(mesh &m : meshes)
+    {
+        if(!f.get(m.bbmin) || !f.get(m.bbmax)
+        || !f.getarray(cachednodes, m.numtris) || (m.numtris && cachednodes.empty())
+        || !f.getarray(cachedtribbs, m.numtris) || static_cast<int>(cachedtribbs.size()) != m.numtris)
+        {
+            return false;
+        }
+        //a bad index would send traversal outside of the mesh's nodes or triangles;
+        //leaves index triangles, and other children are offsets from their parent
+        for(size_t j = 0; j < cachednodes.size(); ++j)
+        {
+            const Node &n = cachednodes[j];
+            for(int i = 0; i < 2; ++i)
+            {
+                size_t index = n.childindex(i);
+                if(n.isleaf(i) ? index >= static_cast<size_t>(m.numtris) : !index || j + index >= cachednodes.size())
+                {
+                    return false;
+                }
+            }
+        }
+        m.numnodes = cachednodes.size();
+        std::copy(cachednodes.begin(), cachednodes.end(), m.nodes);
+        tribbs = std::copy(cachedtribbs.begin(), cachedtribbs.end(), tribbs); //m.tribbs points here, but is read only
+    }
+    return f.done();
 }
 
-BIH::BIH(const std::vector<mesh> &buildmeshes)
+bool BIH::savecache(const std::string &name, ullong key) const
+{
+    modelcachewriter f(bihcacheformat);
+    f.put(key);
+    f.put<uint>(meshes.size());
+    for(const mesh &m : meshes)
+    {
+        f.put(m.bbmin);
+        f.put(m.bbmax);
+        f.putarray(m.nodes, m.numnodes);
+        f.putarray(m.tribbs, m.numtris);
+    }
+    return f.save(modelcachename(name));
+}
+
+BIH::BIH(const std::vector<mesh> &buildmeshes, const std::string &cachename)
   : nodes(nullptr), numnodes(0), bbmin(1e16f, 1e16f, 1e16f), bbmax(-1e16f, -1e16f, -1e16f), center(0, 0, 0), radius(0)
 {
     mesh::tribb *tribbs = nullptr;
@@ -466,10 +722,37 @@ BIH::BIH(const std::vector<mesh> &buildmeshes)
     }
     meshes.assign(buildmeshes.begin(), buildmeshes.end());
     tribbs = new mesh::tribb[numtris];
-    mesh::tribb *dsttri = tribbs;
-    for(mesh &m : meshes)
+    //each mesh's tree has at most one node per triangle, so meshes get separate node ranges and can be built in parallel
+    nodes = new Node[numtris];
+    std::vector<int> firsttri(meshes.size());
+    for(size_t i = 0, offset = 0; i < meshes.size(); ++i)
+    {
+        mesh &m = meshes[i];
+        firsttri[i] = offset;
+        m.tribbs = &tribbs[offset];
+        m.nodes = &nodes[offset];
+        m.numnodes = 0;
+        offset += m.numtris;
+    }
+    const bool usecache = modelcache && cachename.size();
+    ullong key = 0;
+    bool cached = false;
+    if(usecache)
+    {
+        key = cachekey();
+        cached = loadcache(cachename, key, tribbs);
+        if(!cached) //trees are built from scratch after a partial read
+        {
+            for(mesh &m : meshes)
+            {
+                m.numnodes = 0;
+            }
+        }
+    }
+    parallelfor(cached ? 0 : meshes.size(), [&] (size_t i)
     {
-        m.tribbs = dsttri;
+        mesh &m = meshes[i];
+        mesh::tribb *dsttri = &tribbs[firsttri[i]];
         const mesh::tri *srctri = m.tris;
         vec mmin(1e16f, 1e16f, 1e16f), mmax(-1e16f, -1e16f, -1e16f);
         for(int j = 0; j < m.numtris; ++j)
@@ -502,28 +785,53 @@ BIH::BIH(const std::vector<mesh> &buildmeshes)
         }
         m.bbmin = mmin;
         m.bbmax = mmax;
-        bbmin.min(mmin);
-        bbmax.max(mmax);
-    }
 
-    center = vec(bbmin).add(bbmax).mul(0.5f);
-    radius = vec(bbmax).sub(bbmin).mul(0.5f).magnitude();
-
-    nodes = new Node[numtris];
-    Node *curnode = nodes;
-    uint *indices = new uint[numtris];
-    for(mesh &m : meshes)
-    {
-        m.nodes = curnode;
+        if(m.numtris == 1)
+        {
+            //a lone triangle fills both children of the root
+            ivec c(m.tribbs[0].center),
+                 r(m.tribbs[0].radius);
+            Node &root = m.nodes[m.numnodes++];
+            root.split[0] = static_cast<short>(c.x + r.x);
+            root.split[1] = static_cast<short>(c.x - r.x);
+            root.setchildren(0, 0, true, 0, true);
+            return;
+        }
+        if(m.numtris < 1)
+        {
+            return;
+        }
+        std::vector<uint> indices(m.numtris);
         for(int j = 0; j < m.numtris; ++j)
         {
             indices[j] = j;
         }
-        build(m, indices, m.numtris, ivec::floor(m.bbmin), ivec::ceil(m.bbmax));
-        curnode += m.numnodes;
+        if(bihsah)
+        {
+            buildsah(m, indices.data(), m.numtris, 0);
+        }
+        else
+        {
+            build(m, indices.data(), m.numtris, ivec::floor(m.bbmin), ivec::ceil(m.bbmax));
+        }
+    });
+    for(const mesh &m : meshes)
+    {
+        if(!m.numtris)
+        {
+            continue;
+        }
+        bbmin.min(m.bbmin);
+        bbmax.max(m.bbmax);
+        numnodes += m.numnodes;
+    }
+
+    center = vec(bbmin).add(bbmax).mul(0.5f);
+    radius = vec(bbmax).sub(bbmin).mul(0.5f).magnitude();
+    if(usecache && !cached)
+    {
+        savecache(cachename, key);
     }
-    delete[] indices;
-    numnodes = static_cast<int>(curnode - nodes);
 }
 
 BIH::~BIH()
@@ -586,17 +894,18 @@ bool mmintersect(const extentity &e, const vec &o, const vec &ray, float maxdist
         if(!(mode&Ray_Shadow))
         {
             //reorientation
+            vec &surface = worldquery().hitsurface;
             if(roll != 0)
             {
-                hitsurface.rotate_around_y(sincosmod360(roll));
+                surface.rotate_around_y(sincosmod360(roll));
             }
             if(pitch != 0)
             {
-                hitsurface.rotate_around_x(sincosmod360(pitch));
+                surface.rotate_around_x(sincosmod360(pitch));
             }
             if(yaw != 0)
             {
-                hitsurface.rotate_around_z(sincosmod360(yaw));
+                surface.rotate_around_z(sincosmod360(yaw));
             }
         }
         return true;
@@ -1016,7 +1325,7 @@ void BIH::collide(const mesh &m, const physent *d, const vec &dir, float cutoff,
                     }
                     else
                     {
-                        collide<C>(m, d, dir, cutoff, center, radius, orient, dist, &nodes[curnode->childindex(nearidx)], bo, br, cwall);
+                        collide<C>(m, d, dir, cutoff, center, radius, orient, dist, curnode + curnode->childindex(nearidx), bo, br, cwall);
                         curnode += curnode->childindex(faridx);
                         continue;
                     }
@@ -1082,7 +1391,7 @@ CollisionInfo BIH::ellipsecollide(const physent *d, const vec &dir, float cutoff
     vec cwall(0,0,0);
     for(const mesh &m : meshes)
     {
-        if(!(m.flags&Mesh_Collide) || m.flags&Mesh_NoClip)
+        if(!m.numnodes || !(m.flags&Mesh_Collide) || m.flags&Mesh_NoClip)
         {
             continue;
         }
@@ -1142,7 +1451,7 @@ CollisionInfo BIH::boxcollide(const physent *d, const vec &dir, float cutoff, co
     vec cwall;
     for(const mesh &m : meshes)
     {
-        if(!(m.flags&Mesh_Collide) || m.flags&Mesh_NoClip)
+        if(!m.numnodes || !(m.flags&Mesh_Collide) || m.flags&Mesh_NoClip)
         {
             continue;
         }
@@ -1229,7 +1538,7 @@ void BIH::genstaintris(std::vector<std::array<vec, 3>> &tris, const mesh &m, con
                     }
                     else
                     {
-                        genstaintris(tris, m, center, radius, orient, &nodes[curnode->childindex(nearidx)], bo, br);
+                        genstaintris(tris, m, center, radius, orient, curnode + curnode->childindex(nearidx), bo, br);
                         curnode += curnode->childindex(faridx);
                         continue;
                     }
@@ -1293,7 +1602,7 @@ void BIH::genstaintris(std::vector<std::array<vec, 3>> &tris, const vec &staince
          iradius = ivec(imax).sub(imin).add(1).div(2);
     for(const mesh &m : meshes)
     {
-        if(!(m.flags&Mesh_Render) || m.flags&Mesh_Alpha)
+        if(!m.numnodes || !(m.flags&Mesh_Render) || m.flags&Mesh_Alpha)
         {
             continue;
         }
@@ -23,30 +23,34 @@ class BIH final
             /**
              * @brief Array of child indices, packed with leaf and axis information.
              *
-             * 14 bits of index data in each ushort, with two bits of axis data
+             * 30 bits of index data in each uint, with two bits of axis data
              * and two bits of leaf data in the first two bits of the 0th and 1st
              * entry respectively:
              *
-             *  |aaii'iiii'iiii'iiii|llii'iiii'iiii'iiii|
+             *  |aaii'iiii'...'iiii|llii'iiii'...'iiii|
              *
+             * Indices of child nodes are relative to this node; indices of leaves
+             * are triangle indices in the mesh.
              */
-            std::array<ushort, 2> child;
+            std::array<uint, 2> child;
+
+            static constexpr uint maxindex = (1u<<30) - 1; //largest index that fits in child
 
             /**
              * @brief Returns top two bits of child[0] which store axis information
              *
-             * The bottom 14 bits should be accessed separately with childindex(0).
+             * The bottom 30 bits should be accessed separately with childindex(0).
              *
              * @return top two bits (0-3).
              */
             int axis() const;
 
             /**
-             * @brief Returns last 14 bits of the child index (0-16383).
+             * @brief Returns last 30 bits of the child index (0-maxindex).
              *
              * @param which element of child array, valid values: 0,1
              *
-             * @return last 14 bits (0-16383).
+             * @return last 30 bits (0-maxindex).
              */
             int childindex(int which) const;
 
@@ -58,6 +62,17 @@ class BIH final
              * @return whether top 1|2 bits are set
              */
             bool isleaf(int which) const;
+
+            /**
+             * @brief Sets the split axis and both children of the node.
+             *
+             * @param axis the split axis (0-2)
+             * @param left the left child's index, no larger than maxindex
+             * @param leftleaf whether the left child is a triangle rather than a node
+             * @param right the right child's index, no larger than maxindex
+             * @param rightleaf whether the right child is a triangle rather than a node
+             */
+            void setchildren(int axis, uint left, bool leftleaf, uint right, bool rightleaf);
         };
 
         enum
@@ -72,7 +87,7 @@ class BIH final
         class mesh final
         {
             public:
-                static constexpr int maxtriangles = 1<<14;
+                static constexpr int maxtriangles = Node::maxindex + 1; //triangles per mesh addressable by Node::child
 
                 matrix4x3 xform;
                 matrix4x3 invxform() const;
@@ -136,7 +151,24 @@ class BIH final
                 int posstride, tcstride;
         };
 
-        BIH(const std::vector<mesh> &buildmeshes);
+        /**
+         * @brief Builds a BIH for a set of meshes.
+         *
+         * Each mesh gets its own tree, and the meshes are built in parallel on
+         * the worker threads. Trees are built with the surface area heuristic
+         * (see buildsah()), or with midpoint splits if `bihsah` is 0.
+         *
+         * If the modelcache variable is set and a cache name is given, the
+         * trees are read from that model cache file instead when it was saved
+         * for the same triangles, transforms and `bihsah`, and saved to it
+         * after being built otherwise.
+         *
+         * @param buildmeshes the meshes to build trees for, with no more than
+         *        mesh::maxtriangles triangles each
+         * @param cachename the name to pass to modelcachename(), or empty to
+         *        always build the trees
+         */
+        BIH(const std::vector<mesh> &buildmeshes, const std::string &cachename = "");
 
         ~BIH();
 
@@ -155,12 +187,31 @@ class BIH final
 
         static constexpr float maxcollidedistance = -1e9f;
 
+        ullong cachekey() const; //hash of the inputs to the trees, for the model cache
+        bool loadcache(const std::string &name, ullong key, mesh::tribb *tribbs); //fills nodes and tribbs, which must be allocated
+        bool savecache(const std::string &name, ullong key) const;
+
         template<int C>
         void collide(const mesh &m, const physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, Node *curnode, const ivec &bo, const ivec &br, vec &cwall) const;
         template<int C>
         void tricollide(const mesh &m, int tidx, const physent *d, const vec &dir, float cutoff, const vec &center, const vec &radius, const matrix4x3 &orient, float &dist, const ivec &bo, const ivec &br, vec &cwall) const;
 
         void build(mesh &m, uint *indices, int numindices, const ivec &vmin, const ivec &vmax) const;
+        /**
+         * @brief Builds the nodes for a set of triangles using the surface area heuristic.
+         *
+         * Splits the triangles along the axis and position (binned by triangle
+         * center) which minimize the sum of each side's bounding box surface area
+         * times its triangle count. Falls back to a median split if the centers
+         * cannot be separated, or below a maximum depth so that degenerate meshes
+         * do not create very deep trees.
+         *
+         * @param m the mesh whose nodes to add to
+         * @param indices the triangles to build nodes for, which are reordered
+         * @param numindices the number of triangles, at least 2
+         * @param depth the depth of the node being built
+         */
+        void buildsah(mesh &m, uint *indices, int numindices, int depth) const;
         bool traverse(const mesh &m, const vec &o, const vec &ray, const vec &invray, float maxdist, float &dist, int mode, const Node *curnode, float tmin, float tmax) const;
         void genstaintris(std::vector<std::array<vec, 3>> &tris, const mesh &m, const vec &center, float radius, const matrix4x3 &orient, Node *curnode, const ivec &bo, const ivec &br) const;
         void genstaintris(std::vector<std::array<vec, 3>> &tris, const mesh &m, int tidx, const vec &center, float radius, const matrix4x3 &orient, const ivec &bo, const ivec &br) const;
@@ -82,7 +82,7 @@ void cube::freecubeext(cube &c)
 {
     if(c.ext)
     {
-        delete[] reinterpret_cast<uchar *>(c.ext);
+        deletecubeext(c.ext);
         c.ext = nullptr;
     }
 }
@@ -121,9 +121,8 @@ void cube::discardchildren(bool fixtex, int depth)
                 faces[0] = facesolid;
             }
         }
-        delete children;
+        deletecubes(children);
         children = nullptr;
-        allocnodes--;
     }
 }
 
@@ -716,7 +715,8 @@ struct std::hash<cube::cfkey>
 void cube::genmerges(cube * root, const ivec &o, int size)
 {
     static std::unordered_map<cfkey, cfpolys> cpolys;
-    neighborstack[++neighbordepth] = this;
+    querycontext &query = worldquery();
+    query.neighborstack[++query.neighbordepth] = this;
     for(int i = 0; i < 8; ++i)
     {
         ivec co(i, o, size);
@@ -765,7 +765,7 @@ void cube::genmerges(cube * root, const ivec &o, int size)
             cpolys.clear();
         }
     }
-    --neighbordepth;
+    --query.neighbordepth;
 }
 
 void cube::calcmerges()
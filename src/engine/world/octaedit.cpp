@@ -17,6 +17,7 @@
 #include "../../shared/glemu.h"
 #include "../../shared/glexts.h"
 #include "../../shared/stream.h"
+#include "../../shared/threadpool.h"
 
 #include "light.h"
 #include "octaedit.h"
@@ -467,11 +468,11 @@ void cubeworld::commitchanges(bool force)
     }
     haschanged = false;
     int oldlen = valist.size();
-    resetclipplanes();
     entitiesinoctanodes();
     inbetweenframes = false;
     octarender();
     inbetweenframes = true;
+    commitclipplanes(); //drops planes generated from the faces as they were before octarender()
     setupmaterials(oldlen);
     clearshadowcache();
     updatevabbs();
@@ -480,6 +481,7 @@ void cubeworld::commitchanges(bool force)
 void cubeworld::changed(const ivec &bbmin, const ivec &bbmax, bool commit)
 {
     readychanges(bbmin, bbmax, *worldroot, ivec(0, 0, 0), mapsize()/2);
+    invalidateclipplanes(bbmin, bbmax);
     haschanged = true;
 
     if(commit)
@@ -494,7 +496,10 @@ void cubeworld::changed(const block3 &sel, bool commit)
     {
         return;
     }
-    readychanges(ivec(sel.o).sub(1), ivec(sel.s).mul(sel.grid).add(sel.o).add(1), *worldroot, ivec(0, 0, 0), mapsize()/2);
+    ivec bbmin = ivec(sel.o).sub(1),
+         bbmax = ivec(sel.s).mul(sel.grid).add(sel.o).add(1);
+    readychanges(bbmin, bbmax, *worldroot, ivec(0, 0, 0), mapsize()/2);
+    invalidateclipplanes(bbmin, bbmax);
     haschanged = true;
     if(commit)
     {
@@ -922,15 +927,45 @@ static void unpackvslots(block3 &b, ucharbuf &buf)
     unpackingvslots.clear();
 }
 
-static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen)
+static VAR(editcompresslevel, 0, 9, 9);    //zlib level to compress packed edits with
+static VAR(editcompressthreads, 0, 0, 64); //most threads to compress packed edits with, 0 for all workers
+
+/**
+ * Compresses a packed edit in the zlib format, as compress2() would. Edits
+ * larger than one deflate block are compressed as independent blocks on up to
+ * threads worker threads; the output is still a single zlib stream, so
+ * uncompresseditinfo() reads either form.
+ */
+static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen, int level, int threads)
 {
     uLongf len = compressBound(inlen);
     if(len > (1<<20))
     {
         return false;
     }
+    if(threads > 1 && inlen > (1<<17))
+    {
+        std::vector<uchar> packed = {0x78, 0x9C}; //zlib header: 32 KiB window, no preset dictionary
+        if(!deflateblocks(inbuf, inlen, 0, packed, level, threads, true))
+        {
+            return false;
+        }
+        uint adler = adler32(adler32(0, nullptr, 0), inbuf, inlen);
+        for(int i = 24; i >= 0; i -= 8)
+        {
+            packed.push_back((adler>>i)&0xFF);
+        }
+        if(packed.size() > (1<<16))
+        {
+            return false;
+        }
+        outbuf = new uchar[packed.size()];
+        std::memcpy(outbuf, packed.data(), packed.size());
+        outlen = packed.size();
+        return true;
+    }
     outbuf = new uchar[len];
-    if(!outbuf || compress2(static_cast<Bytef *>(outbuf), &len, static_cast<const Bytef *>(inbuf), inlen, Z_BEST_COMPRESSION) != Z_OK || len > (1<<16))
+    if(!outbuf || compress2(static_cast<Bytef *>(outbuf), &len, static_cast<const Bytef *>(inbuf), inlen, level) != Z_OK || len > (1<<16))
     {
         delete[] outbuf;
         outbuf = nullptr;
@@ -940,6 +975,11 @@ static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int
     return true;
 }
 
+static bool compresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen)
+{
+    return compresseditinfo(inbuf, inlen, outbuf, outlen, editcompresslevel, editcompressthreads ? editcompressthreads : numworkers());
+}
+
 //used in iengine.h
 bool uncompresseditinfo(const uchar *inbuf, int inlen, uchar *&outbuf, int &outlen)
 {
@@ -1328,13 +1368,14 @@ static void genprefabmesh(prefabmesh &r, const cube &c, const ivec &co, int size
     //recursively apply to children
     if(c.children)
     {
-        neighborstack[++neighbordepth] = &(*c.children)[0];
+        querycontext &query = worldquery();
+        query.neighborstack[++query.neighbordepth] = &(*c.children)[0];
         for(int i = 0; i < 8; ++i)
         {
             ivec o(i, co, size/2);
             genprefabmesh(r, (*c.children)[i], o, size/2);
         }
-        --neighbordepth;
+        --query.neighbordepth;
     }
     else if(!(c.isempty()))
     {
@@ -1403,13 +1444,14 @@ void cubeworld::genprefabmesh(prefab &p)
     LOOP_XYZ(b, b.grid, if(!(s[i].isempty()) || s[i].children) pastecube(s[i], c); i++);
 
     prefabmesh r;
-    neighborstack[++neighbordepth] = &(*worldroot)[0];
+    querycontext &query = worldquery();
+    query.neighborstack[++query.neighbordepth] = &(*worldroot)[0];
     //recursively apply to children
     for(int i = 0; i < 8; ++i)
     {
         ::genprefabmesh(r, (*worldroot)[i], ivec(i, ivec(0, 0, 0), mapsize()/2), mapsize()/2);
     }
-    --neighbordepth;
+    --query.neighbordepth;
     r.setup(p);
 
     freeocta(worldroot);
@@ -2191,7 +2233,8 @@ void initoctaeditcmds()
     EDITSTAT(vvt, (vverts*100)/std::max(wverts, 1));
     EDITSTAT(evt, xtraverts);
     EDITSTAT(eva, xtravertsva);
-    EDITSTAT(octa, allocnodes*8);
+    EDITSTAT(octa, getallocnodes()*8);
+    EDITSTAT(octakb, static_cast<int>((getoctapoolstats().nodebytes + getoctapoolstats().extbytes)/1024));
     EDITSTAT(va, allocva);
     EDITSTAT(gldes, glde);
     EDITSTAT(geombatch, gbatches);
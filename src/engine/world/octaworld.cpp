@@ -15,6 +15,11 @@
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
 
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <thread>
+
 #include "light.h"
 #include "octacube.h"
 #include "octaworld.h"
@@ -27,7 +32,12 @@
 #include "render/octarender.h"
 #include "render/renderwindow.h"
 
-int allocnodes = 0;
+static std::atomic<int> allocnodes = 0; //newcubes() is called from worker threads when loading maps
+
+int getallocnodes()
+{
+    return allocnodes;
+}
 
 int oppositeorient(int orient)
 {
@@ -46,9 +56,191 @@ static const uchar faceedgesidx[6][4] = // ordered edges surrounding each orient
 
 cubeworld rootworld;
 
+namespace
+{
+    /**
+     * @brief Allocator handing out fixed size blocks carved from large pages.
+     *
+     * Freed blocks are kept on a free list and reused before any new page is
+     * allocated, so consecutive allocations (such as the nodes of a map being
+     * loaded) end up next to each other in memory. Once every block has been
+     * returned, as happens when a map is unloaded, the pages are released all at
+     * once rather than block by block.
+     *
+     * Allocation is locked, as cubeexts may be created by worker threads (see
+     * vacollect::runjob()).
+     */
+    class blockpool final
+    {
+        public:
+            blockpool(size_t size) : blocksize(align(size)), blocksperpage(std::max(pagesize/blocksize, minblocks))
+            {
+            }
+
+            void *alloc()
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if(!freelist)
+                {
+                    addpage();
+                }
+                freeblock *b = freelist;
+                freelist = b->next;
+                numused++;
+                return b;
+            }
+
+            void free(void *p)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                freeblock *b = static_cast<freeblock *>(p);
+                b->next = freelist;
+                freelist = b;
+                if(!--numused)
+                {
+                    releasepages();
+                }
+            }
+
+            //number of blocks currently handed out
+            size_t used() const
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                return numused;
+            }
+
+            //bytes of memory currently held by pages
+            size_t reserved() const
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                return pages.size()*blocksperpage*blocksize;
+            }
+
+        private:
+            static constexpr size_t pagesize = 1<<16,
+                                    minblocks = 16;
+
+            struct freeblock final
+            {
+                freeblock *next;
+            };
+
+            const size_t blocksize,
+                         blocksperpage;
+            std::vector<uchar *> pages;
+            freeblock *freelist = nullptr;
+            size_t numused = 0;
+            mutable std::mutex lock;
+
+            static size_t align(size_t size)
+            {
+                constexpr size_t alignment = alignof(std::max_align_t);
+                return (std::max(size, sizeof(freeblock)) + alignment - 1) & ~(alignment - 1);
+            }
+
+            void addpage()
+            {
+                uchar *page = new uchar[blocksperpage*blocksize];
+                pages.push_back(page);
+                //push in reverse so that blocks are handed out in address order
+                for(size_t i = blocksperpage; i-- > 0;)
+                {
+                    freeblock *b = reinterpret_cast<freeblock *>(page + i*blocksize);
+                    b->next = freelist;
+                    freelist = b;
+                }
+            }
+
+            void releasepages()
+            {
+                for(uchar *page : pages)
+                {
+                    delete[] page;
+                }
+                pages.clear();
+                freelist = nullptr;
+            }
+    };
+
+    //the pools are never destroyed, as static objects in other files (such as the
+    //prefab cache) may still free their cubes during shutdown
+    blockpool &nodepool()
+    {
+        static blockpool *pool = new blockpool(sizeof(std::array<cube, 8>));
+        return *pool;
+    }
+
+    //cubeexts are sized by their vertex capacity, in classes of 0, 1, 2, 4 ... 256 verts
+    constexpr int numextclasses = 10;
+
+    constexpr size_t extclasssize(int extclass)
+    {
+        return sizeof(cubeext) + (extclass ? 1<<(extclass-1) : 0)*sizeof(vertinfo);
+    }
+
+    blockpool &extpool(int extclass)
+    {
+        static std::array<blockpool *, numextclasses> pools = [] ()
+        {
+            std::array<blockpool *, numextclasses> newpools;
+            for(int i = 0; i < numextclasses; ++i)
+            {
+                newpools[i] = new blockpool(extclasssize(i));
+            }
+            return newpools;
+        }();
+        return *pools[extclass];
+    }
+
+    int getextclass(int maxverts)
+    {
+        int extclass = 0;
+        while(extclasssize(extclass) < sizeof(cubeext) + maxverts*sizeof(vertinfo))
+        {
+            extclass++;
+        }
+        return extclass;
+    }
+}
+
+octapoolstats getoctapoolstats()
+{
+    octapoolstats stats;
+    stats.nodes = nodepool().used();
+    stats.nodebytes = nodepool().reserved();
+    stats.exts = 0;
+    stats.extbytes = 0;
+    for(int i = 0; i < numextclasses; ++i)
+    {
+        stats.exts += extpool(i).used();
+        stats.extbytes += extpool(i).reserved();
+    }
+    return stats;
+}
+
+static void printoctapool()
+{
+    const octapoolstats stats = getoctapoolstats();
+    conoutf("octree nodes: %zu (%zu KB reserved)", stats.nodes*8, stats.nodebytes/1024);
+    for(int i = 0; i < numextclasses; ++i)
+    {
+        size_t used = extpool(i).used();
+        if(used)
+        {
+            conoutf("cubeexts with %d verts: %zu (%zu KB reserved)", i ? 1<<(i-1) : 0, used, extpool(i).reserved()/1024);
+        }
+    }
+    conoutf("cubeexts: %zu (%zu KB reserved)", stats.exts, stats.extbytes/1024);
+}
+
+void deletecubeext(cubeext *ext)
+{
+    extpool(getextclass(ext->maxverts)).free(ext);
+}
+
 cubeext *growcubeext(cubeext *old, int maxverts)
 {
-    cubeext *ext = reinterpret_cast<cubeext *>(new uchar[sizeof(cubeext) + maxverts*sizeof(vertinfo)]);
+    cubeext *ext = static_cast<cubeext *>(extpool(getextclass(maxverts)).alloc());
     if(old)
     {
         ext->va = old->va;
@@ -75,7 +267,7 @@ void setcubeext(cube &c, cubeext *ext)
     c.ext = ext;
     if(old)
     {
-        delete[] reinterpret_cast<uchar *>(old);
+        deletecubeext(old);
     }
 }
 
@@ -104,7 +296,7 @@ cubeext *newcubeext(cube &c, int maxverts, bool init)
 
 std::array<cube, 8> *newcubes(uint face, int mat)
 {
-    std::array<cube, 8> *ca = new std::array<cube, 8>;
+    std::array<cube, 8> *ca = new (nodepool().alloc()) std::array<cube, 8>;
     for(int i = 0; i < 8; ++i)
     {
         cube &c = (*ca)[i];
@@ -146,8 +338,14 @@ void freeocta(std::array<cube, 8> *&c)
     {
         (*c)[i].discardchildren();
     }
-    delete c;
+    deletecubes(c);
     c = nullptr;
+}
+
+void deletecubes(std::array<cube, 8> *c)
+{
+    c->~array();
+    nodepool().free(c);
     allocnodes--;
 }
 
@@ -301,8 +499,184 @@ int cubeworld::lookupmaterial(const vec &v)
     return c->material;
 }
 
-std::array<const cube *, 32> neighborstack;
-int neighbordepth = -1;
+static VARF(clipstoresize, 256, 1<<11, 1<<16, resetqueryclipplanes()); //number of clip planes each query context keeps, rounded down to a power of two
+
+namespace
+{
+    constexpr size_t maxclipchanges = 256; //changed() boxes kept before the stores are reset instead
+    constexpr int maxclipoffset = 4;
+
+    int clipstoreresets = 0;           //number of times every store has been invalidated
+    size_t clipstoreslots = 1<<11;     //clipstoresize rounded down to a power of two
+    std::vector<std::pair<ivec, ivec>> clipchanges; //changed() boxes since the last reset, padded to include neighbors
+    size_t clipcommitted = 0;          //number of boxes in clipchanges which were made before the last commitclipplanes()
+
+    //the query contexts which exist, and the totals of those which no longer do
+    struct querycontextlist final
+    {
+        std::mutex lock;
+        std::vector<const querycontext *> contexts;
+        clipplanestats dead = {0, 0, 0};
+    };
+
+    //never destroyed, as worker threads may destroy their contexts after static destruction
+    querycontextlist &querycontexts()
+    {
+        static querycontextlist *list = new querycontextlist;
+        return *list;
+    }
+
+    void addquerycontext(const querycontext *q)
+    {
+        querycontextlist &list = querycontexts();
+        std::lock_guard<std::mutex> guard(list.lock);
+        list.contexts.push_back(q);
+    }
+}
+
+querycontext::querycontext() : neighbordepth(-1), lu(ownlu), lusize(ownlusize), hitsurface(ownsurface), cliphits(0), clipmisses(0), ownlusize(0)
+{
+    addquerycontext(this);
+}
+
+querycontext::querycontext(ivec &lookup, int &lookupsize, vec &surface) : neighbordepth(-1), lu(lookup), lusize(lookupsize), hitsurface(surface), cliphits(0), clipmisses(0), ownlusize(0)
+{
+    addquerycontext(this);
+}
+
+querycontext::~querycontext()
+{
+    querycontextlist &list = querycontexts();
+    std::lock_guard<std::mutex> guard(list.lock);
+    list.dead.hits += cliphits;
+    list.dead.misses += clipmisses;
+    list.contexts.erase(std::find(list.contexts.begin(), list.contexts.end(), this));
+}
+
+const cube &querycontext::lookupcube(const ivec &to)
+{
+    return rootworld.lookupcube(to, 0, lu, lusize);
+}
+
+clipplanes &querycontext::getclipbounds(const cube &c, const ivec &o, int size, int offset)
+{
+    if(clipstore.size() != clipstoreslots)
+    {
+        clipstore.assign(clipstoreslots, clipentry());
+        for(clipentry &e : clipstore)
+        {
+            e.resets = -1;
+        }
+    }
+    clipentry &e = clipstore[(reinterpret_cast<size_t>(&c)/sizeof(cube)*maxclipoffset + offset) & (clipstoreslots-1)];
+    //a cube freed and reallocated elsewhere without a changed() call keeps its address but not its position
+    if(e.p.owner == &c && e.p.version == offset && e.resets == ::clipstoreresets && e.o == o && e.size == size)
+    {
+        bool valid = true;
+        for(; e.changes < clipchanges.size(); e.changes++)
+        {
+            const ivec &bbmin = clipchanges[e.changes].first,
+                       &bbmax = clipchanges[e.changes].second;
+            if(o.x <= bbmax.x && o.y <= bbmax.y && o.z <= bbmax.z &&
+               o.x + size >= bbmin.x && o.y + size >= bbmin.y && o.z + size >= bbmin.z)
+            {
+                valid = false;
+                break;
+            }
+        }
+        if(valid)
+        {
+            cliphits++;
+            return e.p;
+        }
+    }
+    clipmisses++;
+    e.o = o;
+    e.size = size;
+    e.resets = ::clipstoreresets;
+    e.changes = clipchanges.size();
+    e.p.owner = &c;
+    e.p.version = offset;
+    genclipbounds(c, o, size, e.p);
+    return e.p;
+}
+
+size_t querycontext::clipentries() const
+{
+    return std::count_if(clipstore.begin(), clipstore.end(), [] (const clipentry &e) { return e.resets == ::clipstoreresets; });
+}
+
+void resetqueryclipplanes()
+{
+    clipstoreresets++;
+    clipstoreslots = 1;
+    while(clipstoreslots*2 <= static_cast<size_t>(clipstoresize))
+    {
+        clipstoreslots *= 2;
+    }
+    clipchanges.clear();
+    clipcommitted = 0;
+}
+
+void invalidateclipplanes(const ivec &bbmin, const ivec &bbmax)
+{
+    if(clipchanges.size() >= maxclipchanges)
+    {
+        resetqueryclipplanes();
+        return;
+    }
+    clipchanges.emplace_back(ivec(bbmin).sub(1), ivec(bbmax).add(1));
+}
+
+void commitclipplanes()
+{
+    size_t pending = clipchanges.size();
+    if(pending + (pending - clipcommitted) > maxclipchanges)
+    {
+        resetqueryclipplanes();
+        return;
+    }
+    //the boxes are already padded, so they are added again as they are
+    for(size_t i = clipcommitted; i < pending; ++i)
+    {
+        clipchanges.push_back(clipchanges[i]);
+    }
+    clipcommitted = clipchanges.size();
+}
+
+clipplanestats getclipplanestats()
+{
+    querycontextlist &list = querycontexts();
+    std::lock_guard<std::mutex> guard(list.lock);
+    clipplanestats stats = list.dead;
+    for(const querycontext *q : list.contexts)
+    {
+        stats.hits += q->cliphits;
+        stats.misses += q->clipmisses;
+        stats.entries += q->clipentries();
+    }
+    return stats;
+}
+
+static void printclipplanes()
+{
+    const clipplanestats stats = getclipplanestats();
+    size_t queries = stats.hits + stats.misses;
+    conoutf("clip planes: %zu hits, %zu misses (%.1f%% hit), %zu stored", stats.hits, stats.misses, queries ? 100.0*stats.hits/queries : 0.0, stats.entries);
+}
+
+namespace
+{
+    const std::thread::id mainthread = std::this_thread::get_id(); //static initialization runs on the main thread
+    querycontext mainquery(lu, lusize, hitsurface);
+}
+
+querycontext &worldquery()
+{
+    thread_local querycontext threadquery;
+    thread_local querycontext &query = std::this_thread::get_id() == mainthread ? mainquery : threadquery;
+    return query;
+}
 
 const cube &cubeworld::neighborcube(int orient, const ivec &co, int size, ivec &ro, int &rsize)
 {
@@ -326,16 +700,17 @@ const cube &cubeworld::neighborcube(int orient, const ivec &co, int size, ivec &
     }
     int scale = worldscale;
     const cube *nc = &(*worldroot)[0];
-    if(neighbordepth >= 0)
+    const querycontext &query = worldquery();
+    if(query.neighbordepth >= 0)
     {
-        scale -= neighbordepth + 1;
+        scale -= query.neighbordepth + 1;
         diff >>= scale;
         do
         {
             scale++;
             diff >>= 1;
         } while(diff);
-        nc = neighborstack[worldscale - scale];
+        nc = query.neighborstack[worldscale - scale];
     }
     scale--;
     nc = &nc[OCTA_STEP(n.x, n.y, n.z, scale)];
@@ -789,6 +1164,7 @@ void cubeworld::remip()
         ::remip((*worldroot)[i], o, mapsize()>>2);
     }
     (*worldroot)[0].calcmerges(); //created as result of calcmerges being cube member
+    resetclipplanes();
 }
 
 cubeext &ext(cube &c)
@@ -1935,4 +2311,6 @@ uchar octaboxoverlap(const ivec &o, int size, const ivec &bbmin, const ivec &bbm
 void initoctaworldcmds()
 {
     addcommand("printcube", reinterpret_cast<identfun>(printcube), "", Id_Command);
+    addcommand("printoctapool", reinterpret_cast<identfun>(printoctapool), "", Id_Command);
+    addcommand("printclipplanes", reinterpret_cast<identfun>(printclipplanes), "", Id_Command);
 }
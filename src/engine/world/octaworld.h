@@ -178,7 +178,36 @@ extern int wtris, wverts,
            glde, gbatches,
            rplanes;
 
-extern int allocnodes;
+/**
+ * @brief Returns the number of octets of cubes allocated by newcubes() and not yet freed.
+ *
+ * The count is kept atomically, since octree nodes are allocated on worker
+ * threads while maps are loaded.
+ *
+ * @return the number of allocated octets
+ */
+extern int getallocnodes();
+
+/**
+ * @brief Usage of the pooled allocators backing octree nodes and cubeexts.
+ */
+struct octapoolstats final
+{
+    size_t nodes,     /**< number of octets of cubes allocated */
+           nodebytes, /**< bytes reserved by pages for octets of cubes */
+           exts,      /**< number of cubeexts allocated, of all sizes */
+           extbytes;  /**< bytes reserved by pages for cubeexts */
+};
+
+/**
+ * @brief Returns the usage of the octree node and cubeext pools.
+ *
+ * The reserved bytes include space in partially used pages, and therefore show
+ * how much memory the octree of the current map is actually holding.
+ *
+ * @return an octapoolstats object containing the current usage
+ */
+extern octapoolstats getoctapoolstats();
 
 enum
 {
@@ -189,11 +218,11 @@ enum
 };
 
 /**
- * @brief Returns an octet of cubes allocated on the heap.
+ * @brief Returns an octet of cubes allocated from the octree node pool.
  *
  * These cubes should be freed with freeocta() to prevent a leak.
  *
- * `allocnodes` is incremented by one for each call of this function.
+ * getallocnodes() is incremented by one for each call of this function.
  *
  * @param face The face values to set the eight cubes
  * @param mat The material mask to assign to the cubes
@@ -202,11 +231,22 @@ enum
  */
 extern std::array<cube, 8> *newcubes(uint face = faceempty, int mat = Mat_Air);
 
+/**
+ * @brief Frees an octet of cubes, without discarding their children.
+ *
+ * Returns the octet's memory to the octree node pool and decrements getallocnodes().
+ * Use freeocta() to also free the children of the cubes.
+ *
+ * @param c the octet of cubes to free
+ */
+extern void deletecubes(std::array<cube, 8> *c);
+
 /**
  * @brief Moves the cubeext to a new one with the specified vertex array size
  *
  * Does not necessarily create a larger cubeext, if the maxverts passed is smaller
- * the previously allocated size. The new cubeext is allocated on the heap.
+ * the previously allocated size. The new cubeext is allocated from the cubeext
+ * pool for its size, and should be freed with deletecubeext().
  *
  * @param the cubeext to replace
  * @param maxverts the size of the vertex array to allocate
@@ -226,6 +266,15 @@ extern cubeext *growcubeext(cubeext *ext, int maxverts);
  * @param ext the cubeext to assign
  */
 extern void setcubeext(cube &c, cubeext *ext);
+
+/**
+ * @brief Returns a cubeext's memory to the cubeext pool.
+ *
+ * Does not free the ext's va or entities.
+ *
+ * @param ext the cubeext to free
+ */
+extern void deletecubeext(cubeext *ext);
 extern cubeext *newcubeext(cube &c, int maxverts = 0, bool init = true);
 extern void getcubevector(const cube &c, int d, int x, int y, int z, ivec &p);
 extern void setcubevector(cube &c, int d, int x, int y, int z, const ivec &p);
@@ -243,8 +292,176 @@ extern int familysize(const cube &c);
 extern void freeocta(std::array<cube, 8> *&c);
 extern void validatec(std::array<cube, 8> *&c, int size = 0);
 
-extern std::array<const cube *, 32> neighborstack;
-extern int neighbordepth;
+/**
+ * @brief Scratch state used by queries on the world octree.
+ *
+ * Queries such as cubeworld::raycube(), cubeworld::lookupcube() and
+ * cubeworld::neighborcube() keep state between and during calls: the path to
+ * the cube being walked, the result of the last lookup or ray, and the cache
+ * of clip planes. Each thread has its own context holding this state, returned
+ * by worldquery(), so read-only queries may be made from several threads at
+ * once so long as the world is not being modified.
+ *
+ * The main thread's context stores lookups and ray hits in the lu, lusize and
+ * hitsurface globals, as callers on the main thread expect; contexts on other
+ * threads store them in their own fields.
+ */
+class querycontext final
+{
+    public:
+        std::array<const cube *, 32> neighborstack; //first children of the cubes above the cube being walked
+        int neighbordepth;                          //index of the deepest entry in neighborstack, or -1 if not walking
+        ivec &lu;                                   //origin of the cube found by the last lookupcube()
+        int &lusize;                                //size of the cube found by the last lookupcube()
+        vec &hitsurface;                            //normal of the surface hit by the last raycube()
+
+        /**
+         * @brief Creates a context which stores query results in its own fields.
+         */
+        querycontext();
+
+        /**
+         * @brief Creates a context which stores query results in the passed variables.
+         */
+        querycontext(ivec &lookup, int &lookupsize, vec &surface);
+
+        ~querycontext();
+
+        querycontext(const querycontext &) = delete;
+        querycontext &operator=(const querycontext &) = delete;
+
+        /**
+         * @brief Finds the smallest existing cube containing a point.
+         *
+         * Unlike cubeworld::lookupcube(), never subdivides the world, and stores
+         * the cube's origin and size in this context's lu and lusize.
+         *
+         * @param to the point to look up
+         *
+         * @return the leaf cube containing the point
+         */
+        const cube &lookupcube(const ivec &to);
+
+        /**
+         * @brief Returns the clip bounds of a cube, from this context's store if possible.
+         *
+         * The store is direct mapped by the cube's address and offset, with
+         * `clipstoresize` slots. Planes are kept until the cube is covered by a
+         * cubeworld::changed() bounding box, the whole store is reset (see
+         * resetqueryclipplanes()), or another cube's planes take the slot. The
+         * boxes changed since an entry was last used are checked when it is
+         * found, so invalidation never scans the store. Entries are stored per
+         * offset, so that callers generating different sets of clip planes for
+         * the same cube do not evict each other's.
+         *
+         * The returned reference is only valid until the next call.
+         *
+         * @param c the cube to get the clip bounds of
+         * @param o the origin of the cube
+         * @param size the size of the cube
+         * @param offset which version of the planes to use, from 0 to 3
+         *
+         * @return the stored clip planes, with only the bounds generated if new
+         */
+        clipplanes &getclipbounds(const cube &c, const ivec &o, int size, int offset);
+
+        size_t cliphits,   //getclipbounds() calls answered from the store
+               clipmisses; //getclipbounds() calls which generated new bounds
+
+        /**
+         * @brief Returns the number of valid clip planes in this context's store.
+         */
+        size_t clipentries() const;
+
+    private:
+        //clip planes along with the position of the cube they were generated for
+        struct clipentry final
+        {
+            clipplanes p;
+            ivec o;
+            int size,
+                resets;     //value of the global reset count when the planes were generated, -1 if unused
+            size_t changes; //number of changed() boxes already checked against the planes
+        };
+
+        ivec ownlu;
+        int ownlusize;
+        vec ownsurface;
+        std::vector<clipentry> clipstore; //direct mapped by the cube's address and offset, allocated on first use
+};
+
+/**
+ * @brief Hit and miss counts of the clip plane stores of every query context.
+ */
+struct clipplanestats final
+{
+    size_t hits,    /**< number of clip bounds found in a store */
+           misses,  /**< number of clip bounds which had to be generated */
+           entries; /**< number of clip planes currently stored */
+};
+
+/**
+ * @brief Returns the calling thread's query context.
+ *
+ * The main thread is taken to be the thread which initialized the library.
+ *
+ * @return the query context for the calling thread
+ */
+extern querycontext &worldquery();
+
+/**
+ * @brief Whether the world is only prepared for collision and ray queries.
+ *
+ * For programs without a window or GL context, such as the tests and the
+ * benchmarks, which set it before creating a world. cubeworld::allchanged()
+ * then only resets the clip planes, places entities and sets the cubes'
+ * visibility; no vertex arrays, lighting or textures are set up. False by
+ * default, and never set by the engine itself.
+ */
+extern bool worldqueriesonly;
+
+/**
+ * @brief Invalidates the clip planes stored by every query context.
+ *
+ * Must not be called while queries are being made on other threads.
+ */
+extern void resetqueryclipplanes();
+
+/**
+ * @brief Invalidates the stored clip planes of cubes touching a box.
+ *
+ * Cubes sharing a face with the box are included, as their planes depend on
+ * whether their neighbors' faces are visible. Each query context regenerates
+ * the affected planes when querycontext::getclipbounds() next finds them.
+ *
+ * Must not be called while queries are being made on other threads.
+ *
+ * @param bbmin the minimum corner of the box
+ * @param bbmax the maximum corner of the box
+ */
+extern void invalidateclipplanes(const ivec &bbmin, const ivec &bbmax);
+
+/**
+ * @brief Invalidates the clip planes of every box changed since the last commit again.
+ *
+ * Clip planes depend on the cubes' visible faces, which are only recomputed
+ * when the changes are committed; planes generated between a
+ * cubeworld::changed() call and the commit would otherwise be kept with the old
+ * faces. Called by cubeworld::commitchanges() once the faces are up to date.
+ *
+ * Must not be called while queries are being made on other threads.
+ */
+extern void commitclipplanes();
+
+/**
+ * @brief Returns the hit and miss counts of every query context's clip plane store.
+ *
+ * Counts from contexts of threads which have exited are included. Must not be
+ * called while queries are being made on other threads.
+ *
+ * @return a clipplanestats object holding the totals
+ */
+extern clipplanestats getclipplanestats();
 extern int getmippedtexture(const cube &p, int orient);
 extern void forcemip(cube &c, bool fixtex = true);
 extern bool subdividecube(cube &c, bool fullcheck=true, bool brighten=true);
@@ -5,6 +5,7 @@
  */
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
+#include "../../shared/threadpool.h"
 
 #include <memory>
 #include <optional>
@@ -26,22 +27,9 @@
 int numdynents; //updated by engine, visible through iengine.h
 std::vector<dynent *> dynents;
 
-static constexpr int maxclipoffset = 4;
-static constexpr int maxclipplanes = 1024;
-static std::array<clipplanes, maxclipplanes> clipcache;
-static int clipcacheversion = -maxclipoffset;
-
 clipplanes &cubeworld::getclipbounds(const cube &c, const ivec &o, int size, int offset)
 {
-    //index is naive hash of difference between addresses (not necessarily contiguous) modulo cache size
-    clipplanes &p = clipcache[static_cast<int>(&c - &((*worldroot)[0])) & (maxclipplanes-1)];
-    if(p.owner != &c || p.version != clipcacheversion+offset)
-    {
-        p.owner = &c;
-        p.version = clipcacheversion+offset;
-        genclipbounds(c, o, size, p);
-    }
-    return p;
+    return worldquery().getclipbounds(c, o, size, offset);
 }
 
 static clipplanes &getclipbounds(const cube &c, const ivec &o, int size, const physent &d)
@@ -68,21 +56,13 @@ static int forceclipplanes(const cube &c, const ivec &o, int size, clipplanes &p
 
 void cubeworld::resetclipplanes()
 {
-    clipcacheversion += maxclipoffset;
-    if(!clipcacheversion)
-    {
-        for(clipplanes &i : clipcache)
-        {
-            i.clear();
-        }
-        clipcacheversion = maxclipoffset;
-    }
+    resetqueryclipplanes();
 }
 
 /////////////////////////  entity collision  ///////////////////////////////////////////////
 
 // info about collisions
-int collideinside; // whether an internal collision happened
+thread_local int collideinside; // whether an internal collision happened
 const physent *collideplayer; // whether the collection hit a player
 
 static CollisionInfo ellipseboxcollide(const physent *d, const vec &dir, const vec &origin, const vec &center, float yaw, float xr, float yr, float hi, float lo)
@@ -191,35 +171,150 @@ static CollisionInfo ellipsecollide(const physent *d, const vec &dir, const vec
     return {false, vec(0,0,0)};
 }
 
-static constexpr int dynentcachesize = 1024;
+/* dynent grid: a persistent spatial hash of the dynents, bucketed by their x,y
+ * position into square cells 2^dynentsize units across. Each dynent is kept in
+ * every cell its bounding circle overlaps, and only moves between cells when
+ * its cell range changes, so neighbor queries only look at nearby dynents.
+ */
+class dynentgrid final
+{
+    public:
+        //returns the dynents which overlap the cell at x,y
+        const std::vector<const physent *> &cell(int x, int y) const
+        {
+            auto itr = cells.find(cellkey(x, y));
+            return itr != cells.end() ? itr->second : emptycell;
+        }
 
-static size_t dynentframe = 0;
+        //moves d into the cells its bounding circle overlaps, adding it if it is not in the grid
+        void update(const physent *d)
+        {
+            cellrange r = getrange(d);
+            auto [itr, inserted] = ents.try_emplace(d, r);
+            itr->second.frame = frame;
+            if(!inserted)
+            {
+                if(itr->second == r)
+                {
+                    return;
+                }
+                removecells(d, itr->second);
+                itr->second.set(r);
+            }
+            addcells(d, r);
+        }
 
-struct dynentcacheentry final
-{
-    int x, y;
-    size_t frame;
-    std::vector<const physent *> dynents;
+        //adds, moves, and removes dynents to match the dynents vector
+        void sync()
+        {
+            frame++;
+            for(int i = 0; i < numdynents; ++i)
+            {
+                const dynent *d = iterdynents(i);
+                if(d && !d->ragdoll)
+                {
+                    update(d);
+                }
+            }
+            for(auto itr = ents.begin(); itr != ents.end();)
+            {
+                if(itr->second.frame != frame)
+                {
+                    removecells(itr->first, itr->second);
+                    itr = ents.erase(itr);
+                }
+                else
+                {
+                    ++itr;
+                }
+            }
+        }
+
+        void clear()
+        {
+            cells.clear();
+            ents.clear();
+        }
+
+    private:
+        struct cellrange final
+        {
+            int x1, y1, x2, y2; //inclusive
+            size_t frame;       //value of dynentgrid::frame when the dynent was last updated
+
+            bool operator==(const cellrange &r) const
+            {
+                return x1 == r.x1 && y1 == r.y1 && x2 == r.x2 && y2 == r.y2;
+            }
+
+            void set(const cellrange &r)
+            {
+                x1 = r.x1;
+                y1 = r.y1;
+                x2 = r.x2;
+                y2 = r.y2;
+            }
+        };
+
+        std::unordered_map<uint, std::vector<const physent *>> cells;
+        std::unordered_map<const physent *, cellrange> ents;
+        size_t frame = 0;
+        static const std::vector<const physent *> emptycell;
+
+        static uint cellkey(int x, int y)
+        {
+            return (static_cast<uint>(x)<<16) | static_cast<uint>(y);
+        }
+
+        static cellrange getrange(const physent *d);
+
+        void addcells(const physent *d, const cellrange &r)
+        {
+            for(int x = r.x1; x <= r.x2; ++x)
+            {
+                for(int y = r.y1; y <= r.y2; ++y)
+                {
+                    cells[cellkey(x, y)].push_back(d);
+                }
+            }
+        }
+
+        void removecells(const physent *d, const cellrange &r)
+        {
+            for(int x = r.x1; x <= r.x2; ++x)
+            {
+                for(int y = r.y1; y <= r.y2; ++y)
+                {
+                    auto itr = cells.find(cellkey(x, y));
+                    if(itr == cells.end())
+                    {
+                        continue;
+                    }
+                    std::vector<const physent *> &c = itr->second;
+                    auto pos = std::find(c.begin(), c.end(), d);
+                    if(pos != c.end())
+                    {
+                        *pos = c.back();
+                        c.pop_back();
+                    }
+                    if(c.empty())
+                    {
+                        cells.erase(itr);
+                    }
+                }
+            }
+        }
 };
 
-static std::array<dynentcacheentry, dynentcachesize> dynentcache;
+const std::vector<const physent *> dynentgrid::emptycell;
+
+static dynentgrid dynentcache;
 
-//resets the dynentcache[] array entries
+//marks the start of a frame, bringing the dynent grid up to date with the dynents vector
 //used in iengine
 void cleardynentcache()
 {
-    dynentframe++;
-    if(!dynentframe || dynentframe == 1)
-    {
-        for(int i = 0; i < dynentcachesize; ++i)
-        {
-            dynentcache[i].frame = 0;
-        }
-    }
-    if(!dynentframe)
-    {
-        dynentframe = 1;
-    }
+    dynentcache.sync();
 }
 
 //returns the dynent at location i in the dynents vector
@@ -233,59 +328,34 @@ dynent *iterdynents(int i)
     return nullptr;
 }
 
-static VARF(dynentsize, 4, 7, 12, cleardynentcache());
-
-static int dynenthash(int x, int y)
-{
-    return (((((x)^(y))<<5) + (((x)^(y))>>5)) & (dynentcachesize - 1));
-}
-
-static const std::vector<const physent *> &checkdynentcache(int x, int y)
+static VARF(dynentsize, 4, 7, 12,
 {
-    dynentcacheentry &dec = dynentcache[dynenthash(x, y)];
-    if(dec.x == x && dec.y == y && dec.frame == dynentframe)
-    {
-        return dec.dynents;
-    }
-    dec.x = x;
-    dec.y = y;
-    dec.frame = dynentframe;
-    dec.dynents.clear();
-    int numdyns = numdynents,
-        dsize = 1<<dynentsize,
-        dx = x<<dynentsize,
-        dy = y<<dynentsize;
-    for(int i = 0; i < numdyns; ++i)
-    {
-        dynent *d = iterdynents(i);
-        if(d->ragdoll ||
-           d->o.x+d->radius <= dx || d->o.x-d->radius >= dx+dsize ||
-           d->o.y+d->radius <= dy || d->o.y-d->radius >= dy+dsize)
-        {
-            continue;
-        }
-        dec.dynents.push_back(d);
-    }
-    return dec.dynents;
-}
+    dynentcache.clear();
+    dynentcache.sync();
+});
 
 //============================================================== LOOPDYNENTCACHE
 #define LOOPDYNENTCACHE(curx, cury, o, radius) \
     for(int curx = std::max(static_cast<int>(o.x-radius), 0)>>dynentsize, endx = std::min(static_cast<int>(o.x+radius), rootworld.mapsize()-1)>>dynentsize; curx <= endx; curx++) \
         for(int cury = std::max(static_cast<int>(o.y-radius), 0)>>dynentsize, endy = std::min(static_cast<int>(o.y+radius), rootworld.mapsize()-1)>>dynentsize; cury <= endy; cury++)
 
+dynentgrid::cellrange dynentgrid::getrange(const physent *d)
+{
+    int maxcoord = rootworld.mapsize()-1;
+    cellrange r;
+    r.x1 = std::max(static_cast<int>(d->o.x-d->radius), 0)>>dynentsize;
+    r.y1 = std::max(static_cast<int>(d->o.y-d->radius), 0)>>dynentsize;
+    r.x2 = std::min(static_cast<int>(d->o.x+d->radius), maxcoord)>>dynentsize;
+    r.y2 = std::min(static_cast<int>(d->o.y+d->radius), maxcoord)>>dynentsize;
+    r.frame = 0;
+    return r;
+}
+
+//moves d between cells of the dynent grid after it has moved
 //used in iengine
 void updatedynentcache(physent *d)
 {
-    LOOPDYNENTCACHE(x, y, d->o, d->radius)
-    {
-        dynentcacheentry &dec = dynentcache[dynenthash(x, y)];
-        if(dec.x != x || dec.y != y || dec.frame != dynentframe || (std::find(dec.dynents.begin(), dec.dynents.end(), d) != dec.dynents.end()))
-        {
-            continue;
-        }
-        dec.dynents.push_back(d);
-    }
+    dynentcache.update(d);
 }
 
 template<class O>
@@ -350,7 +420,7 @@ CollisionInfo plcollide(const physent *d, const vec &dir, bool insideplayercol)
     const physent *insideplayer = nullptr;
     LOOPDYNENTCACHE(x, y, d->o, d->radius)
     {
-        const std::vector<const physent *> &dynentlist = checkdynentcache(x, y);
+        const std::vector<const physent *> &dynentlist = dynentcache.cell(x, y);
         for(const physent* const& o: dynentlist)
         {
             if(o==d || d->o.reject(o->o, d->radius+o->radius))
@@ -383,6 +453,33 @@ CollisionInfo plcollide(const physent *d, const vec &dir, bool insideplayercol)
 //orient consists of {yaw, pitch, roll}
 //cwall -> collide wall
 template<class M>
+void preparecollidemodel(const extentity &e)
+{
+    model *m = getcollidemodel(e);
+    if(!m)
+    {
+        return;
+    }
+    vec center, radius;
+    m->collisionbox(center, radius);
+    if(mapmodel::mapmodels[e.attr1].m->collide == Collide_TRI || testtricol)
+    {
+        m->setBIH();
+    }
+}
+
+//prepares every mapmodel, as testtricol makes mapmodels collide with their BIHs
+static void preparecollidemodels()
+{
+    for(const extentity *e : entities::getents())
+    {
+        if(e->type == EngineEnt_Mapmodel && e->flags&EntFlag_Octa)
+        {
+            preparecollidemodel(*e);
+        }
+    }
+}
+
 static CollisionInfo mmcollide(const physent *d, const vec &dir, const extentity &e, const vec &center, const vec &radius, const ivec &orient)
 {
     mpr::EntOBB entvol(d);
@@ -607,7 +704,39 @@ static CollisionInfo fuzzycollideellipse(const physent *d, const vec &dir, float
 // 0: do not force
 // 1: Collide_Ellipse
 // 2: Collide_OrientedBoundingBox
-static VAR(testtricol, 0, 0, 2);
+static void preparecollidemodels();
+
+static VARF(testtricol, 0, 0, 2, preparecollidemodels());
+
+static bool collidingbatch = false; //set while collidebatch() runs collision on worker threads, which must not load models
+
+//returns the model to collide with for mapmodel entity e, loading it if needed, or nullptr if it has none
+static model *getcollidemodel(const extentity &e)
+{
+    if(e.flags&EntFlag_NoCollide || !(static_cast<int>(mapmodel::mapmodels.size()) > e.attr1))
+    {
+        return nullptr;
+    }
+    MapModelInfo &mmi = mapmodel::mapmodels[e.attr1];
+    model *m = mmi.collide;
+    if(!m)
+    {
+        if(collidingbatch || (!mmi.m && !loadmodel("", e.attr1)))
+        {
+            return nullptr;
+        }
+        if(!mmi.m->collidemodel.empty())
+        {
+            m = loadmodel(mmi.m->collidemodel);
+        }
+        if(!m)
+        {
+            m = mmi.m;
+        }
+        mmi.collide = m;
+    }
+    return m;
+}
 
 static CollisionInfo mmcollide(const physent *d, const vec &dir, float cutoff, const octaentities &oc) // collide with a mapmodel
 {
@@ -615,28 +744,12 @@ static CollisionInfo mmcollide(const physent *d, const vec &dir, float cutoff, c
     for(const int &i : oc.mapmodels)
     {
         extentity &e = *ents[i];
-        if(e.flags&EntFlag_NoCollide || !(static_cast<int>(mapmodel::mapmodels.size()) > e.attr1))
-        {
-            continue;
-        }
-        MapModelInfo &mmi = mapmodel::mapmodels[e.attr1];
-        model *m = mmi.collide;
+        model *m = getcollidemodel(e);
         if(!m)
         {
-            if(!mmi.m && !loadmodel("", e.attr1))
-            {
-                continue;
-            }
-            if(!mmi.m->collidemodel.empty())
-            {
-                m = loadmodel(mmi.m->collidemodel);
-            }
-            if(!m)
-            {
-                m = mmi.m;
-            }
-            mmi.collide = m;
+            continue;
         }
+        const MapModelInfo &mmi = mapmodel::mapmodels[e.attr1];
         int mcol = mmi.m->collide;
         if(!mcol)
         {
@@ -1186,17 +1299,22 @@ static CollisionInfo octacollide(const physent *d, const vec &dir, float cutoff,
 // all collision happens here
 //
 
-//used in iengine
-bool collide(const physent *d, vec *cwall, const vec &dir, float cutoff, bool insideplayercol)
+//collides with the octree and mapmodels, but not other physents
+static CollisionInfo worldcollide(const physent *d, const vec &dir, float cutoff)
 {
-    collideinside = 0;
-    collideplayer = nullptr;
     ivec bo(static_cast<int>(d->o.x-d->radius), static_cast<int>(d->o.y-d->radius), static_cast<int>(d->o.z-d->eyeheight)),
          bs(static_cast<int>(d->o.x+d->radius), static_cast<int>(d->o.y+d->radius), static_cast<int>(d->o.z+d->aboveeye));
     bo.sub(1);
     bs.add(1);  // guard space for rounding errors
+    return octacollide(d, dir, cutoff, bo, bs, rootworld);
+}
 
-    if(CollisionInfo ci = octacollide(d, dir, cutoff, bo, bs, rootworld); ci.collided)
+//used in iengine
+bool collide(const physent *d, vec *cwall, const vec &dir, float cutoff, bool insideplayercol)
+{
+    collideinside = 0;
+    collideplayer = nullptr;
+    if(CollisionInfo ci = worldcollide(d, dir, cutoff); ci.collided)
     {
         if(cwall)
         {
@@ -1215,6 +1333,66 @@ bool collide(const physent *d, vec *cwall, const vec &dir, float cutoff, bool in
     }
 }
 
+static VAR(collidebatchparallel, 0, 16, 1<<16); //minimum number of physents for collidebatch() to use worker threads
+
+void collidebatch(const std::vector<physcollidequery> &queries, std::vector<physcollideresult> &results)
+{
+    results.resize(queries.size());
+    //world collision only reads the world, so each physent can be tested on any thread
+    auto testworld = [&] (size_t i)
+    {
+        const physcollidequery &q = queries[i];
+        physent p = *q.d;
+        p.o.add(q.offset);
+        collideinside = 0;
+        CollisionInfo ci = worldcollide(&p, q.dir, q.cutoff);
+        physcollideresult &r = results[i];
+        r.collided = ci.collided;
+        r.cwall = ci.collidewall;
+        r.player = nullptr;
+        r.inside = collideinside;
+    };
+    if(queries.size() >= static_cast<size_t>(collidebatchparallel) && numworkers() > 1)
+    {
+        collidingbatch = true;
+        parallelfor(queries.size(), testworld);
+        collidingbatch = false;
+    }
+    else
+    {
+        for(size_t i = 0; i < queries.size(); ++i)
+        {
+            testworld(i);
+        }
+    }
+    //physents collide with each other's positions as moved so far, so this pass runs in order
+    for(size_t i = 0; i < queries.size(); ++i)
+    {
+        const physcollidequery &q = queries[i];
+        physcollideresult &r = results[i];
+        physent *d = q.d;
+        d->o.add(q.offset);
+        if(!r.collided)
+        {
+            collideinside = r.inside;
+            collideplayer = nullptr;
+            CollisionInfo ci = plcollide(d, q.dir, q.insideplayercol);
+            r.collided = ci.collided;
+            r.cwall = ci.collidewall;
+            r.player = collideplayer;
+            r.inside = collideinside;
+        }
+        if(r.collided)
+        {
+            d->o.sub(q.offset);
+        }
+        else
+        {
+            updatedynentcache(d);
+        }
+    }
+}
+
 //used in iengine
 void recalcdir(const physent *d, const vec &oldvel, vec &dir)
 {
@@ -1,8 +1,68 @@
 #ifndef PHYSICS_H_
 #define PHYSICS_H_
 
-extern int collideinside;
+extern thread_local int collideinside;
+extern std::vector<dynent *> dynents; //dynents collided against by collide(), the first numdynents of which are used
 
 extern bool collide(const physent *d, vec *cwall = nullptr, const vec &dir = vec(0, 0, 0), float cutoff = 0.0f, bool insideplayercol = false);
 
+/**
+ * @brief Loads the collision model, bounds and BIH a mapmodel entity collides with.
+ *
+ * Called when a mapmodel entity is added to the octree, so that collidebatch()
+ * can collide with it from worker threads without loading anything.
+ *
+ * @param e the mapmodel entity to prepare
+ */
+extern void preparecollidemodel(const extentity &e);
+
+/**
+ * @brief A physent to test with collidebatch().
+ *
+ * The physent is tested at its position moved by offset; dir, cutoff and
+ * insideplayercol are the parameters of the same name passed to collide().
+ */
+struct physcollidequery final
+{
+    physent *d;
+    vec offset,
+        dir;
+    float cutoff;
+    bool insideplayercol;
+};
+
+/**
+ * @brief The result of testing a physent with collidebatch().
+ */
+struct physcollideresult final
+{
+    bool collided;          /// the value collide() returns for the moved physent
+    vec cwall;              /// the wall normal collide() would have set cwall to
+    const physent *player;  /// the physent collided with, as collideplayer, or nullptr
+    int inside;             /// the value collide() would have left in collideinside
+};
+
+/**
+ * @brief Tests a set of physents for collision at new positions, and moves those which fit.
+ *
+ * Each physent is tested as collide() would test it at its position plus the
+ * query's offset; if it does not collide, it is moved there, otherwise it is
+ * left where it was. Collision with the world (the octree and mapmodels) does
+ * not depend on other physents, so it is run in parallel on the worker threads
+ * for large enough batches (see the `collidebatchparallel` variable). Physents
+ * are then tested against each other in the order they are given, each seeing
+ * the positions of those moved before it, so the results are the same as
+ * calling collide() and moving each physent in turn.
+ *
+ * The world, mapmodels and the set of dynents must not be modified while the
+ * batch runs, and a physent may appear in the batch at most once. Worker
+ * threads do not load models, so mapmodels are only collided with if their
+ * collision model was prepared with preparecollidemodel() when their entity
+ * was added to the octree.
+ *
+ * @param queries the physents to test and the moves to test them with
+ * @param results set to the result of each query, at the same index as the query
+ */
+extern void collidebatch(const std::vector<physcollidequery> &queries, std::vector<physcollideresult> &results);
+
 #endif
@@ -13,16 +13,93 @@
  */
 #include "../libprimis-headers/cube.h"
 #include "../../shared/geomexts.h"
+#include "../../shared/threadpool.h"
+
+#include <functional>
 
 #include "bih.h"
 #include "entities.h"
 #include "octaworld.h"
 #include "raycube.h"
+#include "raypacket.h"
 #include "world/world.h"
 
 //internally relevant functionality
 namespace
 {
+    /**
+     * @brief State kept between the rays of a raycubebatch() cast on one thread.
+     *
+     * While a batch is being cast, raycube() stores each ray's hit surface here
+     * rather than in the hitsurface global, and resumes the descent from the root
+     * where the previous ray's starting point shares an ancestor cube with the
+     * current one.
+     */
+    class raybatchstate final
+    {
+        public:
+            vec surface;
+
+            raybatchstate() : leafshift(-1)
+            {
+            }
+
+            /**
+             * @brief Starts a descent from the deepest cube shared with the last saved descent.
+             *
+             * @param rlevels the ray's array of first children for each level
+             * @param lshift the ray's level, the world scale when called; set to the level to descend from
+             * @param x the x coordinate the ray starts in
+             * @param y the y coordinate the ray starts in
+             * @param z the z coordinate the ray starts in
+             */
+            void resume(std::array<cube *, 20> &rlevels, int &lshift, int x, int y, int z) const
+            {
+                if(leafshift < 0)
+                {
+                    return;
+                }
+                uint diff = static_cast<uint>(start.x^x)|static_cast<uint>(start.y^y)|static_cast<uint>(start.z^z);
+                int shift = leafshift + 1;
+                while(shift < lshift && diff>>shift)
+                {
+                    shift++;
+                }
+                std::copy(levels.begin() + shift, levels.begin() + lshift, rlevels.begin() + shift);
+                lshift = shift;
+            }
+
+            /**
+             * @brief Saves the path from the root to the first leaf cube of a ray.
+             *
+             * @param rlevels the ray's array of first children for each level
+             * @param lshift the level of the leaf cube
+             * @param worldscale the level of the root
+             * @param x the x coordinate the ray starts in
+             * @param y the y coordinate the ray starts in
+             * @param z the z coordinate the ray starts in
+             */
+            void save(const std::array<cube *, 20> &rlevels, int lshift, int worldscale, int x, int y, int z)
+            {
+                std::copy(rlevels.begin() + lshift + 1, rlevels.begin() + worldscale, levels.begin() + lshift + 1);
+                leafshift = lshift;
+                start = ivec(x, y, z);
+            }
+
+        private:
+            std::array<cube *, 20> levels;
+            int leafshift; //level of the saved leaf cube, or -1 if there is no saved descent
+            ivec start;
+    };
+
+    thread_local raybatchstate *raybatch = nullptr;
+
+    //where raycube() stores the normal of the surface it hit
+    vec &rayhitsurface()
+    {
+        return raybatch ? raybatch->surface : worldquery().hitsurface;
+    }
+
     const clipplanes &getclipplanes(const cube &c, const ivec &o, int size)
     {
         clipplanes &p = rootworld.getclipbounds(c, o, size, c.visible&0x80 ? 2 : 0);
@@ -129,14 +206,15 @@ namespace
         dist = std::max(enterdist+0.1f, 0.0f);
         if(dist < maxdist)
         {
+            vec &surface = rayhitsurface();
             if(bbentry>=0)
             {
-                hitsurface = vec(0, 0, 0);
-                hitsurface[bbentry] = ray[bbentry]>0 ? -1 : 1;
+                surface = vec(0, 0, 0);
+                surface[bbentry] = ray[bbentry]>0 ? -1 : 1;
             }
             else
             {
-                hitsurface = p.p[entry];
+                surface = p.p[entry];
             }
         }
         return true;
@@ -306,6 +384,81 @@ namespace
         dist += disttonext;
         return closest;
     }
+
+    /**
+     * @brief Moves a ray starting outside the world to where it enters the world.
+     *
+     * @param mapsize the size of the world
+     * @param invray the inverse of the ray's direction
+     * @param radius the maximum length of the ray
+     * @param outrad set to the distance to return if the ray misses the world
+     * @param o the ray's origin
+     * @param v the ray's current position, moved to the world's boundary
+     * @param ray the ray's direction
+     * @param dist the distance travelled by the ray, increased by the distance moved
+     *
+     * @return true if the ray never enters the world, false otherwise
+     */
+    bool outsideworld(int mapsize, const vec &invray, float radius, float &outrad, const vec &o, vec &v, const vec& ray, float &dist)
+    {
+        if(o.x<0 || o.x>=mapsize || o.y<0 || o.y>=mapsize || o.z<0 || o.z>=mapsize)
+        {
+            float disttoworld = 0,
+                  exitworld = 1e16f;
+            for(int i = 0; i < 3; ++i)
+            {
+                float c = v[i];
+                if(c<0 || c>=mapsize)
+                {
+                    float d = ((invray[i]>0?0:mapsize)-c)*invray[i];
+                    if(d<0)
+                    {
+                        outrad =  radius>0 ? radius :-1;
+                        return true;
+                    }
+                    disttoworld = std::max(disttoworld, 0.1f + d);
+                }
+                float e = ((invray[i]>0?mapsize:0)-c)*invray[i];
+                exitworld = std::min(exitworld, e);
+            }
+            if(disttoworld > exitworld)
+            {
+                outrad = (radius>0?radius:-1);
+                return true;
+            }
+            v.add(vec(ray).mul(disttoworld));
+            dist += disttoworld;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Moves a ray's level up to the smallest cube containing both its old and new cube.
+     *
+     * @return true if the ray has left the world, false otherwise
+     */
+    bool climboctree(int mapsize, const vec &v, int &x, int &y, int &z, const ivec &lo, int &lshift)
+    {
+        x = static_cast<int>(v.x);
+        y = static_cast<int>(v.y);
+        z = static_cast<int>(v.z);
+        uint diff = static_cast<uint>(lo.x^x)|static_cast<uint>(lo.y^y)|static_cast<uint>(lo.z^z);
+        if(diff >= static_cast<uint>(mapsize))
+        {
+            return true;
+        }
+        diff >>= lshift;
+        if(!diff)
+        {
+            return true;
+        }
+        do
+        {
+            lshift++;
+            diff >>= 1;
+        } while(diff);
+        return false;
+    }
 }
 
 //externally relevant functionality
@@ -327,58 +480,12 @@ vec hitsurface;
 //true if outside world, false if inside
 bool cubeworld::checkinsideworld(const vec &invray, float radius, float &outrad, const vec &o, vec &v, const vec& ray, float &dist) const
 {
-    if(!insideworld(o))
-    {
-        float disttoworld = 0,
-              exitworld = 1e16f;
-        for(int i = 0; i < 3; ++i)
-        {
-            float c = v[i];
-            if(c<0 || c>=mapsize())
-            {
-                float d = ((invray[i]>0?0:mapsize())-c)*invray[i];
-                if(d<0)
-                {
-                    outrad =  radius>0 ? radius :-1;
-                    return true;
-                }
-                disttoworld = std::max(disttoworld, 0.1f + d);
-            }
-            float e = ((invray[i]>0?mapsize():0)-c)*invray[i];
-            exitworld = std::min(exitworld, e);
-        }
-        if(disttoworld > exitworld)
-        {
-            outrad = (radius>0?radius:-1);
-            return true;
-        }
-        v.add(vec(ray).mul(disttoworld));
-        dist += disttoworld;
-    }
-    return false;
+    return outsideworld(mapsize(), invray, radius, outrad, o, v, ray, dist);
 }
 
 bool cubeworld::upoctree(const vec &v, int &x, int &y, int &z, const ivec &lo, int &lshift) const
 {
-    x = static_cast<int>(v.x);
-    y = static_cast<int>(v.y);
-    z = static_cast<int>(v.z);
-    uint diff = static_cast<uint>(lo.x^x)|static_cast<uint>(lo.y^y)|static_cast<uint>(lo.z^z);
-    if(diff >= static_cast<uint>(mapsize()))
-    {
-        return true;
-    }
-    diff >>= lshift;
-    if(!diff)
-    {
-        return true;
-    }
-    do
-    {
-        lshift++;
-        diff >>= 1;
-    } while(diff);
-    return false;
+    return climboctree(mapsize(), v, x, y, z, lo, lshift);
 }
 
 //=================================================================== DOWNOCTREE
@@ -431,6 +538,73 @@ struct raycubeinfo final
     }
 };
 
+namespace
+{
+    //as DOWNOCTREE, for rays which do not check entities
+    cube *descendoctree(raycubeinfo &r, int x, int y, int z)
+    {
+        cube *lc = r.levels[r.lshift];
+        for(;;)
+        {
+            r.lshift--;
+            lc += OCTA_STEP(x, y, z, r.lshift);
+            if(lc->children==nullptr)
+            {
+                return lc;
+            }
+            lc = &(*lc->children)[0];
+            r.levels[r.lshift] = lc;
+        }
+    }
+
+    //moves a shadow ray to the next cube along it; true if the ray is finished, with its result in dist
+    bool shadownext(raycubeinfo &r, const ivec &lo, int mapsize, int &x, int &y, int &z, int &side, const vec &ray, float radius, float &dist)
+    {
+        side = findclosest(Orient_Right - r.lsizemask.x, Orient_Front - r.lsizemask.y, Orient_Top - r.lsizemask.z, r.lsizemask, r.invray, lo, r.lshift, r.v, r.dist, ray);
+        if(r.dist>=radius)
+        {
+            dist = r.dist;
+            return true;
+        }
+        if(climboctree(mapsize, r.v, x, y, z, lo, r.lshift))
+        {
+            dist = radius;
+            return true;
+        }
+        return false;
+    }
+
+    //tests a shadow ray against the leaf cube it is in; true if the ray is finished, with its result in dist
+    bool shadowstep(raycubeinfo &r, const cube &c, int mapsize, int &x, int &y, int &z, int &side, const vec &ray, float radius, int mode, float &dist)
+    {
+        ivec lo(x&(~0U<<r.lshift),
+             y&(~0U<<r.lshift),
+             z&(~0U<<r.lshift));
+
+        if(!(c.isempty()) && !(c.material&Mat_Alpha))
+        {
+            if(c.issolid())
+            {
+                dist = c.texture[side]==Default_Sky && mode&Ray_SkipSky ? radius : r.dist;
+                return true;
+            }
+            const clipplanes &p = getclipplanes(c, lo, 1<<r.lshift);
+            float enterdist = -1e16f,
+                  exitdist  = 1e16f;
+            int i = 0;
+            if(intersectplanes(p, r.v, ray, enterdist, exitdist, i) &&
+               intersectbox(p, r.v, ray, r.invray, enterdist, exitdist, i) &&
+               exitdist >= 0)
+            {
+                side = (i<<1) + 1 - r.lsizemask[i];
+                dist = c.texture[side]==Default_Sky && mode&Ray_SkipSky ? radius : r.dist+std::max(enterdist+0.1f, 0.0f);
+                return true;
+            }
+        }
+        return shadownext(r, lo, mapsize, x, y, z, side, ray, radius, dist);
+    }
+}
+
 float cubeworld::raycube(const vec &o, const vec &ray, float radius, int mode, int size, const extentity *t) const
 {
     if(ray.iszero())
@@ -450,9 +624,20 @@ float cubeworld::raycube(const vec &o, const vec &ray, float radius, int mode, i
         x = static_cast<int>(r.v.x),
         y = static_cast<int>(r.v.y),
         z = static_cast<int>(r.v.z);
+    //entities are checked on the way down for Ray_BB, so those rays must always descend from the root
+    raybatchstate *descent = raybatch && !(mode&Ray_BB) ? raybatch : nullptr;
+    if(descent)
+    {
+        descent->resume(r.levels, r.lshift, x, y, z);
+    }
     for(;;)
     {
         DOWNOCTREE(disttoent, if(mode&Ray_Shadow));
+        if(descent)
+        {
+            descent->save(r.levels, r.lshift, worldscale, x, y, z);
+            descent = nullptr;
+        }
 
         int lsize = 1<<r.lshift;
 
@@ -474,8 +659,9 @@ float cubeworld::raycube(const vec &o, const vec &ray, float radius, int mode, i
                           dz = ((z&(~0U<<r.lshift))+(r.invray.z>0 ? 0 : 1<<r.lshift)-r.v.z)*r.invray.z;
                     closest = dx > dy ? (dx > dz ? 0 : 2) : (dy > dz ? 1 : 2);
                 }
-                hitsurface = vec(0, 0, 0);
-                hitsurface[closest] = ray[closest]>0 ? -1 : 1;
+                vec &surface = rayhitsurface();
+                surface = vec(0, 0, 0);
+                surface[closest] = ray[closest]>0 ? -1 : 1;
                 return r.dist;
             }
             return r.dent;
@@ -523,49 +709,10 @@ float cubeworld::shadowray(const vec &o, const vec &ray, float radius, int mode,
     for(;;)
     {
         DOWNOCTREE(shadowent, );
-
-        const cube &c = *lc;
-        ivec lo(x&(~0U<<r.lshift),
-             y&(~0U<<r.lshift),
-             z&(~0U<<r.lshift));
-
-        if(!(c.isempty()) && !(c.material&Mat_Alpha))
+        float dist;
+        if(shadowstep(r, *lc, mapsize(), x, y, z, side, ray, radius, mode, dist))
         {
-            if(c.issolid())
-            {
-                return c.texture[side]==Default_Sky && mode&Ray_SkipSky ? radius : r.dist;
-            }
-            const clipplanes &p = getclipplanes(c, lo, 1<<r.lshift);
-            float enterdist = -1e16f,
-                  exitdist  = 1e16f;
-            int i = 0;
-            bool intersected = intersectplanes(p, r.v, ray, enterdist, exitdist, i);
-            side = p.side[i];
-            if(!intersected)
-            {
-                goto nextcube;
-            }
-            intersected = intersectbox(p, r.v, ray, r.invray, enterdist, exitdist, i);
-            side = (i<<1) + 1 - r.lsizemask[i];
-            if(!intersected)
-            {
-                goto nextcube;
-            }
-            if(exitdist >= 0)
-            {
-                return c.texture[side]==Default_Sky && mode&Ray_SkipSky ? radius : r.dist+std::max(enterdist+0.1f, 0.0f);
-            }
-        }
-
-    nextcube:
-        side = findclosest(Orient_Right - r.lsizemask.x, Orient_Front - r.lsizemask.y, Orient_Top - r.lsizemask.z, r.lsizemask, r.invray, lo, r.lshift, r.v, r.dist, ray);
-        if(r.dist>=radius)
-        {
-            return r.dist;
-        }
-        if(upoctree(r.v, x, y, z, lo, r.lshift))
-        {
-            return radius;
+            return dist;
         }
     }
 }
@@ -618,12 +765,267 @@ float rayfloor(const vec &o, vec &floor, int mode, float radius)
     {
         return -1;
     }
-    hitsurface = vec(0, 0, 1);
+    vec &surface = worldquery().hitsurface;
+    surface = vec(0, 0, 1);
     float dist = rootworld.raycube(o, vec(0, 0, -1), radius, mode);
     if(dist<0 || (radius>0 && dist>=radius))
     {
         return dist;
     }
-    floor = hitsurface;
+    floor = surface;
     return dist;
 }
+
+//interleaves the low 10 bits of x, y, z
+static uint mortonkey(uint x, uint y, uint z)
+{
+    auto spread = [] (uint v) -> uint
+    {
+        v &= 0x3FF;
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v <<  8)) & 0x0300F00F;
+        v = (v | (v <<  4)) & 0x030C30C3;
+        v = (v | (v <<  2)) & 0x09249249;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+}
+
+static VAR(raybatchparallel, 0, 1024, 1<<30); //minimum number of rays for raycubebatch() to use worker threads
+
+void raycubebatch(const std::vector<raycubequery> &rays, std::vector<raycuberesult> &results, bool parallel)
+{
+    constexpr size_t chunksize = 64; //rays cast together by one thread
+    size_t numrays = rays.size();
+    results.resize(numrays);
+    //cast rays in order along a curve through the world, so that consecutive rays start near each other
+    std::vector<std::pair<uint, uint>> order;
+    order.reserve(numrays);
+    std::vector<uint> bbrays; //rays which check entities, which are not safe to cast on worker threads
+    float keyscale = 1024.0f/rootworld.mapsize();
+    for(size_t i = 0; i < numrays; ++i)
+    {
+        const raycubequery &q = rays[i];
+        if(q.mode&Ray_BB)
+        {
+            bbrays.push_back(static_cast<uint>(i));
+            continue;
+        }
+        uint x = static_cast<uint>(std::clamp(q.o.x*keyscale, 0.0f, 1023.0f)),
+             y = static_cast<uint>(std::clamp(q.o.y*keyscale, 0.0f, 1023.0f)),
+             z = static_cast<uint>(std::clamp(q.o.z*keyscale, 0.0f, 1023.0f));
+        order.emplace_back(mortonkey(x, y, z), static_cast<uint>(i));
+    }
+    std::sort(order.begin(), order.end());
+
+    auto cast = [&] (raybatchstate &state, uint i)
+    {
+        const raycubequery &q = rays[i];
+        state.surface = vec(0, 0, 0);
+        results[i].dist = rootworld.raycube(q.o, q.ray, q.radius, q.mode, q.size, q.t);
+        results[i].surface = state.surface;
+    };
+    size_t numchunks = (order.size() + chunksize - 1)/chunksize;
+    if(parallel && order.size() >= static_cast<size_t>(raybatchparallel) && numchunks > 1 && numworkers() > 1)
+    {
+        parallelfor(numchunks, [&] (size_t chunk)
+        {
+            raybatchstate state;
+            raybatch = &state;
+            for(size_t j = chunk*chunksize, end = std::min(j + chunksize, order.size()); j < end; ++j)
+            {
+                cast(state, order[j].second);
+            }
+            raybatch = nullptr;
+        });
+    }
+    else
+    {
+        raybatchstate state;
+        raybatch = &state;
+        for(const std::pair<uint, uint> &j : order)
+        {
+            cast(state, j.second);
+        }
+        raybatch = nullptr;
+    }
+    if(bbrays.size())
+    {
+        raybatchstate state;
+        raybatch = &state;
+        for(uint i : bbrays)
+        {
+            cast(state, i);
+        }
+        raybatch = nullptr;
+    }
+}
+
+void shadowraybatch(const std::vector<shadowrayquery> &rays, std::vector<float> &results, int mode)
+{
+    size_t numrays = rays.size();
+    results.resize(numrays);
+    if(mode&Ray_BB)
+    {
+        for(size_t i = 0; i < numrays; ++i)
+        {
+            results[i] = rootworld.shadowray(rays[i].o, rays[i].ray, rays[i].radius, mode, nullptr);
+        }
+        return;
+    }
+    //group rays which start near each other, as they are the most likely to pass through the same cubes
+    std::vector<std::pair<uint, uint>> order;
+    order.reserve(numrays);
+    float keyscale = 1024.0f/rootworld.mapsize();
+    for(size_t i = 0; i < numrays; ++i)
+    {
+        const vec &o = rays[i].o;
+        uint x = static_cast<uint>(std::clamp(o.x*keyscale, 0.0f, 1023.0f)),
+             y = static_cast<uint>(std::clamp(o.y*keyscale, 0.0f, 1023.0f)),
+             z = static_cast<uint>(std::clamp(o.z*keyscale, 0.0f, 1023.0f));
+        order.emplace_back(mortonkey(x, y, z), static_cast<uint>(i));
+    }
+    std::sort(order.begin(), order.end());
+
+    struct shadowlane final
+    {
+        raycubeinfo r;
+        const shadowrayquery *q;
+        float *result;
+        cube *lc;
+        int x, y, z, side;
+
+        shadowlane(const shadowrayquery &query, float &out, int worldscale, int mode, cube *root) :
+            r(query.radius, query.o, query.ray, worldscale, mode, root), q(&query), result(&out), lc(nullptr), side(Orient_Bottom)
+        {
+        }
+    };
+
+    int mapsize = rootworld.mapsize(),
+        worldscale = rootworld.mapscale(),
+        width = raypacketlanes();
+    ivec ro;
+    int rsize;
+    cube *root = &rootworld.lookupcube(ivec(0, 0, 0), mapsize/2, ro, rsize);
+    std::vector<shadowlane> lanes;
+    lanes.reserve(width);
+    raypacket packet;
+    raypackethits hits;
+    for(size_t start = 0; start < order.size(); start += width)
+    {
+        lanes.clear();
+        int active = 0;
+        for(size_t j = start, end = std::min(start + width, order.size()); j < end; ++j)
+        {
+            uint i = order[j].second;
+            shadowlane &l = lanes.emplace_back(rays[i], results[i], worldscale, mode, root);
+            float outrad = 0.f;
+            if(outsideworld(mapsize, l.r.invray, l.q->radius, outrad, l.q->o, l.r.v, l.q->ray, l.r.dist))
+            {
+                *l.result = outrad;
+                continue;
+            }
+            l.x = static_cast<int>(l.r.v.x);
+            l.y = static_cast<int>(l.r.v.y);
+            l.z = static_cast<int>(l.r.v.z);
+            active |= 1<<(lanes.size()-1);
+        }
+        while(active)
+        {
+            for(int k = 0; k < static_cast<int>(lanes.size()); ++k)
+            {
+                if(active&(1<<k))
+                {
+                    shadowlane &l = lanes[k];
+                    l.lc = descendoctree(l.r, l.x, l.y, l.z);
+                }
+            }
+            //the lanes in the same cube as the first active lane are tested together, the rest on their own
+            int first = 0;
+            while(!(active&(1<<first)))
+            {
+                first++;
+            }
+            const shadowlane &lead = lanes[first];
+            const cube &c = *lead.lc;
+            int group = 0;
+            for(int k = 0; k < static_cast<int>(lanes.size()); ++k)
+            {
+                if(active&(1<<k))
+                {
+                    shadowlane &l = lanes[k];
+                    if(l.lc == lead.lc)
+                    {
+                        group |= 1<<k;
+                        continue;
+                    }
+                    float dist;
+                    if(shadowstep(l.r, *l.lc, mapsize, l.x, l.y, l.z, l.side, l.q->ray, l.q->radius, mode, dist))
+                    {
+                        *l.result = dist;
+                        active &= ~(1<<k);
+                    }
+                }
+            }
+            if(!(group&(group-1)) || c.isempty() || c.material&Mat_Alpha || c.issolid())
+            {
+                //nothing to gain from testing one ray or a cube without clip planes as a packet
+                for(int k = 0; k < static_cast<int>(lanes.size()); ++k)
+                {
+                    if(group&(1<<k))
+                    {
+                        shadowlane &l = lanes[k];
+                        float dist;
+                        if(shadowstep(l.r, *l.lc, mapsize, l.x, l.y, l.z, l.side, l.q->ray, l.q->radius, mode, dist))
+                        {
+                            *l.result = dist;
+                            active &= ~(1<<k);
+                        }
+                    }
+                }
+                continue;
+            }
+            //lanes in the same cube are at the same level, so share its origin
+            const ivec lo(lead.x&(~0U<<lead.r.lshift),
+                          lead.y&(~0U<<lead.r.lshift),
+                          lead.z&(~0U<<lead.r.lshift));
+            const clipplanes &p = getclipplanes(c, lo, 1<<lead.r.lshift);
+            for(int k = 0; k < width; ++k)
+            {
+                //unused lanes are filled with a copy of the lead ray, and their results ignored
+                const shadowlane &l = k < static_cast<int>(lanes.size()) && group&(1<<k) ? lanes[k] : lead;
+                packet.vx[k] = l.r.v.x;
+                packet.vy[k] = l.r.v.y;
+                packet.vz[k] = l.r.v.z;
+                packet.dx[k] = l.q->ray.x;
+                packet.dy[k] = l.q->ray.y;
+                packet.dz[k] = l.q->ray.z;
+                packet.ix[k] = l.r.invray.x;
+                packet.iy[k] = l.r.invray.y;
+                packet.iz[k] = l.r.invray.z;
+            }
+            int hitmask = raypacketintersect(p, packet, width, hits);
+            for(int k = 0; k < static_cast<int>(lanes.size()); ++k)
+            {
+                if(!(group&(1<<k)))
+                {
+                    continue;
+                }
+                shadowlane &l = lanes[k];
+                float dist;
+                if(hitmask&(1<<k) && hits.exitdist[k] >= 0)
+                {
+                    int i = hits.entry[k];
+                    l.side = (i<<1) + 1 - l.r.lsizemask[i];
+                    dist = c.texture[l.side]==Default_Sky && mode&Ray_SkipSky ? l.q->radius : l.r.dist+std::max(hits.enterdist[k]+0.1f, 0.0f);
+                }
+                else if(!shadownext(l.r, lo, mapsize, l.x, l.y, l.z, l.side, l.q->ray, l.q->radius, dist))
+                {
+                    continue;
+                }
+                *l.result = dist;
+                active &= ~(1<<k);
+            }
+        }
+    }
+}
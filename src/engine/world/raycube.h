@@ -1,12 +1,83 @@
 #ifndef RAYCUBE_H_
 #define RAYCUBE_H_
 
-extern vec hitsurface;
+extern vec hitsurface; //surface hit by the last raycube() on the main thread; other threads use worldquery().hitsurface
 
 extern float raycubepos(const vec &o, const vec &ray, vec &hit, float radius = 0, int mode = Ray_ClipMat, int size = 0);
 extern float rayent(const vec &o, const vec &ray, float radius, int mode, int size, int &orient, int &ent);
 extern float rayfloor  (const vec &o, vec &floor, int mode = 0, float radius = 0);
 
+/**
+ * @brief A ray to cast with raycubebatch().
+ *
+ * The fields are the parameters of the same name passed to cubeworld::raycube().
+ */
+struct raycubequery final
+{
+    vec o, ray;
+    float radius;
+    int mode, size;
+    const extentity *t;
+};
+
+/**
+ * @brief The result of a ray cast with raycubebatch().
+ */
+struct raycuberesult final
+{
+    float dist;  /// the value cubeworld::raycube() returns for the ray
+    vec surface; /// the normal raycube() would have set hitsurface to, or (0,0,0) if it would not have been set
+};
+
+/**
+ * @brief Casts a batch of rays against the rootworld.
+ *
+ * Returns the same distances as calling cubeworld::raycube() for each ray, but
+ * casts rays which start near each other in sequence, so that each ray can
+ * reuse the previous ray's descent from the root of the octree. Does not change
+ * the hitsurface global; the surface hit by each ray is returned in its result.
+ *
+ * If parallel is set and the batch is large enough (see the `raybatchparallel`
+ * variable) the rays are split across the worker threads. Rays which check
+ * entities (those with Ray_BB set) are always cast on the calling thread.
+ * The world must not be modified while the batch is being cast.
+ *
+ * @param rays the rays to cast
+ * @param results set to the result of each ray, at the same index as the ray
+ * @param parallel whether to allow the batch to be cast using worker threads
+ */
+extern void raycubebatch(const std::vector<raycubequery> &rays, std::vector<raycuberesult> &results, bool parallel = false);
+
+/**
+ * @brief A ray to cast with shadowraybatch().
+ *
+ * The fields are the parameters of the same name passed to cubeworld::shadowray().
+ */
+struct shadowrayquery final
+{
+    vec o, ray;
+    float radius;
+};
+
+/**
+ * @brief Casts a batch of shadow rays against the rootworld.
+ *
+ * Returns the same distances as calling cubeworld::shadowray() for each ray
+ * (to within floating point rounding), but walks groups of rays which start
+ * near each other through the octree together. While all of the rays in a
+ * group are in the same cube, they are tested against its clip planes at once
+ * using SIMD instructions (see raypacketintersect()); rays which leave the
+ * group's cube continue on their own as in cubeworld::shadowray().
+ *
+ * Rays are cast one at a time with cubeworld::shadowray() if mode has Ray_BB
+ * set, as entities are not checked by the grouped walk.
+ *
+ * @param rays the rays to cast
+ * @param results set to the distance of each ray, at the same index as the ray
+ * @param mode the ray mode flags, as passed to cubeworld::shadowray()
+ */
+extern void shadowraybatch(const std::vector<shadowrayquery> &rays, std::vector<float> &results, int mode = Ray_Shadow);
+
 /**
  * @brief Returns whether the passed vec lies inside the bounds of the rootworld.
  *
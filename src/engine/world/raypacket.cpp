@@ -0,0 +1,361 @@
+/**
+ * @file raypacket.cpp
+ * @brief SIMD intersection of groups of rays with a cube's clip planes
+ *
+ * The octree walk in raycube.cpp spends much of its time testing rays against
+ * the clip planes of the cubes they pass through. When several rays pass
+ * through the same cube, the planes can be tested against all of them at once,
+ * with each ray in one lane of a SIMD register. The kernels here do this for
+ * 4 rays at a time with SSE2 and 8 at a time with AVX2, chosen at runtime
+ * depending on the CPU, along with a scalar version of the same test.
+ */
+#include "../libprimis-headers/cube.h"
+#include "../../shared/geomexts.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define RAYPACKET_X86 1
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+        #define RAYPACKET_AVX2
+    #else
+        #define RAYPACKET_AVX2 __attribute__((target("avx2")))
+    #endif
+#endif
+
+#include "octaworld.h"
+#include "raypacket.h"
+
+//which packet kernel to use: 0 for scalar, 1 for SSE2, 2 for AVX2; limited to what the CPU supports
+static VAR(raypacketsimd, 0, 2, 2);
+
+int raypacketintersectscalar(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits)
+{
+    int mask = 0;
+    for(int k = 0; k < lanes; ++k)
+    {
+        const vec v(rays.vx[k], rays.vy[k], rays.vz[k]),
+                  ray(rays.dx[k], rays.dy[k], rays.dz[k]),
+                  invray(rays.ix[k], rays.iy[k], rays.iz[k]);
+        float enterdist = -1e16f,
+              exitdist  = 1e16f;
+        int entry = 0;
+        bool hit = true;
+        //clip planes
+        for(int i = 0; i < p.size; ++i)
+        {
+            float pdist = p.p[i].dist(v),
+                  facing = ray.dot(p.p[i]);
+            if(facing < 0)
+            {
+                pdist /= -facing;
+                if(pdist > enterdist)
+                {
+                    if(pdist > exitdist)
+                    {
+                        hit = false;
+                        break;
+                    }
+                    enterdist = pdist;
+                    entry = i;
+                }
+            }
+            else if(facing > 0)
+            {
+                pdist /= -facing;
+                if(pdist < exitdist)
+                {
+                    if(pdist < enterdist)
+                    {
+                        hit = false;
+                        break;
+                    }
+                    exitdist = pdist;
+                }
+            }
+            else if(pdist > 0)
+            {
+                hit = false;
+                break;
+            }
+        }
+        //bounding box
+        for(int i = 0; hit && i < 3; ++i)
+        {
+            if(ray[i])
+            {
+                float prad = std::fabs(p.r[i] * invray[i]),
+                      pdist = (p.o[i] - v[i]) * invray[i],
+                      pmin = pdist - prad,
+                      pmax = pdist + prad;
+                if(pmin > enterdist)
+                {
+                    if(pmin > exitdist)
+                    {
+                        hit = false;
+                        break;
+                    }
+                    enterdist = pmin;
+                    entry = i;
+                }
+                if(pmax < exitdist)
+                {
+                    if(pmax < enterdist)
+                    {
+                        hit = false;
+                        break;
+                    }
+                    exitdist = pmax;
+                }
+            }
+            else if(v[i] < p.o[i]-p.r[i] || v[i] > p.o[i]+p.r[i])
+            {
+                hit = false;
+            }
+        }
+        hits.enterdist[k] = enterdist;
+        hits.exitdist[k] = exitdist;
+        hits.entry[k] = entry;
+        if(hit)
+        {
+            mask |= 1<<k;
+        }
+    }
+    return mask;
+}
+
+#ifdef RAYPACKET_X86
+
+namespace
+{
+    /* The SIMD kernels follow the scalar kernel lane by lane: every comparison is
+     * done for every lane, and the results are only applied to the lanes which
+     * would have taken that branch. Lanes which fail a test are dropped from the
+     * live mask; values computed for them afterwards are never used.
+     */
+
+    inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    int intersectsse(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits)
+    {
+        const __m128 zero = _mm_setzero_ps(),
+                     signbit = _mm_set1_ps(-0.0f);
+        int mask = 0;
+        for(int base = 0; base < lanes; base += 4)
+        {
+            const __m128 vx = _mm_load_ps(&rays.vx[base]),
+                         vy = _mm_load_ps(&rays.vy[base]),
+                         vz = _mm_load_ps(&rays.vz[base]),
+                         dx = _mm_load_ps(&rays.dx[base]),
+                         dy = _mm_load_ps(&rays.dy[base]),
+                         dz = _mm_load_ps(&rays.dz[base]);
+            __m128 enter = _mm_set1_ps(-1e16f),
+                   exit = _mm_set1_ps(1e16f),
+                   entry = zero,
+                   live = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for(int i = 0; i < p.size; ++i)
+            {
+                const plane &pl = p.p[i];
+                const __m128 px = _mm_set1_ps(pl.x),
+                             py = _mm_set1_ps(pl.y),
+                             pz = _mm_set1_ps(pl.z);
+                __m128 pdist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(px, vx), _mm_mul_ps(py, vy)), _mm_mul_ps(pz, vz)), _mm_set1_ps(pl.offset)),
+                       facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, px), _mm_mul_ps(dy, py)), _mm_mul_ps(dz, pz)),
+                       t = _mm_div_ps(pdist, _mm_xor_ps(facing, signbit)),
+                       entering = _mm_cmplt_ps(facing, zero),
+                       leaving = _mm_cmpgt_ps(facing, zero),
+                       parallel = _mm_andnot_ps(_mm_or_ps(entering, leaving), live);
+                __m128 later = _mm_cmpgt_ps(t, enter),
+                       sooner = _mm_cmplt_ps(t, exit),
+                       fail = _mm_or_ps(_mm_or_ps(_mm_and_ps(entering, _mm_and_ps(later, _mm_cmpgt_ps(t, exit))),
+                                                  _mm_and_ps(leaving, _mm_and_ps(sooner, _mm_cmplt_ps(t, enter)))),
+                                        _mm_and_ps(parallel, _mm_cmpgt_ps(pdist, zero)));
+                __m128 setenter = _mm_andnot_ps(fail, _mm_and_ps(entering, later)),
+                       setexit = _mm_andnot_ps(fail, _mm_and_ps(leaving, sooner));
+                enter = select4(setenter, t, enter);
+                entry = select4(setenter, _mm_set1_ps(static_cast<float>(i)), entry);
+                exit = select4(setexit, t, exit);
+                live = _mm_andnot_ps(fail, live);
+                if(!_mm_movemask_ps(live))
+                {
+                    break;
+                }
+            }
+            const std::array<const float *, 3> vs = {&rays.vx[base], &rays.vy[base], &rays.vz[base]},
+                                               ds = {&rays.dx[base], &rays.dy[base], &rays.dz[base]},
+                                               invs = {&rays.ix[base], &rays.iy[base], &rays.iz[base]};
+            for(int i = 0; i < 3 && _mm_movemask_ps(live); ++i)
+            {
+                const __m128 v = _mm_load_ps(vs[i]),
+                             d = _mm_load_ps(ds[i]),
+                             inv = _mm_load_ps(invs[i]),
+                             po = _mm_set1_ps(p.o[i]),
+                             pr = _mm_set1_ps(p.r[i]),
+                             moving = _mm_cmpneq_ps(d, zero);
+                __m128 prad = _mm_andnot_ps(signbit, _mm_mul_ps(pr, inv)),
+                       pdist = _mm_mul_ps(_mm_sub_ps(po, v), inv),
+                       pmin = _mm_sub_ps(pdist, prad),
+                       pmax = _mm_add_ps(pdist, prad);
+                __m128 later = _mm_and_ps(moving, _mm_cmpgt_ps(pmin, enter)),
+                       fail = _mm_and_ps(later, _mm_cmpgt_ps(pmin, exit));
+                later = _mm_andnot_ps(fail, later);
+                enter = select4(later, pmin, enter);
+                entry = select4(later, _mm_set1_ps(static_cast<float>(i)), entry);
+                __m128 sooner = _mm_andnot_ps(fail, _mm_and_ps(moving, _mm_cmplt_ps(pmax, exit)));
+                fail = _mm_or_ps(fail, _mm_and_ps(sooner, _mm_cmplt_ps(pmax, enter)));
+                exit = select4(_mm_andnot_ps(fail, sooner), pmax, exit);
+                //axis-parallel rays must start within the box's extent on that axis
+                fail = _mm_or_ps(fail, _mm_andnot_ps(moving, _mm_or_ps(_mm_cmplt_ps(v, _mm_set1_ps(p.o[i]-p.r[i])),
+                                                                      _mm_cmpgt_ps(v, _mm_set1_ps(p.o[i]+p.r[i])))));
+                live = _mm_andnot_ps(fail, live);
+            }
+            _mm_store_ps(&hits.enterdist[base], enter);
+            _mm_store_ps(&hits.exitdist[base], exit);
+            alignas(16) std::array<int, 4> entries;
+            _mm_store_si128(reinterpret_cast<__m128i *>(entries.data()), _mm_cvttps_epi32(entry));
+            std::copy(entries.begin(), entries.end(), hits.entry.begin() + base);
+            mask |= _mm_movemask_ps(live) << base;
+        }
+        return mask & ((1<<lanes)-1);
+    }
+
+    RAYPACKET_AVX2 inline __m256 select8(__m256 mask, __m256 a, __m256 b)
+    {
+        return _mm256_blendv_ps(b, a, mask);
+    }
+
+    RAYPACKET_AVX2 int intersectavx2(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits)
+    {
+        const __m256 zero = _mm256_setzero_ps(),
+                     signbit = _mm256_set1_ps(-0.0f);
+        const __m256 vx = _mm256_load_ps(rays.vx.data()),
+                     vy = _mm256_load_ps(rays.vy.data()),
+                     vz = _mm256_load_ps(rays.vz.data()),
+                     dx = _mm256_load_ps(rays.dx.data()),
+                     dy = _mm256_load_ps(rays.dy.data()),
+                     dz = _mm256_load_ps(rays.dz.data());
+        __m256 enter = _mm256_set1_ps(-1e16f),
+               exit = _mm256_set1_ps(1e16f),
+               entry = zero,
+               live = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for(int i = 0; i < p.size; ++i)
+        {
+            const plane &pl = p.p[i];
+            const __m256 px = _mm256_set1_ps(pl.x),
+                         py = _mm256_set1_ps(pl.y),
+                         pz = _mm256_set1_ps(pl.z);
+            __m256 pdist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px, vx), _mm256_mul_ps(py, vy)), _mm256_mul_ps(pz, vz)), _mm256_set1_ps(pl.offset)),
+                   facing = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, px), _mm256_mul_ps(dy, py)), _mm256_mul_ps(dz, pz)),
+                   t = _mm256_div_ps(pdist, _mm256_xor_ps(facing, signbit)),
+                   entering = _mm256_cmp_ps(facing, zero, _CMP_LT_OQ),
+                   leaving = _mm256_cmp_ps(facing, zero, _CMP_GT_OQ),
+                   parallel = _mm256_andnot_ps(_mm256_or_ps(entering, leaving), live);
+            __m256 later = _mm256_cmp_ps(t, enter, _CMP_GT_OQ),
+                   sooner = _mm256_cmp_ps(t, exit, _CMP_LT_OQ),
+                   fail = _mm256_or_ps(_mm256_or_ps(_mm256_and_ps(entering, _mm256_and_ps(later, _mm256_cmp_ps(t, exit, _CMP_GT_OQ))),
+                                                    _mm256_and_ps(leaving, _mm256_and_ps(sooner, _mm256_cmp_ps(t, enter, _CMP_LT_OQ)))),
+                                       _mm256_and_ps(parallel, _mm256_cmp_ps(pdist, zero, _CMP_GT_OQ)));
+            __m256 setenter = _mm256_andnot_ps(fail, _mm256_and_ps(entering, later)),
+                   setexit = _mm256_andnot_ps(fail, _mm256_and_ps(leaving, sooner));
+            enter = select8(setenter, t, enter);
+            entry = select8(setenter, _mm256_set1_ps(static_cast<float>(i)), entry);
+            exit = select8(setexit, t, exit);
+            live = _mm256_andnot_ps(fail, live);
+            if(!_mm256_movemask_ps(live))
+            {
+                break;
+            }
+        }
+        const std::array<const float *, 3> vs = {rays.vx.data(), rays.vy.data(), rays.vz.data()},
+                                           ds = {rays.dx.data(), rays.dy.data(), rays.dz.data()},
+                                           invs = {rays.ix.data(), rays.iy.data(), rays.iz.data()};
+        for(int i = 0; i < 3 && _mm256_movemask_ps(live); ++i)
+        {
+            const __m256 v = _mm256_load_ps(vs[i]),
+                         d = _mm256_load_ps(ds[i]),
+                         inv = _mm256_load_ps(invs[i]),
+                         po = _mm256_set1_ps(p.o[i]),
+                         pr = _mm256_set1_ps(p.r[i]),
+                         moving = _mm256_cmp_ps(d, zero, _CMP_NEQ_UQ);
+            __m256 prad = _mm256_andnot_ps(signbit, _mm256_mul_ps(pr, inv)),
+                   pdist = _mm256_mul_ps(_mm256_sub_ps(po, v), inv),
+                   pmin = _mm256_sub_ps(pdist, prad),
+                   pmax = _mm256_add_ps(pdist, prad);
+            __m256 later = _mm256_and_ps(moving, _mm256_cmp_ps(pmin, enter, _CMP_GT_OQ)),
+                   fail = _mm256_and_ps(later, _mm256_cmp_ps(pmin, exit, _CMP_GT_OQ));
+            later = _mm256_andnot_ps(fail, later);
+            enter = select8(later, pmin, enter);
+            entry = select8(later, _mm256_set1_ps(static_cast<float>(i)), entry);
+            __m256 sooner = _mm256_andnot_ps(fail, _mm256_and_ps(moving, _mm256_cmp_ps(pmax, exit, _CMP_LT_OQ)));
+            fail = _mm256_or_ps(fail, _mm256_and_ps(sooner, _mm256_cmp_ps(pmax, enter, _CMP_LT_OQ)));
+            exit = select8(_mm256_andnot_ps(fail, sooner), pmax, exit);
+            fail = _mm256_or_ps(fail, _mm256_andnot_ps(moving, _mm256_or_ps(_mm256_cmp_ps(v, _mm256_set1_ps(p.o[i]-p.r[i]), _CMP_LT_OQ),
+                                                                            _mm256_cmp_ps(v, _mm256_set1_ps(p.o[i]+p.r[i]), _CMP_GT_OQ))));
+            live = _mm256_andnot_ps(fail, live);
+        }
+        _mm256_store_ps(hits.enterdist.data(), enter);
+        _mm256_store_ps(hits.exitdist.data(), exit);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(hits.entry.data()), _mm256_cvttps_epi32(entry));
+        return _mm256_movemask_ps(live) & ((1<<lanes)-1);
+    }
+
+    bool cpuhasavx2()
+    {
+#ifdef _MSC_VER
+        std::array<int, 4> info;
+        __cpuid(info.data(), 0);
+        if(info[0] < 7)
+        {
+            return false;
+        }
+        __cpuid(info.data(), 1);
+        //AVX must be supported by both the CPU and the OS (which has to save the registers)
+        if(!(info[2]&(1<<27)) || !(info[2]&(1<<28)) || (_xgetbv(0)&6) != 6)
+        {
+            return false;
+        }
+        __cpuidex(info.data(), 7, 0);
+        return (info[1]&(1<<5)) != 0;
+#else
+        __builtin_cpu_init(); //may be called before libgcc has initialized its cpu info
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    const bool hasavx2 = cpuhasavx2();
+}
+
+int raypacketlanes()
+{
+    return raypacketsimd >= 2 && hasavx2 ? 8 : 4;
+}
+
+int raypacketintersect(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits)
+{
+    if(raypacketsimd >= 2 && hasavx2)
+    {
+        return intersectavx2(p, rays, lanes, hits);
+    }
+    if(raypacketsimd >= 1)
+    {
+        return intersectsse(p, rays, lanes, hits);
+    }
+    return raypacketintersectscalar(p, rays, lanes, hits);
+}
+
+#else
+
+int raypacketlanes()
+{
+    return 4;
+}
+
+int raypacketintersect(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits)
+{
+    return raypacketintersectscalar(p, rays, lanes, hits);
+}
+
+#endif
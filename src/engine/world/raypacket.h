@@ -0,0 +1,76 @@
+#ifndef RAYPACKET_H_
+#define RAYPACKET_H_
+
+/**
+ * @brief A group of rays, stored as a structure of arrays.
+ *
+ * Each array holds one component for every ray, so that a SIMD register loaded
+ * from the array holds that component for several rays at once (one per lane).
+ */
+struct raypacket final
+{
+    static constexpr int maxlanes = 8;
+
+    alignas(32) std::array<float, maxlanes> vx, vy, vz, //current positions of the rays
+                                            dx, dy, dz, //directions of the rays
+                                            ix, iy, iz; //inverse directions, as in raycubeinfo::invray
+};
+
+/**
+ * @brief Per-ray results of raypacketintersect().
+ *
+ * Values in lanes whose rays do not intersect are unspecified.
+ */
+struct raypackethits final
+{
+    alignas(32) std::array<float, raypacket::maxlanes> enterdist,
+                                                       exitdist;
+    std::array<int, raypacket::maxlanes> entry;
+};
+
+/**
+ * @brief Returns the number of rays the current packet kernel tests at once.
+ *
+ * Depends on the `raypacketsimd` variable (0: scalar, 1: SSE2, 2: AVX2) limited
+ * to what the CPU supports. Returns 8 for AVX2, and 4 otherwise; the scalar
+ * kernel uses the same width as SSE2 so that the two can be compared directly.
+ *
+ * @return the number of lanes in a packet, 4 or 8
+ */
+extern int raypacketlanes();
+
+/**
+ * @brief Intersects each ray of a packet with a cube's clip planes.
+ *
+ * For each lane, gives the same result as the clip plane test followed by the
+ * bounding box test that raycube.cpp uses to test one ray against a cube, for
+ * the ray in that lane. Uses the kernel selected by the `raypacketsimd` variable.
+ *
+ * @param p the cube's clip planes
+ * @param rays the rays to test
+ * @param lanes the number of rays in the packet, up to raypacket::maxlanes
+ * @param hits set to the entry and exit distance of each ray, and the index of
+ *        the plane or axis it enters through
+ *
+ * @return bitmask of the lanes whose rays intersect the cube
+ */
+extern int raypacketintersect(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits);
+
+/**
+ * @brief Scalar version of raypacketintersect().
+ *
+ * Tests one lane at a time, without using SIMD instructions. Used as the
+ * fallback on CPUs without SSE2, and as a reference to check the SIMD kernels
+ * against.
+ *
+ * @param p the cube's clip planes
+ * @param rays the rays to test
+ * @param lanes the number of rays in the packet, up to raypacket::maxlanes
+ * @param hits set to the entry and exit distance of each ray, and the index of
+ *        the plane or axis it enters through
+ *
+ * @return bitmask of the lanes whose rays intersect the cube
+ */
+extern int raypacketintersectscalar(const clipplanes &p, const raypacket &rays, int lanes, raypackethits &hits);
+
+#endif
@@ -12,6 +12,7 @@
 #include "light.h"
 #include "octaedit.h"
 #include "octaworld.h"
+#include "physics.h"
 #include "raycube.h"
 #include "world.h"
 
@@ -572,6 +573,14 @@ bool cubeworld::modifyoctaent(int flags, int id, extentity &e)
             }
             break;
         }
+        case EngineEnt_Mapmodel:
+        {
+            if(flags&ModOctaEnt_Add)
+            {
+                preparecollidemodel(e);
+            }
+            break;
+        }
     }
     return true;
 }
@@ -684,7 +693,8 @@ bool cubeworld::emptymap(int scale, bool force, bool usecfg)    // main empty wo
     }
     resetmap();
     worldscale = std::clamp(scale, 10, 16);
-    setvar("emptymap", 1, true, false);
+    static constexpr identkey emptymapkey("emptymap");
+    setvar(emptymapkey, 1, true, false);
     texmru.clear();
     freeocta(worldroot);
     worldroot = newcubes(faceempty);
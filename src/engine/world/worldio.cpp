@@ -7,6 +7,7 @@
 #include "../../shared/geomexts.h"
 #include "../../shared/glexts.h"
 #include "../../shared/stream.h"
+#include "../../shared/threadpool.h"
 
 #include <format>
 
@@ -28,7 +29,9 @@
 namespace
 {
     constexpr int octaversion = 33;
-    constexpr int currentmapversion = 1;   // bump if map format changes, see worldio.cpp
+    constexpr int currentmapversion = 2;   // bump if map format changes, see worldio.cpp
+    constexpr int chunkedmapversion = 2;   // first version storing the octree as separately compressed chunks
+    constexpr uint layerdup = 1<<7;        // if numverts is larger than this, get additional precision
 
     std::string clientmap = "";
 
@@ -264,191 +267,201 @@ enum OctaSave
     OctaSave_Normal
 };
 
-void cubeworld::savec(const std::array<cube, 8> &c, const ivec &o, int size, stream * const f)
+static void savechildren(const std::array<cube, 8> &c, const ivec &o, int size, stream *f);
+
+//writes a cube, and its children if it has any, in the format read by loadc()
+static void savecube(const cube &c, const ivec &co, int size, stream *f)
 {
-    if((savemapprogress++&0xFFF)==0)
+    if(c.children) //recursively note existence of children & save them
     {
-        renderprogress(static_cast<float>(savemapprogress)/allocnodes, "saving octree...");
+        f->putchar(OctaSave_Children);
+        savechildren(*c.children, co, size>>1, f);
+        return;
     }
-    for(int i = 0; i < 8; ++i) //loop through children (there's always eight in an octree)
+    int oflags     = 0,
+        surfmask   = 0,
+        totalverts = 0;
+    if(c.material!=Mat_Air)
     {
-        ivec co(i, o, size);
-        if(c[i].children) //recursively note existence of children & call this fxn again
+        oflags |= 0x40;
+    }
+    if(c.isempty()) //don't need tons of info saved if we know it's just empty
+    {
+        f->putchar(oflags | OctaSave_Empty);
+    }
+    else
+    {
+        if(c.merged)
         {
-            f->putchar(OctaSave_Children);
-            savec(*(c[i].children), co, size>>1, f);
+            oflags |= 0x80;
         }
-        else //once we're done with all cube children within cube *c given
+        if(c.ext)
         {
-            int oflags     = 0,
-                surfmask   = 0,
-                totalverts = 0;
-            if(c[i].material!=Mat_Air)
+            for(int j = 0; j < 6; ++j)
             {
-                oflags |= 0x40;
-            }
-            if(c[i].isempty()) //don't need tons of info saved if we know it's just empty
-            {
-                f->putchar(oflags | OctaSave_Empty);
-            }
-            else
-            {
-                if(c[i].merged)
-                {
-                    oflags |= 0x80;
-                }
-                if(c[i].ext)
                 {
-                    for(int j = 0; j < 6; ++j)
+                    const surfaceinfo &surf = c.ext->surfaces[j];
+                    if(!surf.used())
                     {
-                        {
-                            const surfaceinfo &surf = c[i].ext->surfaces[j];
-                            if(!surf.used())
-                            {
-                                continue;
-                            }
-                            oflags |= 0x20;
-                            surfmask |= 1<<j;
-                            totalverts += surf.totalverts();
-                        }
+                        continue;
                     }
-                }
-                if(c[i].issolid())
-                {
-                    f->putchar(oflags | OctaSave_Solid);
-                }
-                else
-                {
-                    f->putchar(oflags | OctaSave_Normal);
-                    f->write(c[i].edges, 12);
+                    oflags |= 0x20;
+                    surfmask |= 1<<j;
+                    totalverts += surf.totalverts();
                 }
             }
+        }
+        if(c.issolid())
+        {
+            f->putchar(oflags | OctaSave_Solid);
+        }
+        else
+        {
+            f->putchar(oflags | OctaSave_Normal);
+            f->write(c.edges, 12);
+        }
+    }
 
-            for(int j = 0; j < 6; ++j) //for each face (there's always six) save the texture slot
-            {
-                f->put<ushort>(c[i].texture[j]);
-            }
-            if(oflags&0x40) //0x40 is the code for a material (water, lava, alpha, etc.)
-            {
-                f->put<ushort>(c[i].material);
-            }
-            if(oflags&0x80) //0x80 is the code for a merged cube (remipping merged this cube with neighbors)
-            {
-                f->putchar(c[i].merged);
-            }
-            if(oflags&0x20)
+    for(int j = 0; j < 6; ++j) //for each face (there's always six) save the texture slot
+    {
+        f->put<ushort>(c.texture[j]);
+    }
+    if(oflags&0x40) //0x40 is the code for a material (water, lava, alpha, etc.)
+    {
+        f->put<ushort>(c.material);
+    }
+    if(oflags&0x80) //0x80 is the code for a merged cube (remipping merged this cube with neighbors)
+    {
+        f->putchar(c.merged);
+    }
+    if(oflags&0x20)
+    {
+        f->putchar(surfmask);
+        f->putchar(totalverts);
+        for(int j = 0; j < 6; ++j)
+        {
+            if(surfmask&(1<<j))
             {
-                f->putchar(surfmask);
-                f->putchar(totalverts);
-                for(int j = 0; j < 6; ++j)
+                surfaceinfo surf = c.ext->surfaces[j]; //intentional copy
+                const vertinfo *verts = c.ext->verts() + surf.verts;
+                int layerverts = surf.numverts&Face_MaxVerts,
+                    numverts = surf.totalverts(),
+                    vertmask   = 0,
+                    vertorder  = 0,
+                    dim = DIMENSION(j),
+                    vc  = C[dim],
+                    vr  = R[dim];
+                if(numverts)
                 {
-                    if(surfmask&(1<<j))
+                    if(c.merged&(1<<j))
                     {
-                        surfaceinfo surf = c[i].ext->surfaces[j]; //intentional copy
-                        const vertinfo *verts = c[i].ext->verts() + surf.verts;
-                        int layerverts = surf.numverts&Face_MaxVerts,
-                            numverts = surf.totalverts(),
-                            vertmask   = 0,
-                            vertorder  = 0,
-                            dim = DIMENSION(j),
-                            vc  = C[dim],
-                            vr  = R[dim];
-                        if(numverts)
+                        vertmask |= 0x04;
+                        if(layerverts == 4)
                         {
-                            if(c[i].merged&(1<<j))
-                            {
-                                vertmask |= 0x04;
-                                if(layerverts == 4)
-                                {
-                                    std::array<ivec, 4> v = { verts[0].getxyz(), verts[1].getxyz(), verts[2].getxyz(), verts[3].getxyz() };
-                                    for(int k = 0; k < 4; ++k)
-                                    {
-                                        const ivec &v0 = v[k],
-                                                   &v1 = v[(k+1)&3],
-                                                   &v2 = v[(k+2)&3],
-                                                   &v3 = v[(k+3)&3];
-                                        if(v1[vc] == v0[vc] && v1[vr] == v2[vr] && v3[vc] == v2[vc] && v3[vr] == v0[vr])
-                                        {
-                                            vertmask |= 0x01;
-                                            vertorder = k;
-                                            break;
-                                        }
-                                    }
-                                }
-                            }
-                            else
+                            std::array<ivec, 4> v = { verts[0].getxyz(), verts[1].getxyz(), verts[2].getxyz(), verts[3].getxyz() };
+                            for(int k = 0; k < 4; ++k)
                             {
-                                const int vis = visibletris(c[i], j, co, size);
-                                if(vis&4 || faceconvexity(c[i], j) < 0)
+                                const ivec &v0 = v[k],
+                                           &v1 = v[(k+1)&3],
+                                           &v2 = v[(k+2)&3],
+                                           &v3 = v[(k+3)&3];
+                                if(v1[vc] == v0[vc] && v1[vr] == v2[vr] && v3[vc] == v2[vc] && v3[vr] == v0[vr])
                                 {
                                     vertmask |= 0x01;
-                                }
-                                if(layerverts < 4 && vis&2)
-                                {
-                                    vertmask |= 0x02;
-                                }
-                            }
-                            bool matchnorm = true;
-                            for(int k = 0; k < numverts; ++k)
-                            {
-                                const vertinfo &v = verts[k];
-                                if(v.norm)
-                                {
-                                    vertmask |= 0x80;
-                                    if(v.norm != verts[0].norm)
-                                    {
-                                        matchnorm = false;
-                                    }
+                                    vertorder = k;
+                                    break;
                                 }
                             }
-                            if(matchnorm)
-                            {
-                                vertmask |= 0x08;
-                            }
                         }
-                        surf.verts = vertmask;
-                        f->write(&surf, sizeof(surf));
-                        bool hasxyz = (vertmask&0x04)!=0,
-                             hasnorm = (vertmask&0x80)!=0;
-                        if(layerverts == 4)
+                    }
+                    else
+                    {
+                        const int vis = visibletris(c, j, co, size);
+                        if(vis&4 || faceconvexity(c, j) < 0)
                         {
-                            if(hasxyz && vertmask&0x01)
-                            {
-                                const ivec v0 = verts[vertorder].getxyz(),
-                                           v2 = verts[(vertorder+2)&3].getxyz();
-                                f->put<ushort>(v0[vc]); f->put<ushort>(v0[vr]);
-                                f->put<ushort>(v2[vc]); f->put<ushort>(v2[vr]);
-                                hasxyz = false;
-                            }
+                            vertmask |= 0x01;
                         }
-                        if(hasnorm && vertmask&0x08)
+                        if(layerverts < 4 && vis&2)
                         {
-                            f->put<ushort>(verts[0].norm);
-                            hasnorm = false;
+                            vertmask |= 0x02;
                         }
-                        if(hasxyz || hasnorm)
+                    }
+                    bool matchnorm = true;
+                    for(int k = 0; k < numverts; ++k)
+                    {
+                        const vertinfo &v = verts[k];
+                        if(v.norm)
                         {
-                            for(int k = 0; k < layerverts; ++k)
+                            vertmask |= 0x80;
+                            if(v.norm != verts[0].norm)
                             {
-                                const vertinfo &v = verts[(k+vertorder)%layerverts];
-                                if(hasxyz)
-                                {
-                                    const ivec xyz = v.getxyz();
-                                    f->put<ushort>(xyz[vc]); f->put<ushort>(xyz[vr]);
-                                }
-                                if(hasnorm)
-                                {
-                                    f->put<ushort>(v.norm);
-                                }
+                                matchnorm = false;
                             }
                         }
                     }
+                    if(matchnorm)
+                    {
+                        vertmask |= 0x08;
+                    }
+                }
+                surf.verts = vertmask;
+                f->write(&surf, sizeof(surf));
+                bool hasxyz = (vertmask&0x04)!=0,
+                     hasnorm = (vertmask&0x80)!=0;
+                if(layerverts == 4)
+                {
+                    if(hasxyz && vertmask&0x01)
+                    {
+                        const ivec v0 = verts[vertorder].getxyz(),
+                                   v2 = verts[(vertorder+2)&3].getxyz();
+                        f->put<ushort>(v0[vc]); f->put<ushort>(v0[vr]);
+                        f->put<ushort>(v2[vc]); f->put<ushort>(v2[vr]);
+                        hasxyz = false;
+                    }
+                }
+                if(hasnorm && vertmask&0x08)
+                {
+                    f->put<ushort>(verts[0].norm);
+                    hasnorm = false;
+                }
+                if(hasxyz || hasnorm)
+                {
+                    for(int k = 0; k < layerverts; ++k)
+                    {
+                        const vertinfo &v = verts[(k+vertorder)%layerverts];
+                        if(hasxyz)
+                        {
+                            const ivec xyz = v.getxyz();
+                            f->put<ushort>(xyz[vc]); f->put<ushort>(xyz[vr]);
+                        }
+                        if(hasnorm)
+                        {
+                            f->put<ushort>(v.norm);
+                        }
+                    }
                 }
             }
         }
     }
 }
 
+static void savechildren(const std::array<cube, 8> &c, const ivec &o, int size, stream *f)
+{
+    if((savemapprogress++&0xFFF)==0)
+    {
+        renderprogress(static_cast<float>(savemapprogress)/getallocnodes(), "saving octree...");
+    }
+    for(int i = 0; i < 8; ++i) //loop through children (there's always eight in an octree)
+    {
+        savecube(c[i], ivec(i, o, size), size, f);
+    }
+}
+
+void cubeworld::savec(const std::array<cube, 8> &c, const ivec &o, int size, stream * const f)
+{
+    savechildren(c, o, size, f);
+}
+
 static std::array<cube, 8> *loadchildren(stream *f, const ivec &co, int size, bool &failed);
 
 /**
@@ -472,8 +485,6 @@ static std::array<cube, 8> *loadchildren(stream *f, const ivec &co, int size, bo
  */
 static void loadc(stream *f, cube &c, const ivec &co, int size, bool &failed)
 {
-    static constexpr uint layerdup (1<<7); //if numverts is larger than this, get additional precision
-
     int octsav = f->getchar();
     switch(octsav&0x7)
     {
@@ -659,6 +670,450 @@ static std::array<cube, 8> *loadchildren(stream *f, const ivec &co, int size, bo
     return c;
 }
 
+/**
+ * @brief Advances past the bytes of a cube without loading it.
+ *
+ * Reads the same bytes loadc() would for the cube at p, including its children,
+ * but only to find where the cube ends.
+ *
+ * @param p the start of the cube, set to the byte after it
+ * @param end the end of the data available
+ *
+ * @return false if the cube is invalid or extends past end, true otherwise
+ */
+static bool skipc(const uchar *&p, const uchar *end)
+{
+    auto skip = [&p, end] (size_t n)
+    {
+        if(static_cast<size_t>(end - p) < n)
+        {
+            return false;
+        }
+        p += n;
+        return true;
+    };
+    if(p >= end)
+    {
+        return false;
+    }
+    int octsav = *p++;
+    switch(octsav&0x7)
+    {
+        case OctaSave_Children:
+        {
+            for(int i = 0; i < 8; ++i)
+            {
+                if(!skipc(p, end))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case OctaSave_Empty:
+        case OctaSave_Solid:
+        {
+            break;
+        }
+        case OctaSave_Normal:
+        {
+            if(!skip(12))
+            {
+                return false;
+            }
+            break;
+        }
+        default:
+        {
+            return false;
+        }
+    }
+    if(!skip(6*sizeof(ushort) + (octsav&0x40 ? sizeof(ushort) : 0) + (octsav&0x80 ? 1 : 0)))
+    {
+        return false;
+    }
+    if(octsav&0x20)
+    {
+        if(!skip(2))
+        {
+            return false;
+        }
+        int surfmask = p[-2];
+        for(int i = 0; i < 6; ++i)
+        {
+            if(!(surfmask&(1<<i)))
+            {
+                continue;
+            }
+            surfaceinfo surf;
+            if(static_cast<size_t>(end - p) < sizeof(surf))
+            {
+                return false;
+            }
+            std::memcpy(&surf, p, sizeof(surf));
+            p += sizeof(surf);
+            int vertmask = surf.verts,
+                layerverts = surf.numverts&Face_MaxVerts;
+            if(!surf.totalverts())
+            {
+                continue;
+            }
+            bool hasxyz = (vertmask&0x04)!=0,
+                 hasnorm = (vertmask&0x80)!=0;
+            size_t n = 0;
+            if(layerverts == 4 && hasxyz && vertmask&0x01)
+            {
+                n += 4*sizeof(ushort);
+                hasxyz = false;
+            }
+            if(hasnorm && vertmask&0x08)
+            {
+                n += sizeof(ushort);
+                hasnorm = false;
+            }
+            if(hasxyz || hasnorm)
+            {
+                n += layerverts*((hasxyz ? 2 : 0) + (hasnorm ? 1 : 0))*sizeof(ushort);
+            }
+            if(surf.numverts & layerdup)
+            {
+                n += layerverts*2*sizeof(ushort);
+            }
+            if(!skip(n))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static VAR(parallelmapload, 0, 1, 1); //decompress maps on a separate thread, and load the top level octants in parallel
+
+/**
+ * @brief Loads the octree of a map, parsing the top level octants in parallel.
+ *
+ * Reads the rest of the stream in chunks, reporting progress as it goes, and
+ * finds where each of the eight top level octants ends as soon as its bytes
+ * have been read. Once all eight are found, they are loaded on the worker
+ * threads. If the octree is invalid or truncated, it is instead loaded serially
+ * from what was read, so that the result is the same as loadchildren() in
+ * every case.
+ *
+ * @param f the stream to read, positioned at the start of the octree
+ * @param size the size of the top level octants
+ * @param failed set to true if the octree is invalid, as with loadchildren()
+ * @param crc set to the crc32 of the stream up to the end of the octree
+ *
+ * @return the top level octants of the octree
+ */
+static std::array<cube, 8> *loadoctree(stream *f, int size, bool &failed, uint &crc)
+{
+    constexpr size_t chunksize = 1<<18;
+    const uint startcrc = f->getcrc();
+    const stream::offset start = f->tell(),
+                         total = f->size();
+    std::vector<uchar> buf;
+    std::array<size_t, 9> octants; //offset of the start of each octant, and the end of the last
+    octants[0] = 0;
+    int found = 0;
+    size_t retryat = 0; //octants which end past the data read are looked for again once this much has been read
+    bool eof = false;
+    while(found < 8 && !eof)
+    {
+        size_t len = buf.size();
+        buf.resize(len + chunksize);
+        size_t n = f->read(buf.data() + len, chunksize);
+        buf.resize(len + n);
+        eof = n < chunksize;
+        if(total > 0)
+        {
+            renderprogress(static_cast<float>(start + buf.size())/total, "loading octree...");
+        }
+        if(buf.size() < retryat && !eof)
+        {
+            continue;
+        }
+        for(; found < 8; found++)
+        {
+            const uchar *p = buf.data() + octants[found];
+            if(!skipc(p, buf.data() + buf.size()))
+            {
+                retryat = octants[found] + 2*(buf.size() - octants[found]);
+                break;
+            }
+            octants[found+1] = static_cast<size_t>(p - buf.data());
+        }
+    }
+    if(found < 8)
+    {
+        stream *s = openmemstream(buf.data(), buf.size());
+        std::array<cube, 8> *c = loadchildren(s, ivec(0, 0, 0), size, failed);
+        crc = crc32(startcrc, buf.data(), s->tell());
+        delete s;
+        return c;
+    }
+    std::array<cube, 8> *c = newcubes();
+    parallelfor(8, [&] (size_t i)
+    {
+        stream *s = openmemstream(buf.data() + octants[i], octants[i+1] - octants[i]);
+        bool octantfailed = false; //cannot fail, as skipc() has checked the octant
+        loadc(s, (*c)[i], ivec(static_cast<int>(i), ivec(0, 0, 0), size), size, octantfailed);
+        delete s;
+    });
+    crc = crc32(startcrc, buf.data(), octants[8]);
+    return c;
+}
+
+/*
+ * Maps from chunkedmapversion on store the octree as separately compressed
+ * chunks, each holding one cube (with its children) as written by savecube().
+ * Cubes down to mapchunkdepth levels below the top level octants are split
+ * into chunks, so that regions of the map can be found and decompressed
+ * independently.
+ *
+ * The chunk table is written at the end of the gzip stream, where older
+ * versions keep the octree, in the order of a depth first walk of the octree:
+ *
+ *     uint numchunks
+ *     numchunks * { uchar depth, uint size, uint len, uint crc }
+ *
+ * The chunks themselves are zlib streams stored in the same order directly
+ * after the table, so they are read from the same stream as the rest of the
+ * map and need no seeking (maps may be read from packages or through
+ * openreadahead()).
+ */
+namespace
+{
+    struct mapchunk final
+    {
+        int depth;  //levels below the top level octants of the cube stored in the chunk
+        uint size,  //compressed size of the chunk in the file
+             len,   //size of the chunk once decompressed
+             crc;   //crc32 of the decompressed chunk
+    };
+
+    //a cube which is stored as a chunk
+    template<class T>
+    struct chunkcube final
+    {
+        T *c;
+        ivec o;
+        int size;
+    };
+
+    constexpr int maxchunkdepth = 3;
+    constexpr uint maxmapchunks = 8<<(3*maxchunkdepth);
+
+    //collects bytes written to it, for encoding chunks before they are compressed
+    class vectorstream final : public stream
+    {
+        public:
+            std::vector<uchar> buf;
+
+            void close() final
+            {
+            }
+
+            bool end() final
+            {
+                return false;
+            }
+
+            offset tell() const final
+            {
+                return buf.size();
+            }
+
+            size_t write(const void *data, size_t len) final
+            {
+                const uchar *bytes = static_cast<const uchar *>(data);
+                buf.insert(buf.end(), bytes, bytes + len);
+                return len;
+            }
+    };
+}
+
+static VAR(mapchunkdepth, 0, 1, maxchunkdepth); //levels below the top level octants at which saved maps are split into chunks
+static VAR(mapcompresslevel, 0, 9, 9);            //zlib level to compress saved maps with
+static VAR(mapcompressthreads, 0, 0, 64);         //most threads to compress the map stream with, 0 for all workers
+static VAR(mapsaveversion, 1, currentmapversion, currentmapversion); //map version to save, below chunkedmapversion for maps older builds can read
+
+//lists the cubes to store as chunks, in the order the chunk table lists them
+static void findchunks(const std::array<cube, 8> &c, const ivec &o, int size, int depth, std::vector<mapchunk> &chunks, std::vector<chunkcube<const cube>> &cubes)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        ivec co(i, o, size);
+        if(c[i].children && depth < mapchunkdepth)
+        {
+            findchunks(*c[i].children, co, size>>1, depth+1, chunks, cubes);
+        }
+        else
+        {
+            chunks.push_back({depth, 0, 0, 0});
+            cubes.push_back({&c[i], co, size});
+        }
+    }
+}
+
+/**
+ * @brief Encodes and compresses the octree as chunks, and writes the chunk table and chunks.
+ *
+ * The chunks are encoded in order on the calling thread, and compressed on the
+ * worker threads.
+ *
+ * @param root the top level octants of the octree
+ * @param size the size of the top level octants
+ * @param f the stream to write the chunk table and chunks to
+ */
+static void savechunks(const std::array<cube, 8> &root, int size, stream *f)
+{
+    std::vector<mapchunk> chunks;
+    std::vector<chunkcube<const cube>> cubes;
+    findchunks(root, ivec(0, 0, 0), size, 0, chunks, cubes);
+    std::vector<std::vector<uchar>> data(chunks.size());
+    for(size_t i = 0; i < chunks.size(); ++i)
+    {
+        vectorstream s;
+        savecube(*cubes[i].c, cubes[i].o, cubes[i].size, &s);
+        data[i] = std::move(s.buf);
+    }
+    parallelfor(chunks.size(), [&] (size_t i)
+    {
+        mapchunk &chunk = chunks[i];
+        chunk.len = data[i].size();
+        chunk.crc = crc32(crc32(0, nullptr, 0), data[i].data(), chunk.len);
+        uLongf packedsize = compressBound(chunk.len);
+        std::vector<uchar> packed(packedsize);
+        compress2(packed.data(), &packedsize, data[i].data(), chunk.len, mapcompresslevel);
+        packed.resize(packedsize);
+        chunk.size = packedsize;
+        data[i] = std::move(packed);
+    });
+    f->put<uint>(chunks.size());
+    for(const mapchunk &chunk : chunks)
+    {
+        f->putchar(chunk.depth);
+        f->put<uint>(chunk.size);
+        f->put<uint>(chunk.len);
+        f->put<uint>(chunk.crc);
+    }
+    for(const std::vector<uchar> &chunk : data)
+    {
+        f->write(chunk.data(), chunk.size());
+    }
+}
+
+//subdivides the octree down to each chunk's depth, and finds the cube each chunk is loaded into
+static bool placechunks(std::array<cube, 8> &c, const ivec &o, int size, int depth, const std::vector<mapchunk> &chunks, std::vector<chunkcube<cube>> &cubes)
+{
+    for(int i = 0; i < 8; ++i)
+    {
+        size_t next = cubes.size();
+        if(next >= chunks.size() || chunks[next].depth < depth)
+        {
+            return false;
+        }
+        ivec co(i, o, size);
+        if(chunks[next].depth == depth)
+        {
+            cubes.push_back({&c[i], co, size});
+        }
+        else
+        {
+            c[i].children = newcubes();
+            if(!placechunks(*c[i].children, co, size>>1, depth+1, chunks, cubes))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Loads an octree stored as chunks.
+ *
+ * Reads the chunk table and the chunks following it from f, then decompresses,
+ * checks and loads the chunks on the worker threads. Chunks which fail their
+ * crc check are left empty.
+ *
+ * @param f the stream to read, positioned at the chunk table
+ * @param ogzfilename the path of the map file, for error messages
+ * @param size the size of the top level octants
+ * @param failed set to true if the table or any chunk is invalid
+ * @param crc set to the crc32 of the stream up to the end of the table, followed by
+ *            each chunk's decompressed data
+ *
+ * @return the top level octants of the octree
+ */
+static std::array<cube, 8> *loadchunks(stream *f, const char *ogzfilename, int size, bool &failed, uint &crc)
+{
+    std::array<cube, 8> *root = newcubes();
+    uint numchunks = f->get<uint>();
+    if(numchunks > maxmapchunks)
+    {
+        failed = true;
+        return root;
+    }
+    std::vector<mapchunk> chunks(numchunks);
+    std::vector<size_t> offsets(numchunks);
+    size_t total = 0;
+    for(uint i = 0; i < numchunks; ++i)
+    {
+        mapchunk &chunk = chunks[i];
+        chunk.depth = f->getchar();
+        chunk.size = f->get<uint>();
+        chunk.len = f->get<uint>();
+        chunk.crc = f->get<uint>();
+        offsets[i] = total;
+        total += chunk.size;
+    }
+    crc = f->getcrc();
+    std::vector<chunkcube<cube>> cubes;
+    if(!placechunks(*root, ivec(0, 0, 0), size, 0, chunks, cubes) || cubes.size() != chunks.size())
+    {
+        failed = true;
+        return root;
+    }
+    std::vector<uchar> data(total);
+    if(f->read(data.data(), total) != total)
+    {
+        conoutf(Console_Error, "map %s is missing octree data", ogzfilename);
+        failed = true;
+        return root;
+    }
+    renderprogress(0, "loading octree...");
+    std::vector<uchar> loaded(numchunks, 0); //not vector<bool>, as each is set by a different thread
+    parallelfor(numchunks, [&] (size_t i)
+    {
+        const mapchunk &chunk = chunks[i];
+        std::vector<uchar> buf(chunk.len);
+        uLongf len = chunk.len;
+        if(uncompress(buf.data(), &len, data.data() + offsets[i], chunk.size) != Z_OK || len != chunk.len ||
+           crc32(crc32(0, nullptr, 0), buf.data(), len) != chunk.crc)
+        {
+            return;
+        }
+        stream *s = openmemstream(buf.data(), len);
+        bool chunkfailed = false;
+        loadc(s, *cubes[i].c, cubes[i].o, cubes[i].size, chunkfailed);
+        loaded[i] = !chunkfailed;
+        delete s;
+    });
+    for(uint i = 0; i < numchunks; ++i)
+    {
+        if(!loaded[i])
+        {
+            conoutf(Console_Error, "map %s has a corrupt octree chunk at (%d, %d, %d)", ogzfilename, cubes[i].o.x, cubes[i].o.y, cubes[i].o.z);
+            failed = true;
+        }
+        crc = crc32_combine(crc, chunks[i].crc, chunks[i].len);
+    }
+    return root;
+}
+
 static VAR(debugvars, 0, 0, 1);
 
 void savevslots(stream *f, int numvslots)
@@ -847,7 +1302,7 @@ bool cubeworld::save_world(const char *mname, const char *gameident)
     {
         backup(ogzname, bakname);
     }
-    stream *f = opengzfile(ogzname, "wb");
+    stream *f = opengzfile(ogzname, "wb", nullptr, mapcompresslevel, mapcompressthreads ? mapcompressthreads : numworkers());
     if(!f)
     {
         conoutf(Console_Warn, "could not write map to %s", ogzname);
@@ -865,7 +1320,7 @@ bool cubeworld::save_world(const char *mname, const char *gameident)
 
     mapheader hdr;
     std::memcpy(hdr.magic, "TMAP", 4);
-    hdr.version = currentmapversion;
+    hdr.version = mapsaveversion;
     hdr.headersize = sizeof(hdr);
     hdr.worldsize = mapsize();
     hdr.numents = 0;
@@ -957,7 +1412,14 @@ bool cubeworld::save_world(const char *mname, const char *gameident)
     }
     savevslots(f, numvslots);
     renderprogress(0, "saving octree...");
-    savec(*worldroot, ivec(0, 0, 0), rootworld.mapsize()>>1, f);
+    if(hdr.version < chunkedmapversion)
+    {
+        savechildren(*worldroot, ivec(0, 0, 0), mapsize()>>1, f);
+    }
+    else
+    {
+        savechunks(*worldroot, mapsize()>>1, f);
+    }
     delete f;
     conoutf("wrote map file %s", ogzname);
     return true;
@@ -991,10 +1453,15 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
         delete f;
         return false;
     }
+    if(parallelmapload)
+    {
+        f = openreadahead(f); //decompresses ahead while the rest of the map is parsed
+    }
     resetmap();
     const Texture *mapshot = textureload(picname, 3, true, false);
     renderbackground("loading...", mapshot, mname, gameinfo);
-    setvar("mapversion", hdr.version, true, false);
+    static constexpr identkey mapversionkey("mapversion");
+    setvar(mapversionkey, hdr.version, true, false);
     renderprogress(0, "clearing world...");
     freeocta(worldroot);
     worldroot = nullptr;
@@ -1016,7 +1483,8 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
         {
             f->seek(ilen - (maxstrlen-1), SEEK_CUR);
         }
-        const ident *id = getident(name);
+        const identkey key(name); //hashed once for the lookup and the set below
+        const ident *id = getident(key);
         tagval val;
         string str;
         switch(type)
@@ -1057,7 +1525,7 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
                     const int ival = val.getint();
                     if(id->val.i.min <= id->val.i.max && ival >= id->val.i.min && ival <= id->val.i.max)
                     {
-                        setvar(name, ival);
+                        setvar(key, ival);
                         if(debugvars)
                         {
                             conoutf(Console_Debug, "read var %s: %d", name, ival);
@@ -1070,7 +1538,7 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
                     const float fval = val.getfloat();
                     if(id->val.f.min <= id->val.f.max && fval >= id->val.f.min && fval <= id->val.f.max)
                     {
-                        setfvar(name, fval);
+                        setfvar(key, fval);
                         if(debugvars)
                         {
                             conoutf(Console_Debug, "read fvar %s: %f", name, fval);
@@ -1080,7 +1548,7 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
                 }
                 case Id_StringVar:
                 {
-                    setsvar(name, val.getstr());
+                    setsvar(key, val.getstr());
                     if(debugvars)
                     {
                         conoutf(Console_Debug, "read svar %s: %s", name, val.getstr());
@@ -1156,15 +1624,25 @@ bool cubeworld::load_world(const char *mname, const char *gameident, const char
     loadvslots(f, hdr.numvslots);
     renderprogress(0, "loading octree...");
     bool failed = false;
-    worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
+    if(hdr.version >= chunkedmapversion)
+    {
+        worldroot = loadchunks(f, ogzname, hdr.worldsize>>1, failed, mapcrc);
+    }
+    else if(parallelmapload)
+    {
+        worldroot = loadoctree(f, hdr.worldsize>>1, failed, mapcrc);
+    }
+    else
+    {
+        worldroot = loadchildren(f, ivec(0, 0, 0), hdr.worldsize>>1, failed);
+        mapcrc = f->getcrc();
+    }
     if(failed)
     {
         conoutf(Console_Error, "garbage in map");
     }
     renderprogress(0, "validating...");
     validatec(worldroot, hdr.worldsize>>1);
-
-    mapcrc = f->getcrc();
     delete f;
     conoutf("read map %s (%.1f seconds)", ogzname, (SDL_GetTicks()-loadingstart)/1000.0f);
     clearmainmenu();
@@ -0,0 +1,316 @@
+/**
+ * @file asyncio.cpp
+ * @brief background file reading for asset loaders
+ *
+ * Requests are kept in a queue ordered by priority and served by a small pool
+ * of I/O threads (separate from the worker threads in threadpool.cpp, which
+ * are for short compute jobs and would be stalled by blocking reads). Finished
+ * requests wait in a second queue until the main thread collects them.
+ */
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <SDL.h>
+
+#include "../libprimis-headers/tools.h"
+#include "../libprimis-headers/command.h"
+#include "../libprimis-headers/consts.h"
+
+#include "asyncio.h"
+#include "stream.h"
+
+static VAR(asyncreadthreads, 1, 2, 16);  //threads reading files for asyncread(); more can be added later, but not removed
+static VAR(asyncreadmegs, 1, 64, 4096);  //limit on the size of files read but not yet passed to the main thread
+static VAR(asyncreadmillis, 0, 4, 1000); //time per frame to spend calling the done functions of completed reads
+
+namespace
+{
+    struct asyncrequest final
+    {
+        uint id;
+        asyncfile file;
+        std::function<void(asyncfile &)> done;
+        std::function<bool(asyncfile &)> decode;
+        size_t reserved; //bytes counted against the in flight limit
+    };
+
+    class asyncreader final
+    {
+        public:
+            asyncreader() : inflight(0), nextid(1), pending(0), stopping(false), requests(0), cancelled(0), bytesread(0)
+            {
+            }
+
+            ~asyncreader()
+            {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stopping = true;
+                }
+                work.notify_all();
+                space.notify_all();
+                for(std::thread &t : threads)
+                {
+                    t.join();
+                }
+            }
+
+            uint add(const char *name, int priority, const std::function<void(asyncfile &)> &done, const std::function<bool(asyncfile &)> &decode)
+            {
+                std::unique_ptr<asyncrequest> req = std::make_unique<asyncrequest>();
+                req->file.name = name;
+                req->file.ok = false;
+                req->done = done;
+                req->decode = decode;
+                req->reserved = 0;
+                std::lock_guard<std::mutex> guard(lock);
+                uint id = nextid++;
+                req->id = id;
+                queue.emplace(std::make_pair(-priority, id), std::move(req));
+                queued.emplace(id, -priority);
+                pending++;
+                requests++;
+                while(static_cast<int>(threads.size()) < asyncreadthreads)
+                {
+                    threads.emplace_back([this] { run(); });
+                }
+                work.notify_one();
+                return id;
+            }
+
+            bool cancel(uint id)
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                auto itr = queued.find(id);
+                if(itr != queued.end())
+                {
+                    queue.erase(std::make_pair((*itr).second, id));
+                    queued.erase(itr);
+                    cancelled++;
+                    finishrequest(0);
+                    return true;
+                }
+                if(active.count(id))
+                {
+                    //dropped by the I/O thread once it has finished with the file
+                    if(!cancelling.insert(id).second)
+                    {
+                        return false;
+                    }
+                    space.notify_all(); //the I/O thread may be waiting to read it
+                    return true;
+                }
+                for(auto i = completed.begin(); i != completed.end(); ++i)
+                {
+                    if((*i)->id == id)
+                    {
+                        cancelled++;
+                        finishrequest((*i)->reserved);
+                        completed.erase(i);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            //calls done functions until maxmillis have passed, or forever if maxmillis is negative
+            void process(int maxmillis)
+            {
+                uint start = SDL_GetTicks();
+                for(;;)
+                {
+                    std::unique_ptr<asyncrequest> req;
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        if(completed.empty())
+                        {
+                            return;
+                        }
+                        req = std::move(completed.front());
+                        completed.pop_front();
+                    }
+                    req->done(req->file);
+                    {
+                        std::lock_guard<std::mutex> guard(lock);
+                        finishrequest(req->reserved);
+                    }
+                    if(maxmillis >= 0 && SDL_GetTicks() - start >= static_cast<uint>(maxmillis))
+                    {
+                        return;
+                    }
+                }
+            }
+
+            void finish()
+            {
+                for(;;)
+                {
+                    {
+                        std::unique_lock<std::mutex> guard(lock);
+                        finished.wait(guard, [this] { return !pending || completed.size(); });
+                        if(!pending)
+                        {
+                            return;
+                        }
+                    }
+                    process(-1);
+                }
+            }
+
+            asyncreadstats stats()
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                return {queue.size(), active.size(), completed.size(), inflight, requests, cancelled, bytesread};
+            }
+
+        private:
+            std::mutex lock;
+            std::condition_variable work,     //signalled when requests are queued
+                                    space,    //signalled when bytes in flight are released
+                                    finished; //signalled when requests complete
+            std::map<std::pair<int, uint>, std::unique_ptr<asyncrequest>> queue; //by negated priority, then id
+            std::unordered_map<uint, int> queued;                                //negated priority of each queued request
+            std::unordered_set<uint> active,                                     //requests being read or decoded
+                                     cancelling;                                 //active requests which have been cancelled
+            std::deque<std::unique_ptr<asyncrequest>> completed;
+            std::vector<std::thread> threads;
+            size_t inflight;
+            uint nextid;
+            size_t pending; //requests which have neither been passed to their done function nor cancelled
+            bool stopping;
+            size_t requests,
+                   cancelled,
+                   bytesread;
+
+            //releases a request's bytes, once it has been passed to its done function or cancelled; lock must be held
+            void finishrequest(size_t reserved)
+            {
+                inflight -= reserved;
+                pending--;
+                space.notify_all();
+                finished.notify_all();
+            }
+
+            static void readfile(asyncfile &file, stream *f, size_t size)
+            {
+                if(!f)
+                {
+                    return;
+                }
+                if(size)
+                {
+                    file.data.resize(size);
+                    file.ok = f->read(file.data.data(), size) == size;
+                    return;
+                }
+                //size not known in advance
+                constexpr size_t chunksize = 1<<16;
+                for(;;)
+                {
+                    size_t len = file.data.size();
+                    file.data.resize(len + chunksize);
+                    size_t n = f->read(&file.data[len], chunksize);
+                    file.data.resize(len + n);
+                    if(n < chunksize)
+                    {
+                        break;
+                    }
+                }
+                file.ok = !file.data.empty();
+            }
+
+            void run()
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                for(;;)
+                {
+                    work.wait(guard, [this] { return stopping || queue.size(); });
+                    if(stopping)
+                    {
+                        return;
+                    }
+                    std::unique_ptr<asyncrequest> req = std::move((*queue.begin()).second);
+                    queue.erase(queue.begin());
+                    queued.erase(req->id);
+                    active.insert(req->id);
+                    guard.unlock();
+
+                    stream *f = openfile(req->file.name.c_str(), "rb");
+                    stream::offset size = f ? f->size() : -1;
+                    req->reserved = size > 0 ? size : 0;
+
+                    guard.lock();
+                    size_t limit = static_cast<size_t>(asyncreadmegs) << 20;
+                    space.wait(guard, [&] { return stopping || cancelling.count(req->id) || !inflight || inflight + req->reserved <= limit; });
+                    inflight += req->reserved;
+                    bool skip = stopping || cancelling.count(req->id);
+                    guard.unlock();
+
+                    if(!skip)
+                    {
+                        readfile(req->file, f, req->reserved);
+                        if(req->file.ok && req->decode)
+                        {
+                            req->file.ok = req->decode(req->file);
+                        }
+                    }
+                    delete f;
+
+                    guard.lock();
+                    bytesread += req->file.data.size();
+                    active.erase(req->id);
+                    if(cancelling.erase(req->id))
+                    {
+                        cancelled++;
+                        finishrequest(req->reserved);
+                        continue;
+                    }
+                    completed.push_back(std::move(req));
+                    finished.notify_all();
+                }
+            }
+    };
+
+    //constructed on first use, so that it is destroyed (joining its threads) before the globals it uses
+    asyncreader &reader()
+    {
+        static asyncreader r;
+        return r;
+    }
+}
+
+uint asyncread(const char *name, int priority, const std::function<void(asyncfile &)> &done, const std::function<bool(asyncfile &)> &decode)
+{
+    return reader().add(name, priority, done, decode);
+}
+
+bool cancelasyncread(uint id)
+{
+    return reader().cancel(id);
+}
+
+void processasyncreads()
+{
+    reader().process(asyncreadmillis);
+}
+
+void finishasyncreads()
+{
+    reader().finish();
+}
+
+asyncreadstats getasyncreadstats()
+{
+    return reader().stats();
+}
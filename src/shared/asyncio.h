@@ -0,0 +1,102 @@
+#ifndef ASYNCIO_H_
+#define ASYNCIO_H_
+
+/**
+ * @brief Priorities for asyncread(); requests with higher priorities are read first.
+ */
+enum AsyncPriority
+{
+    AsyncPriority_Low = 0,
+    AsyncPriority_Normal,
+    AsyncPriority_High
+};
+
+/**
+ * @brief A file read by asyncread().
+ */
+struct asyncfile final
+{
+    std::string name;        /// the name of the file, as passed to asyncread()
+    std::vector<uchar> data; /// the contents of the file; the decode function may replace them
+    bool ok;                 /// whether the file was read, and decoded if there is a decode function
+};
+
+/**
+ * @brief Statistics about the requests made to asyncread().
+ */
+struct asyncreadstats final
+{
+    size_t queued,    /// requests waiting to be read
+           active,    /// requests being read or decoded
+           completed, /// requests waiting for processasyncreads() to call their callbacks
+           inflight,  /// bytes read but not yet passed to their callbacks
+           requests,  /// requests made in total
+           cancelled, /// requests cancelled in total
+           bytesread; /// bytes read in total
+};
+
+/**
+ * @brief Reads a file on a background thread.
+ *
+ * The file is opened with openfile(), so it may be in a package directory or a
+ * zip archive, and read into memory by one of the `asyncreadthreads` I/O
+ * threads. If decode is set, it is then called on the same I/O thread, so that
+ * loaders can parse the file without blocking the main thread. Finally, done
+ * is called on the main thread by processasyncreads() (or finishasyncreads()),
+ * where loaders can safely upload the result to OpenGL.
+ *
+ * Files which have been read but not yet passed to done count against a limit
+ * of `asyncreadmegs` megabytes; I/O threads wait before reading files which
+ * would exceed it, unless nothing else is in flight.
+ *
+ * The decode function runs on an I/O thread, so must not use the console,
+ * OpenGL, or other main thread state. Package directories and zip archives
+ * must not be added or removed while requests are outstanding.
+ *
+ * @param name the name of the file to read
+ * @param priority the request's AsyncPriority; requests of the same priority are read in order
+ * @param done called on the main thread with the file once it has been read
+ *        (or could not be read; see asyncfile::ok)
+ * @param decode if set, called on the I/O thread after a successful read;
+ *        the file's ok field is set to the value it returns
+ *
+ * @return an id for the request, which may be passed to cancelasyncread()
+ */
+extern uint asyncread(const char *name, int priority, const std::function<void(asyncfile &)> &done, const std::function<bool(asyncfile &)> &decode = nullptr);
+
+/**
+ * @brief Cancels a request made with asyncread().
+ *
+ * The request's done function will not be called. If the file is being read or
+ * decoded, that work finishes on its I/O thread, but the result is discarded.
+ *
+ * @param id the id returned by asyncread()
+ *
+ * @return true if the request was cancelled, false if it had already been
+ *         completed or cancelled
+ */
+extern bool cancelasyncread(uint id);
+
+/**
+ * @brief Calls the done functions of completed asyncread() requests.
+ *
+ * Must be called on the main thread; called once per frame by gl_drawframe().
+ * Calls done functions, in the order their reads completed, until the
+ * `asyncreadmillis` time budget is used up. At least one is always called
+ * if any are waiting.
+ */
+extern void processasyncreads();
+
+/**
+ * @brief Waits for all outstanding asyncread() requests, calling their done functions.
+ *
+ * Must be called on the main thread.
+ */
+extern void finishasyncreads();
+
+/**
+ * @brief Returns statistics about the requests made with asyncread().
+ */
+extern asyncreadstats getasyncreadstats();
+
+#endif
@@ -14,6 +14,12 @@
 #include <stack>
 #include <array>
 #include <algorithm>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <SDL.h>
 
@@ -28,6 +34,8 @@
 #include "../libprimis-headers/consts.h"
 
 #include "stream.h"
+#include "threadpool.h"
+#include "vfs.h"
 
 #include "../engine/interface/console.h"
 
@@ -187,6 +195,7 @@ struct packagedir
 {
     std::string dir;
     std::string filter;
+    int source; //id of the directory in packageindex
 };
 static std::vector<packagedir> packagedirs;
 
@@ -471,6 +480,100 @@ const char *sethomedir(const char *dir)
     return homedir.c_str();
 }
 
+#ifndef WIN32
+//device and inode of each directory indexdir() is inside, so a symlink back to one is not followed
+static std::vector<std::pair<dev_t, ino_t>> indexparents;
+#endif
+
+/**
+ * Adds the files and directories under root + dir, recursively, to a source of
+ * packageindex. dir is empty or ends with PATHDIV, and the paths are indexed
+ * relative to root. Symlinked directories are followed, except for those which
+ * lead back to a directory already being indexed; on Windows, junctions and
+ * other directory reparse points are not followed.
+ */
+static void indexdir(const std::string &root, const std::string &dir, int source)
+{
+    std::string pathname = root + dir;
+#ifndef WIN32
+    struct stat dirinfo;
+    if(stat(pathname.empty() ? "." : pathname.c_str(), &dirinfo))
+    {
+        return;
+    }
+    std::pair<dev_t, ino_t> dirid(dirinfo.st_dev, dirinfo.st_ino);
+    if(std::find(indexparents.begin(), indexparents.end(), dirid) != indexparents.end())
+    {
+        return;
+    }
+#endif
+    if(dir.size())
+    {
+        packageindex.adddir(source, std::string(dir, 0, dir.size()-1).c_str());
+    }
+#ifdef WIN32
+    WIN32_FIND_DATA FindFileData;
+    HANDLE Find = FindFirstFile((pathname + "*").c_str(), &FindFileData);
+    if(Find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    do
+    {
+        const char *name = FindFileData.cFileName;
+        if(!std::strcmp(name, ".") || !std::strcmp(name, ".."))
+        {
+            continue;
+        }
+        if(FindFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if(FindFileData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)
+            {
+                continue;
+            }
+            indexdir(root, dir + name + PATHDIV, source);
+        }
+        else
+        {
+            packageindex.addfile(source, (dir + name).c_str());
+        }
+    } while(FindNextFile(Find, &FindFileData));
+    FindClose(Find);
+#else
+    DIR *d = opendir(pathname.empty() ? "." : pathname.c_str());
+    if(!d)
+    {
+        return;
+    }
+    indexparents.push_back(dirid);
+    struct dirent *de;
+    while((de = readdir(d)) != nullptr)
+    {
+        const char *name = de->d_name;
+        if(!std::strcmp(name, ".") || !std::strcmp(name, ".."))
+        {
+            continue;
+        }
+        bool isdir = de->d_type == DT_DIR;
+        if(de->d_type == DT_UNKNOWN || de->d_type == DT_LNK)
+        {
+            struct stat info;
+            isdir = !stat((pathname + name).c_str(), &info) && S_ISDIR(info.st_mode);
+        }
+        if(isdir)
+        {
+            indexdir(root, dir + name + PATHDIV, source);
+        }
+        else
+        {
+            packageindex.addfile(source, (dir + name).c_str());
+        }
+    }
+    closedir(d);
+    indexparents.pop_back();
+#endif
+}
+
 const char *addpackagedir(const char *dir)
 {
     string pdir;
@@ -497,13 +600,15 @@ const char *addpackagedir(const char *dir)
     packagedir pf;
     pf.dir = filter ? std::string(pdir, filter-pdir) : std::string(pdir);
     pf.filter = filter ? std::string(filter) : "";
+    pf.source = packageindex.addsource(vfsindex::Source_Dir, pf.filter.c_str());
+    indexdir(pf.dir, pf.filter, pf.source);
     packagedirs.push_back(pf);
-    return pf.dir.c_str();
+    return packagedirs.back().dir.c_str();
 }
 
 const char *findfile(const char *filename, const char *mode)
 {
-    static string s;
+    static thread_local string s; //files are opened on asyncread() threads as well as the main thread
     if(homedir[0])
     {
         formatstring(s, "%s%s", homedir.c_str(), filename);
@@ -533,15 +638,13 @@ const char *findfile(const char *filename, const char *mode)
     {
         return filename;
     }
+    //package directories are only indexed below their filter, so the filter need not be checked
+    int source = packageindex.find(filename, vfsindex::Source_Dir);
     for(const packagedir &pf : packagedirs)
     {
-        if(pf.filter.size() > 0 && std::strncmp(filename, pf.filter.c_str(), pf.filter.size()))
-        {
-            continue;
-        }
-        formatstring(s, "%s%s", pf.dir.c_str(), filename);
-        if(fileexists(s, mode))
+        if(pf.source == source)
         {
+            formatstring(s, "%s%s", pf.dir.c_str(), filename);
             return s;
         }
     }
@@ -641,18 +744,7 @@ int listfiles(const char *dir, const char *ext, std::vector<char *> &files)
             dirs++;
         }
     }
-    for(const packagedir &pf : packagedirs)
-    {
-        if(pf.filter.size() && std::strncmp(dirname, pf.filter.c_str(), dirlen == pf.filter.size()-1 ? dirlen : pf.filter.size()))
-        {
-            continue;
-        }
-        formatstring(s, "%s%s", pf.dir.c_str(), dirname);
-        if(listdir(s, false, ext, files))
-        {
-            dirs++;
-        }
-    }
+    dirs += packageindex.list(dirname, ext, vfsindex::Source_Dir, files);
     dirs += listzipfiles(dirname, ext, files);
     return dirs;
 }
@@ -895,12 +987,104 @@ struct filestream final : stream
     }
 };
 
+namespace
+{
+    constexpr size_t deflateblocksize = 1<<17,    //input bytes compressed by each job of deflateblocks()
+                     deflatewindow = 1<<15;       //bytes of preceding input used as the dictionary of each block
+
+    //compresses one block of a raw deflate stream, appending the output to out
+    bool deflateblock(const uchar *in, size_t len, size_t history, int level, bool finish, std::vector<uchar> &out)
+    {
+        z_stream z;
+        z.zalloc = nullptr;
+        z.zfree = nullptr;
+        z.opaque = nullptr;
+        if(deflateInit2(&z, level, Z_DEFLATED, -MAX_WBITS, std::min<int>(MAX_MEM_LEVEL, 8), Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            return false;
+        }
+        if(history && deflateSetDictionary(&z, in - history, history) != Z_OK)
+        {
+            deflateEnd(&z);
+            return false;
+        }
+        out.resize(deflateBound(&z, len) + 16); //room for the empty block ending a sync flush
+        z.next_in = const_cast<Bytef *>(in);
+        z.avail_in = len;
+        z.next_out = out.data();
+        z.avail_out = out.size();
+        bool ok = false;
+        for(;;)
+        {
+            int err = deflate(&z, finish ? Z_FINISH : Z_SYNC_FLUSH);
+            //a sync flush is complete only once deflate() leaves output space unused
+            if(finish ? err == Z_STREAM_END : err == Z_OK && z.avail_out)
+            {
+                ok = true;
+                break;
+            }
+            if(err != Z_OK && err != Z_BUF_ERROR)
+            {
+                break;
+            }
+            size_t used = out.size() - z.avail_out;
+            out.resize(out.size()*2);
+            z.next_out = out.data() + used;
+            z.avail_out = out.size() - used;
+        }
+        out.resize(z.total_out);
+        deflateEnd(&z);
+        return ok;
+    }
+}
+
+bool deflateblocks(const uchar *in, size_t len, size_t history, std::vector<uchar> &out, int level, int threads, bool finish, uint *crc)
+{
+    size_t numblocks = std::max<size_t>((len + deflateblocksize - 1)/deflateblocksize, 1);
+    std::vector<std::vector<uchar>> blocks(numblocks);
+    std::vector<uint> crcs(numblocks);
+    std::vector<uchar> ok(numblocks, 0); //not vector<bool>, as each is set by a different thread
+    auto job = [&] (size_t i)
+    {
+        size_t start = i*deflateblocksize,
+               blocklen = std::min(deflateblocksize, len - start),
+               blockhistory = std::min(deflatewindow, history + start);
+        ok[i] = deflateblock(in + start, blocklen, blockhistory, level, finish && i == numblocks-1, blocks[i]);
+        if(crc)
+        {
+            crcs[i] = crc32(crc32(0, nullptr, 0), in + start, blocklen);
+        }
+    };
+    //at most threads blocks are compressed at once
+    size_t batch = std::max(threads, 1);
+    for(size_t i = 0; i < numblocks; i += batch)
+    {
+        parallelfor(std::min(batch, numblocks - i), [&] (size_t j)
+        {
+            job(i + j);
+        });
+    }
+    for(size_t i = 0; i < numblocks; ++i)
+    {
+        if(!ok[i])
+        {
+            return false;
+        }
+        out.insert(out.end(), blocks[i].begin(), blocks[i].end());
+        if(crc)
+        {
+            *crc = crc32_combine(*crc, crcs[i], std::min(deflateblocksize, len - i*deflateblocksize));
+        }
+    }
+    return true;
+}
+
 static VAR(debuggz, 0, 0, 1); //toggles gz checking routines
 
 class gzstream final : public stream
 {
     public:
-        gzstream() : file(nullptr), buf(nullptr), reading(false), writing(false), autoclose(false), crc(0), headersize(0)
+        gzstream() : file(nullptr), buf(nullptr), reading(false), writing(false), autoclose(false), crc(0), headersize(0), blocklevel(0), blockthreads(1), blockhistory(0), blockinput(0)
         {
             zfile.zalloc = nullptr;
             zfile.zfree = nullptr;
@@ -1005,12 +1189,14 @@ class gzstream final : public stream
             return zfile.avail_in > 0 || !file->end();
         }
 
-        bool open(stream *f, const char *mode, bool needclose, int level)
+        bool open(stream *f, const char *mode, bool needclose, int level, int threads)
         {
             if(file)
             {
                 return false;
             }
+            blocklevel = level;
+            blockthreads = threads;
             for(; *mode; mode++)
             {
                 if(*mode=='r')
@@ -1102,29 +1288,73 @@ class gzstream final : public stream
             reading = false;
         }
 
+        //total bytes written to the stream
+        uLong writtensize() const
+        {
+            return blockthreads > 1 ? blockinput + (blocks.size() - blockhistory) : zfile.total_in;
+        }
+
+        /**
+         * Compresses the buffered input as blocks on the worker threads, and
+         * writes them to the file. Unless all is set, only whole batches of
+         * blocks are compressed, so that each job has a full block to work on.
+         */
+        bool flushblocks(bool all, bool finish)
+        {
+            size_t len = blocks.size() - blockhistory,
+                   batch = deflateblocksize*blockthreads,
+                   n = all ? len : len - len%batch;
+            if(!n && !finish)
+            {
+                return true;
+            }
+            std::vector<uchar> out;
+            uint blockcrc = crc32(0, nullptr, 0);
+            if(!deflateblocks(blocks.data() + blockhistory, n, blockhistory, out, blocklevel, blockthreads, finish, &blockcrc) ||
+               file->write(out.data(), out.size()) != out.size())
+            {
+                return false;
+            }
+            crc = crc32_combine(crc, blockcrc, n);
+            blockinput += n;
+            //keep the end of the compressed input as the dictionary of the next block
+            size_t keep = std::min(blockhistory + n, deflatewindow);
+            blocks.erase(blocks.begin(), blocks.begin() + (blockhistory + n - keep));
+            blockhistory = keep;
+            return true;
+        }
+
         void finishwriting()
         {
             if(!writing)
             {
                 return;
             }
-            for(;;)
+            if(blockthreads > 1)
             {
-                int err = zfile.avail_out > 0 ? deflate(&zfile, Z_FINISH) : Z_OK;
-                if(err != Z_OK && err != Z_STREAM_END)
-                {
-                    break;
-                }
-                flushbuf();
-                if(err == Z_STREAM_END)
+                flushblocks(true, true);
+            }
+            else
+            {
+                for(;;)
                 {
-                    break;
+                    int err = zfile.avail_out > 0 ? deflate(&zfile, Z_FINISH) : Z_OK;
+                    if(err != Z_OK && err != Z_STREAM_END)
+                    {
+                        break;
+                    }
+                    flushbuf();
+                    if(err == Z_STREAM_END)
+                    {
+                        break;
+                    }
                 }
             }
+            uLong total = writtensize();
             uchar trailer[8] =
             {
                 static_cast<uchar>(crc&0xFF), static_cast<uchar>((crc>>8)&0xFF), static_cast<uchar>((crc>>16)&0xFF), static_cast<uchar>((crc>>24)&0xFF),
-                static_cast<uchar>(zfile.total_in&0xFF), static_cast<uchar>((zfile.total_in>>8)&0xFF), static_cast<uchar>((zfile.total_in>>16)&0xFF), static_cast<uchar>((zfile.total_in>>24)&0xFF)
+                static_cast<uchar>(total&0xFF), static_cast<uchar>((total>>8)&0xFF), static_cast<uchar>((total>>16)&0xFF), static_cast<uchar>((total>>24)&0xFF)
             };
             file->write(trailer, sizeof(trailer));
         }
@@ -1170,7 +1400,7 @@ class gzstream final : public stream
 
         offset tell() const final
         {
-            return reading ? zfile.total_out : (writing ? zfile.total_in : offset(-1));
+            return reading ? zfile.total_out : (writing ? writtensize() : offset(-1));
         }
 
         offset rawtell() const final
@@ -1314,6 +1544,10 @@ class gzstream final : public stream
 
         bool flush() final
         {
+            if(blockthreads > 1)
+            {
+                return writing && flushblocks(true, false) && file->flush();
+            }
             return flushbuf(true);
         }
 
@@ -1323,6 +1557,17 @@ class gzstream final : public stream
             {
                 return 0;
             }
+            if(blockthreads > 1)
+            {
+                const uchar *bytes = static_cast<const uchar *>(newbuf);
+                blocks.insert(blocks.end(), bytes, bytes + len);
+                if(!flushblocks(false, false))
+                {
+                    stopwriting();
+                    return 0;
+                }
+                return len;
+            }
             zfile.next_in = static_cast<Bytef *>(const_cast<void *>(newbuf)); //cast away constness, then to Bytef
             zfile.avail_in = len;
             while(zfile.avail_in > 0)
@@ -1368,8 +1613,258 @@ class gzstream final : public stream
         bool reading, writing, autoclose;
         uint crc;
         size_t headersize;
+        int blocklevel,
+            blockthreads;          //if more than one, input is buffered and compressed as blocks by deflateblocks()
+        std::vector<uchar> blocks; //input not yet compressed, after the blockhistory bytes preceding it
+        size_t blockhistory;       //bytes at the start of blocks which have already been compressed
+        uLong blockinput;          //bytes compressed as blocks so far
 };
 
+/**
+ * @brief Stream reading another stream ahead of the caller on a separate thread.
+ *
+ * The source is read in chunks into a ring buffer by a thread owned by this
+ * stream, so that (for example) decompression of a gzstream runs while the
+ * caller parses what has already been read. Only forward seeks are supported.
+ */
+class readaheadstream final : public stream
+{
+    public:
+        readaheadstream(stream *source, bool needclose, size_t bufsize) :
+            source(source), autoclose(needclose), ring(std::max(bufsize, chunksize)),
+            written(0), consumed(0), ended(false), stopping(false), crc(source->getcrc())
+        {
+            //the source may not be used by the caller once the reader has started, so read its size first
+            sourcesize = source->size();
+            reader = std::thread([this] { readsource(); });
+        }
+
+        ~readaheadstream()
+        {
+            close();
+        }
+
+        void close() final
+        {
+            if(reader.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    stopping = true;
+                }
+                space.notify_all();
+                reader.join();
+            }
+            if(autoclose && source)
+            {
+                delete source;
+            }
+            source = nullptr;
+        }
+
+        bool end() final
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            return ended && consumed == written;
+        }
+
+        offset tell() const final
+        {
+            return consumed;
+        }
+
+        offset size() final
+        {
+            return sourcesize;
+        }
+
+        bool seek(offset pos, int whence) final
+        {
+            if(whence == SEEK_CUR)
+            {
+                pos += static_cast<offset>(consumed);
+            }
+            else if(whence != SEEK_SET)
+            {
+                return false;
+            }
+            if(pos < static_cast<offset>(consumed))
+            {
+                return false;
+            }
+            std::array<uchar, 512> skip;
+            while(pos > static_cast<offset>(consumed))
+            {
+                size_t skipped = static_cast<size_t>(std::min<offset>(pos - static_cast<offset>(consumed), static_cast<offset>(skip.size())));
+                if(read(skip.data(), skipped) != skipped)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        size_t read(void *buf, size_t len) final
+        {
+            uchar *dst = static_cast<uchar *>(buf);
+            size_t total = 0;
+            while(total < len)
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                data.wait(guard, [this] { return written > consumed || ended; });
+                size_t n = std::min(len - total, written - consumed);
+                if(!n)
+                {
+                    break;
+                }
+                guard.unlock();
+                //only this thread moves consumed, and the reader does not overwrite unconsumed bytes
+                for(size_t copied = 0; copied < n;)
+                {
+                    size_t start = (consumed + copied) % ring.size(),
+                           run = std::min(n - copied, ring.size() - start);
+                    std::memcpy(dst + total + copied, &ring[start], run);
+                    copied += run;
+                }
+                crc = crc32(crc, dst + total, n);
+                total += n;
+                guard.lock();
+                consumed += n;
+                guard.unlock();
+                space.notify_one();
+            }
+            return total;
+        }
+
+        uint getcrc() final
+        {
+            return crc;
+        }
+
+    private:
+        static constexpr size_t chunksize = 1<<16;
+
+        stream *source;
+        bool autoclose;
+        offset sourcesize;
+        std::vector<uchar> ring;
+        size_t written,  //total bytes the reader has put in the ring
+               consumed; //total bytes the caller has taken from the ring
+        bool ended,      //the reader has reached the end of the source
+             stopping;   //the stream is being closed
+        uint crc;        //crc of the bytes taken by the caller, continuing from the source's crc when opened
+        std::thread reader;
+        std::mutex lock;
+        std::condition_variable data,
+                                space;
+
+        void readsource()
+        {
+            std::vector<uchar> chunk(chunksize);
+            for(;;)
+            {
+                size_t n = source->read(chunk.data(), chunk.size());
+                std::unique_lock<std::mutex> guard(lock);
+                for(size_t copied = 0; copied < n;)
+                {
+                    space.wait(guard, [this] { return written - consumed < ring.size() || stopping; });
+                    if(stopping)
+                    {
+                        return;
+                    }
+                    size_t start = written % ring.size(),
+                           run = std::min({n - copied, ring.size() - (written - consumed), ring.size() - start});
+                    std::memcpy(&ring[start], &chunk[copied], run);
+                    copied += run;
+                    written += run;
+                    data.notify_one();
+                }
+                if(n < chunk.size() || stopping)
+                {
+                    ended = true;
+                    data.notify_one();
+                    return;
+                }
+            }
+        }
+};
+
+/**
+ * @brief Read only stream over a block of memory owned by the caller.
+ */
+class memstream final : public stream
+{
+    public:
+        memstream(const uchar *buf, size_t len) : buf(buf), len(len), pos(0)
+        {
+        }
+
+        void close() final
+        {
+        }
+
+        bool end() final
+        {
+            return pos >= len;
+        }
+
+        offset tell() const final
+        {
+            return pos;
+        }
+
+        offset size() final
+        {
+            return len;
+        }
+
+        bool seek(offset newpos, int whence) final
+        {
+            if(whence == SEEK_CUR)
+            {
+                newpos += static_cast<offset>(pos);
+            }
+            else if(whence == SEEK_END)
+            {
+                newpos += static_cast<offset>(len);
+            }
+            if(newpos < 0 || newpos > static_cast<offset>(len))
+            {
+                return false;
+            }
+            pos = static_cast<size_t>(newpos);
+            return true;
+        }
+
+        size_t read(void *outbuf, size_t outlen) final
+        {
+            size_t n = std::min(outlen, len - pos);
+            std::memcpy(outbuf, buf + pos, n);
+            pos += n;
+            return n;
+        }
+
+        int getchar() final
+        {
+            return pos < len ? buf[pos++] : -1;
+        }
+
+    private:
+        const uchar *buf;
+        size_t len,
+               pos;
+};
+
+stream *openreadahead(stream *source, bool needclose, size_t bufsize)
+{
+    return new readaheadstream(source, needclose, bufsize);
+}
+
+stream *openmemstream(const uchar *buf, size_t len)
+{
+    return new memstream(buf, len);
+}
+
 stream *openrawfile(const char *filename, const char *mode)
 {
     const char *found = findfile(filename, mode);
@@ -1397,6 +1892,11 @@ stream *openfile(const char *filename, const char *mode)
 }
 
 stream *opengzfile(const char *filename, const char *mode, stream *file, int level)
+{
+    return opengzfile(filename, mode, file, level, 1);
+}
+
+stream *opengzfile(const char *filename, const char *mode, stream *file, int level, int threads)
 {
     stream *source = file ? file : openfile(filename, mode);
     if(!source)
@@ -1404,7 +1904,7 @@ stream *opengzfile(const char *filename, const char *mode, stream *file, int lev
         return nullptr;
     }
     gzstream *gz = new gzstream;
-    if(!gz->open(source, mode, !file, level))
+    if(!gz->open(source, mode, !file, level, threads))
     {
         if(!file)
         {
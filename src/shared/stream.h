@@ -73,9 +73,106 @@ inline uchar cubeupper(uchar c)
 extern size_t encodeutf8(uchar *dstbuf, size_t dstlen, const uchar *srcbuf, size_t srclen, size_t *carry = nullptr);
 
 extern char *loadfile(const char *fn, size_t *size, bool utf8 = true);
+
+/**
+ * @brief Opens a stream which reads another stream ahead of the caller on its own thread.
+ *
+ * The source is read in the background into a ring buffer of the given size,
+ * so that decompressing a gz file, for example, overlaps with parsing it. The
+ * returned stream supports reading and forward seeks. Its getcrc() continues
+ * from the source's getcrc() at the time it was opened, so bytes read from the
+ * source before then are included. The source must not be used directly while
+ * the returned stream is open.
+ *
+ * @param source the stream to read from
+ * @param needclose whether to delete the source when the returned stream is closed
+ * @param bufsize the size of the ring buffer, in bytes
+ *
+ * @return a new stream, which the caller must delete
+ */
+extern stream *openreadahead(stream *source, bool needclose = true, size_t bufsize = 1<<20);
+
+/**
+ * @brief Opens a gzip stream, compressing with several threads when writing.
+ *
+ * As the four argument opengzfile(), but if threads is more than one and the
+ * stream is opened for writing, written data is buffered and compressed as
+ * independent blocks on the worker threads (see deflateblocks()). The output
+ * is a standard gzip file, readable by any gzip reader.
+ *
+ * @param filename the file to open, if file is not passed
+ * @param mode the mode to open the file with
+ * @param file the stream to compress to or decompress from, or nullptr to open filename
+ * @param level the zlib compression level to write with
+ * @param threads the most blocks to compress at once
+ *
+ * @return a new stream, or nullptr if the file could not be opened
+ */
+extern stream *opengzfile(const char *filename, const char *mode, stream *file, int level, int threads);
+
+/**
+ * @brief Compresses data as a raw deflate stream, splitting the work across threads.
+ *
+ * The input is split into 128 KiB blocks, each compressed separately on the
+ * worker threads with the 32 KiB of input before it as its dictionary, as the
+ * pigz tool does. Each block ends on a byte boundary, so the blocks join into
+ * one deflate stream readable by inflate(). A stream may be compressed across
+ * several calls by passing the end of the previous call's input as history.
+ *
+ * @param in the data to compress
+ * @param len the number of bytes to compress
+ * @param history the number of bytes before in, up to 32 KiB, to use as the dictionary of the first block
+ * @param out the buffer to append the compressed data to
+ * @param level the zlib compression level
+ * @param threads the most blocks to compress at once
+ * @param finish whether to end the deflate stream after this data
+ * @param crc if not null, updated with the crc32 of the input
+ *
+ * @return true if the data was compressed, false on a zlib error
+ */
+extern bool deflateblocks(const uchar *in, size_t len, size_t history, std::vector<uchar> &out, int level, int threads, bool finish, uint *crc = nullptr);
+
+/**
+ * @brief Opens a read only stream over a block of memory.
+ *
+ * The memory is not copied, and must outlive the returned stream.
+ *
+ * @param buf the memory to read
+ * @param len the number of bytes in buf
+ *
+ * @return a new stream, which the caller must delete
+ */
+extern stream *openmemstream(const uchar *buf, size_t len);
 extern int listfiles(const char *dir, const char *ext, std::vector<char *> &files);
 extern int listzipfiles(const char *dir, const char *ext, std::vector<char *> &files);
 extern bool findzipfile(const char *filename);
+
+/**
+ * @brief Adds a zip archive, making the files in it available to openfile().
+ *
+ * The archive is memory mapped if the `zipmmap` variable is set and the file
+ * can be mapped; otherwise it is read with positioned reads. Either way,
+ * streams of the archive's files may be read from several threads at once.
+ * Zip64 archives, and so archives over 4 GiB, are supported.
+ *
+ * @param name the path of the archive; ".zip" is appended if it has no extension
+ * @param mount the directory to mount the archive's files in, or nullptr to detect it
+ * @param strip a prefix to remove from the archive's file names, or nullptr to detect it
+ *
+ * @return true if the archive was added or had already been added
+ */
+extern bool addzip(const char *name, const char *mount = nullptr, const char *strip = nullptr);
+
+/**
+ * @brief Removes a zip archive added with addzip().
+ *
+ * Fails if any of the archive's files are still open.
+ *
+ * @param name the path of the archive, as passed to addzip()
+ *
+ * @return true if the archive was removed
+ */
+extern bool removezip(const char *name);
 extern const char *addpackagedir(const char *dir);
 extern const char *parentdir(const char *directory);
 extern bool fileexists(const char *path, const char *mode);
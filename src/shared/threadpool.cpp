@@ -0,0 +1,182 @@
+/**
+ * @file threadpool.cpp
+ * @brief persistent worker threads for splitting engine work across cores
+ *
+ * The engine is otherwise single threaded; the pool here is used by subsystems
+ * which can break a large, self-contained workload (such as building the
+ * geometry for independent parts of the octree) into independent jobs. The
+ * worker threads are created once and sleep between calls to parallelfor().
+ */
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <SDL.h>
+
+#include "../libprimis-headers/tools.h"
+#include "../libprimis-headers/command.h"
+#include "../libprimis-headers/consts.h"
+
+#include "threadpool.h"
+
+static VAR(workerthreads, 0, 0, 64); //number of threads for parallel jobs, 0 to use one per hardware core
+
+namespace
+{
+    //set on threads which are currently executing a job, so that nested jobs run serially
+    thread_local bool injob = false;
+
+    class ThreadPool final
+    {
+        public:
+            ~ThreadPool();
+
+            /**
+             * @brief Runs job for every index in [0,n), blocking until all are done.
+             *
+             * The calling thread takes jobs alongside the workers.
+             *
+             * @param threads the total number of threads to use, including the caller;
+             *        the pool is only resized when this changes between calls
+             * @param n the number of indices to run
+             * @param fn the job to run
+             */
+            void run(int threads, size_t n, const std::function<void(size_t)> &fn);
+
+        private:
+            std::vector<std::thread> workers;
+            std::mutex lock;
+            std::condition_variable wake,
+                                    done;
+            const std::function<void(size_t)> *job = nullptr;
+            size_t jobsize = 0;
+            std::atomic<size_t> next = 0;
+            size_t active = 0;     //workers which have not yet finished the current batch
+            uint generation = 0;   //incremented for each batch so sleeping workers can tell it is new
+            bool quit = false;
+
+            void resize(size_t count);
+            void work(uint seen);
+            void runjobs();
+    };
+
+    ThreadPool::~ThreadPool()
+    {
+        resize(0);
+    }
+
+    void ThreadPool::resize(size_t count)
+    {
+        if(count == workers.size())
+        {
+            return;
+        }
+        if(workers.size())
+        {
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                quit = true;
+            }
+            wake.notify_all();
+            for(std::thread &t : workers)
+            {
+                t.join();
+            }
+            workers.clear();
+            quit = false;
+        }
+        //new workers start from the current generation, so that a batch published
+        //after this returns is seen even if a thread has not started running yet
+        uint seen;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            seen = generation;
+        }
+        for(size_t i = 0; i < count; ++i)
+        {
+            workers.emplace_back(&ThreadPool::work, this, seen);
+        }
+    }
+
+    void ThreadPool::runjobs()
+    {
+        injob = true;
+        for(size_t i = next.fetch_add(1); i < jobsize; i = next.fetch_add(1))
+        {
+            (*job)(i);
+        }
+        injob = false;
+    }
+
+    void ThreadPool::work(uint seen)
+    {
+        for(;;)
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [&] { return quit || generation != seen; });
+            if(quit)
+            {
+                return;
+            }
+            seen = generation;
+            guard.unlock();
+            runjobs();
+            guard.lock();
+            if(!--active)
+            {
+                done.notify_one();
+            }
+        }
+    }
+
+    void ThreadPool::run(int threads, size_t n, const std::function<void(size_t)> &fn)
+    {
+        resize(threads-1);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            job = &fn;
+            jobsize = n;
+            next = 0;
+            active = workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        runjobs();
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&] { return !active; });
+        job = nullptr;
+        jobsize = 0;
+    }
+
+    ThreadPool pool;
+}
+
+int numworkers()
+{
+    if(workerthreads > 0)
+    {
+        return workerthreads;
+    }
+    return std::max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+}
+
+void parallelfor(size_t n, const std::function<void(size_t)> &job)
+{
+    int threads = numworkers();
+    if(injob || threads <= 1 || n <= 1)
+    {
+        for(size_t i = 0; i < n; ++i)
+        {
+            job(i);
+        }
+        return;
+    }
+    pool.run(threads, n, job);
+}
@@ -0,0 +1,32 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+/**
+ * @brief Returns the number of threads parallelfor() will spread work across.
+ *
+ * This count includes the calling (main) thread, so a value of 1 means that
+ * parallel jobs will run serially. Controlled by the `workerthreads` variable;
+ * a value of 0 for that variable uses one thread per hardware core.
+ *
+ * @return the number of threads available for jobs, at least 1
+ */
+extern int numworkers();
+
+/**
+ * @brief Runs a job for every index in [0, n) across the worker threads.
+ *
+ * Indices are handed out to the worker threads (and the calling thread, which
+ * also participates) in increasing order, but may complete in any order. The
+ * call returns once every index has finished. Jobs must not call OpenGL, as
+ * they may run on threads other than the one holding the GL context.
+ *
+ * Calls made from inside a running job, or calls made with only one thread
+ * available, run serially on the calling thread. parallelfor() should only be
+ * called from the main thread.
+ *
+ * @param n the number of indices to run
+ * @param job the function to call once for each index
+ */
+extern void parallelfor(size_t n, const std::function<void(size_t)> &job);
+
+#endif
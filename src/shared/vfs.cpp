@@ -0,0 +1,315 @@
+/**
+ * @file vfs.cpp
+ * @brief index of the files in package directories and zip archives
+ *
+ * findfile(), listfiles(), and the zip archive lookups consult this index
+ * instead of checking each package directory on disk, or each zip archive's
+ * file table, in turn. The index is only changed when a package directory or
+ * zip archive is added or removed.
+ */
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <string_view>
+#include <cctype>
+
+#include <SDL.h>
+
+#include "../libprimis-headers/tools.h"
+
+#include "vfs.h"
+
+vfsindex packageindex;
+
+namespace
+{
+    //returns the path with PATHDIV separators, no empty or "." parts, and ".." parts removed along
+    //with the directory before them, which is how the file system would have resolved it
+    std::string cleanpath(const char *name)
+    {
+        std::vector<std::string> parts;
+        for(const char *part = name; *part;)
+        {
+            const char *end = std::strpbrk(part, "/\\");
+            if(!end)
+            {
+                end = part + std::strlen(part);
+            }
+            std::string_view cur(part, end - part);
+            if(cur == "..")
+            {
+                if(parts.size() && parts.back() != "..")
+                {
+                    parts.pop_back();
+                }
+                else
+                {
+                    parts.emplace_back(cur); //outside of the source, so it will not be found
+                }
+            }
+            else if(cur.size() && cur != ".")
+            {
+                parts.emplace_back(cur);
+            }
+            part = *end ? end + 1 : end;
+        }
+        std::string cleaned;
+        for(const std::string &i : parts)
+        {
+            if(cleaned.size())
+            {
+                cleaned.push_back(PATHDIV);
+            }
+            cleaned.append(i);
+        }
+        return cleaned;
+    }
+
+    //returns the key a path is indexed by: names differing only in case are the same file on Windows
+    std::string pathkey(std::string name)
+    {
+#ifdef WIN32
+        for(char &c : name)
+        {
+            c = std::tolower(static_cast<uchar>(c));
+        }
+#endif
+        return name;
+    }
+}
+
+int vfsindex::addsource(int type, const char *root)
+{
+    types.push_back(type);
+    std::string dir = cleanpath(root);
+    rootdepths.push_back(dir.size() ? static_cast<size_t>(std::count(dir.begin(), dir.end(), PATHDIV)) + 1 : 0);
+    return types.size() - 1;
+}
+
+//removes the source from the directory (whose key is prefix) and its subdirectories, returning true if the directory is now empty
+bool vfsindex::removefromdir(dirnode &d, int source, const std::string &prefix)
+{
+    auto files = d.files.find(source);
+    if(files != d.files.end())
+    {
+        for(const std::string &name : (*files).second)
+        {
+            auto itr = paths.find(prefix + pathkey(name));
+            if(itr == paths.end())
+            {
+                continue;
+            }
+            std::vector<int> &sources = (*itr).second;
+            sources.erase(std::find(sources.begin(), sources.end(), source));
+            if(sources.empty())
+            {
+                paths.erase(itr);
+            }
+        }
+        d.files.erase(files);
+    }
+    auto itr = std::find(d.sources.begin(), d.sources.end(), source);
+    if(itr != d.sources.end())
+    {
+        d.sources.erase(itr);
+    }
+    for(auto i = d.subdirs.begin(); i != d.subdirs.end();)
+    {
+        if(removefromdir(*(*i).second, source, prefix + (*i).first + PATHDIV))
+        {
+            i = d.subdirs.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    //directories above a source's root may only hold the subdirectories leading to it
+    return d.sources.empty() && d.subdirs.empty();
+}
+
+void vfsindex::removesource(int source)
+{
+    if(source < 0 || source >= static_cast<int>(types.size()) || types[source] < 0)
+    {
+        return;
+    }
+    types[source] = -1;
+    removefromdir(root, source, "");
+}
+
+//returns the directory, creating it and its parents if needed, and adds the source
+//to those no shallower than its root; dir must be cleaned by cleanpath()
+vfsindex::dirnode &vfsindex::makedir(int source, const std::string &dir)
+{
+    dirnode *d = &root;
+    size_t depth = 0;
+    for(size_t start = 0;; depth++)
+    {
+        if(depth >= rootdepths[source] && std::find(d->sources.begin(), d->sources.end(), source) == d->sources.end())
+        {
+            d->sources.push_back(source);
+        }
+        if(start >= dir.size())
+        {
+            return *d;
+        }
+        size_t end = dir.find(PATHDIV, start);
+        if(end == std::string::npos)
+        {
+            end = dir.size();
+        }
+        std::string name = dir.substr(start, end - start);
+        std::unique_ptr<dirnode> &sub = d->subdirs[pathkey(name)];
+        if(!sub)
+        {
+            sub = std::make_unique<dirnode>();
+            sub->name = std::move(name);
+        }
+        d = sub.get();
+        start = end + 1;
+    }
+}
+
+void vfsindex::addfile(int source, const char *name)
+{
+    std::string cleaned = cleanpath(name);
+    std::vector<int> &sources = paths[pathkey(cleaned)];
+    if(std::find(sources.begin(), sources.end(), source) != sources.end())
+    {
+        return;
+    }
+    sources.push_back(source);
+    size_t base = cleaned.rfind(PATHDIV);
+    dirnode &d = makedir(source, base != std::string::npos ? cleaned.substr(0, base) : "");
+    d.files[source].push_back(base != std::string::npos ? cleaned.substr(base + 1) : cleaned);
+}
+
+void vfsindex::adddir(int source, const char *name)
+{
+    makedir(source, cleanpath(name));
+}
+
+//returns the sources of the type from the list, in the order they should be searched
+std::vector<int> vfsindex::searchorder(const std::vector<int> &sources, int type) const
+{
+    std::vector<int> order;
+    for(int i : sources)
+    {
+        if(types[i] == type)
+        {
+            order.push_back(i);
+        }
+    }
+    //sources are added with increasing ids, but zip archives added later take priority
+    std::sort(order.begin(), order.end());
+    if(type == Source_Zip)
+    {
+        std::reverse(order.begin(), order.end());
+    }
+    return order;
+}
+
+//returns the directory with the key, as returned by pathkey(cleanpath()), or nullptr if it is not indexed
+const vfsindex::dirnode *vfsindex::finddir(const std::string &dir) const
+{
+    const dirnode *d = &root;
+    for(size_t start = 0; start < dir.size();)
+    {
+        size_t end = dir.find(PATHDIV, start);
+        if(end == std::string::npos)
+        {
+            end = dir.size();
+        }
+        auto itr = d->subdirs.find(dir.substr(start, end - start));
+        if(itr == d->subdirs.end())
+        {
+            return nullptr;
+        }
+        d = (*itr).second.get();
+        start = end + 1;
+    }
+    return d;
+}
+
+int vfsindex::find(const char *name, int type) const
+{
+    std::string key = pathkey(cleanpath(name));
+    auto itr = paths.find(key);
+    if(itr != paths.end())
+    {
+        std::vector<int> order = searchorder((*itr).second, type);
+        if(order.size())
+        {
+            return order[0];
+        }
+    }
+    if(type == Source_Dir && key.size())
+    {
+        const dirnode *d = finddir(key);
+        if(d)
+        {
+            std::vector<int> order = searchorder(d->sources, type);
+            if(order.size())
+            {
+                return order[0];
+            }
+        }
+    }
+    return -1;
+}
+
+int vfsindex::list(const char *dir, const char *ext, int type, std::vector<char *> &files) const
+{
+    const dirnode *d = finddir(pathkey(cleanpath(dir)));
+    if(!d)
+    {
+        return 0;
+    }
+    size_t extsize = ext ? std::strlen(ext)+1 : 0;
+    std::vector<int> order = searchorder(d->sources, type);
+    for(int source : order)
+    {
+        auto itr = d->files.find(source);
+        if(itr != d->files.end())
+        {
+            for(const std::string &name : (*itr).second)
+            {
+                if(!ext)
+                {
+                    files.push_back(newstring(name.c_str()));
+                    continue;
+                }
+                size_t namelen = name.size();
+                if(namelen > extsize)
+                {
+                    namelen -= extsize;
+                    if(name[namelen] == '.' && !std::strcmp(name.c_str()+namelen+1, ext))
+                    {
+                        files.push_back(newstring(name.c_str(), namelen));
+                    }
+                }
+            }
+        }
+        if(type == Source_Dir && !ext)
+        {
+            for(const auto &[key, sub] : d->subdirs)
+            {
+                if(std::find(sub->sources.begin(), sub->sources.end(), source) != sub->sources.end())
+                {
+                    files.push_back(newstring(sub->name.c_str()));
+                }
+            }
+        }
+    }
+    return order.size();
+}
+
+size_t vfsindex::numpaths() const
+{
+    return paths.size();
+}
@@ -0,0 +1,137 @@
+#ifndef VFS_H_
+#define VFS_H_
+
+/**
+ * @brief Index of the files in package directories and zip archives.
+ *
+ * Each package directory or zip archive added to the index is a source, given
+ * an id when it is added. Paths are relative to the root of their source, and
+ * are stored once in a hash table (for lookups) and once in a tree of
+ * directories (for listings), so that neither needs to scan every source or ask
+ * the file system.
+ *
+ * Paths are matched the way the file system would open them: '/' and '\' both
+ * separate directories, "." and "dir/.." parts are resolved, and on Windows
+ * names differing only in case are the same. Listings use the names as they
+ * were added.
+ *
+ * Sources are searched in the same order as the engine searched them before
+ * the index: package directories in the order they were added, and zip
+ * archives from the most recently added to the least.
+ */
+class vfsindex final
+{
+    public:
+        enum SourceType
+        {
+            Source_Dir = 0,
+            Source_Zip
+        };
+
+        /**
+         * @brief Adds a new, empty source to the index.
+         *
+         * A source may be limited to a directory, as package directories are
+         * to their filter. The directories above it are then only kept in the
+         * index to reach it, and are not found or listed for the source.
+         *
+         * @param type the kind of source, a SourceType
+         * @param root the directory all of the source's paths are in, or
+         *        empty for the whole source
+         *
+         * @return the id of the new source
+         */
+        int addsource(int type, const char *root = "");
+
+        /**
+         * @brief Removes a source and all of its paths from the index.
+         *
+         * @param source the id of the source, as returned by addsource()
+         */
+        void removesource(int source);
+
+        /**
+         * @brief Adds a file to a source.
+         *
+         * The directories containing the file are added as well.
+         *
+         * @param source the id of the source containing the file
+         * @param name the path of the file, relative to the root of the source
+         */
+        void addfile(int source, const char *name);
+
+        /**
+         * @brief Adds a directory to a source.
+         *
+         * Only needed for directories with no files in them; the parents of
+         * any added file or directory are added as well.
+         *
+         * @param source the id of the source containing the directory
+         * @param name the path of the directory, relative to the root of the source
+         */
+        void adddir(int source, const char *name);
+
+        /**
+         * @brief Finds the source to read a file from.
+         *
+         * For sources of type Source_Dir, directories match as well as files.
+         *
+         * @param name the path to look for
+         * @param type the kind of source to look in
+         *
+         * @return the id of the first source of the type (in search order)
+         *         containing name, or -1 if none do
+         */
+        int find(const char *name, int type) const;
+
+        /**
+         * @brief Lists the contents of a directory.
+         *
+         * Lists each name once for every source containing it, as listing the
+         * directory in each source would. Subdirectories are only listed for
+         * sources of type Source_Dir, and only if ext is not set.
+         *
+         * @param dir the directory to list
+         * @param ext if set, only names ending in '.' followed by ext are
+         *        listed, with the extension removed
+         * @param type the kind of source to list
+         * @param files the vector to add new copies of the names to
+         *
+         * @return the number of sources containing the directory
+         */
+        int list(const char *dir, const char *ext, int type, std::vector<char *> &files) const;
+
+        /**
+         * @brief Returns the number of paths in the index.
+         */
+        size_t numpaths() const;
+
+    private:
+        struct dirnode final
+        {
+            std::string name;                                        //the name as first added, for listings
+            std::map<std::string, std::unique_ptr<dirnode>> subdirs; //by key, see pathkey() in vfs.cpp
+            std::map<int, std::vector<std::string>> files; //names of the files directly in this directory, by source
+            std::vector<int> sources;                      //sources containing this directory, in order added
+        };
+
+        std::unordered_map<std::string, std::vector<int>> paths; //sources containing each file, by key, in order added
+        std::vector<int> types;                                  //type of each source id, or -1 once removed
+        std::vector<size_t> rootdepths;                          //number of directories in each source's root
+        dirnode root;
+
+        const dirnode *finddir(const std::string &dir) const;
+        dirnode &makedir(int source, const std::string &dir);
+        bool removefromdir(dirnode &d, int source, const std::string &prefix);
+        std::vector<int> searchorder(const std::vector<int> &sources, int type) const;
+};
+
+/**
+ * @brief The index of the engine's package directories and zip archives.
+ *
+ * Modified by addpackagedir(), addzip(), and removezip(); may be read from
+ * any thread while none of those are being called.
+ */
+extern vfsindex packageindex;
+
+#endif
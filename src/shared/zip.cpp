@@ -4,8 +4,12 @@
 #include <string>
 #include <queue>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <array>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
 
 #include <SDL.h>
 
@@ -20,19 +24,37 @@
 #include "../libprimis-headers/consts.h"
 
 #include "stream.h"
+#include "vfs.h"
 
 #include "../engine/interface/console.h"
 
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 enum ZipFlags
 {
-    Zip_LocalFileSignature  = 0x04034B50,
-    Zip_LocalFileSize       = 30,
-    Zip_FileSignature       = 0x02014B50,
-    Zip_FileSize            = 46,
-    Zip_DirectorySignature  = 0x06054B50,
-    Zip_DirectorySize       = 22
+    Zip_LocalFileSignature   = 0x04034B50,
+    Zip_LocalFileSize        = 30,
+    Zip_FileSignature        = 0x02014B50,
+    Zip_FileSize             = 46,
+    Zip_DirectorySignature   = 0x06054B50,
+    Zip_DirectorySize        = 22,
+    Zip64_DirectorySignature = 0x06064B50,
+    Zip64_DirectorySize      = 56,
+    Zip64_LocatorSignature   = 0x07064B50,
+    Zip64_LocatorSize        = 20,
+    Zip64_ExtraField         = 0x0001
 };
 
+//fields of zip64 archives which do not fit in the 32 bit header fields are set to this
+constexpr uint zip64field = 0xFFFFFFFFU;
+
 struct ziplocalfileheader final
 {
     uint signature;
@@ -45,71 +67,205 @@ struct zipfileheader final
 {
     uint signature;
     ushort version, needversion, flags, compression, modtime, moddate;
-    uint crc32, compressedsize, uncompressedsize;
+    uint crc32;
+    stream::offset compressedsize, uncompressedsize; //widened from the 32 bit fields by any zip64 extra field
     ushort namelength, extralength, commentlength, disknumber, internalattribs;
-    uint externalattribs, offset;
+    uint externalattribs;
+    stream::offset offset;
 };
 
 struct zipdirectoryheader final
 {
     uint signature;
-    ushort disknumber, directorydisk, diskentries, entries;
-    uint size, offset;
+    ushort disknumber, directorydisk, diskentries;
+    stream::offset entries, size, offset; //taken from the zip64 directory record, if there is one
     ushort commentlength;
 };
 
 struct zipfile final
 {
-    const char *name;
-    uint header, offset, size, compressedsize;
-
-    zipfile() : name(nullptr), header(0), offset(~0U), size(0), compressedsize(0)
-    {
-    }
-    ~zipfile()
-    {
-        delete[] name;
-    }
+    std::string name;
+    stream::offset offset,         //position of the file's data in the archive
+                   size,
+                   compressedsize; //0 if the file is stored without compression
 };
 
-class zipstream;
-
-struct ziparchive final
+/**
+ * The contents of a zip archive file. The file is memory mapped if possible,
+ * and otherwise read with positioned reads; either way there is no shared file
+ * position, so any number of threads may read from it at once.
+ */
+class zipdata final
 {
-    const char *name;
-    FILE *data;
-    std::map<std::string, zipfile> files;
-    int openfiles;
-    zipstream *owner;
+    public:
+        zipdata() : view(nullptr), len(0),
+#ifdef WIN32
+            file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#else
+            fd(-1)
+#endif
+        {
+        }
 
-    ziparchive() : name(nullptr), data(nullptr), files(), openfiles(0), owner(nullptr)
-    {
-    }
-    ~ziparchive()
-    {
-        delete[] name;
-        if(data)
+        ~zipdata()
         {
-            std::fclose(data);
-            data = nullptr;
+#ifdef WIN32
+            if(view)
+            {
+                UnmapViewOfFile(view);
+            }
+            if(mapping)
+            {
+                CloseHandle(mapping);
+            }
+            if(file != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(file);
+            }
+#else
+            if(view)
+            {
+                munmap(const_cast<uchar *>(view), len);
+            }
+            if(fd >= 0)
+            {
+                ::close(fd);
+            }
+#endif
         }
-    }
+
+        zipdata(const zipdata &) = delete;
+        zipdata &operator=(const zipdata &) = delete;
+
+        bool open(const char *filename, bool map)
+        {
+#ifdef WIN32
+            file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            LARGE_INTEGER filesize;
+            if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &filesize))
+            {
+                return false;
+            }
+            len = filesize.QuadPart;
+            if(map && len > 0)
+            {
+                mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if(mapping)
+                {
+                    view = static_cast<const uchar *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                }
+            }
+#else
+            fd = ::open(filename, O_RDONLY);
+            struct stat info;
+            if(fd < 0 || fstat(fd, &info) < 0)
+            {
+                return false;
+            }
+            len = info.st_size;
+            if(map && len > 0)
+            {
+                void *p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(p != MAP_FAILED)
+                {
+                    view = static_cast<const uchar *>(p);
+                }
+            }
+#endif
+            return true;
+        }
+
+        //the whole archive, or nullptr if it could not be mapped
+        const uchar *data() const
+        {
+            return view;
+        }
+
+        stream::offset size() const
+        {
+            return len;
+        }
+
+        //copies up to n bytes at pos into buf, returning the number of bytes copied
+        size_t read(stream::offset pos, void *buf, size_t n) const
+        {
+            if(pos < 0 || pos >= len)
+            {
+                return 0;
+            }
+            n = static_cast<size_t>(std::min<stream::offset>(n, len - pos));
+            if(view)
+            {
+                std::memcpy(buf, view + pos, n);
+                return n;
+            }
+            size_t total = 0;
+            while(total < n)
+            {
+#ifdef WIN32
+                OVERLAPPED o = {};
+                o.Offset = static_cast<DWORD>((pos + total)&0xFFFFFFFF);
+                o.OffsetHigh = static_cast<DWORD>((pos + total)>>32);
+                DWORD got = 0;
+                if(!ReadFile(file, static_cast<uchar *>(buf) + total, static_cast<DWORD>(std::min<size_t>(n - total, 1<<30)), &got, &o) || !got)
+                {
+                    break;
+                }
+#else
+                ssize_t got = pread(fd, static_cast<uchar *>(buf) + total, n - total, pos + total);
+                if(got <= 0)
+                {
+                    if(got < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+#endif
+                total += got;
+            }
+            return total;
+        }
+
+    private:
+        const uchar *view;
+        stream::offset len;
+#ifdef WIN32
+        HANDLE file, mapping;
+#else
+        int fd;
+#endif
 };
 
-static bool findzipdirectory(FILE *f, zipdirectoryheader &hdr)
+struct ziparchive final
 {
-    if(fseek(f, 0, SEEK_END) < 0)
-    {
-        return false;
-    }
-    long offset = ftell(f);
-    if(offset < 0)
+    std::string name;
+    zipdata data;
+    std::unordered_map<std::string, zipfile> files;
+    std::atomic<int> openfiles; //streams may be closed on any thread
+    int source;                 //id of the archive in packageindex
+
+    ziparchive() : openfiles(0), source(-1)
     {
-        return false;
     }
+};
+
+//reads a field of a zip header, which are little endian, and moves src past it
+template<class T>
+static T getzipfield(const uchar *&src)
+{
+    T val;
+    std::memcpy(&val, src, sizeof(T));
+    src += sizeof(T);
+    return val;
+}
+
+static bool findzipdirectory(const zipdata &f, zipdirectoryheader &hdr)
+{
+    stream::offset offset = f.size();
     std::array<uchar, 1024> buf;
-    uchar *src = nullptr;
-    long end = std::max<long>(offset - 0xFFFFL - Zip_DirectorySize, 0L);
+    const uchar *src = nullptr;
+    stream::offset end = std::max<stream::offset>(offset - 0xFFFF - Zip_DirectorySize, 0);
     size_t len = 0;
     const uint signature = static_cast<uint>(Zip_DirectorySignature);
     while(offset > end)
@@ -117,15 +273,17 @@ static bool findzipdirectory(FILE *f, zipdirectoryheader &hdr)
         size_t carry = std::min<size_t>(len, static_cast<size_t>(Zip_DirectorySize-1)), next = std::min<size_t>(sizeof(buf) - carry, static_cast<size_t>(offset - end));
         offset -= next;
         std::memmove(&buf[next], buf.data(), carry);
-        if(next + carry < Zip_DirectorySize || fseek(f, offset, SEEK_SET) < 0 || std::fread(buf.data(), 1, next, f) != next)
+        if(next + carry < Zip_DirectorySize || f.read(offset, buf.data(), next) != next)
         {
             return false;
         }
         len = next + carry;
-        uchar *search = &buf[next-1];
+        //signatures starting in the carried bytes were checked by the last pass; the last 3 bytes cannot start one
+        const uchar *search = &buf[std::min(next, len - 3) - 1];
         for(; search >= buf.data(); search--)
         {
-            if(*reinterpret_cast<uint *>(search) == signature)
+            const uchar *field = search;
+            if(getzipfield<uint>(field) == signature)
             {
                 break;
             }
@@ -140,127 +298,199 @@ static bool findzipdirectory(FILE *f, zipdirectoryheader &hdr)
     {
         return false;
     }
-    hdr.signature = *reinterpret_cast<uint *>(src); src += 4; //src is incremented by the size of the field (int is 4 bytes)
-    hdr.disknumber = *reinterpret_cast<ushort *>(src); src += 2;
-    hdr.directorydisk = *reinterpret_cast<ushort *>(src); src += 2;
-    hdr.diskentries = *reinterpret_cast<ushort *>(src); src += 2;
-    hdr.entries = *reinterpret_cast<ushort *>(src); src += 2;
-    hdr.size = *reinterpret_cast<uint *>(src); src += 4;
-    hdr.offset = *reinterpret_cast<uint *>(src); src += 4;
-    hdr.commentlength = *reinterpret_cast<ushort *>(src); src += 2;
+    stream::offset directorypos = offset + (src - buf.data());
+    hdr.signature     = getzipfield<uint>(src);
+    hdr.disknumber    = getzipfield<ushort>(src);
+    hdr.directorydisk = getzipfield<ushort>(src);
+    hdr.diskentries   = getzipfield<ushort>(src);
+    hdr.entries       = getzipfield<ushort>(src);
+    hdr.size          = getzipfield<uint>(src);
+    hdr.offset        = getzipfield<uint>(src);
+    hdr.commentlength = getzipfield<ushort>(src);
     if(hdr.signature != Zip_DirectorySignature || hdr.disknumber != hdr.directorydisk || hdr.diskentries != hdr.entries)
     {
         return false;
     }
-    return true;
+    //zip64 archives have a locator just before the directory header, pointing to a record with the full size fields
+    std::array<uchar, Zip64_DirectorySize> buf64;
+    const uchar *src64 = buf64.data();
+    if(directorypos < Zip64_LocatorSize || f.read(directorypos - Zip64_LocatorSize, buf64.data(), Zip64_LocatorSize) != Zip64_LocatorSize ||
+       getzipfield<uint>(src64) != Zip64_LocatorSignature)
+    {
+        return true;
+    }
+    src64 += 4; //disk with the zip64 directory record
+    stream::offset recordpos = getzipfield<ullong>(src64);
+    src64 = buf64.data();
+    if(f.read(recordpos, buf64.data(), Zip64_DirectorySize) != Zip64_DirectorySize || getzipfield<uint>(src64) != Zip64_DirectorySignature)
+    {
+        return false;
+    }
+    src64 += 8 + 2 + 2; //record size, versions
+    uint disknumber = getzipfield<uint>(src64),
+         directorydisk = getzipfield<uint>(src64);
+    ullong diskentries = getzipfield<ullong>(src64);
+    hdr.entries = getzipfield<ullong>(src64);
+    hdr.size    = getzipfield<ullong>(src64);
+    hdr.offset  = getzipfield<ullong>(src64);
+    return disknumber == directorydisk && diskentries == static_cast<ullong>(hdr.entries);
 }
 
 static VAR(debugzip, 0, 0, 1); /// toggles printing to console information about zip file actions
+static VAR(zipmmap, 0, 1, 1);  /// memory maps zip archives when they are added, rather than reading them with positioned reads
 
-static bool readzipdirectory(const char *archname, FILE *f, int entries, int offset, uint size, std::vector<zipfile> &files)
+//replaces the 32 bit fields of hdr which are set to zip64field with the values in its zip64 extra field
+static bool readzip64extra(zipfileheader &hdr, const uchar *extra, const uchar *end)
 {
-    uchar *buf = new uchar[size],
-          *src = buf;
-    if(!buf || fseek(f, offset, SEEK_SET) < 0 || std::fread(buf, 1, size, f) != size)
+    while(extra + 4 <= end)
+    {
+        ushort id  = getzipfield<ushort>(extra),
+               len = getzipfield<ushort>(extra);
+        if(extra + len > end)
+        {
+            return false;
+        }
+        if(id != Zip64_ExtraField)
+        {
+            extra += len;
+            continue;
+        }
+        const uchar *fieldend = extra + len;
+        for(stream::offset *field : {&hdr.uncompressedsize, &hdr.compressedsize, &hdr.offset})
+        {
+            if(*field != zip64field)
+            {
+                continue;
+            }
+            if(extra + 8 > fieldend)
+            {
+                return false;
+            }
+            *field = getzipfield<ullong>(extra);
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool readlocalfileheader(const zipdata &f, ziplocalfileheader &h, stream::offset offset)
+{
+    std::array<uchar, Zip_LocalFileSize> buf;
+    if(f.read(offset, buf.data(), Zip_LocalFileSize) != Zip_LocalFileSize)
     {
-        delete[] buf;
         return false;
     }
-    for(int i = 0; i < entries; ++i)
+    const uchar *src = buf.data();
+    h.signature        = getzipfield<uint>(src);
+    h.version          = getzipfield<ushort>(src);
+    h.flags            = getzipfield<ushort>(src);
+    h.compression      = getzipfield<ushort>(src);
+    h.modtime          = getzipfield<ushort>(src);
+    h.moddate          = getzipfield<ushort>(src);
+    h.crc32            = getzipfield<uint>(src);
+    h.compressedsize   = getzipfield<uint>(src);
+    h.uncompressedsize = getzipfield<uint>(src);
+    h.namelength       = getzipfield<ushort>(src);
+    h.extralength      = getzipfield<ushort>(src);
+    if(h.signature != Zip_LocalFileSignature)
+    {
+        return false;
+    }
+    // h.uncompressedsize or h.compressedsize may be zero - so don't validate
+    return true;
+}
+
+static bool readzipdirectory(const char *archname, const zipdata &f, const zipdirectoryheader &dir, std::vector<zipfile> &files)
+{
+    if(dir.offset < 0 || dir.size < 0 || dir.offset + dir.size > f.size())
+    {
+        return false;
+    }
+    //read the directory straight from the mapping if there is one
+    std::vector<uchar> copy;
+    const uchar *buf = f.data() ? f.data() + dir.offset : nullptr;
+    if(!buf)
+    {
+        copy.resize(dir.size);
+        if(f.read(dir.offset, copy.data(), copy.size()) != copy.size())
+        {
+            return false;
+        }
+        buf = copy.data();
+    }
+    const uchar *src = buf,
+                *end = buf + dir.size;
+    for(stream::offset i = 0; i < dir.entries; ++i)
     {
-        if(src + Zip_FileSize > &buf[size])
+        if(src + Zip_FileSize > end)
         {
             break;
         }
         zipfileheader hdr;
-        hdr.signature   = *reinterpret_cast<uint *>(src); src += 4; //src is incremented by the size of the field (int is 4 bytes)
-        hdr.version     = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.needversion = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.flags       = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.compression = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.modtime     = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.moddate     = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.crc32            = *reinterpret_cast<uint *>(src); src += 4;
-        hdr.compressedsize   = *reinterpret_cast<uint *>(src); src += 4;
-        hdr.uncompressedsize = *reinterpret_cast<uint *>(src); src += 4;
-        hdr.namelength       = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.extralength      = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.commentlength    = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.disknumber       = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.internalattribs  = *reinterpret_cast<ushort *>(src); src += 2;
-        hdr.externalattribs  = *reinterpret_cast<uint *>(src); src += 4;
-        hdr.offset           = *reinterpret_cast<uint *>(src); src += 4;
-        if(hdr.signature != Zip_FileSignature)
+        hdr.signature        = getzipfield<uint>(src);
+        hdr.version          = getzipfield<ushort>(src);
+        hdr.needversion      = getzipfield<ushort>(src);
+        hdr.flags            = getzipfield<ushort>(src);
+        hdr.compression      = getzipfield<ushort>(src);
+        hdr.modtime          = getzipfield<ushort>(src);
+        hdr.moddate          = getzipfield<ushort>(src);
+        hdr.crc32            = getzipfield<uint>(src);
+        hdr.compressedsize   = getzipfield<uint>(src);
+        hdr.uncompressedsize = getzipfield<uint>(src);
+        hdr.namelength       = getzipfield<ushort>(src);
+        hdr.extralength      = getzipfield<ushort>(src);
+        hdr.commentlength    = getzipfield<ushort>(src);
+        hdr.disknumber       = getzipfield<ushort>(src);
+        hdr.internalattribs  = getzipfield<ushort>(src);
+        hdr.externalattribs  = getzipfield<uint>(src);
+        hdr.offset           = getzipfield<uint>(src);
+        if(hdr.signature != Zip_FileSignature || src + hdr.namelength + hdr.extralength > end)
         {
             break;
         }
+        const uchar *name = src;
+        src += hdr.namelength + hdr.extralength + hdr.commentlength;
+        if((hdr.uncompressedsize == zip64field || hdr.compressedsize == zip64field || hdr.offset == zip64field) &&
+           !readzip64extra(hdr, name + hdr.namelength, name + hdr.namelength + hdr.extralength))
+        {
+            continue;
+        }
         if(!hdr.namelength || !hdr.uncompressedsize || (hdr.compression && (hdr.compression != Z_DEFLATED || !hdr.compressedsize)))
         {
-            src += hdr.namelength + hdr.extralength + hdr.commentlength;
             continue;
         }
-        if(src + hdr.namelength > &buf[size])
+        //find where the file's data starts now, so that streams never have to update the directory
+        ziplocalfileheader local;
+        if(!readlocalfileheader(f, local, hdr.offset))
         {
-            break;
+            continue;
+        }
+        stream::offset offset = hdr.offset + Zip_LocalFileSize + local.namelength + local.extralength;
+        if(offset + (hdr.compression ? hdr.compressedsize : hdr.uncompressedsize) > f.size())
+        {
+            continue;
         }
         string pname;
         int namelen = std::min<int>(static_cast<int>(hdr.namelength), static_cast<int>(sizeof(pname)-1));
-        std::memcpy(pname, src, namelen);
+        std::memcpy(pname, name, namelen);
         pname[namelen] = '\0';
         path(pname);
-        char *name = newstring(pname);
-        {
-            zipfile zf;
-            zf.name = name;
-            zf.header = hdr.offset;
-            zf.size = hdr.uncompressedsize;
-            files.push_back(zf);
-            zf.compressedsize = hdr.compression ? hdr.compressedsize : 0;
-        }
+        files.push_back({pname, offset, hdr.uncompressedsize, hdr.compression ? hdr.compressedsize : 0});
         if(debugzip)
         {
-            conoutf(Console_Debug, "%s: file %s, size %d, compress %d, flags %x", archname, name, hdr.uncompressedsize, hdr.compression, hdr.flags);
+            conoutf(Console_Debug, "%s: file %s, size %lld, compress %d, flags %x", archname, pname, static_cast<long long>(hdr.uncompressedsize), hdr.compression, hdr.flags);
         }
-        src += hdr.namelength + hdr.extralength + hdr.commentlength;
     }
-    delete[] buf;
     return files.size() > 0;
 }
 
-static bool readlocalfileheader(FILE *f, ziplocalfileheader &h, uint offset)
-{
-    std::array<uchar, Zip_LocalFileSize> buf;
-    if(fseek(f, offset, SEEK_SET) < 0 || std::fread(buf.data(), 1, Zip_LocalFileSize, f) != Zip_LocalFileSize)
-    {
-        return false;
-    }
-    uchar *src = buf.data();
-    h.signature = *reinterpret_cast<uint *>(src); src += 4; //src is incremented by the size of the field (int is 4 bytes e.g)
-    h.version = *reinterpret_cast<ushort *>(src); src += 2;
-    h.flags = *reinterpret_cast<ushort *>(src); src += 2;
-    h.compression = *reinterpret_cast<ushort *>(src); src += 2;
-    h.modtime = *reinterpret_cast<ushort *>(src); src += 2;
-    h.moddate = *reinterpret_cast<ushort *>(src); src += 2;
-    h.crc32 = *reinterpret_cast<uint *>(src); src += 4;
-    h.compressedsize = *reinterpret_cast<uint *>(src); src += 4;
-    h.uncompressedsize = *reinterpret_cast<uint *>(src); src += 4;
-    h.namelength = *reinterpret_cast<ushort *>(src); src += 2;
-    h.extralength = *reinterpret_cast<ushort *>(src); src += 2;
-    if(h.signature != Zip_LocalFileSignature)
-    {
-        return false;
-    }
-    // h.uncompressedsize or h.compressedsize may be zero - so don't validate
-    return true;
-}
-
 static std::vector<ziparchive *> archives;
 
 ziparchive *findzip(const char *name)
 {
     for(size_t i = 0; i < archives.size(); i++)
     {
-        if(!std::strcmp(name, archives[i]->name))
+        if(archives[i]->name == name)
         {
             return archives[i];
         }
@@ -268,11 +498,11 @@ ziparchive *findzip(const char *name)
     return nullptr;
 }
 
-static bool checkprefix(std::vector<zipfile> &files, const char *prefix, int prefixlen)
+static bool checkprefix(const std::vector<zipfile> &files, const char *prefix, int prefixlen)
 {
     for(const zipfile &z : files)
     {
-        if(!std::strncmp(z.name, prefix, prefixlen))
+        if(!std::strncmp(z.name.c_str(), prefix, prefixlen))
         {
             return false;
         }
@@ -280,39 +510,40 @@ static bool checkprefix(std::vector<zipfile> &files, const char *prefix, int pre
     return true;
 }
 
-static void mountzip(ziparchive &arch, std::vector<zipfile> &files, const char *mountdir, const char *stripdir)
+static void mountzip(ziparchive &arch, const std::vector<zipfile> &files, const char *mountdir, const char *stripdir)
 {
     string packagesdir = "media/";
     path(packagesdir);
     size_t striplen = stripdir ? std::strlen(stripdir) : 0;
     if(!mountdir && !stripdir)
     {
-        for(zipfile &f : files)
+        for(const zipfile &f : files)
         {
-            const char *foundpackages = std::strstr(f.name, packagesdir);
+            const char *name = f.name.c_str(),
+                       *foundpackages = std::strstr(name, packagesdir);
             if(foundpackages)
             {
-                if(foundpackages > f.name)
+                if(foundpackages > name)
                 {
-                    stripdir = f.name;
-                    striplen = foundpackages - f.name;
+                    stripdir = name;
+                    striplen = foundpackages - name;
                 }
                 break;
             }
-            const char *foundogz = std::strstr(f.name, ".ogz");
+            const char *foundogz = std::strstr(name, ".ogz");
             if(foundogz)
             {
                 const char *ogzdir = foundogz;
-                while(--ogzdir >= f.name && *ogzdir != PATHDIV)
+                while(--ogzdir >= name && *ogzdir != PATHDIV)
                 {
                     //(empty body)
                 }
-                if(ogzdir < f.name || checkprefix(files, f.name, ogzdir + 1 - f.name))
+                if(ogzdir < name || checkprefix(files, name, ogzdir + 1 - name))
                 {
-                    if(ogzdir >= f.name)
+                    if(ogzdir >= name)
                     {
-                        stripdir = f.name;
-                        striplen = ogzdir + 1 - f.name;
+                        stripdir = name;
+                        striplen = ogzdir + 1 - name;
                     }
                     if(!mountdir)
                     {
@@ -332,21 +563,19 @@ static void mountzip(ziparchive &arch, std::vector<zipfile> &files, const char *
             mdir[0] = '\0';
         }
     }
-    for(zipfile &f : files)
+    for(const zipfile &f : files)
     {
-        formatstring(fname, "%s%s", mdir, striplen && !std::strncmp(f.name, stripdir, striplen) ? &f.name[striplen] : f.name);
-        if(arch.files.find(fname) != arch.files.end())
+        const char *name = f.name.c_str();
+        formatstring(fname, "%s%s", mdir, striplen && !std::strncmp(name, stripdir, striplen) ? &name[striplen] : name);
+        auto [itr, added] = arch.files.try_emplace(fname, f);
+        if(added)
         {
-            continue;
+            itr->second.name = fname;
         }
-        char *mname = newstring(fname);
-        zipfile &mf = arch.files[mname];
-        mf = f;
-        mf.name = mname;
     }
 }
 
-bool addzip(const char *name, const char *mount = nullptr, const char *strip = nullptr)
+bool addzip(const char *name, const char *mount, const char *strip)
 {
     string pname;
     copystring(pname, name);
@@ -362,31 +591,34 @@ bool addzip(const char *name, const char *mount = nullptr, const char *strip = n
         conoutf(Console_Error, "already added zip %s", pname);
         return true;
     }
-
-    FILE *f = fopen(findfile(pname, "rb"), "rb");
-    if(!f)
+    ziparchive *arch = new ziparchive;
+    if(!arch->data.open(findfile(pname, "rb"), zipmmap != 0))
     {
         conoutf(Console_Error, "could not open file %s", pname);
+        delete arch;
         return false;
     }
     zipdirectoryheader h;
     std::vector<zipfile> files;
-    if(!findzipdirectory(f, h) || !readzipdirectory(pname, f, h.entries, h.offset, h.size, files))
+    if(!findzipdirectory(arch->data, h) || !readzipdirectory(pname, arch->data, h, files))
     {
         conoutf(Console_Error, "could not read directory in zip %s", pname);
-        std::fclose(f);
+        delete arch;
         return false;
     }
-    ziparchive *arch = new ziparchive;
-    arch->name = newstring(pname);
-    arch->data = f;
+    arch->name = pname;
     mountzip(*arch, files, mount, strip);
+    arch->source = packageindex.addsource(vfsindex::Source_Zip);
+    for(const auto &[name, f] : arch->files)
+    {
+        packageindex.addfile(arch->source, name.c_str());
+    }
     archives.push_back(arch);
     conoutf("added zip %s", pname);
     return true;
 }
 
-static bool removezip(const char *name)
+bool removezip(const char *name)
 {
     string pname;
     copystring(pname, name);
@@ -407,12 +639,19 @@ static bool removezip(const char *name)
         conoutf(Console_Error, "zip %s has open files", pname);
         return false;
     }
-    conoutf("removed zip %s", exists->name);
+    conoutf("removed zip %s", exists->name.c_str());
+    packageindex.removesource(exists->source);
     archives.erase(std::find(archives.begin(), archives.end(), exists));
     delete exists;
     return true;
 }
 
+/**
+ * A file in a zip archive. Each stream keeps its own position in the archive,
+ * so streams of the same archive may be read from different threads at once.
+ * If the archive is memory mapped, stored files are copied straight from the
+ * mapping and compressed files are inflated from it, without buffering.
+ */
 class zipstream final : public stream
 {
     public:
@@ -421,7 +660,7 @@ class zipstream final : public stream
             Buffer_Size  = 16384
         };
 
-        zipstream() : arch(nullptr), info(nullptr), buf(nullptr), reading(~0U), ended(false)
+        zipstream() : arch(nullptr), info(nullptr), buf(nullptr), reading(-1), inflated(0), ended(false)
         {
             zfile.zalloc = nullptr;
             zfile.zfree = nullptr;
@@ -435,43 +674,30 @@ class zipstream final : public stream
             close();
         }
 
-        void readbuf(uint size = Buffer_Size)
+        //gives inflate() the next part of the compressed data, once it has used all of the last part
+        void readbuf()
         {
-            if(!zfile.avail_in)
+            offset remaining = info->offset + info->compressedsize - reading;
+            if(remaining <= 0)
             {
-                zfile.next_in = static_cast<Bytef *>(buf);
+                return;
             }
-            size = std::min<uint>(size, static_cast<uint>(&buf[Buffer_Size] - &zfile.next_in[zfile.avail_in]));
-            if(arch->owner != this)
+            const uchar *view = arch->data.data();
+            if(view)
             {
-                arch->owner = nullptr;
-                if(fseek(arch->data, reading, SEEK_SET) >= 0)
-                {
-                    arch->owner = this;
-                }
-                else
-                {
-                    return;
-                }
+                zfile.next_in = const_cast<Bytef *>(view + reading);
+                zfile.avail_in = static_cast<uInt>(std::min<offset>(remaining, 1<<30));
             }
-            uint remaining = info->offset + info->compressedsize - reading,
-                 n = arch->owner == this ? std::fread(zfile.next_in + zfile.avail_in, 1, std::min<uint>(size, remaining), arch->data) : 0U;
-            zfile.avail_in += n;
-            reading += n;
+            else
+            {
+                zfile.next_in = buf;
+                zfile.avail_in = arch->data.read(reading, buf, static_cast<size_t>(std::min<offset>(remaining, Buffer_Size)));
+            }
+            reading += zfile.avail_in;
         }
 
-        bool open(ziparchive *a, zipfile *f)
+        bool open(ziparchive *a, const zipfile *f)
         {
-            if(f->offset == ~0U)
-            {
-                ziplocalfileheader h;
-                a->owner = nullptr;
-                if(!readlocalfileheader(a->data, h, f->header))
-                {
-                    return false;
-                }
-                f->offset = f->header + Zip_LocalFileSize + h.namelength + h.extralength;
-            }
             if(f->compressedsize && inflateInit2(&zfile, -MAX_WBITS) != Z_OK)
             {
                 return false;
@@ -480,8 +706,9 @@ class zipstream final : public stream
             arch = a;
             info = f;
             reading = f->offset;
+            inflated = 0;
             ended = false;
-            if(f->compressedsize)
+            if(f->compressedsize && !a->data.data())
             {
                 buf = new uchar[Buffer_Size];
             }
@@ -490,19 +717,19 @@ class zipstream final : public stream
 
         void stopreading()
         {
-            if(reading == ~0U)
+            if(reading < 0)
             {
                 return;
             }
             if(debugzip)
             {
-                conoutf(Console_Debug, info->compressedsize ? "%s: zfile.total_out %u, info->size %u" : "%s: reading %u, info->size %u", info->name, info->compressedsize ? static_cast<uint>(zfile.total_out) : reading - info->offset, info->size);
+                conoutf(Console_Debug, "%s: read %lld, info->size %lld", info->name.c_str(), static_cast<long long>(tell()), static_cast<long long>(info->size));
             }
             if(info->compressedsize)
             {
                 inflateEnd(&zfile);
             }
-            reading = ~0U;
+            reading = -1;
         }
 
         void close() final
@@ -512,7 +739,6 @@ class zipstream final : public stream
             buf = nullptr;
             if(arch)
             {
-                arch->owner = nullptr;
                 arch->openfiles--;
                 arch = nullptr;
             }
@@ -525,55 +751,20 @@ class zipstream final : public stream
 
         bool end() final
         {
-            return reading == ~0U || ended;
+            return reading < 0 || ended;
         }
 
         offset tell() const final
         {
-            return reading != ~0U ? (info->compressedsize ? zfile.total_out : reading - info->offset) : offset(-1);
+            return reading >= 0 ? (info->compressedsize ? inflated : reading - info->offset) : offset(-1);
         }
 
         bool seek(offset pos, int whence) final
         {
-            if(reading == ~0U)
+            if(reading < 0)
             {
                 return false;
             }
-            if(!info->compressedsize)
-            {
-                switch(whence)
-                {
-                    case SEEK_END:
-                    {
-                        pos += info->offset + info->size;
-                        break;
-                    }
-                    case SEEK_CUR:
-                    {
-                        pos += reading;
-                        break;
-                    }
-                    case SEEK_SET:
-                    {
-                        pos += info->offset;
-                        break;
-                    }
-                    default:
-                    {
-                        return false;
-                    }
-                }
-                pos = std::clamp(pos, static_cast<offset>(info->offset), static_cast<offset>(info->offset + info->size));
-                arch->owner = nullptr;
-                if(fseek(arch->data, static_cast<int>(pos), SEEK_SET) < 0)
-                {
-                    return false;
-                }
-                arch->owner = this;
-                reading = pos;
-                ended = false;
-                return true;
-            }
             switch(whence)
             {
                 case SEEK_END:
@@ -583,7 +774,7 @@ class zipstream final : public stream
                 }
                 case SEEK_CUR:
                 {
-                    pos += zfile.total_out;
+                    pos += tell();
                     break;
                 }
                 case SEEK_SET:
@@ -595,14 +786,17 @@ class zipstream final : public stream
                     return false;
                 }
             }
-            if(pos >= static_cast<offset>(info->size))
+            if(!info->compressedsize)
+            {
+                reading = info->offset + std::clamp(pos, offset(0), info->size);
+                ended = false;
+                return true;
+            }
+            if(pos >= info->size)
             {
                 reading = info->offset + info->compressedsize;
-                zfile.next_in += zfile.avail_in;
                 zfile.avail_in = 0;
-                zfile.total_in = info->compressedsize;
-                zfile.total_out = info->size;
-                arch->owner = nullptr;
+                inflated = info->size;
                 ended = false;
                 return true;
             }
@@ -610,25 +804,17 @@ class zipstream final : public stream
             {
                 return false;
             }
-            if(pos >= static_cast<offset>(zfile.total_out))
+            if(pos >= inflated)
             {
-                pos -= zfile.total_out;
+                pos -= inflated;
             }
             else
             {
-                if(zfile.next_in && zfile.total_in <= static_cast<uint>(zfile.next_in - buf))
-                {
-                    zfile.avail_in += zfile.total_in;
-                    zfile.next_in -= zfile.total_in;
-                }
-                else
-                {
-                    arch->owner = nullptr;
-                    zfile.avail_in = 0;
-                    zfile.next_in = nullptr;
-                    reading = info->offset;
-                }
+                //restart from the beginning of the compressed data
                 inflateReset(&zfile);
+                zfile.avail_in = 0;
+                reading = info->offset;
+                inflated = 0;
             }
             uchar skip[512];
             while(pos > 0)
@@ -647,23 +833,13 @@ class zipstream final : public stream
 
         size_t read(void *inbuf, size_t len) final
         {
-            if(reading == ~0U || !inbuf || !len)
+            if(reading < 0 || !inbuf || !len)
             {
                 return 0;
             }
             if(!info->compressedsize)
             {
-                if(arch->owner != this)
-                {
-                    arch->owner = nullptr;
-                    if(fseek(arch->data, reading, SEEK_SET) < 0)
-                    {
-                        stopreading();
-                        return 0;
-                    }
-                    arch->owner = this;
-                }
-                size_t n = std::fread(inbuf, 1, std::min<size_t>(len, static_cast<size_t>(info->size + info->offset - reading)), arch->data);
+                size_t n = arch->data.read(reading, inbuf, static_cast<size_t>(std::min<offset>(len, info->offset + info->size - reading)));
                 reading += n;
                 if(n < len)
                 {
@@ -671,13 +847,19 @@ class zipstream final : public stream
                 }
                 return n;
             }
+            if(inflated >= info->size)
+            {
+                ended = true;
+                return 0;
+            }
             zfile.next_out = static_cast<Bytef *>(inbuf);
-            zfile.avail_out = len;
+            zfile.avail_out = static_cast<uInt>(std::min<size_t>(len, 1<<30));
+            uInt wanted = zfile.avail_out;
             while(zfile.avail_out > 0)
             {
                 if(!zfile.avail_in)
                 {
-                    readbuf(Buffer_Size);
+                    readbuf();
                 }
                 int err = inflate(&zfile, Z_NO_FLUSH);
                 if(err != Z_OK)
@@ -697,18 +879,39 @@ class zipstream final : public stream
                     break;
                 }
             }
-            return len - zfile.avail_out;
+            size_t n = wanted - zfile.avail_out;
+            inflated += n;
+            return n;
         }
 
     private:
         ziparchive *arch;
         const zipfile *info;
         z_stream zfile;
-        uchar *buf;
-        uint reading;
+        uchar *buf;       //compressed data read from the archive, if it is not memory mapped
+        offset reading,   //position in the archive of the next data to read, or -1 once closed
+               inflated;  //bytes of the file inflated so far
         bool ended;
 };
 
+//returns the archive to read the named file from, or nullptr if it is not in any archive
+static ziparchive *findziparchive(const char *name)
+{
+    int source = packageindex.find(name, vfsindex::Source_Zip);
+    if(source < 0)
+    {
+        return nullptr;
+    }
+    for(ziparchive *arch : archives)
+    {
+        if(arch->source == source)
+        {
+            return arch;
+        }
+    }
+    return nullptr;
+}
+
 stream *openzipfile(const char *name, const char *mode)
 {
     for(; *mode; mode++)
@@ -718,86 +921,35 @@ stream *openzipfile(const char *name, const char *mode)
             return nullptr;
         }
     }
-    for(int i = archives.size(); --i >=0;) //note reverse iteration
+    ziparchive *arch = findziparchive(name);
+    if(!arch)
+    {
+        return nullptr;
+    }
+    auto itr = arch->files.find(name);
+    if(itr == arch->files.end())
+    {
+        return nullptr;
+    }
+    zipstream *s = new zipstream;
+    if(!s->open(arch, &(*itr).second))
     {
-        ziparchive *arch = archives[i];
-        auto itr = arch->files.find(name);
-        zipfile *f = nullptr;
-        if(itr == arch->files.end())
-        {
-            continue;
-        }
-        f = &(*(itr)).second;
-        zipstream *s = new zipstream;
-        if(s->open(arch, f))
-        {
-            return s;
-        }
         delete s;
+        return nullptr;
     }
-    return nullptr;
+    return s;
 }
 
 bool findzipfile(const char *name)
 {
-    for(int i = archives.size(); --i >=0;) //note reverse iteration
-    {
-        const ziparchive *arch = archives[i];
-        if(arch->files.find(name) != arch->files.end())
-        {
-            return true;
-        }
-    }
-    return false;
+    //archive names are matched exactly, as openzipfile() looks them up
+    const ziparchive *arch = findziparchive(name);
+    return arch && arch->files.find(name) != arch->files.end();
 }
 
 int listzipfiles(const char *dir, const char *ext, std::vector<char *> &files)
 {
-    size_t extsize = ext ? std::strlen(ext)+1 : 0,
-           dirsize = std::strlen(dir);
-    int dirs = 0;
-    for(int i = archives.size(); --i >=0;) //note reverse iteration
-    {
-        const ziparchive *arch = archives[i];
-        uint oldsize = files.size();
-        for(const auto& [k, f] : arch->files)
-        {
-            if(std::strncmp(k.c_str(), dir, dirsize))
-            {
-                continue;
-            }
-            const char *name = k.c_str() + dirsize;
-            if(name[0] == PATHDIV)
-            {
-                name++;
-            }
-            if(std::strchr(name, PATHDIV))
-            {
-                continue;
-            }
-            if(!ext)
-            {
-                files.push_back(newstring(name));
-            }
-            else
-            {
-                size_t namelen = std::strlen(name);
-                if(namelen > extsize)
-                {
-                    namelen -= extsize;
-                    if(name[namelen] == '.' && std::strncmp(name+namelen+1, ext, extsize-1)==0)
-                    {
-                        files.push_back(newstring(name, namelen));
-                    }
-                }
-            }
-        }
-        if(files.size() > oldsize)
-        {
-            dirs++;
-        }
-    }
-    return dirs;
+    return packageindex.list(dir, ext, vfsindex::Source_Zip, files);
 }
 
 void initzipcmds()
@@ -1,5 +1,7 @@
 
 #include "libprimis.h"
+#include "../src/shared/geomexts.h"
+#include "../src/engine/world/octaworld.h"
 #include "testutils.h"
 #include "testidents.h"
 #include "testcs.h"
@@ -17,10 +19,13 @@
 #include "testragdoll.h"
 #include "testbih.h"
 #include "testmpr.h"
+#include "testraycube.h"
+#include "testphysics.h"
 
 int main()
 {
     std::setbuf(stdout, nullptr); //disable buffering to ensure full printout
+    worldqueriesonly = true; //the worlds the tests make have no GL context to render them with
 
     testutils();
 
@@ -40,5 +45,7 @@ int main()
     test_matrix();
     test_bih();
     test_mpr();
+    test_raycube();
+    test_physics();
     return EXIT_SUCCESS;
 }
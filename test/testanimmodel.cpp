@@ -3,6 +3,7 @@
 
 #include "../src/shared/geomexts.h"
 #include "../src/shared/glexts.h"
+#include "../src/shared/asyncio.h"
 
 #include <optional>
 #include <memory>
@@ -181,6 +182,33 @@ namespace
 
     //animmodel related objects
 
+    void test_part_loadskintexture()
+    {
+        std::printf("testing part loadskintexture\n");
+        animmodel::part p(nullptr);
+        p.initskins(nullptr, nullptr, 2);
+        Shader t;
+        p.skins[1].shader = &t;
+
+        int set = 0;
+        auto setter = [&set] (animmodel::skin &s, Texture *)
+        {
+            assert(s.shader);
+            set++;
+        };
+        asyncreadstats before = getasyncreadstats();
+        //both requests for the same texture share one read
+        p.loadskintexture(1, "media/model/missing_skin.png", setter);
+        p.loadskintexture(1, "media/model/missing_skin.png", setter);
+        //skins that do not exist by the time the load finishes are skipped
+        p.loadskintexture(5, "media/model/missing_skin.png", setter);
+        assert(getasyncreadstats().requests == before.requests + 1);
+        assert(set == 0);
+        finishasyncreads();
+        assert(set == 2);
+        p.skins[1].shader = nullptr;
+    }
+
     void test_animinfo_ctor()
     {
         std::printf("testing animinfo ctor\n");
@@ -381,6 +409,7 @@ testing animmodel functionality\n\
     test_shaderparams_equals();
     test_skin_ctor();
     test_skin_cleanup();
+    test_part_loadskintexture();
     test_animinfo_ctor();
     test_animinfo_equals();
     test_animinfo_nequals();
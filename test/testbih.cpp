@@ -1,10 +1,14 @@
 
 #include "../src/libprimis-headers/cube.h"
+#include "../src/libprimis-headers/iengine.h"
+#include "../src/libprimis-headers/consts.h"
 
 #include "../src/shared/geomexts.h"
 #include "../src/shared/glexts.h"
+#include "../src/shared/stream.h"
 
 #include "../src/engine/world/bih.h"
+#include "../src/engine/model/modelcache.h"
 
 
 namespace
@@ -105,17 +109,17 @@ namespace
 
         {
             BIH::Node n;
-            n.child[0] = 0b0010'0000'0000'0000;
+            n.child[0] = 1u<<29;
             assert(n.axis() == 0);
         }
         {
             BIH::Node n;
-            n.child[0] = 0b0100'0000'0000'0000;
+            n.child[0] = 1u<<30;
             assert(n.axis() == 1);
         }
         {
             BIH::Node n;
-            n.child[0] = 0b1100'0000'0000'0000;
+            n.child[0] = 3u<<30;
             assert(n.axis() == 0b11);
             assert(n.axis() == 3);
         }
@@ -144,12 +148,23 @@ namespace
             BIH::Node n;
             n.child[0] = 0x3FFF;
             assert(n.childindex(0) == 0x3FFF);
-            assert(n.childindex(0) == 0b11'1111'1111'1111);
             assert(n.childindex(0) == 16383);
         }
         {
+            //past the old 14 bit limit
             BIH::Node n;
             n.child[0] = 0x4000;
+            assert(n.childindex(0) == 0x4000);
+            assert(n.childindex(0) == 16384);
+        }
+        {
+            BIH::Node n;
+            n.child[0] = 0x3FFF'FFFF;
+            assert(n.childindex(0) == static_cast<int>(BIH::Node::maxindex));
+        }
+        {
+            BIH::Node n;
+            n.child[0] = 1u<<30;
             assert(n.childindex(0) == 0x0);
             assert(n.childindex(0) == 0b0);
             assert(n.childindex(0) == 0);
@@ -161,30 +176,164 @@ namespace
         std::printf("test bih::node isleaf\n");
         {
             BIH::Node n;
-            n.child[1] = 0b0010'0000'0000'0000;
+            n.child[1] = 1u<<29;
             assert(n.isleaf(0) == false);
             assert(n.isleaf(1) == false);
         }
         {
             BIH::Node n;
-            n.child[1] = 0b0100'0000'0000'0000;
+            n.child[1] = 1u<<30;
             assert(n.isleaf(0) == true);
             assert(n.isleaf(1) == false);
         }
         {
             BIH::Node n;
-            n.child[1] = 0b1000'0000'0000'0000;
+            n.child[1] = 1u<<31;
             assert(n.isleaf(0) == false);
             assert(n.isleaf(1) == true);
         }
         {
             BIH::Node n;
-            n.child[1] = 0b1100'0000'0000'0000;
+            n.child[1] = 3u<<30;
             assert(n.isleaf(0) == true);
             assert(n.isleaf(1) == true);
         }
     }
 
+    void test_bih_node_setchildren()
+    {
+        std::printf("test bih::node setchildren\n");
+        {
+            BIH::Node n;
+            n.setchildren(2, 1, false, 100000, true);
+            assert(n.axis() == 2);
+            assert(n.childindex(0) == 1);
+            assert(n.childindex(1) == 100000);
+            assert(n.isleaf(0) == false);
+            assert(n.isleaf(1) == true);
+        }
+        {
+            BIH::Node n;
+            n.setchildren(1, BIH::Node::maxindex, true, 0, false);
+            assert(n.axis() == 1);
+            assert(n.childindex(0) == static_cast<int>(BIH::Node::maxindex));
+            assert(n.childindex(1) == 0);
+            assert(n.isleaf(0) == true);
+            assert(n.isleaf(1) == false);
+        }
+    }
+
+    //a flat grid at height 8, with more triangles than 14 bit node indices could address
+    void test_bih_build()
+    {
+        std::printf("test bih build\n");
+
+        constexpr int gridsize = 128;
+        std::vector<vec> pos;
+        for(int y = 0; y <= gridsize; ++y)
+        {
+            for(int x = 0; x <= gridsize; ++x)
+            {
+                pos.emplace_back(x, y, 8);
+            }
+        }
+        std::vector<BIH::mesh::tri> tris;
+        for(uint y = 0; y < gridsize; ++y)
+        {
+            for(uint x = 0; x < gridsize; ++x)
+            {
+                uint v = y*(gridsize+1) + x;
+                tris.push_back({{v, v+1, v+gridsize+2}});
+                tris.push_back({{v, v+gridsize+2, v+gridsize+1}});
+            }
+        }
+        assert(tris.size() > 1<<14);
+
+        //both the midpoint and surface area heuristic builds
+        for(int sah = 0; sah < 2; ++sah)
+        {
+            setvar("bihsah", sah);
+            BIH::mesh m;
+            m.xform.identity();
+            m.flags = BIH::Mesh_Render | BIH::Mesh_Collide;
+            m.setmesh(tris.data(), tris.size(), reinterpret_cast<const uchar *>(pos.data()), sizeof(vec), reinterpret_cast<const uchar *>(pos.data()), sizeof(vec));
+            std::vector<BIH::mesh> meshes = {m};
+            BIH b(meshes);
+            for(int i = 0; i < 64; ++i)
+            {
+                vec o(1.3f + i*1.97f, 0.7f + i*1.93f, 50);
+                float dist = 0;
+                assert(b.traverse(o, vec(0, 0, -1), 100, dist, Ray_Shadow));
+                assert(std::abs(dist - 42) < tolerance);
+            }
+            float dist = 0;
+            assert(!b.traverse(vec(200, 200, 50), vec(0, 0, -1), 100, dist, Ray_Shadow));
+            assert(!b.traverse(vec(64, 64, 50), vec(0, 0, 1), 100, dist, Ray_Shadow));
+        }
+        setvar("bihsah", 1);
+    }
+
+    void test_bih_modelcache()
+    {
+        std::printf("test bih modelcache\n");
+
+        constexpr int gridsize = 16;
+        std::vector<vec> pos;
+        for(int y = 0; y <= gridsize; ++y)
+        {
+            for(int x = 0; x <= gridsize; ++x)
+            {
+                pos.emplace_back(x, y, 8 + (x*y)%3);
+            }
+        }
+        std::vector<BIH::mesh::tri> tris;
+        for(uint y = 0; y < gridsize; ++y)
+        {
+            for(uint x = 0; x < gridsize; ++x)
+            {
+                uint v = y*(gridsize+1) + x;
+                tris.push_back({{v, v+1, v+gridsize+2}});
+                tris.push_back({{v, v+gridsize+2, v+gridsize+1}});
+            }
+        }
+        BIH::mesh m;
+        m.xform.identity();
+        m.flags = BIH::Mesh_Render | BIH::Mesh_Collide;
+        m.setmesh(tris.data(), tris.size(), reinterpret_cast<const uchar *>(pos.data()), sizeof(vec), reinterpret_cast<const uchar *>(pos.data()), sizeof(vec));
+        std::vector<BIH::mesh> meshes = {m};
+
+        const std::string cachefile = modelcachename("test_bih.bih");
+        //no home directory is set, so the cache's directories must be made here
+        createdir("cache");
+        createdir("cache/models");
+        modelcache = 1;
+
+        BIH built(meshes, "test_bih.bih");
+        assert(fileexists(cachefile.c_str(), "r"));
+        BIH cached(meshes, "test_bih.bih");
+        assert(cached.getentradius() == built.getentradius());
+        for(int i = 0; i < 64; ++i)
+        {
+            vec o(0.3f + i*0.23f, 0.2f + i*0.24f, 50);
+            float builtdist = 0,
+                  cacheddist = 0;
+            assert(built.traverse(o, vec(0, 0, -1), 100, builtdist, Ray_Shadow));
+            assert(cached.traverse(o, vec(0, 0, -1), 100, cacheddist, Ray_Shadow));
+            assert(builtdist == cacheddist);
+        }
+
+        //a moved mesh does not reuse the tree cached for the old transform
+        meshes[0].xform.settranslation(vec(100, 0, 0));
+        BIH moved(meshes, "test_bih.bih");
+        float dist = 0;
+        assert(!moved.traverse(vec(8, 8, 50), vec(0, 0, -1), 100, dist, Ray_Shadow));
+        assert(moved.traverse(vec(108, 8, 50), vec(0, 0, -1), 100, dist, Ray_Shadow));
+
+        modelcache = 0;
+        std::remove(cachefile.c_str());
+        std::remove("cache/models");
+        std::remove("cache");
+    }
 }
 
 void test_bih()
@@ -201,4 +350,7 @@ testing bih functionality\n\
     test_bih_node_axis();
     test_bih_node_childindex();
     test_bih_node_isleaf();
+    test_bih_node_setchildren();
+    test_bih_build();
+    test_bih_modelcache();
 };
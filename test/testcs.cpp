@@ -1377,6 +1377,37 @@ namespace
         test_cs_command_string(inputs);
     }
 
+    void test_cs_longlist()
+    {
+        std::printf("testing CS list commands on long lists\n");
+
+        //long enough that the list is kept parsed between commands
+        execute("longlist = []; loop i 100 [longlist = (concat $longlist (concatword item $i))]; longlist = (concat $longlist [[a b] \"c d\"])");
+        std::vector<std::pair<std::string, std::string>> inputs = {
+            {"listlen $longlist", "102"},
+            {"at $longlist 0", "item0"},
+            {"at $longlist 57", "item57"},
+            {"at $longlist 57", "item57"},
+            {"at $longlist -1", "item0"},
+            {"at $longlist 100 1", "b"},
+            {"at $longlist 101", "c d"},
+            {"at $longlist 102", ""},
+            {"sublist $longlist 98 3", "item98 item99 [a b]"},
+            {"sublist $longlist 100", "[a b] \"c d\""},
+            {"sublist $longlist 200", ""},
+            {"sublist $longlist 101 5", "\"c d\""},
+            {"result (loopconcat i 3 [at $longlist (+ $i 10)])", "item10 item11 item12"},
+            {"result (loopconcat i 2 [at $longlist 100 $i])", "a b"},
+            //assigning the alias drops its parsed form, even when the new value is as long
+            {"longlist = (listsplice $longlist item9 0 1); at $longlist 0", "item9"},
+            {"longlist = (listsplice $longlist [[x y]] 100 1); at $longlist 100 1", "y"},
+            {"longlist = (listsplice $longlist zz 100 1); at $longlist 100 1", ""},
+            {"listlen $longlist", "102"},
+        };
+
+        test_cs_command_string(inputs);
+    }
+
     void test_cs_sublist()
     {
         std::printf("testing CS sublist cmd\n");
@@ -1706,6 +1737,135 @@ namespace
 
         test_cs_command_string(stringinputs);
     }
+
+    void test_cs_codecache()
+    {
+        std::printf("testing CS compiled code cache\n");
+
+        execute("codecachetest = 0");
+        codecachestats before = getcodecachestats();
+        for(int i = 0; i < 3; ++i)
+        {
+            execute("codecachetest = (+ $codecachetest 1)");
+        }
+        codecachestats after = getcodecachestats();
+        assert(after.misses - before.misses == 1);
+        assert(after.hits - before.hits == 2);
+        assert(execute("result $codecachetest") == 3);
+        //strings executed with and without a return value are cached separately
+        tagval t;
+        executeret("result $codecachetest", t);
+        assert(t.getint() == 3);
+        freearg(t);
+        assert(getcodecachestats().misses - after.misses == 2);
+        //disabling the cache empties it, but code still runs
+        setvar("codecachekb", 0);
+        assert(execute("codecachetest = (+ $codecachetest 1); result $codecachetest") == 4);
+        assert(getcodecachestats().entries == 0 && getcodecachestats().bytes == 0);
+        setvar("codecachekb", 1024);
+        clearcodecache();
+        assert(getcodecachestats().entries == 0);
+    }
+
+    void test_cs_profile()
+    {
+        std::printf("testing CS profiler\n");
+
+        execute("profiletestinner = [+ $arg1 1]; profiletestouter = [loop i 3 [profiletestinner $i]]");
+        setvar("csprofile", 1);
+        execute("profiletestouter");
+        execute("profiletestouter");
+        setvar("csprofile", 0, false); //without clearing the profile
+        csprofilestats outer, inner;
+        assert(getcsprofilestats("profiletestouter", outer));
+        assert(getcsprofilestats("profiletestinner", inner));
+        assert(outer.calls == 2);
+        assert(inner.calls == 6);
+        assert(outer.inclusive >= inner.inclusive);
+        assert(outer.exclusive <= outer.inclusive);
+        //recursive calls are only counted once in the inclusive time
+        execute("profiletestrec = [if (> $arg1 0) [profiletestrec (- $arg1 1)]]");
+        resetcsprofile();
+        setvar("csprofile", 1, false);
+        execute("profiletestrec 4");
+        csprofilestats rec;
+        assert(getcsprofilestats("profiletestrec", rec));
+        assert(rec.calls == 5);
+        assert(rec.exclusive <= rec.inclusive);
+        //changing the variable clears the profile
+        setvar("csprofile", 0);
+        assert(!getcsprofilestats("profiletestrec", rec));
+        execute("profiletestouter");
+        assert(!getcsprofilestats("profiletestouter", outer));
+    }
+
+    void test_cs_optimize()
+    {
+        std::printf("testing CS compile time optimizations\n");
+
+        execute("csopttest = 5");
+        const std::vector<std::string> inputs = {
+            "+ 1 2 3",
+            "- 5",
+            "-f 0",
+            "*f 1e30 1e30",
+            "* (+ 1 2) (- 7 3)",
+            "+ 3000000 (* 2 4000000)",
+            "+ $csopttest (* 2 3)",
+            "<= (div 7 0) (mod 7 0) $csopttest",
+            "<< 1 40",
+            ">> -8 2",
+            "=f 0.5 0.5 (*f 0.25 2)",
+            "<f 1 2 1",
+            "pow 2 0.5",
+            "modf 7.5 (+f 1 1)",
+            "minf 3 -1.5 $csopttest",
+            "max 3 9 4",
+            "^~ 6 3",
+            "+",
+            "*f",
+            "concat (+ 1 2) (+f 1 2)",
+            "if (< 1 2) [result a] [result b]",
+            "if (> 1 2) [result a] [result b]",
+            "if (< $csopttest 2) [result a] [result b]",
+            "if 1 [result a]",
+            "result c; if 0 [result a]",
+            "result c; if (- 1 1) [result a]",
+            "if 1 [] [result b]",
+            "if 0 [] [result b]",
+            "if yes [result a] [result b]",
+            "if 0.0 [result a] [result b]",
+            "if \"\" [result a] [result b]"
+        };
+        std::vector<std::string> results;
+        for(int optimize = 0; optimize < 2; ++optimize)
+        {
+            setvar("csoptimize", optimize);
+            for(size_t i = 0; i < inputs.size(); ++i)
+            {
+                tagval t;
+                executeret(inputs[i].c_str(), t);
+                std::string result = std::to_string(t.type) + " " + t.getstr();
+                freearg(t);
+                std::printf("exec (csoptimize %d): %s > %s\n", optimize, inputs[i].c_str(), result.c_str());
+                if(optimize)
+                {
+                    assert(result == results[i]);
+                }
+                else
+                {
+                    results.push_back(result);
+                }
+            }
+        }
+        //constant math compiles to its result, and a false if without an else to nothing
+        uint *code = compilecode("* 6 (+ 3 4)");
+        assert(code[1] == (Code_ValI|Ret_Integer|(42<<8)) && code[2] == Code_Result);
+        freecode(code);
+        code = compilecode("if 0 [echo unreachable]");
+        assert(code[1] == Code_Exit);
+        freecode(code);
+    }
 }
 
 //run tests
@@ -1777,6 +1937,7 @@ void testcs()
     test_cs_listlen();
     test_cs_at();
     test_cs_sublist();
+    test_cs_longlist();
     test_cs_listcount();
     test_cs_listfind();
     test_cs_loop();
@@ -1794,6 +1955,9 @@ void testcs()
     test_cs_listsplice();
     test_cs_sortlist();
     test_cs_uniquelist();
+    test_cs_codecache();
+    test_cs_optimize();
+    test_cs_profile();
     //command.h
     testescapestring();
     testescapeid();
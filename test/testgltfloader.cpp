@@ -461,6 +461,85 @@ void testnodetranslate()
     }
 }
 
+void testglb()
+{
+    std::printf("test GLB binary container loading\n");
+    std::string modelname = "gltf/box.gltf",
+                modelname2 = "gltf/box.glb";
+    GLTFModelInfo mi(modelname),
+                  mi2(modelname2);
+    assert(mi2.getnodenames(GLTFModelInfo::NodeType_All) == mi.getnodenames(GLTFModelInfo::NodeType_All));
+    assert(mi == mi2);
+}
+
+void testbase64uri()
+{
+    std::printf("test GLTF buffer embedded as a base64 data URI\n");
+    std::string modelname = "gltf/obj_cube.gltf",
+                modelname2 = "gltf/obj_cube_base64.gltf";
+    GLTFModelInfo mi(modelname),
+                  mi2(modelname2);
+    assert(mi == mi2);
+}
+
+void testescapeduri()
+{
+    std::printf("test GLTF buffer URI with %%-escaped characters\n");
+    std::string modelname = "gltf/obj_cube.gltf",
+                modelname2 = "gltf/obj_cube_escaped.gltf";
+    GLTFModelInfo mi(modelname),
+                  mi2(modelname2);
+    assert(mi == mi2);
+}
+
+void testbytestride()
+{
+    std::printf("test GLTF interleaved buffer view with byteStride\n");
+    std::string modelname = "gltf/obj_cube.gltf",
+                modelname2 = "gltf/obj_cube_interleaved.gltf";
+    GLTFModelInfo mi(modelname),
+                  mi2(modelname2);
+    //positions and normals share one buffer view, 24 bytes per vertex
+    assert(mi == mi2);
+}
+
+void testaccessoroverflow()
+{
+    std::printf("testing GLTF accessor running past the end of its buffer view\n");
+    std::string modelname1 = "gltf/obj_cube_accessor_range.gltf";
+    GLTFModelInfo mi1(modelname1);
+    std::string meshname = mi1.getnodenames(GLTFModelInfo::NodeType_Mesh)[0];
+
+    bool exceptioncaught = false;
+    try
+    {
+        mi1.getpositions(meshname);
+    }
+    catch(const std::logic_error &e)
+    {
+        exceptioncaught = true;
+        std::printf("Exception thrown: %s\n", e.what());
+    }
+    assert(exceptioncaught);
+}
+
+void testglbtruncated()
+{
+    std::printf("testing GLB file with a chunk past the end of the file\n");
+    std::string modelname1 = "gltf/box_truncated.glb";
+    bool exceptioncaught = false;
+    try
+    {
+        GLTFModelInfo mi1(modelname1);
+    }
+    catch(const std::logic_error &e)
+    {
+        exceptioncaught = true;
+        std::printf("Exception thrown: %s\n", e.what());
+    }
+    assert(exceptioncaught);
+}
+
 void test_gltf()
 {
     std::printf(
@@ -487,4 +566,10 @@ testing GLTF file loader\n\
     testmultimesh();
     testequals();
     testnodetranslate();
+    testglb();
+    testbase64uri();
+    testescapeduri();
+    testbytestride();
+    testaccessoroverflow();
+    testglbtruncated();
 };
@@ -141,6 +141,62 @@ static void tryexecother()
     printf("===============================================================\n");
 }
 
+static void test_identkey()
+{
+    printf("Testing ident lookup by key\n");
+
+    static constexpr identkey key("testkeyalias");
+    static_assert(key.hash == hashidentname("testkeyalias"));
+    assert(!getident(key));
+    alias("testkeyalias", "1");
+    ident *id = getident("testkeyalias");
+    assert(id && getident(key) == id);
+    //names need not be null terminated
+    std::string_view slice("testkeyaliasxyz", 12);
+    assert(&(*idents.find(slice)).second == id);
+    assert(!getvar(Id_Var, key));
+    for(auto & [name, val] : idents)
+    {
+        if(val.type == Id_Var && !(val.flags&(Idf_ReadOnly|Idf_Override)))
+        {
+            identkey varkey(name);
+            assert(getvar(Id_Var, varkey) == &val);
+            int old = *val.val.storage.i;
+            setvar(varkey, val.val.i.max, false);
+            assert(*val.val.storage.i == val.val.i.max);
+            setvar(name.c_str(), old, false);
+            assert(*val.val.storage.i == old);
+            break;
+        }
+    }
+    for(auto & [name, val] : idents)
+    {
+        if(val.type == Id_FloatVar && !(val.flags&(Idf_ReadOnly|Idf_Override)))
+        {
+            identkey varkey(name);
+            float old = *val.val.storage.f;
+            setfvar(varkey, val.val.f.max, false);
+            assert(*val.val.storage.f == val.val.f.max);
+            setfvar(name.c_str(), old, false);
+            assert(*val.val.storage.f == old);
+            break;
+        }
+    }
+    for(auto & [name, val] : idents)
+    {
+        if(val.type == Id_StringVar && !(val.flags&(Idf_ReadOnly|Idf_Override)))
+        {
+            identkey varkey(name);
+            std::string old = *val.val.storage.s;
+            setsvar(varkey, "testkeyvalue", false);
+            assert(!std::strcmp(*val.val.storage.s, "testkeyvalue"));
+            setsvar(name.c_str(), old.c_str(), false);
+            assert(old == *val.val.storage.s);
+            break;
+        }
+    }
+}
+
 static void test_clear_command()
 {
     printf("Testing clearing commands (aliases)\n");
@@ -168,5 +224,6 @@ void testidents()
     tryexeccommands();
     tryexecother();
 
+    test_identkey();
     test_clear_command();
 }
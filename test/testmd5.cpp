@@ -2,6 +2,7 @@
 
 #include "../src/shared/geomexts.h"
 #include "../src/shared/glexts.h"
+#include "../src/shared/asyncio.h"
 #include "../src/shared/stream.h"
 
 #include <optional>
@@ -9,6 +10,7 @@
 #include <format>
 
 #include "../src/engine/interface/console.h"
+#include "../src/engine/interface/control.h"
 #include "../src/engine/interface/cs.h"
 
 #include "../src/engine/render/rendergl.h"
@@ -23,6 +25,7 @@
 #include "../src/engine/model/model.h"
 #include "../src/engine/model/ragdoll.h"
 #include "../src/engine/model/animmodel.h"
+#include "../src/engine/model/modelcache.h"
 #include "../src/engine/model/skelmodel.h"
 #include "../src/engine/model/md5.h"
 
@@ -228,6 +231,201 @@ namespace
         delete m;
     }
 
+    void test_md5_checkskelcache()
+    {
+        std::printf("testing md5 checkskelcache\n");
+
+        md5 *m = generate_md5_model();
+
+        //anims must be registered in this global first
+        animnames.emplace_back("pulserifle");
+
+        float speed = 30;
+        int priority = 0,
+            offsets = 0;
+        skelcommands<md5>::setanim("pulserifle", "pulserifle.md5anim", &speed, &priority, &offsets, &offsets);
+        m->loaded();
+        m->endload();
+
+        skelmodel::skelpart *p = static_cast<skelmodel::skelpart *>(m->parts[0]);
+        skelmodel::skeleton *skel = static_cast<skelmodel::skelmeshgroup *>(p->meshes)->skel;
+
+        animmodel::AnimState as;
+        as.owner = p;
+        as.cur.anim = as.prev.anim = 0;
+        as.cur.fr1 = as.prev.fr1 = 0;
+        as.cur.fr2 = as.prev.fr2 = 1;
+        as.cur.t = as.prev.t = 0.5f;
+        as.interp = 1;
+
+        const vec pos(0, 0, 0),
+                  axis(0, 0, 1),
+                  forward(0, 1, 0);
+        lastmillis = 1;
+        skelmodel::skeleton::posecachestats before = skelmodel::skeleton::getposecachestats();
+        size_t first = &skel->checkskelcache(pos, 1, &as, 0, axis, forward, nullptr) - skel->skelcache.data();
+        size_t second = &skel->checkskelcache(pos, 1, &as, 0, axis, forward, nullptr) - skel->skelcache.data();
+        assert(first == second);
+
+        //same pose in a later frame is kept rather than evaluated again
+        lastmillis = 2;
+        size_t third = &skel->checkskelcache(pos, 1, &as, 0, axis, forward, nullptr) - skel->skelcache.data();
+        assert(first == third);
+
+        //t differs, and is only ignored when both frames are the same
+        as.cur.t = 0.25f;
+        size_t fourth = &skel->checkskelcache(pos, 1, &as, 0, axis, forward, nullptr) - skel->skelcache.data();
+        assert(fourth != first);
+        as.cur.fr2 = 0;
+        as.cur.t = 0.75f;
+        size_t fifth = &skel->checkskelcache(pos, 1, &as, 0, axis, forward, nullptr) - skel->skelcache.data();
+        as.cur.t = 0.5f;
+        assert(&skel->checkskelcache(pos, 1, &as, 0, axis, forward, nullptr) - skel->skelcache.data() == static_cast<std::ptrdiff_t>(fifth));
+
+        skelmodel::skeleton::posecachestats after = skelmodel::skeleton::getposecachestats();
+        assert(after.lookups - before.lookups == 6);
+        assert(after.evaluated - before.evaluated == 3);
+        assert(after.shared - before.shared == 2);
+        assert(after.reused - before.reused == 1);
+
+        lastmillis = 0;
+        animnames.clear();
+        delete m;
+    }
+
+    void test_md5_modelcache()
+    {
+        std::printf("testing md5 modelcache\n");
+
+        md5 *m = generate_md5_model();
+        m->endload();
+        const skelmodel::skelmeshgroup *source = static_cast<skelmodel::skelmeshgroup *>(m->parts[0]->meshes);
+        const std::string meshfile = source->groupname(),
+                          cachefile = modelcachename(meshfile);
+
+        //no home directory is set, so the cache's directories must be made here
+        std::vector<std::string> dirs;
+        for(size_t i = cachefile.find('/'); i != std::string::npos; i = cachefile.find('/', i+1))
+        {
+            dirs.push_back(cachefile.substr(0, i));
+            createdir(dirs.back().c_str());
+        }
+
+        //loadmeshes() is called directly, as sharemeshes() would return the already loaded group
+        modelcache = 1;
+        skelmodel::skelpart &savedpart = m->addpart();
+        skelmodel::skelmeshgroup *saved = static_cast<skelmodel::skelmeshgroup *>(m->loadmeshes(meshfile)); //loaded from the source and saved
+        assert(saved);
+        assert(fileexists(cachefile.c_str(), "r"));
+        skelmodel::skelpart &cachedpart = m->addpart();
+        skelmodel::skelmeshgroup *cached = static_cast<skelmodel::skelmeshgroup *>(m->loadmeshes(meshfile)); //loaded from the cache
+        assert(cached);
+        modelcache = 0;
+
+        assert(cached->groupname() == source->groupname());
+        assert(cached->skel->numbones == source->skel->numbones);
+        for(size_t i = 0; i < source->skel->numbones; ++i)
+        {
+            const dualquat s = *source->skel->getbonebase(i),
+                           c = *cached->skel->getbonebase(i);
+            assert(c.real.x == s.real.x && c.real.y == s.real.y && c.real.z == s.real.z && c.real.w == s.real.w);
+            assert(c.dual.x == s.dual.x && c.dual.y == s.dual.y && c.dual.z == s.dual.z && c.dual.w == s.dual.w);
+        }
+        assert(cached->blendcombos.size() == source->blendcombos.size());
+        assert(cached->meshes.size() == source->meshes.size());
+        for(size_t i = 0; i < source->meshes.size(); ++i)
+        {
+            const skelmodel::skelmesh *s = static_cast<skelmodel::skelmesh *>(source->meshes[i]),
+                                      *c = static_cast<skelmodel::skelmesh *>(cached->meshes[i]);
+            assert(c->name == s->name);
+            assert(c->vertcount() == s->vertcount());
+            assert(c->tricount() == s->tricount());
+            for(int j = 0; j < s->vertcount(); ++j)
+            {
+                assert(c->getvert(j).pos == s->getvert(j).pos);
+                assert(c->getvert(j).norm == s->getvert(j).norm);
+                assert(c->getvert(j).blend == s->getvert(j).blend);
+            }
+        }
+        assert(cachedpart.skins.size() == savedpart.skins.size());
+        for(size_t i = 0; i < savedpart.skins.size(); ++i)
+        {
+            assert(cachedpart.skins[i].tex == savedpart.skins[i].tex);
+        }
+
+        std::remove(cachefile.c_str());
+        for(auto i = dirs.rbegin(); i != dirs.rend(); ++i)
+        {
+            std::remove(i->c_str());
+        }
+        delete saved;
+        delete cached;
+        delete m;
+    }
+
+    void test_md5_animcache()
+    {
+        std::printf("testing md5 animcache\n");
+
+        md5 *m = generate_md5_model();
+        m->endload();
+        const std::string meshfile = static_cast<skelmodel::skelmeshgroup *>(m->parts[0]->meshes)->groupname(),
+                          animfile = path(std::format("{}/pulserifle.md5anim", md5::dir)),
+                          meshcache = modelcachename(meshfile),
+                          animcache = modelcachename(animfile);
+
+        //no home directory is set, so the cache's directories must be made here
+        std::vector<std::string> dirs;
+        for(size_t i = animcache.find('/'); i != std::string::npos; i = animcache.find('/', i+1))
+        {
+            dirs.push_back(animcache.substr(0, i));
+            createdir(dirs.back().c_str());
+        }
+
+        //each group is loaded with loadmeshes(), so that its skeleton has no animations yet
+        modelcache = 1;
+        m->addpart();
+        skelmodel::skelmeshgroup *parsed = static_cast<skelmodel::skelmeshgroup *>(m->loadmeshes(meshfile));
+        const skelmodel::skelanimspec *parsedanim = parsed->loadanim(animfile); //parsed and saved
+        assert(parsedanim);
+        assert(fileexists(animcache.c_str(), "r"));
+        const size_t numframes = parsed->skel->numframes,
+                     numbones = parsed->skel->numbones;
+
+        m->addpart();
+        skelmodel::skelmeshgroup *cached = static_cast<skelmodel::skelmeshgroup *>(m->loadmeshes(meshfile));
+        const skelmodel::skelanimspec *cachedanim = cached->loadanimcache(animfile, md5::adjustments);
+        assert(cachedanim);
+        assert(cachedanim->name == parsedanim->name);
+        assert(cachedanim->frame == parsedanim->frame);
+        assert(cachedanim->range == parsedanim->range);
+        assert(cached->skel->numframes == numframes);
+        assert(!std::memcmp(cached->skel->framebones, parsed->skel->framebones, numframes*numbones*sizeof(dualquat)));
+
+        //frames saved without bone adjustments are not used for a model with them
+        md5::adjustments.emplace_back(90, 0, 0, vec(0, 0, 0));
+        m->addpart();
+        skelmodel::skelmeshgroup *adjusted = static_cast<skelmodel::skelmeshgroup *>(m->loadmeshes(meshfile));
+        assert(!adjusted->loadanimcache(animfile, md5::adjustments));
+        assert(adjusted->skel->numframes == 0);
+        assert(adjusted->loadanim(animfile));
+        assert(adjusted->skel->numframes == numframes);
+        assert(std::memcmp(adjusted->skel->framebones, parsed->skel->framebones, numframes*numbones*sizeof(dualquat)));
+        md5::adjustments.clear();
+        modelcache = 0;
+
+        std::remove(animcache.c_str());
+        std::remove(meshcache.c_str());
+        for(auto i = dirs.rbegin(); i != dirs.rend(); ++i)
+        {
+            std::remove(i->c_str());
+        }
+        delete parsed;
+        delete cached;
+        delete adjusted;
+        delete m;
+    }
+
     void test_md5_setanimpart()
     {
         std::printf("testing md5 setanimpart\n");
@@ -262,6 +460,7 @@ namespace
         skelmodel::skelpart *p = static_cast<skelmodel::skelpart *>(m->parts[0]);
         p->initskins();
         skelcommands<md5>::setskin("*", "blank.png", "blank.png");
+        finishasyncreads(); //skin textures are set once their loads finish
 
         assert(p->skins.size() == 1);
         auto skinlist = skelcommands<md5>::getskins("*");
@@ -291,6 +490,7 @@ namespace
         md5 *m = generate_md5_model();
 
         skelcommands<md5>::setbumpmap("*", "blank.png");
+        finishasyncreads(); //skin textures are set once their loads finish
 
         auto skinlist = skelcommands<md5>::getskins("*");
         assert(skinlist.size() == 1);
@@ -317,6 +517,7 @@ namespace
         md5 *m = generate_md5_model();
 
         skelcommands<md5>::setdecal("*", "blank.png");
+        finishasyncreads(); //skin textures are set once their loads finish
 
         auto skinlist = skelcommands<md5>::getskins("*");
         assert(skinlist.size() == 1);
@@ -340,6 +541,7 @@ namespace
         skelmodel::skelpart *p = static_cast<skelmodel::skelpart *>(m->parts[0]);
         p->initskins();
         skelcommands<md5>::setskin("*", "blank.png", "blank.png");
+        finishasyncreads(); //skin textures are set once their loads finish
 
         m->preloadBIH(); //needs a mask texture to run
 
@@ -356,6 +558,7 @@ namespace
         skelmodel::skelpart *p = static_cast<skelmodel::skelpart *>(m->parts[0]);
         p->initskins();
         skelcommands<md5>::setskin("*", "blank.png", "blank.png");
+        finishasyncreads(); //skin textures are set once their loads finish
 
         m->setBIH(); //needs a mask texture to run
 
@@ -384,6 +587,9 @@ testing md5 functionality\n\
     test_md5_settag();
     test_md5_loadanim();
     test_md5_setpitchtarget();
+    test_md5_checkskelcache();
+    test_md5_modelcache();
+    test_md5_animcache();
     test_md5_setanimpart();
     test_md5_setskin();
     test_md5_setbumpmap();
@@ -1,6 +1,7 @@
 
 #include "libprimis.h"
 #include "../shared/geomexts.h"
+#include "../shared/stream.h"
 #include "../src/engine/world/octaworld.h"
 #include "../src/engine/world/octacube.h"
 
@@ -56,6 +57,33 @@ namespace
         freeocta(c1.children);
     }
 
+    void test_octapoolstats()
+    {
+        std::printf("Testing octree pool stats\n");
+        octapoolstats before = getoctapoolstats();
+        int allocbefore = getallocnodes();
+        std::array<cube, 8> *c = newcubes();
+        (*c)[0].children = newcubes();
+        assert(getoctapoolstats().nodes == before.nodes + 2);
+        assert(getallocnodes() == allocbefore + 2);
+        assert(getoctapoolstats().nodebytes > 0);
+        //siblings allocated in sequence share a page
+        assert(std::abs(reinterpret_cast<char *>((*c)[0].children) - reinterpret_cast<char *>(c)) < (1<<16));
+
+        cubeext *e = growcubeext(nullptr, 5);
+        assert(e->maxverts == 5);
+        assert(getoctapoolstats().exts == before.exts + 1);
+        cubeext *e2 = growcubeext(e, 40);
+        assert(e2->maxverts == 40);
+        deletecubeext(e);
+        deletecubeext(e2);
+        assert(getoctapoolstats().exts == before.exts);
+
+        freeocta(c);
+        assert(getoctapoolstats().nodes == before.nodes);
+        assert(getallocnodes() == allocbefore);
+    }
+
     void testgetcubevector()
     {
         std::printf("Testing getcubevector\n");
@@ -293,6 +321,49 @@ namespace
         assert(notouchingface(c, 1));
         assert(!notouchingface(c, 2));
     }
+
+    void test_mapcrc()
+    {
+        std::printf("testing map crc with and without parallel loading\n");
+        rootworld.emptymap(10, true, false);
+        int size = rootworld.mapsize();
+        for(int i = 0; i < 64; ++i)
+        {
+            setcubefaces(rootworld.lookupcube(ivec((i*97)%size, (i*193)%size, size/2 + (i%4)*64), 16 << (i%3)), facesolid);
+        }
+        createdir("media");
+        createdir("media/map");
+        setvar("savebak", 0);
+        const int saveversion = getvar("mapsaveversion");
+
+        std::array<int, 2> versionnodes;
+        //version 1 stores the octree as a single stream, later versions as chunks
+        for(int version = 1; version <= 2; ++version)
+        {
+            setvar("mapsaveversion", version);
+            assert(rootworld.save_world("test_mapcrc", "test"));
+
+            std::array<uint, 2> crcs;
+            std::array<int, 2> nodes;
+            for(int parallel = 0; parallel < 2; ++parallel)
+            {
+                setvar("parallelmapload", parallel);
+                assert(rootworld.load_world("test_mapcrc", "test", nullptr, nullptr));
+                crcs[parallel] = rootworld.getmapcrc();
+                nodes[parallel] = getallocnodes();
+            }
+            setvar("parallelmapload", 1);
+            //the crc covers the whole uncompressed map, including the header read before the readahead stream is opened
+            assert(crcs[0] && crcs[0] == crcs[1]);
+            //chunks allocate their nodes on worker threads, which must all be counted
+            assert(nodes[0] == nodes[1]);
+            versionnodes[version-1] = nodes[0];
+        }
+        assert(versionnodes[0] == versionnodes[1]);
+        setvar("mapsaveversion", saveversion);
+        setvar("savebak", 2);
+        std::remove("media/map/test_mapcrc.ogz");
+    }
 }
 
 void test_octa()
@@ -304,6 +375,7 @@ testing octa functionality\n\
     );
     testoctaboxoverlap();
     testfamilysize();
+    test_octapoolstats();
     testgetcubevector();
     test_octadim();
     test_cube_isempty();
@@ -322,4 +394,5 @@ testing octa functionality\n\
     test_undoblock_ents();
     test_touchingface();
     test_notouchingface();
+    test_mapcrc();
 }
@@ -0,0 +1,177 @@
+#include "libprimis.h"
+#include "../src/engine/world/physics.h"
+
+namespace
+{
+    void setdynents(const std::vector<dynent *> &ents)
+    {
+        dynents = ents;
+        numdynents = static_cast<int>(ents.size());
+        cleardynentcache();
+    }
+
+    bool collidesplayer(const physent &d)
+    {
+        return collide(&d, nullptr, vec(1, 0, 0), 0, true);
+    }
+
+    void test_dynentgrid_update()
+    {
+        std::printf("Testing dynent grid updates\n");
+        rootworld.emptymap(10, true, false);
+        dynent a,
+               b;
+        a.o = vec(100, 100, 600);
+        b.o = vec(103, 100, 600);
+        setdynents({&a, &b});
+        assert(collidesplayer(a));
+        //moved away, and updated
+        b.o = vec(700, 700, 600);
+        updatedynentcache(&b);
+        assert(!collidesplayer(a));
+        //moved back without an update, picked up at the start of the next frame
+        b.o = vec(103, 100, 600);
+        cleardynentcache();
+        assert(collidesplayer(a));
+        //moved across a cell boundary
+        a.o = vec(126, 126, 600);
+        b.o = vec(130, 129, 600);
+        updatedynentcache(&a);
+        updatedynentcache(&b);
+        assert(collidesplayer(a));
+        assert(collidesplayer(b));
+        //removed from the dynents vector
+        setdynents({&a});
+        assert(!collidesplayer(a));
+        setdynents({});
+    }
+
+    void test_dynentgrid_many()
+    {
+        std::printf("Testing dynent grid with many dynents\n");
+        rootworld.emptymap(10, true, false);
+        std::vector<dynent> ents(256);
+        std::vector<dynent *> ptrs;
+        for(size_t i = 0; i < ents.size(); ++i)
+        {
+            //spaced 16 units apart in a grid, so none touch
+            ents[i].o = vec(32 + (i%16)*16, 32 + (i/16)*16, 600);
+            ptrs.push_back(&ents[i]);
+        }
+        setdynents(ptrs);
+        for(const dynent &d : ents)
+        {
+            assert(!collidesplayer(d));
+        }
+        //move every other dynent onto its neighbor
+        for(size_t i = 0; i < ents.size(); i += 2)
+        {
+            ents[i].o.x += 13;
+            updatedynentcache(&ents[i]);
+        }
+        for(const dynent &d : ents)
+        {
+            assert(collidesplayer(d));
+        }
+        setdynents({});
+    }
+
+    //places a grid of dynents and picks a move for each: some into the floor, some onto a neighbor
+    std::vector<physcollidequery> genmoves(std::vector<dynent> &ents)
+    {
+        std::vector<physcollidequery> queries;
+        for(size_t i = 0; i < ents.size(); ++i)
+        {
+            ents[i].o = vec(32 + (i%16)*16, 32 + (i/16)*16, 600);
+            vec offset(0, 0, 0);
+            switch(i%4)
+            {
+                case 0:
+                {
+                    offset = vec(0, 0, -200); //into the floor
+                    break;
+                }
+                case 1:
+                {
+                    offset = vec(13, 0, 0); //onto the next dynent, unless it moves out of the way first
+                    break;
+                }
+                case 2:
+                {
+                    offset = vec(0, 0, 20); //up into open space
+                    break;
+                }
+                default:
+                {
+                    offset = vec(-3, 0, 0); //towards the previous dynent, which is still clear of it
+                    break;
+                }
+            }
+            queries.push_back({&ents[i], offset, vec(offset).normalize(), 0, false});
+        }
+        return queries;
+    }
+
+    void test_collidebatch()
+    {
+        std::printf("Testing batch collision\n");
+        rootworld.emptymap(10, true, false);
+        std::vector<dynent> serialents(256),
+                            batchents(256);
+        //moves each dynent in turn with collide(), as collidebatch() should
+        std::vector<physcollidequery> serial = genmoves(serialents);
+        std::vector<dynent *> ptrs;
+        for(dynent &d : serialents)
+        {
+            ptrs.push_back(&d);
+        }
+        setdynents(ptrs);
+        std::vector<bool> serialcollided;
+        for(const physcollidequery &q : serial)
+        {
+            q.d->o.add(q.offset);
+            bool collided = collide(q.d, nullptr, q.dir, q.cutoff, q.insideplayercol);
+            if(collided)
+            {
+                q.d->o.sub(q.offset);
+            }
+            else
+            {
+                updatedynentcache(q.d);
+            }
+            serialcollided.push_back(collided);
+        }
+        //same moves in a batch
+        std::vector<physcollidequery> batch = genmoves(batchents);
+        ptrs.clear();
+        for(dynent &d : batchents)
+        {
+            ptrs.push_back(&d);
+        }
+        setdynents(ptrs);
+        std::vector<physcollideresult> results;
+        collidebatch(batch, results);
+        assert(results.size() == batch.size());
+        for(size_t i = 0; i < batch.size(); ++i)
+        {
+            assert(results[i].collided == serialcollided[i]);
+            assert(batchents[i].o == serialents[i].o);
+        }
+        //moves into the floor hit the world, not a player
+        assert(results[0].collided && !results[0].player);
+        assert(!results[2].collided);
+        setdynents({});
+    }
+}
+
+void test_physics()
+{
+    std::printf(
+"===============================================================\n\
+testing physics functionality\n\
+===============================================================\n"
+    );
+    test_dynentgrid_update();
+    test_dynentgrid_many();
+    test_collidebatch();
+}
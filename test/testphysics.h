@@ -0,0 +1,6 @@
+#ifndef TEST_PHYSICS_H_
+#define TEST_PHYSICS_H_
+
+extern void test_physics();
+
+#endif
@@ -0,0 +1,312 @@
+#include "libprimis.h"
+#include "../src/shared/geomexts.h"
+#include "../src/shared/threadpool.h"
+#include "../src/engine/world/octaworld.h"
+#include "../src/engine/world/raycube.h"
+#include "../src/engine/world/raypacket.h"
+
+namespace
+{
+    //small world with a stepped, sloped floor and some floating blocks
+    void makeworld()
+    {
+        rootworld.emptymap(10, true, false);
+        int size = rootworld.mapsize();
+        for(int x = 0; x < size; x += 64)
+        {
+            for(int y = 0; y < size; y += 64)
+            {
+                int h = ((x*7 + y*13)/64)%5;
+                for(int z = 0; z < h; ++z)
+                {
+                    setcubefaces(rootworld.lookupcube(ivec(x, y, size/2 + z*64), 64), facesolid);
+                }
+                if(h)
+                {
+                    cube &c = rootworld.lookupcube(ivec(x, y, size/2 + (h-1)*64), 64);
+                    EDGE_SET(CUBE_EDGE(c, 2, 0, 0), 1, 4 + (x/64)%5);
+                    EDGE_SET(CUBE_EDGE(c, 2, 1, 1), 1, 4 + (y/64)%5);
+                }
+            }
+        }
+        for(int i = 0; i < 32; ++i)
+        {
+            setcubefaces(rootworld.lookupcube(ivec((i*97)%size, (i*193)%size, size - 128), 16), facesolid);
+        }
+        rootworld.allchanged();
+    }
+
+    std::vector<raycubequery> makerays(size_t n, int mode)
+    {
+        std::vector<raycubequery> rays;
+        float size = rootworld.mapsize();
+        for(size_t i = 0; i < n; ++i)
+        {
+            //spread origins and directions over the world without a random generator
+            float a = i*0.61803f,
+                  b = i*0.41421f;
+            vec o(size*(a - std::floor(a)), size*(b - std::floor(b)), size*(0.6f + 0.35f*((i%7)/7.0f))),
+                ray(std::sin(a*6.283f), std::cos(a*6.283f), -0.2f - (i%5)*0.3f);
+            rays.push_back({o, ray.normalize(), (i%3) ? 0.0f : 200.0f, mode, 0, nullptr});
+        }
+        return rays;
+    }
+
+    void test_raycubebatch()
+    {
+        std::printf("Testing raycubebatch against raycube\n");
+        makeworld();
+        for(int mode : {Ray_ClipMat, Ray_ClipMat|Ray_SkipFirst, Ray_Shadow})
+        {
+            std::vector<raycubequery> rays = makerays(4096, mode);
+            std::vector<raycuberesult> serial,
+                                       parallel;
+            raycubebatch(rays, serial, false);
+            raycubebatch(rays, parallel, true);
+            assert(serial.size() == rays.size());
+            assert(parallel.size() == rays.size());
+            for(size_t i = 0; i < rays.size(); ++i)
+            {
+                const raycubequery &q = rays[i];
+                hitsurface = vec(0, 0, 0);
+                float dist = rootworld.raycube(q.o, q.ray, q.radius, q.mode, q.size, q.t);
+                assert(serial[i].dist == dist);
+                assert(parallel[i].dist == dist);
+                assert(serial[i].surface == hitsurface);
+                assert(parallel[i].surface == hitsurface);
+            }
+        }
+        std::vector<raycubequery> empty;
+        std::vector<raycuberesult> results(4);
+        raycubebatch(empty, results);
+        assert(results.empty());
+    }
+
+    //casts rays and looks up cubes from every worker thread at once, each using its own query context
+    void test_worldquery()
+    {
+        std::printf("Testing concurrent world queries\n");
+        makeworld();
+        assert(&worldquery().hitsurface == &hitsurface);
+        std::vector<raycubequery> rays = makerays(4096, Ray_ClipMat);
+        std::vector<raycuberesult> expected(rays.size()),
+                                   results(rays.size());
+        std::vector<ivec> expectedlu(rays.size()),
+                          resultlu(rays.size());
+        auto query = [&] (size_t i, std::vector<raycuberesult> &out, std::vector<ivec> &outlu)
+        {
+            const raycubequery &q = rays[i];
+            querycontext &ctx = worldquery();
+            ctx.hitsurface = vec(0, 0, 0);
+            out[i].dist = rootworld.raycube(q.o, q.ray, q.radius, q.mode, q.size, q.t);
+            out[i].surface = ctx.hitsurface;
+            ctx.lookupcube(ivec(vec(q.ray).mul(std::min(out[i].dist, 64.0f)).add(q.o)));
+            ivec no;
+            int nsize;
+            rootworld.neighborcube(i%6, ctx.lu, ctx.lusize, no, nsize);
+            outlu[i] = no;
+        };
+        for(size_t i = 0; i < rays.size(); ++i)
+        {
+            query(i, expected, expectedlu);
+        }
+        parallelfor(rays.size(), [&] (size_t i)
+        {
+            query(i, results, resultlu);
+        });
+        for(size_t i = 0; i < rays.size(); ++i)
+        {
+            assert(results[i].dist == expected[i].dist);
+            assert(results[i].surface == expected[i].surface);
+            assert(resultlu[i] == expectedlu[i]);
+        }
+    }
+
+    void test_clipplanestore()
+    {
+        std::printf("Testing clip plane store invalidation\n");
+        makeworld();
+        int size = rootworld.mapsize();
+        ivec o;
+        int csize;
+        const cube &c = rootworld.lookupcube(ivec(0, 64, size/2), 0, o, csize);
+        querycontext &ctx = worldquery();
+        auto lookup = [&] () -> bool //returns whether the lookup was a hit
+        {
+            size_t hits = ctx.cliphits;
+            const clipplanes &p = ctx.getclipbounds(c, o, csize, 0);
+            clipplanes expected;
+            genclipbounds(c, o, csize, expected);
+            assert(p.o == expected.o && p.r == expected.r);
+            return ctx.cliphits > hits;
+        };
+        //allchanged() resets the store
+        assert(!lookup());
+        assert(lookup());
+        assert(getclipplanestats().entries > 0);
+        //changes elsewhere in the world keep the planes
+        invalidateclipplanes(ivec(size - 64, size - 64, size - 64), ivec(size, size, size));
+        assert(lookup());
+        //changes to a neighboring cube drop them
+        ivec n = ivec(o).add(ivec(csize, 0, 0));
+        invalidateclipplanes(n, ivec(n).add(csize));
+        assert(!lookup());
+        assert(lookup());
+        //planes generated before a commit are dropped again once the faces are recomputed
+        invalidateclipplanes(n, ivec(n).add(csize));
+        assert(!lookup());
+        assert(lookup());
+        commitclipplanes();
+        assert(!lookup());
+        assert(lookup());
+        resetqueryclipplanes();
+        assert(!lookup());
+        clipplanestats stats = getclipplanestats();
+        assert(stats.hits >= 5 && stats.misses >= 5);
+
+        //the store is direct mapped, so filling it replaces entries rather than growing
+        setvar("clipstoresize", 300); //rounded down to 256 slots
+        size_t generated = 0;
+        for(int x = 0; x < size; x += 64)
+        {
+            for(int y = 0; y < size; y += 64)
+            {
+                ivec co;
+                int cs;
+                const cube &other = rootworld.lookupcube(ivec(x, y, size/2), 0, co, cs);
+                for(int offset = 0; offset < 4; ++offset)
+                {
+                    size_t misses = ctx.clipmisses;
+                    const clipplanes &p = ctx.getclipbounds(other, co, cs, offset);
+                    clipplanes expected;
+                    genclipbounds(other, co, cs, expected);
+                    assert(p.o == expected.o && p.r == expected.r);
+                    generated += ctx.clipmisses - misses;
+                }
+            }
+        }
+        assert(generated >= 256);
+        assert(ctx.clipentries() <= 256);
+        lookup();
+        assert(lookup());
+        setvar("clipstoresize", 1<<11);
+    }
+
+    //checks each kernel against the scalar reference, with planes cutting through a cube and rays around it
+    void test_raypacketintersect()
+    {
+        std::printf("Testing raypacketintersect against scalar reference\n");
+        auto wave = [] (int i, float f) -> float
+        {
+            float a = i*f;
+            return 2*(a - std::floor(a)) - 1;
+        };
+        for(int simd = 0; simd <= 2; ++simd)
+        {
+            setvar("raypacketsimd", simd);
+            int lanes = raypacketlanes();
+            assert(lanes == 4 || lanes == 8);
+            for(int n = 0; n < 2000; ++n)
+            {
+                clipplanes p;
+                p.clear();
+                p.o = vec(32, 32, 32);
+                p.r = vec(8, 8, 8);
+                p.size = n%7;
+                for(int i = 0; i < p.size; ++i)
+                {
+                    vec normal = vec(wave(n*7 + i, 0.61803f), wave(n*7 + i, 0.41421f), wave(n*7 + i, 0.73205f)).normalize();
+                    p.p[i] = plane(normal, -normal.dot(p.o) + 4*wave(n + i, 0.23607f));
+                }
+                raypacket rays;
+                for(int k = 0; k < lanes; ++k)
+                {
+                    int j = n*lanes + k;
+                    vec v = vec(wave(j, 0.31831f), wave(j, 0.57722f), wave(j, 0.69315f)).mul(16).add(p.o),
+                        ray = vec(wave(j, 0.14159f), wave(j, 0.27183f), wave(j, 0.12207f)).normalize();
+                    if(!(j%5))
+                    {
+                        ray[j%3] = 0; //axis-parallel rays take a different path in the box test
+                    }
+                    rays.vx[k] = v.x;
+                    rays.vy[k] = v.y;
+                    rays.vz[k] = v.z;
+                    rays.dx[k] = ray.x;
+                    rays.dy[k] = ray.y;
+                    rays.dz[k] = ray.z;
+                    rays.ix[k] = ray.x ? 1/ray.x : 1e16f;
+                    rays.iy[k] = ray.y ? 1/ray.y : 1e16f;
+                    rays.iz[k] = ray.z ? 1/ray.z : 1e16f;
+                }
+                raypackethits ref,
+                              hits;
+                int refmask = raypacketintersectscalar(p, rays, lanes, ref),
+                    mask = raypacketintersect(p, rays, lanes, hits);
+                assert(mask == refmask);
+                for(int k = 0; k < lanes; ++k)
+                {
+                    if(mask&(1<<k))
+                    {
+                        assert(hits.entry[k] == ref.entry[k]);
+                        assert(std::fabs(hits.enterdist[k] - ref.enterdist[k]) < 1e-3f);
+                        assert(std::fabs(hits.exitdist[k] - ref.exitdist[k]) < 1e-3f);
+                    }
+                }
+            }
+        }
+        setvar("raypacketsimd", 2);
+    }
+
+    void test_shadowraybatch()
+    {
+        std::printf("Testing shadowraybatch against shadowray\n");
+        makeworld();
+        float size = rootworld.mapsize();
+        std::vector<shadowrayquery> rays;
+        for(size_t i = 0; i < 4096; ++i)
+        {
+            //clusters of rays from nearby points towards the same light, as when shadowing a surface
+            float a = (i/8)*0.61803f,
+                  b = (i/8)*0.41421f,
+                  c = i*0.31831f;
+            vec o(size*(a - std::floor(a)), size*(b - std::floor(b)), size*0.5f + 64*(c - std::floor(c))),
+                light(size*(b - std::floor(b)), size*(a - std::floor(a)), size*0.9f);
+            o.add(vec(i%8, (i*3)%8, 0));
+            vec ray = vec(light).sub(o);
+            float dist = ray.magnitude();
+            rays.push_back({o, ray.div(dist), (i%4) ? dist : 0.0f});
+        }
+        rays.push_back({vec(-10, -10, -10), vec(-1, 0, 0), 100}); //outside of the world
+        for(int mode : {Ray_Shadow, Ray_Shadow|Ray_SkipSky, Ray_Shadow|Ray_BB})
+        {
+            for(int simd = 0; simd <= 2; ++simd)
+            {
+                setvar("raypacketsimd", simd);
+                std::vector<float> results;
+                shadowraybatch(rays, results, mode);
+                assert(results.size() == rays.size());
+                for(size_t i = 0; i < rays.size(); ++i)
+                {
+                    const shadowrayquery &q = rays[i];
+                    float dist = rootworld.shadowray(q.o, q.ray, q.radius, mode, nullptr);
+                    assert(std::fabs(results[i] - dist) <= 1e-3f*std::max(1.0f, std::fabs(dist)));
+                }
+            }
+        }
+        setvar("raypacketsimd", 2);
+    }
+}
+
+void test_raycube()
+{
+    std::printf(
+"===============================================================\n\
+testing raycube functionality\n\
+===============================================================\n"
+    );
+    test_raycubebatch();
+    test_worldquery();
+    test_clipplanestore();
+    test_raypacketintersect();
+    test_shadowraybatch();
+}
@@ -0,0 +1,6 @@
+#ifndef TEST_RAYCUBE_H_
+#define TEST_RAYCUBE_H_
+
+extern void test_raycube();
+
+#endif
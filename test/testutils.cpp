@@ -1,5 +1,14 @@
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <unordered_map>
+
 #include "libprimis.h"
+#include "../shared/asyncio.h"
 #include "../shared/stream.h"
+#include "../shared/threadpool.h"
+#include "../shared/vfs.h"
 
 namespace
 {
@@ -685,6 +694,342 @@ namespace
         assert(s.get<int>() == 0);
         assert(s.putbig<int>(0) == false);
     }
+
+    void test_memstream()
+    {
+        std::printf("Testing memory streams\n");
+        const std::array<uchar, 6> buf = {1, 2, 3, 4, 5, 6};
+        stream *s = openmemstream(buf.data(), buf.size());
+        assert(s->size() == 6);
+        assert(s->getchar() == 1);
+        std::array<uchar, 8> out;
+        assert(s->read(out.data(), 2) == 2);
+        assert(out[0] == 2 && out[1] == 3);
+        assert(s->seek(1, SEEK_CUR));
+        assert(s->tell() == 4);
+        assert(s->read(out.data(), out.size()) == 2);
+        assert(s->end());
+        assert(s->getchar() == -1);
+        assert(s->seek(0, SEEK_SET));
+        assert(s->getchar() == 1);
+        assert(!s->seek(7, SEEK_SET));
+        delete s;
+    }
+
+    void test_readahead()
+    {
+        std::printf("Testing readahead streams\n");
+        std::vector<uchar> data(300001);
+        for(size_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = static_cast<uchar>((i*2654435761U)>>13);
+        }
+        //a buffer smaller than the data, so the reader has to wrap around and wait for space
+        stream *s = openreadahead(openmemstream(data.data(), data.size()), true, 1<<16);
+        assert(s->size() == static_cast<stream::offset>(data.size()));
+        std::vector<uchar> out(data.size());
+        size_t pos = 0,
+               step = 1;
+        while(pos < out.size())
+        {
+            size_t n = s->read(out.data() + pos, std::min(step, out.size() - pos));
+            assert(n);
+            pos += n;
+            step = (step*3)%70001 + 1;
+        }
+        assert(out == data);
+        assert(s->read(out.data(), 1) == 0);
+        assert(s->end());
+        assert(s->getcrc() == crc32(crc32(0, nullptr, 0), data.data(), data.size()));
+        delete s;
+        //forward seeks skip data, backward seeks fail
+        s = openreadahead(openmemstream(data.data(), data.size()), true, 1<<16);
+        assert(s->seek(100000, SEEK_SET));
+        assert(s->getchar() == data[100000]);
+        assert(s->seek(99999, SEEK_CUR));
+        assert(s->getchar() == data[200000]);
+        assert(!s->seek(0, SEEK_SET));
+        //closing before reaching the end stops the reader
+        delete s;
+    }
+
+    //inflates a raw deflate stream, returning an empty vector if it is invalid
+    std::vector<uchar> rawinflate(const std::vector<uchar> &in, size_t len)
+    {
+        std::vector<uchar> out(len + 1);
+        z_stream z = {};
+        assert(inflateInit2(&z, -MAX_WBITS) == Z_OK);
+        z.next_in = const_cast<Bytef *>(in.data());
+        z.avail_in = in.size();
+        z.next_out = out.data();
+        z.avail_out = out.size();
+        int err = inflate(&z, Z_FINISH);
+        out.resize(z.total_out);
+        inflateEnd(&z);
+        return err == Z_STREAM_END ? out : std::vector<uchar>();
+    }
+
+    void test_deflateblocks()
+    {
+        std::printf("Testing parallel block deflate\n");
+        std::vector<uchar> data(600001);
+        for(size_t i = 0; i < data.size(); ++i)
+        {
+            data[i] = static_cast<uchar>("octree"[(i*2654435761U>>20)%6] + i/50000);
+        }
+        uint datacrc = crc32(crc32(0, nullptr, 0), data.data(), data.size());
+        for(int threads : {1, 4})
+        {
+            std::vector<uchar> out;
+            uint crc = crc32(0, nullptr, 0);
+            assert(deflateblocks(data.data(), data.size(), 0, out, 9, threads, true, &crc));
+            assert(crc == datacrc);
+            assert(out.size() < data.size());
+            assert(rawinflate(out, data.size()) == data);
+            //the same stream, compressed across two calls with the end of the first as history
+            std::vector<uchar> split;
+            crc = crc32(0, nullptr, 0);
+            assert(deflateblocks(data.data(), 200000, 0, split, 9, threads, false, &crc));
+            assert(deflateblocks(data.data() + 200000, data.size() - 200000, 1<<15, split, 9, threads, true, &crc));
+            assert(crc == datacrc);
+            assert(rawinflate(split, data.size()) == data);
+        }
+    }
+
+    void test_zip()
+    {
+        std::printf("Testing zip64 archives\n");
+        std::string stored;
+        for(int i = 0; i < 500; ++i)
+        {
+            stored += "stored line " + std::to_string(i) + "\n";
+        }
+        std::vector<uchar> deflated(100000);
+        for(size_t i = 0; i < deflated.size(); ++i)
+        {
+            deflated[i] = static_cast<uchar>(((i*7)%251) ^ ((i>>12)&0xFF));
+        }
+        //once memory mapped, and once read with positioned reads
+        for(int mmap : {1, 0})
+        {
+            setvar("zipmmap", mmap);
+            assert(addzip("media/zip/zip64"));
+            assert(findzipfile("test/stored.txt"));
+            assert(findzipfile("test/deflated.bin"));
+            assert(!findzipfile("test/missing.txt"));
+            std::vector<char *> listed;
+            assert(listzipfiles("test", "txt", listed) == 1);
+            assert(listed.size() == 1 && !std::strcmp(listed[0], "stored"));
+            delete[] listed[0];
+            stream *a = openzipfile("test/stored.txt", "rb"),
+                   *b = openzipfile("test/deflated.bin", "rb"),
+                   *c = openzipfile("test/deflated.bin", "rb");
+            assert(a && b && c);
+            assert(a->size() == static_cast<stream::offset>(stored.size()));
+            assert(b->size() == static_cast<stream::offset>(deflated.size()));
+            //interleaved reads of the same archive do not disturb each other
+            std::string storedout(stored.size(), '\0');
+            std::vector<uchar> bout(deflated.size()),
+                               dout(deflated.size());
+            size_t apos = 0,
+                   bpos = 0,
+                   cpos = 0;
+            while(apos < storedout.size() || bpos < bout.size() || cpos < dout.size())
+            {
+                apos += a->read(&storedout[apos], std::min<size_t>(37, storedout.size() - apos));
+                bpos += b->read(&bout[bpos], std::min<size_t>(1000, bout.size() - bpos));
+                cpos += c->read(&dout[cpos], std::min<size_t>(777, dout.size() - cpos));
+            }
+            assert(storedout == stored);
+            assert(bout == deflated && dout == deflated);
+            assert(b->read(bout.data(), 1) == 0 && b->end());
+            //backwards and forwards seeks
+            assert(b->seek(5000, SEEK_SET));
+            assert(b->tell() == 5000);
+            assert(b->getchar() == deflated[5000]);
+            assert(b->seek(-1001, SEEK_END));
+            assert(b->getchar() == deflated[deflated.size() - 1001]);
+            assert(a->seek(13, SEEK_SET));
+            assert(a->getchar() == stored[13]);
+            delete c;
+            //archives with open files cannot be removed
+            assert(!removezip("media/zip/zip64"));
+            delete a;
+            delete b;
+            assert(removezip("media/zip/zip64"));
+            assert(!findzipfile("test/stored.txt"));
+        }
+        setvar("zipmmap", 1);
+    }
+
+    //returns the listing of a directory as sorted strings, freeing the names
+    std::vector<std::string> listvfs(const vfsindex &index, const char *dir, const char *ext, int type)
+    {
+        std::vector<char *> files;
+        index.list(dir, ext, type, files);
+        std::vector<std::string> names;
+        for(char *i : files)
+        {
+            names.emplace_back(i);
+            delete[] i;
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    void test_vfsindex()
+    {
+        std::printf("Testing package file index\n");
+        std::string map = std::string("media") + PATHDIV + "map",
+                    ogz = map + PATHDIV + "test.ogz",
+                    cfg = map + PATHDIV + "test.cfg",
+                    other = map + PATHDIV + "other.ogz",
+                    empty = std::string("media") + PATHDIV + "empty";
+        vfsindex index;
+        int dir1 = index.addsource(vfsindex::Source_Dir),
+            dir2 = index.addsource(vfsindex::Source_Dir),
+            zip1 = index.addsource(vfsindex::Source_Zip),
+            zip2 = index.addsource(vfsindex::Source_Zip);
+        index.addfile(dir1, ogz.c_str());
+        index.addfile(dir2, ogz.c_str());
+        index.addfile(dir2, cfg.c_str());
+        index.adddir(dir2, empty.c_str());
+        index.addfile(zip1, ogz.c_str());
+        index.addfile(zip1, other.c_str());
+        index.addfile(zip2, other.c_str());
+        assert(index.numpaths() == 3);
+        //package directories are searched first added first, zip archives last added first
+        assert(index.find(ogz.c_str(), vfsindex::Source_Dir) == dir1);
+        assert(index.find(cfg.c_str(), vfsindex::Source_Dir) == dir2);
+        assert(index.find(ogz.c_str(), vfsindex::Source_Zip) == zip1);
+        assert(index.find(other.c_str(), vfsindex::Source_Zip) == zip2);
+        assert(index.find(other.c_str(), vfsindex::Source_Dir) < 0);
+        //directories are found in package directories only
+        assert(index.find(empty.c_str(), vfsindex::Source_Dir) == dir2);
+        assert(index.find(map.c_str(), vfsindex::Source_Dir) == dir1);
+        assert(index.find(map.c_str(), vfsindex::Source_Zip) < 0);
+        //listings have a name for each source containing it
+        assert((listvfs(index, map.c_str(), "ogz", vfsindex::Source_Dir) == std::vector<std::string>{"test", "test"}));
+        assert((listvfs(index, map.c_str(), "ogz", vfsindex::Source_Zip) == std::vector<std::string>{"other", "other", "test"}));
+        assert((listvfs(index, "media", nullptr, vfsindex::Source_Dir) == std::vector<std::string>{"empty", "map", "map"}));
+        assert(listvfs(index, "media", nullptr, vfsindex::Source_Zip).empty());
+        //paths are matched as the file system would resolve them
+        assert(index.find("media/map/test.cfg", vfsindex::Source_Dir) == dir2);
+        assert(index.find("media\\map\\test.cfg", vfsindex::Source_Dir) == dir2);
+        assert(index.find("./media//empty/../map/test.cfg", vfsindex::Source_Dir) == dir2);
+        assert(index.find("media/map/../../media/map/test.cfg", vfsindex::Source_Dir) == dir2);
+        assert(index.find("../media/map/test.cfg", vfsindex::Source_Dir) < 0);
+        assert((listvfs(index, "media/./map/", "ogz", vfsindex::Source_Dir) == std::vector<std::string>{"test", "test"}));
+#ifdef WIN32
+        assert(index.find("MEDIA/Map/Test.cfg", vfsindex::Source_Dir) == dir2);
+#else
+        assert(index.find("MEDIA/Map/Test.cfg", vfsindex::Source_Dir) < 0);
+#endif
+        //a source limited to a directory is not found or listed above it, and keeps the case of its names
+        int sub = index.addsource(vfsindex::Source_Dir, "Data/Sub/");
+        index.addfile(sub, "Data/Sub/Test.cfg");
+        assert(index.find("Data", vfsindex::Source_Dir) < 0);
+        assert(index.find("Data/Sub", vfsindex::Source_Dir) == sub);
+        assert(index.find("Data/Sub/Test.cfg", vfsindex::Source_Dir) == sub);
+        assert((listvfs(index, "", nullptr, vfsindex::Source_Dir) == std::vector<std::string>{"media", "media"}));
+        assert(listvfs(index, "Data", nullptr, vfsindex::Source_Dir).empty());
+        assert((listvfs(index, "Data/Sub", nullptr, vfsindex::Source_Dir) == std::vector<std::string>{"Test.cfg"}));
+        index.removesource(sub);
+        assert(index.find("Data/Sub", vfsindex::Source_Dir) < 0);
+        assert(index.numpaths() == 3);
+        //removing a source only removes its own paths
+        index.removesource(zip2);
+        assert(index.find(other.c_str(), vfsindex::Source_Zip) == zip1);
+        index.removesource(zip1);
+        assert(index.find(other.c_str(), vfsindex::Source_Zip) < 0);
+        assert(index.numpaths() == 2);
+        index.removesource(dir1);
+        assert(index.find(ogz.c_str(), vfsindex::Source_Dir) == dir2);
+        index.removesource(dir2);
+        assert(index.numpaths() == 0);
+        assert(index.find("media", vfsindex::Source_Dir) < 0);
+    }
+
+    void test_asyncread()
+    {
+        std::printf("Testing asynchronous file reads\n");
+        asyncreadstats before = getasyncreadstats();
+        stream *f = openfile("media/zip/zip64.zip", "rb");
+        assert(f);
+        std::vector<uchar> contents(f->size());
+        assert(f->read(contents.data(), contents.size()) == contents.size());
+        delete f;
+
+        std::vector<std::string> order;
+        bool decodedok = false;
+        //decode functions replace the data on the I/O thread
+        asyncread("media/zip/zip64.zip", AsyncPriority_Normal,
+            [&] (asyncfile &file)
+            {
+                order.push_back(file.name);
+                decodedok = file.ok && file.data.size() == 1 && file.data[0] == contents.size()%251;
+            },
+            [] (asyncfile &file)
+            {
+                uchar sum = file.data.size()%251;
+                file.data.assign(1, sum);
+                return true;
+            });
+        bool readok = false;
+        asyncread("media/zip/zip64.zip", AsyncPriority_High,
+            [&] (asyncfile &file)
+            {
+                order.push_back(file.name);
+                readok = file.ok && file.data == contents;
+            });
+        bool missingok = true;
+        asyncread("media/zip/missing.zip", AsyncPriority_Low,
+            [&] (asyncfile &file)
+            {
+                order.push_back(file.name);
+                missingok = file.ok;
+            });
+        bool cancelleddone = false;
+        uint id = asyncread("media/zip/zip64.zip", AsyncPriority_Low,
+            [&] (asyncfile &)
+            {
+                cancelleddone = true;
+            });
+        assert(cancelasyncread(id));
+        assert(!cancelasyncread(id));
+        finishasyncreads();
+
+        assert(order.size() == 3);
+        assert(decodedok && readok && !missingok);
+        assert(!cancelleddone);
+        asyncreadstats after = getasyncreadstats();
+        assert(after.queued == 0 && after.active == 0 && after.completed == 0 && after.inflight == 0);
+        assert(after.requests - before.requests == 4);
+        assert(after.cancelled - before.cancelled == 1);
+    }
+
+    void test_parallelfor_resize()
+    {
+        std::printf("Testing parallelfor across thread pool resizes\n");
+        //each change of thread count recreates the workers just before a job is published
+        for(int threads : {2, 3, 8, 2, 5})
+        {
+            setvar("workerthreads", threads);
+            for(int i = 0; i < 4; ++i)
+            {
+                std::vector<std::atomic<int>> counts(1000);
+                parallelfor(counts.size(), [&] (size_t j)
+                {
+                    counts[j]++;
+                });
+                for(const std::atomic<int> &c : counts)
+                {
+                    assert(c == 1);
+                }
+            }
+        }
+        setvar("workerthreads", 0);
+    }
 }
 
 void testutils()
@@ -728,4 +1073,11 @@ testing tools functionality\n\
     test_databuf_check();
     test_databuf_forceoverread();
     test_stream_overloadable();
+    test_memstream();
+    test_readahead();
+    test_deflateblocks();
+    test_zip();
+    test_vfsindex();
+    test_asyncread();
+    test_parallelfor_resize();
 }